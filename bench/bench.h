@@ -0,0 +1,65 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench.h
+ *
+ * Minimal helpers shared by the benchmarks in this directory. Each benchmark
+ * is a standalone program registered with meson's benchmark() function; run
+ * them with "meson test --benchmark". Sources must define _POSIX_C_SOURCE
+ * before including any system header.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_BENCH_H
+#define FOXEN_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Prevents the compiler from optimising away the computation of X.
+ */
+#define BENCH_KEEP(X) __asm__ volatile("" : : "r"(X) : "memory")
+
+/**
+ * Prints the time per operation of a benchmark run.
+ *
+ * @param name is the name of the benchmark.
+ * @param t0 is the timestamp at the beginning of the run.
+ * @param t1 is the timestamp at the end of the run.
+ * @param n_ops is the number of operations performed during the run.
+ */
+static inline void bench_report(const char *name, uint64_t t0, uint64_t t1,
+                                uint64_t n_ops) {
+	printf("%-48s %10.2f ns/op\n", name,
+	       (double)(t1 - t0) / (double)(n_ops ? n_ops : 1U));
+}
+
+#endif /* FOXEN_BENCH_H */
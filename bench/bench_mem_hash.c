@@ -0,0 +1,186 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench_mem_hash.c
+ *
+ * Compares fx_mem_hash_aligned() with a straightforward implementation of
+ * XXH64 and with FNV-1a, and fx_mem_equal_aligned() with memcmp(), for block
+ * sizes from 64 bytes to 16 MiB. Each run processes roughly the same number of
+ * bytes.
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <foxen/mem_hash.h>
+
+#include "bench.h"
+
+#define N_BYTES_TOTAL (1ULL << 30U)
+#define MIN_SIZE 64U
+#define MAX_SIZE (16U << 20U)
+
+/* XXH64 reference implementation, see https://github.com/Cyan4973/xxHash */
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl(uint64_t x, uint32_t r) {
+	return (x << r) | (x >> (64U - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t *p) {
+	uint64_t res;
+	memcpy(&res, p, sizeof(res));
+	return res;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+	return xxh_rotl(acc + input * XXH_PRIME64_2, 31U) * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+	return (acc ^ xxh_round(0U, val)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static uint64_t xxh64(const void *mem, size_t size, uint64_t seed) {
+	const uint8_t *p = (const uint8_t *)mem, *end = p + size;
+	uint64_t h;
+	if (size >= 32U) {
+		uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = seed + XXH_PRIME64_2, v3 = seed;
+		uint64_t v4 = seed - XXH_PRIME64_1;
+		for (; p + 32U <= end; p += 32U) {
+			v1 = xxh_round(v1, xxh_read64(p));
+			v2 = xxh_round(v2, xxh_read64(p + 8U));
+			v3 = xxh_round(v3, xxh_read64(p + 16U));
+			v4 = xxh_round(v4, xxh_read64(p + 24U));
+		}
+		h = xxh_rotl(v1, 1U) + xxh_rotl(v2, 7U) + xxh_rotl(v3, 12U) +
+		    xxh_rotl(v4, 18U);
+		h = xxh_merge(xxh_merge(xxh_merge(xxh_merge(h, v1), v2), v3), v4);
+	} else {
+		h = seed + XXH_PRIME64_5;
+	}
+	h += size;
+	for (; p + 8U <= end; p += 8U) {
+		h ^= xxh_round(0U, xxh_read64(p));
+		h = xxh_rotl(h, 27U) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = xxh_rotl(h, 11U) * XXH_PRIME64_1;
+	}
+	h ^= h >> 33U;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29U;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32U;
+	return h;
+}
+
+/* FNV-1a, the typical "generic" byte-wise hash */
+
+static uint64_t fnv1a(const void *mem, size_t size, uint64_t seed) {
+	const uint8_t *p = (const uint8_t *)mem;
+	uint64_t h = 0xCBF29CE484222325ULL ^ seed;
+	for (size_t i = 0U; i < size; i++) {
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static void report(const char *name, uint32_t size, uint64_t t0, uint64_t t1,
+                   uint64_t n_iter) {
+	char buf[64];
+	if (size >= (1U << 20U)) {
+		snprintf(buf, sizeof(buf), "%s, %u MiB", name, size >> 20U);
+	} else if (size >= (1U << 10U)) {
+		snprintf(buf, sizeof(buf), "%s, %u KiB", name, size >> 10U);
+	} else {
+		snprintf(buf, sizeof(buf), "%s, %u B", name, size);
+	}
+	bench_report(buf, t0, t1, n_iter);
+}
+
+#define BENCH_HASH(NAME, FUN)                                          \
+	do {                                                               \
+		uint64_t sum = 0U;                                             \
+		const uint64_t t0 = bench_now();                               \
+		for (uint64_t i = 0U; i < n_iter; i++) {                       \
+			sum += FUN(a, size, i);                                    \
+		}                                                              \
+		const uint64_t t1 = bench_now();                               \
+		BENCH_KEEP(sum);                                               \
+		report(NAME, size, t0, t1, n_iter);                            \
+	} while (0)
+
+static void bench_size(const uint8_t *a, uint8_t *b, uint32_t size) {
+	const uint64_t n_iter = N_BYTES_TOTAL / size / 4U;
+	BENCH_HASH("hash, FNV-1a", fnv1a);
+	BENCH_HASH("hash, XXH64", xxh64);
+	BENCH_HASH("hash, fx_mem_hash_aligned", fx_mem_hash_aligned);
+
+	/* Equal blocks are the worst case for both comparison functions; the
+	   asm statement keeps the compiler from hoisting the calls */
+	uint64_t n_equal = 0U;
+	uint64_t t0 = bench_now();
+	for (uint64_t i = 0U; i < n_iter; i++) {
+		BENCH_KEEP(b);
+		n_equal += memcmp(a, b, size) == 0;
+	}
+	uint64_t t1 = bench_now();
+	report("equal, memcmp", size, t0, t1, n_iter);
+	t0 = bench_now();
+	for (uint64_t i = 0U; i < n_iter; i++) {
+		BENCH_KEEP(b);
+		n_equal += fx_mem_equal_aligned(a, b, size);
+	}
+	t1 = bench_now();
+	report("equal, fx_mem_equal_aligned", size, t0, t1, n_iter);
+	BENCH_KEEP(n_equal);
+}
+
+int main() {
+	void *a_mem, *b_mem;
+	if (posix_memalign(&a_mem, 64U, MAX_SIZE) ||
+	    posix_memalign(&b_mem, 64U, MAX_SIZE)) {
+		return 1;
+	}
+	uint8_t *a = (uint8_t *)a_mem, *b = (uint8_t *)b_mem;
+	uint32_t seed = 1U;
+	for (uint32_t i = 0U; i < MAX_SIZE; i++) {
+		seed = seed * 1103515245U + 12345U;
+		a[i] = (uint8_t)(seed >> 16U);
+	}
+	memcpy(b, a, MAX_SIZE);
+	for (uint32_t size = MIN_SIZE; size <= MAX_SIZE; size *= 16U) {
+		bench_size(a, b, size);
+	}
+	free(a);
+	free(b);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench_mem_malloc.c
+ *
+ * Compares the malloc() replacement in tools/foxenmalloc.c with the system
+ * allocator on a set of standard workloads: back-to-back allocation and
+ * release of a fixed size, building up and tearing down a large number of
+ * small objects, random churn over a window of live objects of mixed size
+ * (single- and multi-threaded), and a growing buffer resized with realloc().
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "foxenmalloc.h"
+
+#define N_PAIRS (1U << 23U)
+#define N_OBJECTS (1U << 18U)
+#define N_ROUNDS 16U
+#define N_CHURN (1U << 22U)
+#define N_LIVE 4096U
+#define N_THREADS 4U
+#define N_GROW 2000U
+
+typedef struct allocator {
+	const char *name;
+	void *(*malloc)(size_t);
+	void (*free)(void *);
+	void *(*realloc)(void *, size_t);
+} allocator_t;
+
+static const allocator_t allocators[] = {
+    {"system", malloc, free, realloc},
+    {"foxenmalloc", fx_malloc, fx_free, fx_realloc},
+};
+
+static void *objects[N_OBJECTS];
+
+static uint32_t next_rand(uint32_t *seed) {
+	*seed = *seed * 1103515245U + 12345U;
+	return *seed >> 8U;
+}
+
+static void report(const allocator_t *a, const char *workload, uint64_t t0,
+                   uint64_t t1, uint64_t n_ops) {
+	char name[64];
+	snprintf(name, sizeof(name), "%s, %s", workload, a->name);
+	bench_report(name, t0, t1, n_ops);
+}
+
+static void bench_pairs(const allocator_t *a) {
+	const uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_PAIRS; i++) {
+		void *ptr = a->malloc(64U);
+		BENCH_KEEP(ptr);
+		a->free(ptr);
+	}
+	report(a, "malloc/free pair, 64 B", t0, bench_now(), N_PAIRS);
+}
+
+static void bench_build_teardown(const allocator_t *a) {
+	const uint64_t t0 = bench_now();
+	for (uint32_t r = 0U; r < N_ROUNDS; r++) {
+		for (uint32_t i = 0U; i < N_OBJECTS; i++) {
+			objects[i] = a->malloc(16U + 16U * (i % 8U));
+			*(uint32_t *)objects[i] = i;
+		}
+		for (uint32_t i = 0U; i < N_OBJECTS; i++) {
+			a->free(objects[i]);
+		}
+	}
+	report(a, "build/teardown, 16-128 B", t0, bench_now(),
+	       2U * N_ROUNDS * N_OBJECTS);
+}
+
+static void churn(const allocator_t *a, uint32_t seed, uint32_t n_ops) {
+	void *live[N_LIVE] = {NULL};
+	for (uint32_t i = 0U; i < n_ops; i++) {
+		const uint32_t r = next_rand(&seed);
+		const uint32_t j = r % N_LIVE;
+		a->free(live[j]);
+		live[j] = a->malloc((r & 0x100U) ? 16U + (r >> 12U) % 240U
+		                                  : 256U + (r >> 12U) % 3840U);
+		*(uint32_t *)live[j] = i;
+	}
+	for (uint32_t j = 0U; j < N_LIVE; j++) {
+		a->free(live[j]);
+	}
+}
+
+static void bench_churn(const allocator_t *a) {
+	const uint64_t t0 = bench_now();
+	churn(a, 1U, N_CHURN);
+	report(a, "random churn, 16-4096 B", t0, bench_now(), 2U * N_CHURN);
+}
+
+static const allocator_t *thread_allocator;
+
+static void *thread_main(void *arg) {
+	churn(thread_allocator, (uint32_t)(uintptr_t)arg, N_CHURN / N_THREADS);
+	return NULL;
+}
+
+static void bench_churn_threads(const allocator_t *a) {
+	pthread_t threads[N_THREADS];
+	thread_allocator = a;
+	const uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, thread_main,
+		               (void *)(uintptr_t)(i + 1U));
+	}
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	report(a, "random churn, 4 threads", t0, bench_now(), 2U * N_CHURN);
+}
+
+static void bench_grow(const allocator_t *a) {
+	const uint64_t t0 = bench_now();
+	for (uint32_t r = 0U; r < N_ROUNDS; r++) {
+		uint8_t *buf = NULL;
+		for (uint32_t i = 1U; i <= N_GROW; i++) {
+			buf = (uint8_t *)a->realloc(buf, (size_t)i * 1024U);
+			buf[(size_t)i * 1024U - 1U] = (uint8_t)i;
+		}
+		a->free(buf);
+	}
+	report(a, "realloc growth to 2 MB, 1 KB steps", t0, bench_now(),
+	       N_ROUNDS * N_GROW);
+}
+
+int main() {
+	const uint32_t n = sizeof(allocators) / sizeof(allocators[0]);
+	for (uint32_t i = 0U; i < n; i++) {
+		bench_pairs(&allocators[i]);
+	}
+	for (uint32_t i = 0U; i < n; i++) {
+		bench_build_teardown(&allocators[i]);
+	}
+	for (uint32_t i = 0U; i < n; i++) {
+		bench_churn(&allocators[i]);
+	}
+	for (uint32_t i = 0U; i < n; i++) {
+		bench_churn_threads(&allocators[i]);
+	}
+	for (uint32_t i = 0U; i < n; i++) {
+		bench_grow(&allocators[i]);
+	}
+	return 0;
+}
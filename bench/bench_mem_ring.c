@@ -0,0 +1,224 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench_mem_ring.c
+ *
+ * Compares the double-mapped ring buffer with a conventional ring buffer that
+ * splits writes at the wrap point and copies records straddling it into a
+ * scratch buffer before parsing. Records are length-prefixed with payloads of
+ * varying size; the "parser" sums the payload words. The last benchmark
+ * measures the throughput of the multi-producer API.
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <foxen/mem_ring.h>
+
+#include "bench.h"
+
+#define RING_SIZE (64U * 1024U)
+#define N_RECORDS (1U << 23U)
+#define MAX_WORDS 64U
+#define N_PRODUCERS 2U
+
+static uint32_t src[MAX_WORDS + 1U];
+
+static uint32_t record_words(uint32_t i) {
+	return 4U + ((i * 2654435761U) >> 26U); /* 4..67 words */
+}
+
+static uint64_t parse(const uint32_t *rec) {
+	uint64_t sum = 0U;
+	for (uint32_t i = 1U; i <= rec[0]; i++) {
+		sum += rec[i];
+	}
+	return sum;
+}
+
+/**
+ * Conventional ring buffer; contiguous access across the wrap point requires
+ * copying.
+ */
+typedef struct copy_ring {
+	uint8_t *buf;
+	uint64_t head, tail;
+	uint32_t scratch[MAX_WORDS + 1U];
+} copy_ring_t;
+
+static bool copy_ring_write(copy_ring_t *ring, const void *data, size_t n) {
+	if (n > RING_SIZE - (ring->head - ring->tail)) {
+		return false;
+	}
+	const size_t offs = ring->head % RING_SIZE, n0 = RING_SIZE - offs;
+	if (n <= n0) {
+		memcpy(ring->buf + offs, data, n);
+	} else {
+		memcpy(ring->buf + offs, data, n0);
+		memcpy(ring->buf, (const uint8_t *)data + n0, n - n0);
+	}
+	ring->head += n;
+	return true;
+}
+
+static const uint32_t *copy_ring_peek(copy_ring_t *ring, size_t *n) {
+	if (ring->head == ring->tail) {
+		return NULL;
+	}
+	const size_t offs = ring->tail % RING_SIZE, n0 = RING_SIZE - offs;
+	uint32_t n_words; /* Records are word-aligned, the prefix is never split */
+	memcpy(&n_words, ring->buf + offs, 4U);
+	*n = 4U * (n_words + 1U);
+	if (*n <= n0) {
+		return (const uint32_t *)(ring->buf + offs);
+	}
+	memcpy(ring->scratch, ring->buf + offs, n0);
+	memcpy((uint8_t *)ring->scratch + n0, ring->buf, *n - n0);
+	return ring->scratch;
+}
+
+static void bench_copy_ring(void) {
+	copy_ring_t ring = {.buf = malloc(RING_SIZE)};
+	uint64_t sum = 0U;
+	uint32_t i_write = 0U, i_read = 0U;
+	const uint64_t t0 = bench_now();
+	while (i_read < N_RECORDS) {
+		while (i_write < N_RECORDS) {
+			src[0] = record_words(i_write);
+			if (!copy_ring_write(&ring, src, 4U * (src[0] + 1U))) {
+				break;
+			}
+			i_write++;
+		}
+		const uint32_t *rec;
+		size_t n;
+		while ((rec = copy_ring_peek(&ring, &n))) {
+			sum += parse(rec);
+			ring.tail += n;
+			i_read++;
+		}
+	}
+	const uint64_t t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("ring, copy on wrap", t0, t1, N_RECORDS);
+	free(ring.buf);
+}
+
+static void bench_magic_ring(void) {
+	fx_mem_ring_t ring;
+	if (!fx_mem_ring_init(&ring, RING_SIZE)) {
+		return;
+	}
+	uint64_t sum = 0U;
+	uint32_t i_write = 0U, i_read = 0U;
+	const uint64_t t0 = bench_now();
+	while (i_read < N_RECORDS) {
+		while (i_write < N_RECORDS) {
+			src[0] = record_words(i_write);
+			const size_t n = 4U * (src[0] + 1U);
+			void *w = fx_mem_ring_write_begin(&ring, n);
+			if (!w) {
+				break;
+			}
+			memcpy(w, src, n);
+			fx_mem_ring_write_end(&ring, n);
+			i_write++;
+		}
+		size_t n_avail, offs = 0U;
+		const uint8_t *r =
+		    (const uint8_t *)fx_mem_ring_read_begin(&ring, &n_avail);
+		while (offs < n_avail) {
+			const uint32_t *rec = (const uint32_t *)(r + offs);
+			sum += parse(rec);
+			offs += 4U * (rec[0] + 1U);
+			i_read++;
+		}
+		fx_mem_ring_read_end(&ring, offs);
+	}
+	const uint64_t t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("ring, double-mapped", t0, t1, N_RECORDS);
+	fx_mem_ring_destroy(&ring);
+}
+
+static fx_mem_ring_t mp_ring;
+
+static void *producer_main(void *arg) {
+	uint32_t buf[MAX_WORDS + 1U] = {0U};
+	for (uint32_t i = 0U; i < N_RECORDS / N_PRODUCERS; i++) {
+		buf[0] = record_words(i);
+		const size_t n = 4U * (buf[0] + 1U);
+		uint64_t pos;
+		void *w;
+		while (!(w = fx_mem_ring_mp_reserve(&mp_ring, n, &pos))) {
+			sched_yield();
+		}
+		memcpy(w, buf, n);
+		fx_mem_ring_mp_commit(&mp_ring, pos, n);
+	}
+	return arg;
+}
+
+static void bench_magic_ring_mpsc(void) {
+	if (!fx_mem_ring_init(&mp_ring, RING_SIZE)) {
+		return;
+	}
+	pthread_t threads[N_PRODUCERS];
+	uint64_t sum = 0U;
+	uint32_t i_read = 0U;
+	const uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_PRODUCERS; i++) {
+		pthread_create(&threads[i], NULL, producer_main, NULL);
+	}
+	while (i_read < (N_RECORDS / N_PRODUCERS) * N_PRODUCERS) {
+		size_t n_avail, offs = 0U;
+		const uint8_t *r =
+		    (const uint8_t *)fx_mem_ring_read_begin(&mp_ring, &n_avail);
+		if (n_avail == 0U) {
+			sched_yield();
+		}
+		while (offs < n_avail) {
+			const uint32_t *rec = (const uint32_t *)(r + offs);
+			sum += parse(rec);
+			offs += 4U * (rec[0] + 1U);
+			i_read++;
+		}
+		fx_mem_ring_read_end(&mp_ring, offs);
+	}
+	for (uint32_t i = 0U; i < N_PRODUCERS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	const uint64_t t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("ring, double-mapped, 2 producers", t0, t1, i_read);
+	fx_mem_ring_destroy(&mp_ring);
+}
+
+int main() {
+	bench_copy_ring();
+	bench_magic_ring();
+	bench_magic_ring_mpsc();
+	return 0;
+}
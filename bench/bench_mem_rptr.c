@@ -0,0 +1,163 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench_mem_rptr.c
+ *
+ * Compares absolute 64-bit pointers with 32-bit relative pointers. The
+ * "chase" benchmarks follow a random cycle through a linked list and are
+ * dominated by cache misses, the "scan" benchmarks sequentially dereference
+ * pointer fields and measure the decode overhead itself.
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include <foxen/mem_rptr.h>
+
+#include "bench.h"
+
+#define N_NODES (1U << 20U)
+#define N_STEPS (1U << 24U)
+#define N_SCAN 64U
+
+typedef struct node_ptr {
+	struct node_ptr *next;
+	uint64_t value;
+} node_ptr_t;
+
+typedef struct node_rptr {
+	fx_mem_rptr_t next;
+	uint32_t value;
+} node_rptr_t;
+
+static uint32_t *random_cycle(void) {
+	/* Sattolo's algorithm generates a single cycle through all nodes */
+	uint32_t *perm = malloc(sizeof(uint32_t) * N_NODES);
+	uint64_t x = 88172645463325252ULL;
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		perm[i] = i;
+	}
+	for (uint32_t i = N_NODES - 1U; i > 0U; i--) {
+		x ^= x << 13U, x ^= x >> 7U, x ^= x << 17U;
+		const uint32_t j = (uint32_t)(x % i);
+		const uint32_t tmp = perm[i];
+		perm[i] = perm[j], perm[j] = tmp;
+	}
+	return perm;
+}
+
+static void bench_chase(const uint32_t *perm) {
+	/* Absolute pointers */
+	node_ptr_t *nodes = malloc(sizeof(node_ptr_t) * N_NODES);
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		nodes[i].next = &nodes[perm[i]];
+		nodes[i].value = i;
+	}
+	uint64_t sum = 0U;
+	const node_ptr_t *p = &nodes[0];
+	uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_STEPS; i++) {
+		sum += p->value;
+		p = p->next;
+	}
+	uint64_t t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("chase, 64-bit pointer (16 B/node)", t0, t1, N_STEPS);
+	free(nodes);
+
+	/* Relative pointers; the first node is placed after a header so that
+	   no node lives at offset zero */
+	uint8_t *base = malloc(FX_ALIGN + sizeof(node_rptr_t) * N_NODES);
+	node_rptr_t *rnodes = (node_rptr_t *)(base + FX_ALIGN);
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		rnodes[i].next = fx_mem_rptr_encode(base, &rnodes[perm[i]]);
+		rnodes[i].value = i;
+	}
+	sum = 0U;
+	const node_rptr_t *q = &rnodes[0];
+	t0 = bench_now();
+	for (uint32_t i = 0U; i < N_STEPS; i++) {
+		sum += q->value;
+		q = (const node_rptr_t *)fx_mem_rptr_decode_nonnull(base, q->next);
+	}
+	t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("chase, 32-bit relative pointer (8 B/node)", t0, t1,
+	             N_STEPS);
+	free(base);
+}
+
+static void bench_scan(void) {
+	/* Arrays of pointer fields pointing at the nodes of a small array that
+	   stays in L1 cache */
+	uint8_t *base = malloc(FX_ALIGN + sizeof(uint64_t) * N_SCAN);
+	uint64_t *values = (uint64_t *)(base + FX_ALIGN);
+	uint64_t **ptrs = malloc(sizeof(uint64_t *) * N_NODES);
+	fx_mem_rptr_t *rptrs = malloc(sizeof(fx_mem_rptr_t) * N_NODES);
+	for (uint32_t i = 0U; i < N_SCAN; i++) {
+		values[i] = i;
+	}
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		ptrs[i] = &values[(i * 7U) % N_SCAN];
+		rptrs[i] = fx_mem_rptr_encode(base, ptrs[i]);
+	}
+
+	uint64_t sum = 0U;
+	uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		sum += *ptrs[i];
+	}
+	uint64_t t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("scan, 64-bit pointer", t0, t1, N_NODES);
+
+	sum = 0U;
+	t0 = bench_now();
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		sum += *(const uint64_t *)fx_mem_rptr_decode_nonnull(base, rptrs[i]);
+	}
+	t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("scan, 32-bit relative pointer", t0, t1, N_NODES);
+
+	sum = 0U;
+	t0 = bench_now();
+	for (uint32_t i = 0U; i < N_NODES; i++) {
+		sum += *(const uint64_t *)fx_mem_rptr_decode(base, rptrs[i]);
+	}
+	t1 = bench_now();
+	BENCH_KEEP(sum);
+	bench_report("scan, 32-bit relative pointer (NULL check)", t0, t1,
+	             N_NODES);
+
+	free(rptrs);
+	free(ptrs);
+	free(base);
+}
+
+int main() {
+	uint32_t *perm = random_cycle();
+	bench_chase(perm);
+	bench_scan();
+	free(perm);
+	return 0;
+}
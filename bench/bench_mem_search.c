@@ -0,0 +1,131 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bench_mem_search.c
+ *
+ * Compares a std::lower_bound style binary search over a sorted array with the
+ * branch-free searches over the Eytzinger and van Emde Boas layouts. The
+ * arrays hold 2^k - 1 uint32_t keys, so that the van Emde Boas tree needs no
+ * padding, and range from 1 KiB to 1 GiB. Sizes for which memory cannot be
+ * allocated are skipped.
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include <foxen/mem_search.h>
+
+#include "bench.h"
+
+#define N_QUERIES (1U << 20U)
+#define MIN_SIZE (1ULL << 10U)
+#define MAX_SIZE (1ULL << 30U)
+
+static uint32_t queries[N_QUERIES];
+
+static const uint32_t *std_lower_bound(const uint32_t *a, uint32_t n,
+                                       uint32_t key) {
+	size_t first = 0U, count = n;
+	while (count > 0U) {
+		const size_t step = count / 2U;
+		if (a[first + step] < key) {
+			first += step + 1U;
+			count -= step + 1U;
+		} else {
+			count = step;
+		}
+	}
+	return a + first;
+}
+
+static void report(const char *layout, uint64_t size, uint64_t t0,
+                   uint64_t t1) {
+	char name[64];
+	if (size >= (1ULL << 20U)) {
+		snprintf(name, sizeof(name), "search, %s, %u MiB", layout,
+		         (unsigned)(size >> 20U));
+	} else {
+		snprintf(name, sizeof(name), "search, %s, %u KiB", layout,
+		         (unsigned)(size >> 10U));
+	}
+	bench_report(name, t0, t1, N_QUERIES);
+}
+
+static void bench_size(uint64_t size) {
+	const uint32_t n = (uint32_t)(size / sizeof(uint32_t) - 1U);
+	uint32_t *keys = (uint32_t *)malloc(size);
+	if (!keys) {
+		return;
+	}
+	uint32_t seed = 1U;
+	for (uint32_t i = 0U; i < n; i++) {
+		keys[i] = 2U * i + 1U;
+	}
+	for (uint32_t i = 0U; i < N_QUERIES; i++) {
+		seed = seed * 1103515245U + 12345U;
+		queries[i] = (uint32_t)(((uint64_t)seed * (2U * (uint64_t)n)) >> 32U);
+	}
+
+	uint64_t sum = 0U;
+	uint64_t t0 = bench_now();
+	for (uint32_t i = 0U; i < N_QUERIES; i++) {
+		sum += *std_lower_bound(keys, n, queries[i]);
+	}
+	uint64_t t1 = bench_now();
+	report("std::lower_bound", size, t0, t1);
+
+	void *mem = malloc(fx_mem_eytz_size(n, sizeof(uint32_t)));
+	if (mem) {
+		const uint32_t *base =
+		    (const uint32_t *)fx_mem_eytz_init(mem, keys, n, sizeof(uint32_t));
+		t0 = bench_now();
+		for (uint32_t i = 0U; i < N_QUERIES; i++) {
+			sum += *fx_mem_eytz_lower_bound(base, n, queries[i]);
+		}
+		t1 = bench_now();
+		report("Eytzinger", size, t0, t1);
+		free(mem);
+	}
+
+	mem = malloc(fx_mem_veb_size(n, sizeof(uint32_t)));
+	if (mem) {
+		const fx_mem_veb_t *veb =
+		    fx_mem_veb_init(mem, keys, n, sizeof(uint32_t));
+		t0 = bench_now();
+		for (uint32_t i = 0U; i < N_QUERIES; i++) {
+			sum += *fx_mem_veb_lower_bound(veb, queries[i]);
+		}
+		t1 = bench_now();
+		report("van Emde Boas", size, t0, t1);
+		free(mem);
+	}
+
+	BENCH_KEEP(sum);
+	free(keys);
+}
+
+int main() {
+	for (uint64_t size = MIN_SIZE; size <= MAX_SIZE; size *= 4U) {
+		bench_size(size);
+	}
+	return 0;
+}
@@ -16,44 +16,30 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
+
 #include <foxen/mem.h>
+#include <foxen/mem_bitset.h>
+#include <foxen/mem_heatmap.h>
 
 /******************************************************************************
  * PRIVATE IMPLEMENTATION DETAILS                                             *
  ******************************************************************************/
 
-/* http://graphics.stanford.edu/~seander/bithacks.html#IntegerLogDeBruijn */
-
-static const int multiply_de_bruijn_tbl[32U] = {
-    0,  1,  28, 2,  29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4,  8,
-    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6,  11, 5,  10, 9};
-
-static inline uint32_t _fx_lsb(uint32_t v) {
-	return multiply_de_bruijn_tbl[(uint32_t)((v & -v) * 0x077CB531UL) >> 27U];
-}
-
-/******************************************************************************
- * PUBLIC C API                                                               *
- ******************************************************************************/
-
-uint32_t fx_mem_pool_alloc(uint32_t allocated_ptr[], uint32_t *free_idx_ptr,
-                           uint32_t *n_allocated_ptr, uint32_t n_available) {
+static inline uint32_t _fx_mem_pool_alloc(uint32_t allocated_ptr[],
+                                          uint32_t *free_idx_ptr,
+                                          uint32_t *n_allocated_ptr,
+                                          uint32_t n_available,
+                                          uint32_t *n_failed_ptr,
+                                          fx_mem_heatmap_t *heatmap) {
 	const uint32_t free_idx = __atomic_load_n(free_idx_ptr, __ATOMIC_SEQ_CST);
 	uint32_t idx = free_idx & (~(32U - 1U));
 	while (true) {
-		/* Load the current bitmap entry and search the first free zero-bit. If
-		   all bits are set, go to the next bitmap entry. */
-		uint32_t *allocated_slot_ptr = allocated_ptr + idx / 32U;
-		uint32_t allocated =
-		    __atomic_load_n(allocated_slot_ptr, __ATOMIC_SEQ_CST);
-		uint32_t offs = 32U; /* Assume there is no free bit */
-		if (~allocated) {
-			offs = _fx_lsb(~allocated);
-		}
+		/* Search the first free zero-bit in the bitmap, starting at the
+		   current index. */
+		idx = fx_mem_bitset_find_next_clear(allocated_ptr, n_available, idx);
 
-		/* Update the result index, start from the beginning of the list if we
-		   passed the end */
-		idx += offs;
+		/* Start from the beginning of the list if we passed the end */
 		if (idx >= n_available) {
 			/* We wrapped around. Abort if there is no more space and all slots
 			 * have been allocated. Note that we may wrongly abort here if a
@@ -66,19 +52,16 @@ uint32_t fx_mem_pool_alloc(uint32_t allocated_ptr[], uint32_t *free_idx_ptr,
 			idx = 0U;
 			continue;
 		}
-		if (offs >= 32U) {
-			continue; /* No free bit, continue */
-		}
 
-		/* Check whether the entry is in use. If yes, continue with the next
-		 * iteration, then try to write the new bitmap entry. If no, try to
-		 * write the updated value to the bitmap. If this is successful, update
-		 * the number of allocated elements, otherwise continue with the outer
-		 * loop and search for a free bitmap entry. */
-		const uint32_t mask = (1U << offs);
-		if (__atomic_compare_exchange_n(allocated_slot_ptr, &allocated,
-		                                allocated | mask, false,
-		                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		/* Try to claim the slot by setting the corresponding bit. If the bit
+		 * has already been set by another thread in the meantime, continue
+		 * searching for a free bitmap entry. Otherwise, update the number of
+		 * allocated elements. */
+		const bool failed = fx_mem_bitset_test_and_set(allocated_ptr, idx);
+		if (heatmap) {
+			fx_mem_heatmap_record(heatmap, idx / 32U, failed);
+		}
+		if (!failed) {
 			/* Writing the new bitmap entry was successful, we need to update
 			 * n_allocated by incrementing it by one. There may be a period
 			 * where the slot is allocated by setting the corresponding bit in
@@ -98,25 +81,42 @@ uint32_t fx_mem_pool_alloc(uint32_t allocated_ptr[], uint32_t *free_idx_ptr,
 			return idx;
 		}
 
-		/* Make sure the index is rounded appropriately, then try again */
-		idx = idx & (~(32U - 1U));
+		/* Another thread claimed the slot between the search and the
+		   test-and-set */
+		if (n_failed_ptr) {
+			(*n_failed_ptr)++;
+		}
 	}
 }
 
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_pool_alloc(uint32_t allocated_ptr[], uint32_t *free_idx_ptr,
+                           uint32_t *n_allocated_ptr, uint32_t n_available) {
+	return _fx_mem_pool_alloc(allocated_ptr, free_idx_ptr, n_allocated_ptr,
+	                          n_available, NULL, NULL);
+}
+
+uint32_t fx_mem_pool_alloc_probe(uint32_t allocated_ptr[],
+                                 uint32_t *free_idx_ptr,
+                                 uint32_t *n_allocated_ptr,
+                                 uint32_t n_available, uint32_t *n_failed_ptr,
+                                 fx_mem_heatmap_t *heatmap) {
+	*n_failed_ptr = 0U;
+	return _fx_mem_pool_alloc(allocated_ptr, free_idx_ptr, n_allocated_ptr,
+	                          n_available, n_failed_ptr, heatmap);
+}
+
 void fx_mem_pool_free(uint32_t idx, uint32_t allocated_ptr[],
                       uint32_t *free_idx_ptr, uint32_t *n_allocated_ptr) {
 	/* Load all state variables */
-	uint32_t *allocated_slot_ptr = allocated_ptr + idx / 32U;
-	uint32_t allocated = __atomic_load_n(allocated_ptr, __ATOMIC_SEQ_CST);
 	uint32_t n_allocated = __atomic_load_n(n_allocated_ptr, __ATOMIC_SEQ_CST);
 	uint32_t free_idx = __atomic_load_n(free_idx_ptr, __ATOMIC_SEQ_CST);
 
 	/* Reset the corresponding bit in the bitmap. */
-	uint32_t mask = ~(1U << (idx % 32U));
-	while (!__atomic_compare_exchange_n(allocated_slot_ptr, &allocated,
-	                                    allocated & mask, true,
-	                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
-		;
+	fx_mem_bitset_test_and_clear(allocated_ptr, idx);
 
 	/* Decrement the n_allocated counter. Note that the value stored in
 	 * n_allocated is temporarily too large (since the slot was already freed),
@@ -32,6 +32,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * Memory alignment for pointers internally used by Stanchion. Aligning memory
  * and telling the compiler about it allows the compiler to perform better
@@ -214,6 +218,23 @@ static inline void fx_mem_zero_aligned(void *mem, uint32_t size) {
 uint32_t fx_mem_pool_alloc(uint32_t allocated[], uint32_t *free_idx,
                            uint32_t *n_allocated, uint32_t n_available);
 
+struct fx_mem_heatmap;
+
+/**
+ * Same as fx_mem_pool_alloc(), but additionally reports how often a slot found
+ * to be free was claimed by another thread before this thread could claim it.
+ * This number is a direct measure of the contention on the bitmap.
+ *
+ * @param n_failed is a pointer at an integer that receives the number of
+ * failed claims.
+ * @param heatmap is an optional heatmap (see mem_heatmap.h) in which claims
+ * and failed claims are recorded per bitmap word. May be NULL.
+ */
+uint32_t fx_mem_pool_alloc_probe(uint32_t allocated[], uint32_t *free_idx,
+                                 uint32_t *n_allocated, uint32_t n_available,
+                                 uint32_t *n_failed,
+                                 struct fx_mem_heatmap *heatmap);
+
 /**
  * Marks the slot previously allocated by _fx_mem_alloc() as free.
  *
@@ -233,4 +254,8 @@ uint32_t fx_mem_pool_alloc(uint32_t allocated[], uint32_t *free_idx,
 void fx_mem_pool_free(uint32_t idx, uint32_t allocated[], uint32_t *free_idx,
                       uint32_t *n_allocated);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* FOXEN_MEM_H */
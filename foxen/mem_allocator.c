@@ -0,0 +1,260 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_bitset.h>
+
+/******************************************************************************
+ * GENERIC ALLOCATOR INTERFACE                                                *
+ ******************************************************************************/
+
+__thread uint32_t fx_mem_allocator_thread_stripe = 0U;
+
+static uint32_t _fx_allocator_n_threads = 0U;
+
+uint32_t fx_mem_allocator_assign_stripe(void) {
+	const uint32_t idx =
+	    __atomic_fetch_add(&_fx_allocator_n_threads, 1U, __ATOMIC_RELAXED);
+	fx_mem_allocator_thread_stripe = idx % FX_MEM_ALLOCATOR_N_STRIPES + 1U;
+	return fx_mem_allocator_thread_stripe;
+}
+
+uint32_t fx_mem_allocator_counters_size(void) {
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, FX_MEM_ALLOCATOR_COUNTERS_ALIGN -
+	                                        FX_ALIGN) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_allocator_counters_t));
+	return ok ? size : 0U;
+}
+
+fx_mem_allocator_counters_t *fx_mem_allocator_counters_init(void *mem) {
+	fx_mem_allocator_counters_t *counters =
+	    (fx_mem_allocator_counters_t *)fx_mem_align_ex(
+	        &mem, sizeof(fx_mem_allocator_counters_t),
+	        FX_MEM_ALLOCATOR_COUNTERS_ALIGN);
+	fx_mem_zero_aligned(counters, sizeof(fx_mem_allocator_counters_t));
+	return counters;
+}
+
+void fx_mem_allocator_counters_read(const fx_mem_allocator_counters_t *counters,
+                                    size_t *n_allocs_total, size_t *n_contended,
+                                    size_t *n_peak) {
+	*n_allocs_total = *n_contended = *n_peak = 0U;
+	for (uint32_t i = 0U; counters && i < FX_MEM_ALLOCATOR_N_STRIPES; i++) {
+		const fx_mem_allocator_stripe_t *s = &counters->stripes[i];
+		const size_t peak = __atomic_load_n(&s->n_peak, __ATOMIC_RELAXED);
+		*n_allocs_total +=
+		    __atomic_load_n(&s->n_allocs_total, __ATOMIC_RELAXED);
+		*n_contended += __atomic_load_n(&s->n_contended, __ATOMIC_RELAXED);
+		*n_peak = (peak > *n_peak) ? peak : *n_peak;
+	}
+}
+
+/******************************************************************************
+ * STATIC POOL                                                                *
+ ******************************************************************************/
+
+static uint32_t _fx_static_pool_slot_size(uint32_t slot_size) {
+	return (slot_size + FX_ALIGN - 1U) & ~(uint32_t)(FX_ALIGN - 1U);
+}
+
+static void *_fx_static_pool_alloc(fx_mem_allocator_t *self, size_t size,
+                                   size_t align) {
+	fx_mem_static_pool_t *pool = (fx_mem_static_pool_t *)self;
+	if (size > pool->slot_size || align > FX_ALIGN) {
+		return NULL;
+	}
+	return fx_mem_static_pool_alloc(pool);
+}
+
+static void _fx_static_pool_free(fx_mem_allocator_t *self, void *ptr,
+                                 size_t size) {
+	(void)size;
+	if (ptr) {
+		fx_mem_static_pool_free((fx_mem_static_pool_t *)self, ptr);
+	}
+}
+
+static void *_fx_static_pool_realloc(fx_mem_allocator_t *self, void *ptr,
+                                     size_t old_size, size_t new_size,
+                                     size_t align) {
+	(void)old_size;
+	fx_mem_static_pool_t *pool = (fx_mem_static_pool_t *)self;
+	if (!ptr) {
+		return _fx_static_pool_alloc(self, new_size, align);
+	}
+
+	/* All slots have the same size, so we either fit into the current slot,
+	   or we don't fit at all. */
+	if (new_size > pool->slot_size || align > FX_ALIGN) {
+		return NULL;
+	}
+	return ptr;
+}
+
+static void _fx_static_pool_reset(fx_mem_allocator_t *self) {
+	fx_mem_static_pool_t *pool = (fx_mem_static_pool_t *)self;
+	fx_mem_bitset_clear_range(pool->allocated, 0U, pool->n_available);
+	__atomic_store_n(&pool->free_idx, 0U, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&pool->n_allocated, 0U, __ATOMIC_SEQ_CST);
+}
+
+static void _fx_static_pool_stats(const fx_mem_allocator_t *self,
+                                  fx_mem_allocator_stats_t *stats) {
+	const fx_mem_static_pool_t *pool = (const fx_mem_static_pool_t *)self;
+	const uint32_t n_allocated =
+	    __atomic_load_n(&pool->n_allocated, __ATOMIC_RELAXED);
+	stats->n_bytes_reserved = (size_t)pool->n_available * pool->slot_size;
+	stats->n_bytes_used = (size_t)n_allocated * pool->slot_size;
+	stats->n_allocations = n_allocated;
+	fx_mem_allocator_counters_read(
+	    __atomic_load_n(&self->counters, __ATOMIC_RELAXED),
+	    &stats->n_allocs_total, &stats->n_contended, &stats->n_bytes_peak);
+	stats->n_bytes_peak *= pool->slot_size;
+	stats->n_frees_total = (stats->n_allocs_total > n_allocated)
+	                           ? stats->n_allocs_total - n_allocated
+	                           : 0U;
+}
+
+const fx_mem_allocator_vtable_t fx_mem_static_pool_vtable = {
+    _fx_static_pool_alloc, _fx_static_pool_free, _fx_static_pool_realloc,
+    _fx_static_pool_reset, _fx_static_pool_stats};
+
+uint32_t fx_mem_static_pool_size(uint32_t n_available, uint32_t slot_size) {
+	slot_size = _fx_static_pool_slot_size(slot_size);
+	const uint64_t n_bytes_slots = (uint64_t)n_available * slot_size;
+	if (slot_size == 0U || n_bytes_slots > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_static_pool_t)) &&
+	          fx_mem_update_size(&size, sizeof(uint32_t) *
+	                                        fx_mem_bitset_n_words(n_available)) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_slots);
+	return ok ? size : 0U;
+}
+
+fx_mem_static_pool_t *fx_mem_static_pool_init(void *mem, uint32_t n_available,
+                                              uint32_t slot_size) {
+	fx_mem_static_pool_t *pool = (fx_mem_static_pool_t *)fx_mem_align(
+	    &mem, sizeof(fx_mem_static_pool_t));
+	fx_mem_allocator_init(&pool->allocator, &fx_mem_static_pool_vtable);
+	pool->slot_size = _fx_static_pool_slot_size(slot_size);
+	pool->n_available = n_available;
+	pool->allocated = (uint32_t *)fx_mem_align(
+	    &mem, sizeof(uint32_t) * fx_mem_bitset_n_words(n_available));
+	pool->slots = (uint8_t *)fx_mem_align(&mem, n_available * pool->slot_size);
+	fx_mem_zero_aligned(pool->allocated,
+	                    sizeof(uint32_t) * fx_mem_bitset_n_words(n_available));
+	pool->heatmap = NULL;
+	pool->seqlock = NULL;
+	_fx_static_pool_reset(&pool->allocator);
+	return pool;
+}
+
+/******************************************************************************
+ * ARENA                                                                      *
+ ******************************************************************************/
+
+static void *_fx_arena_alloc(fx_mem_allocator_t *self, size_t size,
+                             size_t align) {
+	return fx_mem_arena_alloc((fx_mem_arena_t *)self, size, align ? align : 1U);
+}
+
+static void _fx_arena_free(fx_mem_allocator_t *self, void *ptr, size_t size) {
+	if (ptr) {
+		fx_mem_arena_free((fx_mem_arena_t *)self, ptr, size);
+	}
+}
+
+static void *_fx_arena_realloc(fx_mem_allocator_t *self, void *ptr,
+                               size_t old_size, size_t new_size,
+                               size_t align) {
+	fx_mem_arena_t *arena = (fx_mem_arena_t *)self;
+	align = align ? align : 1U;
+	if (!ptr) {
+		return fx_mem_arena_alloc(arena, new_size, align);
+	}
+
+	/* Resize the block in place if it is the most recent allocation */
+	const size_t begin = (size_t)((uint8_t *)ptr - arena->base);
+	const size_t new_end = begin + new_size;
+	const bool aligned = ((uintptr_t)ptr & (align - 1U)) == 0U;
+	size_t end = begin + old_size;
+	if (aligned && new_end >= begin && new_end <= arena->capacity &&
+	    __atomic_compare_exchange_n(&arena->offset, &end, new_end, false,
+	                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return ptr;
+	}
+
+	/* Shrinking always works in place, the memory is just not reclaimed */
+	if (aligned && new_size <= old_size) {
+		return ptr;
+	}
+
+	/* Otherwise allocate a new block and copy the data. The block may be
+	   smaller than the old one if it was moved to satisfy the alignment. */
+	void *res = fx_mem_arena_alloc(arena, new_size, align);
+	if (res) {
+		memcpy(res, ptr, new_size < old_size ? new_size : old_size);
+		fx_mem_arena_free(arena, ptr, old_size);
+	}
+	return res;
+}
+
+static void _fx_arena_reset(fx_mem_allocator_t *self) {
+	fx_mem_arena_reset((fx_mem_arena_t *)self);
+}
+
+static void _fx_arena_stats(const fx_mem_allocator_t *self,
+                            fx_mem_allocator_stats_t *stats) {
+	const fx_mem_arena_t *arena = (const fx_mem_arena_t *)self;
+	stats->n_bytes_reserved = arena->capacity;
+	stats->n_bytes_used = __atomic_load_n(&arena->offset, __ATOMIC_RELAXED);
+	stats->n_allocations =
+	    __atomic_load_n(&arena->n_allocations, __ATOMIC_RELAXED);
+	fx_mem_allocator_counters_read(
+	    __atomic_load_n(&self->counters, __ATOMIC_RELAXED),
+	    &stats->n_allocs_total, &stats->n_contended, &stats->n_bytes_peak);
+	stats->n_frees_total = (stats->n_allocs_total > stats->n_allocations)
+	                           ? stats->n_allocs_total - stats->n_allocations
+	                           : 0U;
+}
+
+const fx_mem_allocator_vtable_t fx_mem_arena_vtable = {
+    _fx_arena_alloc, _fx_arena_free, _fx_arena_realloc, _fx_arena_reset,
+    _fx_arena_stats};
+
+fx_mem_arena_t *fx_mem_arena_init(void *mem, size_t size) {
+	const uintptr_t end = (uintptr_t)mem + size;
+	fx_mem_arena_t *arena =
+	    (fx_mem_arena_t *)fx_mem_align(&mem, sizeof(fx_mem_arena_t));
+	uint8_t *base = (uint8_t *)FX_ALIGN_ADDR(mem);
+	if ((uintptr_t)base > end) {
+		return NULL;
+	}
+	fx_mem_allocator_init(&arena->allocator, &fx_mem_arena_vtable);
+	arena->base = base;
+	arena->capacity = end - (uintptr_t)base;
+	fx_mem_arena_reset(arena);
+	return arena;
+}
@@ -0,0 +1,628 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_allocator.h
+ *
+ * Type-erased allocator interface and the allocators implementing it. All
+ * allocators operate on a memory region provided by the caller; an allocator
+ * can be passed to library code as an fx_mem_allocator_t pointer. Code that
+ * knows the concrete allocator type at compile time should call the inline
+ * fx_mem_static_pool_*() and fx_mem_arena_*() functions directly, which
+ * avoids the indirect function call.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_ALLOCATOR_H
+#define FOXEN_MEM_ALLOCATOR_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_budget.h>
+#include <foxen/mem_heatmap.h>
+#include <foxen/mem_sampler.h>
+#include <foxen/mem_seqlock.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+ * GENERIC ALLOCATOR INTERFACE                                                *
+ ******************************************************************************/
+
+/**
+ * Statistics reported by an allocator.
+ */
+typedef struct fx_mem_allocator_stats {
+	/**
+	 * Total number of bytes managed by the allocator.
+	 */
+	size_t n_bytes_reserved;
+
+	/**
+	 * Number of bytes currently in use, including internal fragmentation.
+	 */
+	size_t n_bytes_used;
+
+	/**
+	 * Number of allocations that have not been freed yet.
+	 */
+	size_t n_allocations;
+
+	/**
+	 * Largest number of bytes that were in use at the same time. This and the
+	 * following counters are only maintained while counters are attached to
+	 * the allocator, see fx_mem_allocator_set_counters(), and are zero
+	 * otherwise.
+	 */
+	size_t n_bytes_peak;
+
+	/**
+	 * Total number of allocations and frees since the counters were attached.
+	 * Rates are obtained by sampling these counters.
+	 */
+	size_t n_allocs_total;
+	size_t n_frees_total;
+
+	/**
+	 * Number of times an allocation had to be retried because another thread
+	 * modified the allocator state concurrently.
+	 */
+	size_t n_contended;
+} fx_mem_allocator_stats_t;
+
+/**
+ * Number of stripes of the allocation counters. Threads are assigned to the
+ * stripes in round-robin order.
+ */
+#define FX_MEM_ALLOCATOR_N_STRIPES 16U
+
+/**
+ * Alignment of the allocation counters; corresponds to the cache line size.
+ */
+#define FX_MEM_ALLOCATOR_COUNTERS_ALIGN 64U
+
+/**
+ * Allocation counters of the threads assigned to a single stripe. Each stripe
+ * occupies a cache line of its own, so threads assigned to different stripes
+ * do not share any cache line when updating the counters.
+ */
+typedef struct fx_mem_allocator_stripe {
+	size_t n_allocs_total;
+	size_t n_contended;
+	size_t n_peak; /* High-water mark in allocator-specific units */
+	uint8_t _pad[FX_MEM_ALLOCATOR_COUNTERS_ALIGN - 3U * sizeof(size_t)];
+} fx_mem_allocator_stripe_t;
+
+/**
+ * Allocation counters that can be attached to an allocator. The counters are
+ * accumulated per stripe and summed up when the statistics are read.
+ */
+typedef struct fx_mem_allocator_counters {
+	fx_mem_allocator_stripe_t stripes[FX_MEM_ALLOCATOR_N_STRIPES];
+} fx_mem_allocator_counters_t;
+
+/**
+ * Stripe of the calling thread plus one, or zero if the thread has not been
+ * assigned a stripe yet.
+ */
+extern __thread uint32_t fx_mem_allocator_thread_stripe;
+
+/**
+ * Assigns a stripe to the calling thread and returns the new value of
+ * fx_mem_allocator_thread_stripe.
+ */
+uint32_t fx_mem_allocator_assign_stripe(void);
+
+/**
+ * Computes the size of the memory region required to store the allocation
+ * counters.
+ */
+uint32_t fx_mem_allocator_counters_size(void);
+
+/**
+ * Initialises zeroed allocation counters in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_allocator_counters_size() bytes.
+ * @return a pointer at the counters.
+ */
+fx_mem_allocator_counters_t *fx_mem_allocator_counters_init(void *mem);
+
+/**
+ * Sums up the allocation counters. All results are zero if counters is NULL.
+ */
+void fx_mem_allocator_counters_read(const fx_mem_allocator_counters_t *counters,
+                                    size_t *n_allocs_total, size_t *n_contended,
+                                    size_t *n_peak);
+
+struct fx_mem_allocator;
+
+/**
+ * Function table implemented by each allocator.
+ */
+typedef struct fx_mem_allocator_vtable {
+	void *(*alloc)(struct fx_mem_allocator *self, size_t size, size_t align);
+	void (*free)(struct fx_mem_allocator *self, void *ptr, size_t size);
+	void *(*realloc)(struct fx_mem_allocator *self, void *ptr, size_t old_size,
+	                 size_t new_size, size_t align);
+	void (*reset)(struct fx_mem_allocator *self);
+	void (*stats)(const struct fx_mem_allocator *self,
+	              fx_mem_allocator_stats_t *stats);
+} fx_mem_allocator_vtable_t;
+
+/**
+ * Base "class" of all allocators. Each allocator structure has an
+ * fx_mem_allocator_t as its first member, so a pointer at a concrete allocator
+ * can be cast to an fx_mem_allocator_t pointer.
+ */
+typedef struct fx_mem_allocator {
+	const fx_mem_allocator_vtable_t *vtable;
+
+	/* Budget this allocator is charged to, see fx_mem_budget_join() */
+	fx_mem_budget_t *budget;
+
+	/* Optional sampling profiler, see fx_mem_allocator_set_sampler() */
+	fx_mem_sampler_t *sampler;
+
+	/* Optional allocation counters, see fx_mem_allocator_set_counters() */
+	fx_mem_allocator_counters_t *counters;
+} fx_mem_allocator_t;
+
+/**
+ * Initialises the generic part of an allocator. Called by the initialisation
+ * functions of the individual allocators.
+ */
+static inline void fx_mem_allocator_init(fx_mem_allocator_t *allocator,
+                                         const fx_mem_allocator_vtable_t *vtable) {
+	allocator->vtable = vtable;
+	allocator->budget = NULL;
+	allocator->sampler = NULL;
+	allocator->counters = NULL;
+}
+
+/**
+ * Attaches a sampling profiler to the allocator. Allocations are reported to
+ * the sampler with the returned pointer as key. Pass NULL to detach the
+ * sampler. Must not be called while allocations are performed concurrently.
+ */
+static inline void fx_mem_allocator_set_sampler(fx_mem_allocator_t *allocator,
+                                                fx_mem_sampler_t *sampler) {
+	allocator->sampler = sampler;
+}
+
+/**
+ * Attaches allocation counters to the allocator. While counters are attached,
+ * fx_mem_allocator_stats() reports the high-water mark, the allocation and
+ * free totals, and the contention counter. Each allocation then updates the
+ * stripe of the allocating thread. Pass NULL to detach the counters. Must not
+ * be called while allocations are performed concurrently.
+ */
+static inline void fx_mem_allocator_set_counters(
+    fx_mem_allocator_t *allocator, fx_mem_allocator_counters_t *counters) {
+	__atomic_store_n(&allocator->counters, counters, __ATOMIC_RELAXED);
+}
+
+/**
+ * Raises the high-water mark stored in peak to value. Only performs an atomic
+ * write if the high-water mark actually changes.
+ */
+static inline void fx_mem_allocator_update_peak(size_t *peak, size_t value) {
+	size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+	while (value > old &&
+	       !__atomic_compare_exchange_n(peak, &old, value, true,
+	                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Records an allocation attempt in the stripe of the calling thread.
+ *
+ * @param counters are the counters attached to the allocator.
+ * @param success is true if the allocation succeeded.
+ * @param n_failed is the number of retries caused by other threads.
+ * @param level is the new fill level of the allocator in allocator-specific
+ * units; used to update the high-water mark.
+ */
+static inline void fx_mem_allocator_count(fx_mem_allocator_counters_t *counters,
+                                          bool success, size_t n_failed,
+                                          size_t level) {
+	uint32_t stripe = fx_mem_allocator_thread_stripe;
+	if (!stripe) {
+		stripe = fx_mem_allocator_assign_stripe();
+	}
+	fx_mem_allocator_stripe_t *s =
+	    &counters->stripes[(stripe - 1U) % FX_MEM_ALLOCATOR_N_STRIPES];
+	if (n_failed) {
+		__atomic_fetch_add(&s->n_contended, n_failed, __ATOMIC_RELAXED);
+	}
+	if (success) {
+		__atomic_fetch_add(&s->n_allocs_total, 1U, __ATOMIC_RELAXED);
+		fx_mem_allocator_update_peak(&s->n_peak, level);
+	}
+}
+
+/**
+ * Charges n_bytes to the budget the allocator is a member of, if any.
+ */
+static inline bool fx_mem_allocator_charge(fx_mem_allocator_t *allocator,
+                                           size_t n_bytes) {
+	fx_mem_budget_t *budget =
+	    __atomic_load_n(&allocator->budget, __ATOMIC_ACQUIRE);
+	return !budget || fx_mem_budget_charge(budget, n_bytes);
+}
+
+/**
+ * Returns n_bytes to the budget the allocator is a member of, if any.
+ */
+static inline void fx_mem_allocator_uncharge(fx_mem_allocator_t *allocator,
+                                             size_t n_bytes) {
+	fx_mem_budget_t *budget =
+	    __atomic_load_n(&allocator->budget, __ATOMIC_ACQUIRE);
+	if (budget) {
+		fx_mem_budget_release(budget, n_bytes);
+	}
+}
+
+/**
+ * Allocates a block of memory.
+ *
+ * @param allocator is the allocator from which the memory should be taken.
+ * @param size is the size of the block in bytes.
+ * @param align is the required alignment of the block. Must be a power of
+ * two.
+ * @return a pointer at the allocated block or NULL if the allocation failed,
+ * or if the allocation would exceed the budget of the allocator.
+ */
+static inline void *fx_mem_allocator_alloc(fx_mem_allocator_t *allocator,
+                                           size_t size, size_t align) {
+	if (!fx_mem_allocator_charge(allocator, size)) {
+		return NULL;
+	}
+	void *res = allocator->vtable->alloc(allocator, size, align);
+	if (!res) {
+		fx_mem_allocator_uncharge(allocator, size);
+	} else if (allocator->sampler) {
+		fx_mem_sampler_alloc(allocator->sampler, (uintptr_t)res, size);
+	}
+	return res;
+}
+
+/**
+ * Returns a block of memory to the allocator.
+ *
+ * @param allocator is the allocator the block was allocated from.
+ * @param ptr is the pointer returned by fx_mem_allocator_alloc(). May be NULL.
+ * @param size is the size that was passed to fx_mem_allocator_alloc().
+ */
+static inline void fx_mem_allocator_free(fx_mem_allocator_t *allocator,
+                                         void *ptr, size_t size) {
+	if (ptr) {
+		if (allocator->sampler) {
+			fx_mem_sampler_free(allocator->sampler, (uintptr_t)ptr);
+		}
+		fx_mem_allocator_uncharge(allocator, size);
+	}
+	allocator->vtable->free(allocator, ptr, size);
+}
+
+/**
+ * Resizes a block of memory. The block is resized in place if possible,
+ * otherwise a new block is allocated and the contents are copied.
+ *
+ * @return a pointer at the resized block or NULL if the block could not be
+ * resized. In the latter case the original block is left untouched.
+ */
+static inline void *fx_mem_allocator_realloc(fx_mem_allocator_t *allocator,
+                                             void *ptr, size_t old_size,
+                                             size_t new_size, size_t align) {
+	old_size = ptr ? old_size : 0U;
+	if (new_size > old_size &&
+	    !fx_mem_allocator_charge(allocator, new_size - old_size)) {
+		return NULL;
+	}
+	void *res =
+	    allocator->vtable->realloc(allocator, ptr, old_size, new_size, align);
+	if (!res && new_size > old_size) {
+		fx_mem_allocator_uncharge(allocator, new_size - old_size);
+	} else if (res && new_size < old_size) {
+		fx_mem_allocator_uncharge(allocator, old_size - new_size);
+	}
+	if (res && allocator->sampler) {
+		if (ptr) {
+			fx_mem_sampler_free(allocator->sampler, (uintptr_t)ptr);
+		}
+		fx_mem_sampler_alloc(allocator->sampler, (uintptr_t)res, new_size);
+	}
+	return res;
+}
+
+/**
+ * Frees all allocations at once and returns the bytes the allocator reports
+ * as used to its budget. This function is not thread-safe.
+ */
+static inline void fx_mem_allocator_reset(fx_mem_allocator_t *allocator) {
+	if (__atomic_load_n(&allocator->budget, __ATOMIC_ACQUIRE)) {
+		fx_mem_allocator_stats_t stats;
+		allocator->vtable->stats(allocator, &stats);
+		fx_mem_allocator_uncharge(allocator, stats.n_bytes_used);
+	}
+	allocator->vtable->reset(allocator);
+}
+
+/**
+ * Retrieves statistics about the allocator.
+ */
+static inline void fx_mem_allocator_stats(const fx_mem_allocator_t *allocator,
+                                          fx_mem_allocator_stats_t *stats) {
+	allocator->vtable->stats(allocator, stats);
+}
+
+/******************************************************************************
+ * STATIC POOL                                                                *
+ ******************************************************************************/
+
+/**
+ * Thread-safe pool of equally-sized slots backed by fx_mem_pool_alloc(). The
+ * bookkeeping data, the allocation bitmap, and the slots are stored in a
+ * single memory region.
+ */
+typedef struct fx_mem_static_pool {
+	fx_mem_allocator_t allocator;
+	uint32_t slot_size;
+	uint32_t n_available;
+	uint32_t *allocated;
+	uint8_t *slots;
+	fx_mem_heatmap_t *heatmap;
+	fx_mem_seqlock_t *seqlock;
+
+	/* Frequently modified state, placed on its own cache line */
+	uint8_t _pad0[64];
+	uint32_t free_idx;
+	uint32_t n_allocated;
+	uint8_t _pad1[64];
+} fx_mem_static_pool_t;
+
+/**
+ * Vtable of the static pool.
+ */
+extern const fx_mem_allocator_vtable_t fx_mem_static_pool_vtable;
+
+/**
+ * Computes the size of the memory region required to store a static pool.
+ *
+ * @param n_available is the number of slots.
+ * @param slot_size is the size of a single slot in bytes. Rounded up to a
+ * multiple of FX_ALIGN.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_static_pool_size(uint32_t n_available, uint32_t slot_size);
+
+/**
+ * Initialises a static pool in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_static_pool_size() bytes.
+ * @param n_available is the number of slots.
+ * @param slot_size is the size of a single slot in bytes.
+ * @return a pointer at the pool.
+ */
+fx_mem_static_pool_t *fx_mem_static_pool_init(void *mem, uint32_t n_available,
+                                              uint32_t slot_size);
+
+/**
+ * Attaches a contention heatmap to the pool. The heatmap must cover at least
+ * fx_mem_bitset_n_words(n_available) words. Pass NULL to detach the heatmap.
+ * Must not be called while allocations are performed concurrently.
+ */
+static inline void fx_mem_static_pool_set_heatmap(fx_mem_static_pool_t *pool,
+                                                  fx_mem_heatmap_t *heatmap) {
+	pool->heatmap = heatmap;
+}
+
+/**
+ * Attaches sequence counters to the pool (see mem_seqlock.h). The counters
+ * must cover at least n_available slots. Freeing a slot then advances its
+ * counter. Pass NULL to detach the counters. Must not be called while slots
+ * are freed concurrently.
+ */
+static inline void fx_mem_static_pool_set_seqlock(fx_mem_static_pool_t *pool,
+                                                  fx_mem_seqlock_t *seqlock) {
+	assert(!seqlock || seqlock->n_slots >= pool->n_available);
+	pool->seqlock = seqlock;
+}
+
+/**
+ * Returns the pointer at the slot with the given index.
+ */
+static inline void *fx_mem_static_pool_ptr(const fx_mem_static_pool_t *pool,
+                                           uint32_t idx) {
+	return FX_ASSUME_ALIGNED(pool->slots + (size_t)idx * pool->slot_size);
+}
+
+/**
+ * Returns the index of the slot the given pointer points at.
+ */
+static inline uint32_t fx_mem_static_pool_idx(const fx_mem_static_pool_t *pool,
+                                              const void *ptr) {
+	return (uint32_t)(((const uint8_t *)ptr - pool->slots) / pool->slot_size);
+}
+
+/**
+ * Returns true if the given pointer points into the slot area of the pool.
+ */
+static inline bool fx_mem_static_pool_owns(const fx_mem_static_pool_t *pool,
+                                           const void *ptr) {
+	const uint8_t *p = (const uint8_t *)ptr;
+	return p >= pool->slots &&
+	       p < pool->slots + (size_t)pool->n_available * pool->slot_size;
+}
+
+/**
+ * Allocates a single slot from the pool. This function bypasses the budget
+ * and the sampler attached to the allocator; use fx_mem_allocator_alloc() for
+ * allocations that should be accounted for.
+ *
+ * @return a pointer at the slot or NULL if all slots are in use.
+ */
+static inline void *fx_mem_static_pool_alloc(fx_mem_static_pool_t *pool) {
+	uint32_t n_failed;
+	const uint32_t idx = fx_mem_pool_alloc_probe(
+	    pool->allocated, &pool->free_idx, &pool->n_allocated, pool->n_available,
+	    &n_failed, pool->heatmap);
+	fx_mem_allocator_counters_t *counters =
+	    __atomic_load_n(&pool->allocator.counters, __ATOMIC_RELAXED);
+	if (counters) {
+		fx_mem_allocator_count(
+		    counters, idx < pool->n_available, n_failed,
+		    __atomic_load_n(&pool->n_allocated, __ATOMIC_RELAXED));
+	}
+	if (idx >= pool->n_available) {
+		return NULL;
+	}
+	return fx_mem_static_pool_ptr(pool, idx);
+}
+
+/**
+ * Returns a slot to the pool. Must only be used for slots allocated with
+ * fx_mem_static_pool_alloc(), see above.
+ *
+ * @param ptr is a pointer previously returned by fx_mem_static_pool_alloc().
+ */
+static inline void fx_mem_static_pool_free(fx_mem_static_pool_t *pool,
+                                           void *ptr) {
+	const uint32_t idx = fx_mem_static_pool_idx(pool, ptr);
+	if (pool->seqlock) {
+		fx_mem_seqlock_invalidate(pool->seqlock, idx);
+	}
+	fx_mem_pool_free(idx, pool->allocated, &pool->free_idx,
+	                 &pool->n_allocated);
+}
+
+/******************************************************************************
+ * ARENA                                                                      *
+ ******************************************************************************/
+
+/**
+ * Thread-safe bump allocator. Memory is allocated by atomically advancing an
+ * offset into the memory region. Only the most recent allocation can be freed
+ * or resized in place; all other memory is reclaimed by resetting the arena.
+ */
+typedef struct fx_mem_arena {
+	fx_mem_allocator_t allocator;
+	uint8_t *base;
+	size_t capacity;
+
+	/* Frequently modified state, placed on its own cache line */
+	uint8_t _pad0[64];
+	size_t offset;
+	size_t n_allocations;
+	uint8_t _pad1[64];
+} fx_mem_arena_t;
+
+/**
+ * Vtable of the arena.
+ */
+extern const fx_mem_allocator_vtable_t fx_mem_arena_vtable;
+
+/**
+ * Initialises an arena in the given memory region. The arena bookkeeping data
+ * is stored at the beginning of the region, the remaining memory is available
+ * for allocations.
+ *
+ * @param mem is a pointer at the memory region.
+ * @param size is the size of the memory region in bytes.
+ * @return a pointer at the arena or NULL if the region is too small to hold
+ * the bookkeeping data.
+ */
+fx_mem_arena_t *fx_mem_arena_init(void *mem, size_t size);
+
+/**
+ * Allocates a block of memory from the arena. Like fx_mem_static_pool_alloc(),
+ * this function bypasses the budget and the sampler attached to the
+ * allocator.
+ *
+ * @param arena is the arena from which the memory should be allocated.
+ * @param size is the size of the block in bytes.
+ * @param align is the alignment of the block. Must be a power of two.
+ * @return a pointer at the block or NULL if the arena is exhausted.
+ */
+static inline void *fx_mem_arena_alloc(fx_mem_arena_t *arena, size_t size,
+                                       size_t align) {
+	const uintptr_t base = (uintptr_t)arena->base;
+	size_t offset = __atomic_load_n(&arena->offset, __ATOMIC_RELAXED);
+	size_t begin, end, n_failed = 0U;
+	while (true) {
+		begin = ((base + offset + align - 1U) & ~(uintptr_t)(align - 1U)) - base;
+		end = begin + size;
+		if (end < begin || end > arena->capacity) {
+			return NULL;
+		}
+		if (__atomic_compare_exchange_n(&arena->offset, &offset, end, true,
+		                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			break;
+		}
+		n_failed++;
+	}
+	__atomic_fetch_add(&arena->n_allocations, 1U, __ATOMIC_RELAXED);
+	fx_mem_allocator_counters_t *counters =
+	    __atomic_load_n(&arena->allocator.counters, __ATOMIC_RELAXED);
+	if (counters) {
+		fx_mem_allocator_count(counters, true, n_failed, end);
+	}
+	return arena->base + begin;
+}
+
+/**
+ * Frees a block of memory. The memory is only reclaimed if the block is the
+ * most recent allocation. Must only be used for blocks allocated with
+ * fx_mem_arena_alloc().
+ *
+ * @param arena is the arena the block was allocated from.
+ * @param ptr is a pointer previously returned by fx_mem_arena_alloc().
+ * @param size is the size of the block in bytes.
+ */
+static inline void fx_mem_arena_free(fx_mem_arena_t *arena, void *ptr,
+                                     size_t size) {
+	const size_t begin = (size_t)((uint8_t *)ptr - arena->base);
+	size_t end = begin + size;
+	__atomic_compare_exchange_n(&arena->offset, &end, begin, false,
+	                            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&arena->n_allocations, 1U, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees all allocations. This function is not thread-safe.
+ */
+static inline void fx_mem_arena_reset(fx_mem_arena_t *arena) {
+	__atomic_store_n(&arena->offset, 0U, __ATOMIC_RELAXED);
+	__atomic_store_n(&arena->n_allocations, 0U, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_ALLOCATOR_H */
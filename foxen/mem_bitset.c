@@ -0,0 +1,315 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include <foxen/mem_bitset.h>
+
+/* Only use the AVX2 kernels if the compiler supports function-level target
+   attributes and runtime CPU detection. Define FX_MEM_NO_SIMD to force the
+   generic implementation. */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(FX_MEM_NO_SIMD)
+#define FX_MEM_BITSET_AVX2
+#include <immintrin.h>
+#endif
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static inline uint32_t _fx_popcount(uint32_t v) {
+#ifdef __GNUC__
+	return (uint32_t)__builtin_popcount(v);
+#else
+	v = v - ((v >> 1U) & 0x55555555U);
+	v = (v & 0x33333333U) + ((v >> 2U) & 0x33333333U);
+	return (((v + (v >> 4U)) & 0x0F0F0F0FU) * 0x01010101U) >> 24U;
+#endif
+}
+
+static inline uint32_t _fx_load(const uint32_t *ptr) {
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+/* Returns a mask selecting the bits [begin % 32, begin % 32 + n) of a word. */
+static inline uint32_t _fx_mask(uint32_t begin, uint32_t n) {
+	return ((n >= 32U) ? ~0U : ((1U << n) - 1U)) << (begin % 32U);
+}
+
+/**
+ * Table with the implementations of the individual kernels. The kernels only
+ * operate on entire words; handling partial words at the beginning and the end
+ * of a range is the job of the public functions below.
+ */
+typedef struct {
+	/* Returns the index of the first word w >= w0 for which bits[w] ^ inv is
+	   non-zero, or n_words if there is no such word. */
+	uint32_t (*find_word)(const uint32_t *bits, uint32_t w0, uint32_t n_words,
+	                      uint32_t inv);
+	uint32_t (*popcount)(const uint32_t *bits, uint32_t n_words);
+	void (*and_)(uint32_t *tar, const uint32_t *a, const uint32_t *b,
+	             uint32_t n_words);
+	void (*or_)(uint32_t *tar, const uint32_t *a, const uint32_t *b,
+	            uint32_t n_words);
+	void (*andnot)(uint32_t *tar, const uint32_t *a, const uint32_t *b,
+	               uint32_t n_words);
+} _fx_bitset_kernels_t;
+
+/* Generic kernels */
+
+static uint32_t _fx_find_word_generic(const uint32_t *bits, uint32_t w0,
+                                      uint32_t n_words, uint32_t inv) {
+	for (uint32_t w = w0; w < n_words; w++) {
+		if (_fx_load(&bits[w]) ^ inv) {
+			return w;
+		}
+	}
+	return n_words;
+}
+
+static uint32_t _fx_popcount_generic(const uint32_t *bits, uint32_t n_words) {
+	uint32_t res = 0U;
+	for (uint32_t w = 0U; w < n_words; w++) {
+		res += _fx_popcount(_fx_load(&bits[w]));
+	}
+	return res;
+}
+
+static void _fx_and_generic(uint32_t *tar, const uint32_t *a,
+                            const uint32_t *b, uint32_t n_words) {
+	for (uint32_t w = 0U; w < n_words; w++) {
+		tar[w] = a[w] & b[w];
+	}
+}
+
+static void _fx_or_generic(uint32_t *tar, const uint32_t *a, const uint32_t *b,
+                           uint32_t n_words) {
+	for (uint32_t w = 0U; w < n_words; w++) {
+		tar[w] = a[w] | b[w];
+	}
+}
+
+static void _fx_andnot_generic(uint32_t *tar, const uint32_t *a,
+                               const uint32_t *b, uint32_t n_words) {
+	for (uint32_t w = 0U; w < n_words; w++) {
+		tar[w] = a[w] & ~b[w];
+	}
+}
+
+static const _fx_bitset_kernels_t _fx_bitset_kernels_generic = {
+    _fx_find_word_generic, _fx_popcount_generic, _fx_and_generic,
+    _fx_or_generic, _fx_andnot_generic};
+
+/* AVX2 kernels */
+
+#ifdef FX_MEM_BITSET_AVX2
+#define FX_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+
+FX_TARGET_AVX2 static uint32_t _fx_find_word_avx2(const uint32_t *bits,
+                                                  uint32_t w0,
+                                                  uint32_t n_words,
+                                                  uint32_t inv) {
+	/* Skip blocks of eight words that do not contain the bit we're looking
+	   for, then let the generic code find the exact word. */
+	const __m256i vinv = _mm256_set1_epi32((int)inv);
+	uint32_t w = w0;
+	for (; w + 8U <= n_words; w += 8U) {
+		const __m256i v = _mm256_xor_si256(
+		    _mm256_loadu_si256((const __m256i *)(bits + w)), vinv);
+		if (!_mm256_testz_si256(v, v)) {
+			break;
+		}
+	}
+	return _fx_find_word_generic(bits, w, n_words, inv);
+}
+
+FX_TARGET_AVX2 static uint32_t _fx_popcount_avx2(const uint32_t *bits,
+                                                 uint32_t n_words) {
+	/* Nibble lookup-table based population count, see Mula et al., "Faster
+	   Population Counts Using AVX2 Instructions", 2016. */
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2,
+	                                     3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+	                                     2, 3, 2, 3, 3, 4);
+	const __m256i mask_lo = _mm256_set1_epi8(0x0F);
+	__m256i acc = _mm256_setzero_si256();
+	uint32_t w = 0U;
+	for (; w + 8U <= n_words; w += 8U) {
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(bits + w));
+		const __m256i lo = _mm256_and_si256(v, mask_lo);
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask_lo);
+		const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+		                                    _mm256_shuffle_epi8(lut, hi));
+		acc = _mm256_add_epi64(acc,
+		                       _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+	}
+	uint32_t res = (uint32_t)(_mm256_extract_epi64(acc, 0) +
+	                          _mm256_extract_epi64(acc, 1) +
+	                          _mm256_extract_epi64(acc, 2) +
+	                          _mm256_extract_epi64(acc, 3));
+	return res + _fx_popcount_generic(bits + w, n_words - w);
+}
+
+#define FX_BITSET_AVX2_BINARY_OP(NAME, EXPR, SCALAR)                         \
+	FX_TARGET_AVX2 static void NAME(uint32_t *tar, const uint32_t *a,        \
+	                                const uint32_t *b, uint32_t n_words) {   \
+		uint32_t w = 0U;                                                     \
+		for (; w + 8U <= n_words; w += 8U) {                                 \
+			const __m256i va = _mm256_loadu_si256((const __m256i *)(a + w)); \
+			const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + w)); \
+			_mm256_storeu_si256((__m256i *)(tar + w), EXPR);                 \
+		}                                                                    \
+		SCALAR(tar + w, a + w, b + w, n_words - w);                          \
+	}
+
+FX_BITSET_AVX2_BINARY_OP(_fx_and_avx2, _mm256_and_si256(va, vb),
+                         _fx_and_generic)
+FX_BITSET_AVX2_BINARY_OP(_fx_or_avx2, _mm256_or_si256(va, vb), _fx_or_generic)
+FX_BITSET_AVX2_BINARY_OP(_fx_andnot_avx2, _mm256_andnot_si256(vb, va),
+                         _fx_andnot_generic)
+
+#undef FX_BITSET_AVX2_BINARY_OP
+#undef FX_TARGET_AVX2
+
+static const _fx_bitset_kernels_t _fx_bitset_kernels_avx2 = {
+    _fx_find_word_avx2, _fx_popcount_avx2, _fx_and_avx2, _fx_or_avx2,
+    _fx_andnot_avx2};
+#endif /* FX_MEM_BITSET_AVX2 */
+
+/* Runtime dispatch */
+
+static const _fx_bitset_kernels_t *_fx_bitset_kernels_ptr = NULL;
+
+static const _fx_bitset_kernels_t *_fx_bitset_kernels(void) {
+	const _fx_bitset_kernels_t *kernels =
+	    __atomic_load_n(&_fx_bitset_kernels_ptr, __ATOMIC_RELAXED);
+	if (!kernels) {
+		/* Multiple threads may end up here at the same time, but they will all
+		   come to the same conclusion. */
+		kernels = &_fx_bitset_kernels_generic;
+#ifdef FX_MEM_BITSET_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+			kernels = &_fx_bitset_kernels_avx2;
+		}
+#endif
+		__atomic_store_n(&_fx_bitset_kernels_ptr, kernels, __ATOMIC_RELAXED);
+	}
+	return kernels;
+}
+
+static uint32_t _fx_find_next(const uint32_t bits[], uint32_t n_bits,
+                              uint32_t pos, uint32_t inv) {
+	if (pos >= n_bits) {
+		return n_bits;
+	}
+
+	/* Mask out the bits before pos in the first word */
+	const uint32_t n_words = fx_mem_bitset_n_words(n_bits);
+	uint32_t w = pos / 32U;
+	uint32_t v = (_fx_load(&bits[w]) ^ inv) & (~0U << (pos % 32U));
+
+	/* Search the remaining words. We need to reload the word found by the
+	   kernel, since it may have been changed in the meantime. */
+	while (!v) {
+		w = _fx_bitset_kernels()->find_word(bits, w + 1U, n_words, inv);
+		if (w >= n_words) {
+			return n_bits;
+		}
+		v = _fx_load(&bits[w]) ^ inv;
+	}
+
+	/* Make sure we do not return bits past the end of the bit-array */
+	const uint32_t idx = w * 32U + fx_mem_bitset_lsb(v);
+	return (idx < n_bits) ? idx : n_bits;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_bitset_find_next_set(const uint32_t bits[], uint32_t n_bits,
+                                     uint32_t pos) {
+	return _fx_find_next(bits, n_bits, pos, 0U);
+}
+
+uint32_t fx_mem_bitset_find_next_clear(const uint32_t bits[], uint32_t n_bits,
+                                       uint32_t pos) {
+	return _fx_find_next(bits, n_bits, pos, ~0U);
+}
+
+uint32_t fx_mem_bitset_popcount(const uint32_t bits[], uint32_t begin,
+                                uint32_t end) {
+	if (begin >= end) {
+		return 0U;
+	}
+
+	/* Special case: the range is contained in a single word */
+	uint32_t w0 = begin / 32U;
+	const uint32_t w1 = end / 32U;
+	if (w0 == (end - 1U) / 32U) {
+		return _fx_popcount(_fx_load(&bits[w0]) & _fx_mask(begin, end - begin));
+	}
+
+	/* Count the partial first word, all full words, and the partial last
+	   word. */
+	uint32_t res = 0U;
+	if (begin % 32U) {
+		res += _fx_popcount(_fx_load(&bits[w0]) & (~0U << (begin % 32U)));
+		w0++;
+	}
+	res += _fx_bitset_kernels()->popcount(bits + w0, w1 - w0);
+	if (end % 32U) {
+		res += _fx_popcount(_fx_load(&bits[w1]) & _fx_mask(0U, end % 32U));
+	}
+	return res;
+}
+
+void fx_mem_bitset_set_range(uint32_t bits[], uint32_t begin, uint32_t end) {
+	while (begin < end) {
+		const uint32_t n = 32U - (begin % 32U);
+		const uint32_t n_bits = (n < end - begin) ? n : (end - begin);
+		__atomic_fetch_or(&bits[begin / 32U], _fx_mask(begin, n_bits),
+		                  __ATOMIC_SEQ_CST);
+		begin += n_bits;
+	}
+}
+
+void fx_mem_bitset_clear_range(uint32_t bits[], uint32_t begin, uint32_t end) {
+	while (begin < end) {
+		const uint32_t n = 32U - (begin % 32U);
+		const uint32_t n_bits = (n < end - begin) ? n : (end - begin);
+		__atomic_fetch_and(&bits[begin / 32U], ~_fx_mask(begin, n_bits),
+		                   __ATOMIC_SEQ_CST);
+		begin += n_bits;
+	}
+}
+
+void fx_mem_bitset_and(uint32_t tar[], const uint32_t a[], const uint32_t b[],
+                       uint32_t n_words) {
+	_fx_bitset_kernels()->and_(tar, a, b, n_words);
+}
+
+void fx_mem_bitset_or(uint32_t tar[], const uint32_t a[], const uint32_t b[],
+                      uint32_t n_words) {
+	_fx_bitset_kernels()->or_(tar, a, b, n_words);
+}
+
+void fx_mem_bitset_andnot(uint32_t tar[], const uint32_t a[],
+                          const uint32_t b[], uint32_t n_words) {
+	_fx_bitset_kernels()->andnot(tar, a, b, n_words);
+}
@@ -0,0 +1,172 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_bitset.h
+ *
+ * Bit-array utility functions operating on arrays of 32-bit words, as used by
+ * the pool allocator in mem.h. Bit i is stored in word i / 32 at bit position
+ * i % 32. The search, popcount and bulk logic operations are vectorised where
+ * the CPU supports it; the implementation is selected at runtime.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_BITSET_H
+#define FOXEN_MEM_BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the index of the least significant bit set in v. The result is
+ * undefined if v is zero.
+ */
+static inline uint32_t fx_mem_bitset_lsb(uint32_t v) {
+#ifdef __GNUC__
+	return (uint32_t)__builtin_ctz(v);
+#else
+	/* http://graphics.stanford.edu/~seander/bithacks.html#IntegerLogDeBruijn */
+	static const uint8_t multiply_de_bruijn_tbl[32U] = {
+	    0,  1,  28, 2,  29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4,  8,
+	    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6,  11, 5,  10, 9};
+	return multiply_de_bruijn_tbl[(uint32_t)((v & -v) * 0x077CB531UL) >> 27U];
+#endif
+}
+
+/**
+ * Returns the number of words required to store a bit-array with n_bits
+ * entries.
+ */
+static inline uint32_t fx_mem_bitset_n_words(uint32_t n_bits) {
+	return (n_bits + 31U) / 32U;
+}
+
+/**
+ * Returns true if the bit with the given index is set. Performs an atomic load
+ * of the corresponding word.
+ */
+static inline bool fx_mem_bitset_test(const uint32_t bits[], uint32_t idx) {
+	return (__atomic_load_n(&bits[idx / 32U], __ATOMIC_ACQUIRE) >>
+	        (idx % 32U)) & 1U;
+}
+
+/**
+ * Atomically sets the bit with the given index.
+ *
+ * @return true if the bit had already been set before, false otherwise. In
+ * other words, the caller "owns" the bit if this function returns false.
+ */
+static inline bool fx_mem_bitset_test_and_set(uint32_t bits[], uint32_t idx) {
+	const uint32_t mask = 1U << (idx % 32U);
+	return __atomic_fetch_or(&bits[idx / 32U], mask, __ATOMIC_SEQ_CST) & mask;
+}
+
+/**
+ * Atomically clears the bit with the given index.
+ *
+ * @return true if the bit had been set before, false otherwise.
+ */
+static inline bool fx_mem_bitset_test_and_clear(uint32_t bits[],
+                                                uint32_t idx) {
+	const uint32_t mask = 1U << (idx % 32U);
+	return __atomic_fetch_and(&bits[idx / 32U], ~mask, __ATOMIC_SEQ_CST) &
+	       mask;
+}
+
+/**
+ * Searches for the first set bit with an index larger or equal to pos.
+ *
+ * Note that if the bit-array is concurrently modified by other threads, the
+ * result is merely a hint and must be confirmed by an atomic operation such as
+ * fx_mem_bitset_test_and_set().
+ *
+ * @param bits is the bit-array that should be searched.
+ * @param n_bits is the total number of bits in the bit-array.
+ * @param pos is the index of the bit at which the search should start.
+ * @return the index of the first set bit at or after pos, or n_bits if there is
+ * no such bit.
+ */
+uint32_t fx_mem_bitset_find_next_set(const uint32_t bits[], uint32_t n_bits,
+                                     uint32_t pos);
+
+/**
+ * Searches for the first cleared bit with an index larger or equal to pos. See
+ * fx_mem_bitset_find_next_set() regarding concurrent modifications.
+ *
+ * @param bits is the bit-array that should be searched.
+ * @param n_bits is the total number of bits in the bit-array.
+ * @param pos is the index of the bit at which the search should start.
+ * @return the index of the first cleared bit at or after pos, or n_bits if
+ * there is no such bit.
+ */
+uint32_t fx_mem_bitset_find_next_clear(const uint32_t bits[], uint32_t n_bits,
+                                       uint32_t pos);
+
+/**
+ * Counts the number of set bits in the index range [begin, end).
+ *
+ * @param bits is the bit-array in which the bits should be counted.
+ * @param begin is the index of the first bit that should be counted.
+ * @param end is the index one past the last bit that should be counted.
+ * @return the number of set bits in the given range.
+ */
+uint32_t fx_mem_bitset_popcount(const uint32_t bits[], uint32_t begin,
+                                uint32_t end);
+
+/**
+ * Atomically sets all bits in the index range [begin, end). Each word is
+ * updated with a single atomic operation, the range as a whole is not updated
+ * atomically.
+ */
+void fx_mem_bitset_set_range(uint32_t bits[], uint32_t begin, uint32_t end);
+
+/**
+ * Atomically clears all bits in the index range [begin, end). Each word is
+ * updated with a single atomic operation, the range as a whole is not updated
+ * atomically.
+ */
+void fx_mem_bitset_clear_range(uint32_t bits[], uint32_t begin, uint32_t end);
+
+/**
+ * Computes tar[i] = a[i] & b[i] for all n_words words. tar may alias a or b.
+ */
+void fx_mem_bitset_and(uint32_t tar[], const uint32_t a[], const uint32_t b[],
+                       uint32_t n_words);
+
+/**
+ * Computes tar[i] = a[i] | b[i] for all n_words words. tar may alias a or b.
+ */
+void fx_mem_bitset_or(uint32_t tar[], const uint32_t a[], const uint32_t b[],
+                      uint32_t n_words);
+
+/**
+ * Computes tar[i] = a[i] & ~b[i] for all n_words words. tar may alias a or b.
+ */
+void fx_mem_bitset_andnot(uint32_t tar[], const uint32_t a[],
+                          const uint32_t b[], uint32_t n_words);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_BITSET_H */
@@ -0,0 +1,209 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FX_MEM_BLOB_HAVE_MMAP
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_blob.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static uint64_t _fx_blob_header_size(uint32_t max_fields) {
+	return sizeof(fx_mem_blob_t) +
+	       (uint64_t)max_fields * sizeof(fx_mem_blob_field_t);
+}
+
+static uint32_t _fx_blob_checksum(const uint8_t *data, uint64_t size) {
+	/* Multiplicative hash over 64-bit words; the payload of each field is
+	   aligned, so the words can be loaded directly */
+	uint64_t h = 0xCBF29CE484222325ULL ^ size;
+	uint64_t i = 0U;
+	for (; i + 8U <= size; i += 8U) {
+		uint64_t w;
+		memcpy(&w, data + i, 8U);
+		h = (h ^ w) * 0x100000001B3ULL;
+		h ^= h >> 29U;
+	}
+	for (; i < size; i++) {
+		h = (h ^ data[i]) * 0x100000001B3ULL;
+	}
+	return (uint32_t)(h ^ (h >> 32U));
+}
+
+static const fx_mem_blob_field_t *_fx_blob_find(const fx_mem_blob_t *blob,
+                                                uint32_t tag) {
+	for (uint32_t i = 0U; i < blob->n_fields; i++) {
+		if (blob->fields[i].tag == tag) {
+			return &blob->fields[i];
+		}
+	}
+	return NULL;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+bool fx_mem_blob_init_size(uint32_t *size, uint32_t max_fields) {
+	const uint64_t n_bytes = _fx_blob_header_size(max_fields);
+	return n_bytes <= 0xFFFFFFFFU && fx_mem_init_size(size) &&
+	       fx_mem_update_size(size, (uint32_t)n_bytes);
+}
+
+fx_mem_blob_t *fx_mem_blob_init(void *mem, uint32_t max_fields) {
+	const uint32_t n_bytes = (uint32_t)_fx_blob_header_size(max_fields);
+	fx_mem_blob_t *blob = (fx_mem_blob_t *)fx_mem_align(&mem, n_bytes);
+	memset(blob, 0, n_bytes);
+	blob->magic = FX_MEM_BLOB_MAGIC;
+	blob->version = FX_MEM_BLOB_VERSION;
+	blob->align = FX_ALIGN;
+	blob->max_fields = max_fields;
+	blob->size = n_bytes;
+	return blob;
+}
+
+void *fx_mem_blob_add(fx_mem_blob_t *blob, uint32_t tag, uint32_t n_bytes) {
+	if (blob->n_fields >= blob->max_fields) {
+		return NULL;
+	}
+	const uint64_t offset =
+	    (blob->size + FX_ALIGN - 1U) & ~(uint64_t)(FX_ALIGN - 1U);
+	fx_mem_blob_field_t *field = &blob->fields[blob->n_fields++];
+	field->tag = tag;
+	field->checksum = 0U;
+	field->offset = offset;
+	field->size = n_bytes;
+	blob->size = offset + n_bytes;
+	return FX_ASSUME_ALIGNED((uint8_t *)blob + offset);
+}
+
+void fx_mem_blob_seal(fx_mem_blob_t *blob) {
+	for (uint32_t i = 0U; i < blob->n_fields; i++) {
+		fx_mem_blob_field_t *field = &blob->fields[i];
+		field->checksum = _fx_blob_checksum((uint8_t *)blob + field->offset,
+		                                    field->size);
+	}
+}
+
+const fx_mem_blob_t *fx_mem_blob_open(const void *mem, size_t size) {
+	const fx_mem_blob_t *blob = (const fx_mem_blob_t *)mem;
+	if (((uintptr_t)mem & (FX_ALIGN - 1U)) || size < sizeof(fx_mem_blob_t) ||
+	    blob->magic != FX_MEM_BLOB_MAGIC ||
+	    blob->version != FX_MEM_BLOB_VERSION || blob->align != FX_ALIGN ||
+	    blob->n_fields > blob->max_fields || blob->size > size ||
+	    _fx_blob_header_size(blob->max_fields) > blob->size) {
+		return NULL;
+	}
+
+	/* Make sure all fields are aligned and within the blob */
+	const uint64_t begin = _fx_blob_header_size(blob->max_fields);
+	for (uint32_t i = 0U; i < blob->n_fields; i++) {
+		const fx_mem_blob_field_t *field = &blob->fields[i];
+		if (field->offset < begin || (field->offset & (FX_ALIGN - 1U)) ||
+		    field->offset > blob->size ||
+		    field->size > blob->size - field->offset) {
+			return NULL;
+		}
+	}
+	return blob;
+}
+
+const void *fx_mem_blob_get(const fx_mem_blob_t *blob, uint32_t tag,
+                            uint64_t *size) {
+	const fx_mem_blob_field_t *field = _fx_blob_find(blob, tag);
+	if (!field) {
+		return NULL;
+	}
+	if (size) {
+		*size = field->size;
+	}
+	return FX_ASSUME_ALIGNED((const uint8_t *)blob + field->offset);
+}
+
+bool fx_mem_blob_verify(const fx_mem_blob_t *blob, uint32_t tag) {
+	const fx_mem_blob_field_t *field = _fx_blob_find(blob, tag);
+	return field &&
+	       field->checksum == _fx_blob_checksum(
+	                              (const uint8_t *)blob + field->offset,
+	                              field->size);
+}
+
+bool fx_mem_blob_write(const fx_mem_blob_t *blob, const char *path) {
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		return false;
+	}
+	bool ok = fwrite(blob, 1U, blob->size, f) == blob->size;
+	ok = (fclose(f) == 0) && ok;
+	return ok;
+}
+
+#ifdef FX_MEM_BLOB_HAVE_MMAP
+
+const fx_mem_blob_t *fx_mem_blob_map(const char *path) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	void *mem = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* The mapping is unmapped with the size stored in the header, so reject
+	   files with trailing data */
+	const fx_mem_blob_t *blob = fx_mem_blob_open(mem, st.st_size);
+	if (!blob || blob->size != (uint64_t)st.st_size) {
+		munmap(mem, st.st_size);
+		return NULL;
+	}
+	return blob;
+}
+
+void fx_mem_blob_unmap(const fx_mem_blob_t *blob) {
+	if (blob) {
+		munmap((void *)blob, blob->size);
+	}
+}
+
+#else /* FX_MEM_BLOB_HAVE_MMAP */
+
+const fx_mem_blob_t *fx_mem_blob_map(const char *path) { return NULL; }
+
+void fx_mem_blob_unmap(const fx_mem_blob_t *blob) {}
+
+#endif /* FX_MEM_BLOB_HAVE_MMAP */
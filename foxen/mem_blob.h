@@ -0,0 +1,175 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_blob.h
+ *
+ * Relocatable binary blobs. A blob is a single memory region consisting of a
+ * header, a table of tagged fields, and the field payload. Blobs are built in
+ * memory with the usual fx_mem_update_size()/fx_mem_align() pattern, written
+ * to a file, and later mapped read-only and used in place without copying or
+ * fixing up pointers. Fields refer to each other through relative pointers
+ * (see mem_rptr.h) with the blob header as base.
+ *
+ * Loading a blob only validates the header and the field table. The contents
+ * of an individual field are validated against its checksum on demand with
+ * fx_mem_blob_verify().
+ *
+ * Blobs use the native byte order; a blob written on a machine with a
+ * different byte order is rejected because of the magic number.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_BLOB_H
+#define FOXEN_MEM_BLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Magic number at the beginning of each blob ("FXMB").
+ */
+#define FX_MEM_BLOB_MAGIC 0x424D5846U
+
+/**
+ * Version of the blob format.
+ */
+#define FX_MEM_BLOB_VERSION 1U
+
+/**
+ * Entry in the field table.
+ */
+typedef struct fx_mem_blob_field {
+	uint32_t tag;
+	uint32_t checksum;
+	uint64_t offset; /* Relative to the blob header */
+	uint64_t size;
+} fx_mem_blob_field_t;
+
+/**
+ * Blob header, followed by the field table.
+ */
+typedef struct fx_mem_blob {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t align;
+	uint32_t n_fields;
+	uint32_t max_fields;
+	uint64_t size;
+	uint64_t _reserved;
+	fx_mem_blob_field_t fields[];
+} fx_mem_blob_t;
+
+/**
+ * Call this instead of fx_mem_init_size() at the beginning of a chain of
+ * fx_mem_update_size() calls describing the fields of a blob.
+ *
+ * @param size is a pointer at the variable receiving the size.
+ * @param max_fields is the maximum number of fields in the blob.
+ * @return false if there was an overflow.
+ */
+bool fx_mem_blob_init_size(uint32_t *size, uint32_t max_fields);
+
+/**
+ * Initialises an empty blob in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of the size computed with
+ * fx_mem_blob_init_size() and fx_mem_update_size().
+ * @param max_fields is the maximum number of fields.
+ * @return a pointer at the blob header. This is the base address for relative
+ * pointers between fields.
+ */
+fx_mem_blob_t *fx_mem_blob_init(void *mem, uint32_t max_fields);
+
+/**
+ * Appends a field to the blob. The field is aligned at FX_ALIGN bytes. Fields
+ * must be added in the same order as their sizes were passed to
+ * fx_mem_update_size().
+ *
+ * @param blob is the blob the field should be added to.
+ * @param tag is a user-defined tag identifying the field.
+ * @param n_bytes is the size of the field.
+ * @return a pointer at the field payload or NULL if the field table is full.
+ */
+void *fx_mem_blob_add(fx_mem_blob_t *blob, uint32_t tag, uint32_t n_bytes);
+
+/**
+ * Computes the checksums of all fields. Call this after all fields have been
+ * filled and before the blob is written.
+ */
+void fx_mem_blob_seal(fx_mem_blob_t *blob);
+
+/**
+ * Validates the header and the field table of a blob in memory, e.g. a blob
+ * that was read from a file. The field contents are not checked.
+ *
+ * @param mem is a pointer at the blob. Must be aligned at FX_ALIGN bytes.
+ * @param size is the number of valid bytes at mem.
+ * @return a pointer at the blob or NULL if the blob is invalid.
+ */
+const fx_mem_blob_t *fx_mem_blob_open(const void *mem, size_t size);
+
+/**
+ * Returns the payload of the field with the given tag.
+ *
+ * @param blob is the blob.
+ * @param tag is the tag of the field.
+ * @param size if not NULL, receives the size of the field in bytes.
+ * @return a pointer at the field or NULL if there is no such field.
+ */
+const void *fx_mem_blob_get(const fx_mem_blob_t *blob, uint32_t tag,
+                            uint64_t *size);
+
+/**
+ * Checks the contents of the field with the given tag against its checksum.
+ *
+ * @return true if the field exists and its contents are intact.
+ */
+bool fx_mem_blob_verify(const fx_mem_blob_t *blob, uint32_t tag);
+
+/**
+ * Writes the blob to the given file.
+ *
+ * @return true on success.
+ */
+bool fx_mem_blob_write(const fx_mem_blob_t *blob, const char *path);
+
+/**
+ * Maps the blob stored in the given file read-only and validates it with
+ * fx_mem_blob_open(). Only available on POSIX systems.
+ *
+ * @return a pointer at the blob or NULL on failure.
+ */
+const fx_mem_blob_t *fx_mem_blob_map(const char *path);
+
+/**
+ * Unmaps a blob returned by fx_mem_blob_map().
+ */
+void fx_mem_blob_unmap(const fx_mem_blob_t *blob);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_BLOB_H */
@@ -0,0 +1,349 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_budget.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define FX_MEM_BUDGET_HAVE_NOTIFY_FD
+#endif
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* Number of budgets a thread holds credit for at the same time */
+#define FX_BUDGET_N_CREDITS 4U
+
+/**
+ * Thread-local credit, one entry per recently used budget. An entry is only
+ * valid while the epoch of its budget is unchanged. Budgets are never accessed
+ * through an entry without first looking them up in the registry, since they
+ * may have been destroyed in the meantime.
+ */
+static __thread struct {
+	fx_mem_budget_t *budget;
+	uint64_t epoch;
+	size_t credit;
+} _fx_budget_tls[FX_BUDGET_N_CREDITS];
+
+/* Entry that is evicted next if all entries are in use */
+static __thread uint32_t _fx_budget_tls_evict;
+
+/* Registry of live budgets */
+static uint32_t _fx_budget_registry_lock;
+static fx_mem_budget_t *_fx_budget_registry;
+static uint64_t _fx_budget_epoch;
+
+static void _fx_budget_lock(uint32_t *lock) {
+	while (__atomic_exchange_n(lock, 1U, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void _fx_budget_unlock(uint32_t *lock) {
+	__atomic_store_n(lock, 0U, __ATOMIC_RELEASE);
+}
+
+static void _fx_budget_fire(fx_mem_budget_t *budget, bool pressure,
+                            size_t n_bytes_used) {
+	if (budget->callback) {
+		budget->callback(budget, pressure, n_bytes_used, budget->callback_data);
+	}
+#ifdef FX_MEM_BUDGET_HAVE_NOTIFY_FD
+	if (budget->notify_fd >= 0) {
+		const uint64_t one = 1U;
+		if (write(budget->notify_fd, &one, sizeof(one)) != sizeof(one)) {
+			/* Nothing we can do here; an eventfd only fails to accept the
+			   write if its counter would overflow. */
+		}
+	}
+#endif
+}
+
+/* Checks whether the given number of used bytes causes a transition between
+   the normal and the pressure state. Only the thread that successfully
+   performs the transition invokes the callback. */
+static void _fx_budget_check(fx_mem_budget_t *budget, size_t n_bytes_used) {
+	uint32_t pressure = __atomic_load_n(&budget->pressure, __ATOMIC_RELAXED);
+	if (!pressure && n_bytes_used >= budget->high_watermark) {
+		if (__atomic_compare_exchange_n(&budget->pressure, &pressure, 1U,
+		                                false, __ATOMIC_ACQ_REL,
+		                                __ATOMIC_RELAXED)) {
+			_fx_budget_fire(budget, true, n_bytes_used);
+		}
+	} else if (pressure && n_bytes_used < budget->low_watermark) {
+		if (__atomic_compare_exchange_n(&budget->pressure, &pressure, 0U,
+		                                false, __ATOMIC_ACQ_REL,
+		                                __ATOMIC_RELAXED)) {
+			_fx_budget_fire(budget, false, n_bytes_used);
+		}
+	}
+}
+
+/* Atomically adds n_bytes to the global counter, fails if this would exceed
+   the limit. */
+static bool _fx_budget_take(fx_mem_budget_t *budget, size_t n_bytes) {
+	size_t used = __atomic_load_n(&budget->n_bytes_used, __ATOMIC_RELAXED);
+	size_t new_used;
+	do {
+		new_used = used + n_bytes;
+		if (new_used < used || new_used > budget->limit) {
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&budget->n_bytes_used, &used,
+	                                      new_used, true, __ATOMIC_RELAXED,
+	                                      __ATOMIC_RELAXED));
+	_fx_budget_check(budget, new_used);
+	return true;
+}
+
+/* Atomically subtracts n_bytes from the global counter. Saturates at zero,
+   since allocators leaving the budget return their used bytes including
+   internal fragmentation, which may exceed what was charged. */
+static void _fx_budget_give(fx_mem_budget_t *budget, size_t n_bytes) {
+	size_t used = __atomic_load_n(&budget->n_bytes_used, __ATOMIC_RELAXED);
+	size_t new_used;
+	do {
+		new_used = (used > n_bytes) ? used - n_bytes : 0U;
+	} while (!__atomic_compare_exchange_n(&budget->n_bytes_used, &used,
+	                                      new_used, true, __ATOMIC_RELAXED,
+	                                      __ATOMIC_RELAXED));
+	_fx_budget_check(budget, new_used);
+}
+
+/* Removes the budget from the registry. Must be called with the registry
+   lock held. */
+static void _fx_budget_unregister(fx_mem_budget_t *budget) {
+	fx_mem_budget_t **ptr = &_fx_budget_registry;
+	while (*ptr && *ptr != budget) {
+		ptr = &(*ptr)->next;
+	}
+	if (*ptr) {
+		*ptr = budget->next;
+	}
+}
+
+/* Returns the credit held by the given thread-local entry to its budget, if
+   the budget is still alive, and clears the entry */
+static void _fx_budget_return(uint32_t i) {
+	if (_fx_budget_tls[i].credit) {
+		_fx_budget_lock(&_fx_budget_registry_lock);
+		for (fx_mem_budget_t *budget = _fx_budget_registry; budget;
+		     budget = budget->next) {
+			if (budget == _fx_budget_tls[i].budget &&
+			    budget->epoch == _fx_budget_tls[i].epoch) {
+				_fx_budget_give(budget, _fx_budget_tls[i].credit);
+				break;
+			}
+		}
+		_fx_budget_unlock(&_fx_budget_registry_lock);
+	}
+	_fx_budget_tls[i].budget = NULL;
+	_fx_budget_tls[i].epoch = 0U;
+	_fx_budget_tls[i].credit = 0U;
+}
+
+static size_t *_fx_budget_credit_slow(fx_mem_budget_t *budget) {
+	/* Drop entries of a destroyed budget that lived at the same address */
+	uint32_t free_entry = FX_BUDGET_N_CREDITS;
+	for (uint32_t i = 0U; i < FX_BUDGET_N_CREDITS; i++) {
+		if (_fx_budget_tls[i].budget == budget) {
+			_fx_budget_tls[i].budget = NULL;
+			_fx_budget_tls[i].credit = 0U;
+		}
+		if (!_fx_budget_tls[i].budget && free_entry == FX_BUDGET_N_CREDITS) {
+			free_entry = i;
+		}
+	}
+
+	/* Evict the entries in round-robin order if all of them are in use */
+	if (free_entry == FX_BUDGET_N_CREDITS) {
+		free_entry = _fx_budget_tls_evict;
+		_fx_budget_tls_evict = (free_entry + 1U) % FX_BUDGET_N_CREDITS;
+		_fx_budget_return(free_entry);
+	}
+	_fx_budget_tls[free_entry].budget = budget;
+	_fx_budget_tls[free_entry].epoch = budget->epoch;
+	return &_fx_budget_tls[free_entry].credit;
+}
+
+/* Returns the thread-local credit of the calling thread for the budget */
+static inline size_t *_fx_budget_credit(fx_mem_budget_t *budget) {
+	for (uint32_t i = 0U; i < FX_BUDGET_N_CREDITS; i++) {
+		if (_fx_budget_tls[i].budget == budget &&
+		    _fx_budget_tls[i].epoch == budget->epoch) {
+			return &_fx_budget_tls[i].credit;
+		}
+	}
+	return _fx_budget_credit_slow(budget);
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+void fx_mem_budget_init(fx_mem_budget_t *budget, size_t limit) {
+	budget->limit = limit;
+	budget->callback = NULL;
+	budget->callback_data = NULL;
+	budget->notify_fd = -1;
+	budget->members_lock = 0U;
+	budget->members = NULL;
+	budget->n_bytes_reserved = 0U;
+	budget->n_bytes_used = 0U;
+	budget->pressure = 0U;
+	fx_mem_budget_set_watermarks(budget, limit - limit / 4U,
+	                             limit - limit / 8U);
+	fx_mem_budget_set_slack(budget, (limit / 64U < 65536U) ? limit / 64U
+	                                                       : 65536U);
+
+	/* Register the budget with a new epoch; it may already be registered if
+	   it is initialised again without being destroyed */
+	_fx_budget_lock(&_fx_budget_registry_lock);
+	_fx_budget_unregister(budget);
+	budget->epoch = __atomic_add_fetch(&_fx_budget_epoch, 1U, __ATOMIC_RELAXED);
+	budget->next = _fx_budget_registry;
+	_fx_budget_registry = budget;
+	_fx_budget_unlock(&_fx_budget_registry_lock);
+}
+
+void fx_mem_budget_destroy(fx_mem_budget_t *budget) {
+	_fx_budget_lock(&_fx_budget_registry_lock);
+	_fx_budget_unregister(budget);
+	budget->epoch = __atomic_add_fetch(&_fx_budget_epoch, 1U, __ATOMIC_RELAXED);
+	budget->next = NULL;
+	_fx_budget_unlock(&_fx_budget_registry_lock);
+}
+
+void fx_mem_budget_set_watermarks(fx_mem_budget_t *budget, size_t low,
+                                  size_t high) {
+	budget->low_watermark = low;
+	budget->high_watermark = high;
+}
+
+void fx_mem_budget_set_slack(fx_mem_budget_t *budget, size_t slack) {
+	budget->slack = slack;
+}
+
+void fx_mem_budget_set_callback(fx_mem_budget_t *budget,
+                                fx_mem_budget_callback_t callback, void *data) {
+	budget->callback = callback;
+	budget->callback_data = data;
+}
+
+void fx_mem_budget_set_notify_fd(fx_mem_budget_t *budget, int fd) {
+	budget->notify_fd = fd;
+}
+
+void fx_mem_budget_join(fx_mem_budget_t *budget,
+                        fx_mem_budget_member_t *member, const char *name,
+                        fx_mem_allocator_t *allocator) {
+	fx_mem_allocator_stats_t stats;
+	allocator->vtable->stats(allocator, &stats);
+
+	member->name = name;
+	member->allocator = allocator;
+	member->n_bytes_reserved = stats.n_bytes_reserved;
+
+	_fx_budget_lock(&budget->members_lock);
+	member->next = budget->members;
+	budget->members = member;
+	_fx_budget_unlock(&budget->members_lock);
+
+	__atomic_add_fetch(&budget->n_bytes_reserved, member->n_bytes_reserved,
+	                   __ATOMIC_RELAXED);
+	__atomic_store_n(&allocator->budget, budget, __ATOMIC_RELEASE);
+}
+
+void fx_mem_budget_leave(fx_mem_budget_t *budget,
+                         fx_mem_budget_member_t *member) {
+	_fx_budget_lock(&budget->members_lock);
+	fx_mem_budget_member_t **ptr = &budget->members;
+	while (*ptr && *ptr != member) {
+		ptr = &(*ptr)->next;
+	}
+	if (*ptr) {
+		*ptr = member->next;
+	}
+	_fx_budget_unlock(&budget->members_lock);
+
+	/* Return everything that is still in use in this allocator */
+	fx_mem_allocator_t *allocator = member->allocator;
+	__atomic_store_n(&allocator->budget, NULL, __ATOMIC_RELEASE);
+	fx_mem_allocator_stats_t stats;
+	allocator->vtable->stats(allocator, &stats);
+	_fx_budget_give(budget, stats.n_bytes_used);
+	__atomic_sub_fetch(&budget->n_bytes_reserved, member->n_bytes_reserved,
+	                   __ATOMIC_RELAXED);
+}
+
+void fx_mem_budget_foreach(fx_mem_budget_t *budget,
+                           void (*f)(fx_mem_budget_member_t *member,
+                                     void *data),
+                           void *data) {
+	_fx_budget_lock(&budget->members_lock);
+	for (fx_mem_budget_member_t *member = budget->members; member;
+	     member = member->next) {
+		f(member, data);
+	}
+	_fx_budget_unlock(&budget->members_lock);
+}
+
+bool fx_mem_budget_charge(fx_mem_budget_t *budget, size_t n_bytes) {
+	/* Fast path: serve the request from the thread-local credit */
+	size_t *tls_credit = _fx_budget_credit(budget);
+	const size_t credit = *tls_credit;
+	if (credit >= n_bytes) {
+		*tls_credit = credit - n_bytes;
+		return true;
+	}
+
+	/* Slow path: charge the missing bytes plus the slack to the global
+	   counter. Close to the limit, only try to charge the missing bytes. */
+	const size_t missing = n_bytes - credit;
+	if (missing + budget->slack >= missing &&
+	    _fx_budget_take(budget, missing + budget->slack)) {
+		*tls_credit = budget->slack;
+		return true;
+	}
+	if (_fx_budget_take(budget, missing)) {
+		*tls_credit = 0U;
+		return true;
+	}
+	return false;
+}
+
+void fx_mem_budget_release(fx_mem_budget_t *budget, size_t n_bytes) {
+	/* Keep up to twice the slack as thread-local credit, return the rest to
+	   the global counter. */
+	size_t *tls_credit = _fx_budget_credit(budget);
+	const size_t credit = *tls_credit + n_bytes;
+	if (credit > 2U * budget->slack) {
+		*tls_credit = budget->slack;
+		_fx_budget_give(budget, credit - budget->slack);
+	} else {
+		*tls_credit = credit;
+	}
+}
+
+void fx_mem_budget_flush(void) {
+	for (uint32_t i = 0U; i < FX_BUDGET_N_CREDITS; i++) {
+		_fx_budget_return(i);
+	}
+}
@@ -0,0 +1,243 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_budget.h
+ *
+ * Memory budget shared by multiple allocators. Allocators join a budget, which
+ * keeps track of the number of bytes reserved by and used in all its members.
+ * Allocations through the fx_mem_allocator_*() functions fail once the limit
+ * of the budget is reached. A callback and/or a file descriptor (e.g. an
+ * eventfd) is notified whenever the number of used bytes crosses the high or
+ * low watermark.
+ *
+ * To keep global atomic operations out of the allocation fast path, each
+ * thread charges the budget in chunks of "slack" bytes, and then serves
+ * allocations from its thread-local credit. A thread holds separate credit
+ * for each of the last few budgets it used. Correspondingly, the number of
+ * used bytes reported by the budget is an over-estimate by at most two times
+ * the slack per thread; threads return their credit with
+ * fx_mem_budget_flush(). Allocators do not count the bytes charged through
+ * them; fx_mem_allocator_reset() and fx_mem_budget_leave() instead return the
+ * number of bytes the allocator reports as used in its statistics. This
+ * includes internal fragmentation, so the budget may slightly under-count
+ * after an allocator with outstanding allocations was reset or left.
+ *
+ * Budgets are registered in a process-wide list when they are initialised and
+ * must be removed from it with fx_mem_budget_destroy() before their memory is
+ * reused. Credit that threads still hold for a destroyed budget is dropped.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_BUDGET_H
+#define FOXEN_MEM_BUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct fx_mem_allocator;
+struct fx_mem_budget;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Callback function invoked whenever the budget enters (pressure = true) or
+ * leaves (pressure = false) the high memory pressure state. The callback is
+ * called from within the allocation or free function that caused the
+ * transition and must not allocate from allocators charging this budget. It
+ * may also be called from fx_mem_budget_flush() of another thread and must not
+ * call fx_mem_budget_init(), fx_mem_budget_destroy() or fx_mem_budget_flush().
+ */
+typedef void (*fx_mem_budget_callback_t)(struct fx_mem_budget *budget,
+                                         bool pressure, size_t n_bytes_used,
+                                         void *data);
+
+/**
+ * Registry entry describing an allocator that joined a budget. Members are
+ * stored in an intrusive linked list, so the memory for each entry must be
+ * provided by the caller.
+ */
+typedef struct fx_mem_budget_member {
+	struct fx_mem_budget_member *next;
+	const char *name;
+	struct fx_mem_allocator *allocator;
+	size_t n_bytes_reserved;
+} fx_mem_budget_member_t;
+
+/**
+ * Budget state. Use the functions below to initialise and configure the
+ * budget; do not access the members directly.
+ */
+typedef struct fx_mem_budget {
+	/* Configuration */
+	size_t limit;
+	size_t low_watermark;
+	size_t high_watermark;
+	size_t slack;
+	fx_mem_budget_callback_t callback;
+	void *callback_data;
+	int notify_fd;
+
+	/* Registry of live budgets. The epoch changes whenever the budget is
+	   initialised or destroyed and invalidates thread-local credit. */
+	uint64_t epoch;
+	struct fx_mem_budget *next;
+
+	/* Registry of members */
+	uint32_t members_lock;
+	fx_mem_budget_member_t *members;
+
+	/* Global counters, placed on their own cache line */
+	uint8_t _pad0[64];
+	size_t n_bytes_reserved;
+	size_t n_bytes_used;
+	uint32_t pressure;
+	uint8_t _pad1[64];
+} fx_mem_budget_t;
+
+/**
+ * Initialises the given budget. The watermarks default to 7/8 (high) and 3/4
+ * (low) of the limit, the per-thread slack defaults to 64 KiB, but is at most
+ * 1/64 of the limit.
+ *
+ * @param budget is the budget that should be initialised.
+ * @param limit is the maximum number of bytes that may be allocated from all
+ * members of the budget.
+ */
+void fx_mem_budget_init(fx_mem_budget_t *budget, size_t limit);
+
+/**
+ * Removes the budget from the registry of live budgets. Credit that threads
+ * still hold for the budget is dropped instead of being returned. All members
+ * must have left the budget, and no thread may charge the budget afterwards.
+ */
+void fx_mem_budget_destroy(fx_mem_budget_t *budget);
+
+/**
+ * Sets the watermarks. The budget enters the pressure state once the number
+ * of used bytes reaches high and leaves it once the number of used bytes drops
+ * below low.
+ */
+void fx_mem_budget_set_watermarks(fx_mem_budget_t *budget, size_t low,
+                                  size_t high);
+
+/**
+ * Sets the number of bytes each thread charges the budget at once.
+ */
+void fx_mem_budget_set_slack(fx_mem_budget_t *budget, size_t slack);
+
+/**
+ * Sets the callback invoked whenever the memory pressure state changes.
+ */
+void fx_mem_budget_set_callback(fx_mem_budget_t *budget,
+                                fx_mem_budget_callback_t callback, void *data);
+
+/**
+ * Sets a file descriptor that is notified whenever the memory pressure state
+ * changes. The notification consists of writing the eight-byte integer one to
+ * the file descriptor, which is compatible with eventfd(2). Pass -1 to disable
+ * notifications.
+ */
+void fx_mem_budget_set_notify_fd(fx_mem_budget_t *budget, int fd);
+
+/**
+ * Adds an allocator to the budget. Subsequent allocations through the
+ * fx_mem_allocator_*() functions are charged to the budget. The allocator
+ * must not have any outstanding allocations when joining the budget, since
+ * these would be returned to the budget when the allocator leaves. Joining
+ * does not enable the detailed statistics of the allocator; see
+ * fx_mem_allocator_set_counters().
+ *
+ * @param budget is the budget the allocator should join.
+ * @param member is a pointer at memory holding the registry entry. Must remain
+ * valid until fx_mem_budget_leave() is called.
+ * @param name is a human-readable name of the allocator. May be NULL.
+ * @param allocator is the allocator joining the budget.
+ */
+void fx_mem_budget_join(fx_mem_budget_t *budget,
+                        fx_mem_budget_member_t *member, const char *name,
+                        struct fx_mem_allocator *allocator);
+
+/**
+ * Removes an allocator from the budget and returns the bytes it reports as
+ * used to the budget.
+ */
+void fx_mem_budget_leave(fx_mem_budget_t *budget,
+                         fx_mem_budget_member_t *member);
+
+/**
+ * Calls the given function for each member of the budget. Members cannot join
+ * or leave the budget while this function is running.
+ */
+void fx_mem_budget_foreach(fx_mem_budget_t *budget,
+                           void (*f)(fx_mem_budget_member_t *member,
+                                     void *data),
+                           void *data);
+
+/**
+ * Charges the given number of bytes to the budget. This is called by
+ * fx_mem_allocator_alloc() and usually does not need to be called directly.
+ *
+ * @return true if the bytes could be charged, false if this would exceed the
+ * limit of the budget.
+ */
+bool fx_mem_budget_charge(fx_mem_budget_t *budget, size_t n_bytes);
+
+/**
+ * Returns the given number of bytes to the budget. This is called by
+ * fx_mem_allocator_free() and usually does not need to be called directly.
+ */
+void fx_mem_budget_release(fx_mem_budget_t *budget, size_t n_bytes);
+
+/**
+ * Returns the thread-local credit of the calling thread to all budgets it
+ * holds credit for. Should be called before a thread exits.
+ */
+void fx_mem_budget_flush(void);
+
+/**
+ * Returns the number of bytes reserved by all members of the budget.
+ */
+static inline size_t fx_mem_budget_reserved(const fx_mem_budget_t *budget) {
+	return __atomic_load_n(&budget->n_bytes_reserved, __ATOMIC_RELAXED);
+}
+
+/**
+ * Returns the number of bytes charged to the budget, including the credit
+ * held by individual threads.
+ */
+static inline size_t fx_mem_budget_used(const fx_mem_budget_t *budget) {
+	return __atomic_load_n(&budget->n_bytes_used, __ATOMIC_RELAXED);
+}
+
+/**
+ * Returns true if the budget is currently in the high memory pressure state.
+ */
+static inline bool fx_mem_budget_under_pressure(const fx_mem_budget_t *budget) {
+	return __atomic_load_n(&budget->pressure, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_BUDGET_H */
@@ -0,0 +1,230 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_bitset.h>
+#include <foxen/mem_cache.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#define FX_CACHE_NOT_FOUND 0xFFFFFFFFU
+
+static uint32_t _fx_cache_slot_size(uint32_t value_size) {
+	return (value_size + FX_ALIGN - 1U) & ~(uint32_t)(FX_ALIGN - 1U);
+}
+
+static uint32_t _fx_cache_n_buckets(uint32_t n_slots) {
+	/* Keep the load factor of the index at or below one half */
+	uint32_t n = 1U;
+	while (n < 2U * (uint64_t)n_slots && n < 0x80000000U) {
+		n *= 2U;
+	}
+	return n;
+}
+
+static inline uint32_t _fx_cache_hash(const fx_mem_cache_t *cache,
+                                      uint64_t key) {
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32U) &
+	       (cache->n_buckets - 1U);
+}
+
+/* Returns the bucket holding the key or FX_CACHE_NOT_FOUND */
+static uint32_t _fx_cache_find(const fx_mem_cache_t *cache, uint64_t key) {
+	const uint32_t mask = cache->n_buckets - 1U;
+	for (uint32_t b = _fx_cache_hash(cache, key);; b = (b + 1U) & mask) {
+		const uint32_t entry = cache->index[b];
+		if (entry == 0U) {
+			return FX_CACHE_NOT_FOUND;
+		}
+		if (cache->keys[entry - 1U] == key) {
+			return b;
+		}
+	}
+}
+
+static void _fx_cache_index_insert(fx_mem_cache_t *cache, uint64_t key,
+                                   uint32_t slot) {
+	const uint32_t mask = cache->n_buckets - 1U;
+	uint32_t b = _fx_cache_hash(cache, key);
+	while (cache->index[b]) {
+		b = (b + 1U) & mask;
+	}
+	cache->keys[slot] = key;
+	cache->index[b] = slot + 1U;
+}
+
+static void _fx_cache_index_erase(fx_mem_cache_t *cache, uint32_t b) {
+	/* Backward-shift deletion keeps probe sequences intact without
+	   tombstones */
+	const uint32_t mask = cache->n_buckets - 1U;
+	for (uint32_t next = (b + 1U) & mask; cache->index[next];
+	     next = (next + 1U) & mask) {
+		const uint32_t home =
+		    _fx_cache_hash(cache, cache->keys[cache->index[next] - 1U]);
+		if (((next - home) & mask) >= ((next - b) & mask)) {
+			cache->index[b] = cache->index[next];
+			b = next;
+		}
+	}
+	cache->index[b] = 0U;
+}
+
+static void *_fx_cache_touch(fx_mem_cache_t *cache, uint32_t b) {
+	/* Avoid dirtying the cache line if the bit is already set */
+	const uint32_t slot = cache->index[b] - 1U;
+	const uint32_t mask = 1U << (slot % 32U);
+	if (!(cache->referenced[slot / 32U] & mask)) {
+		cache->referenced[slot / 32U] |= mask;
+	}
+	return fx_mem_cache_value(cache, slot);
+}
+
+static uint32_t _fx_cache_sweep(fx_mem_cache_t *cache) {
+	/* Called with all slots allocated, so every unreferenced slot is a
+	   candidate. The hand clears the referenced bits it passes over; after
+	   wrapping around once at least the slot the hand started at is clear. */
+	const uint32_t n_slots = cache->n_slots;
+	uint32_t slot =
+	    fx_mem_bitset_find_next_clear(cache->referenced, n_slots, cache->hand);
+	if (slot >= n_slots) {
+		fx_mem_bitset_clear_range(cache->referenced, cache->hand, n_slots);
+		cache->hand = 0U;
+		slot = fx_mem_bitset_find_next_clear(cache->referenced, n_slots, 0U);
+	}
+	fx_mem_bitset_clear_range(cache->referenced, cache->hand, slot);
+	cache->hand = (slot + 1U < n_slots) ? slot + 1U : 0U;
+	return slot;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_cache_size(uint32_t n_slots, uint32_t value_size) {
+	const uint32_t slot_size = _fx_cache_slot_size(value_size);
+	const uint32_t n_buckets = _fx_cache_n_buckets(n_slots);
+	const uint64_t n_bytes_values = (uint64_t)n_slots * slot_size;
+	const uint32_t n_bytes_bitmap =
+	    sizeof(uint32_t) * fx_mem_bitset_n_words(n_slots);
+	const uint64_t n_bytes_keys = sizeof(uint64_t) * (uint64_t)n_slots;
+	const uint64_t n_bytes_index = sizeof(uint32_t) * (uint64_t)n_buckets;
+	if (slot_size < value_size || n_bytes_values > 0xFFFFFFFFU ||
+	    n_bytes_keys > 0xFFFFFFFFU || n_bytes_index > 0xFFFFFFFFU ||
+	    n_buckets < 2U * (uint64_t)n_slots) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_cache_t)) &&
+	          fx_mem_update_size(&size, n_bytes_bitmap) &&
+	          fx_mem_update_size(&size, n_bytes_bitmap) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_keys) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_index) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_values);
+	return ok ? size : 0U;
+}
+
+fx_mem_cache_t *fx_mem_cache_init(void *mem, uint32_t n_slots,
+                                  uint32_t value_size) {
+	const uint32_t n_bytes_bitmap =
+	    sizeof(uint32_t) * fx_mem_bitset_n_words(n_slots);
+	fx_mem_cache_t *cache =
+	    (fx_mem_cache_t *)fx_mem_align(&mem, sizeof(fx_mem_cache_t));
+	cache->n_slots = n_slots;
+	cache->value_size = value_size;
+	cache->slot_size = _fx_cache_slot_size(value_size);
+	cache->n_buckets = _fx_cache_n_buckets(n_slots);
+	cache->allocated = (uint32_t *)fx_mem_align(&mem, n_bytes_bitmap);
+	cache->referenced = (uint32_t *)fx_mem_align(&mem, n_bytes_bitmap);
+	cache->keys = (uint64_t *)fx_mem_align(&mem, sizeof(uint64_t) * n_slots);
+	cache->index =
+	    (uint32_t *)fx_mem_align(&mem, sizeof(uint32_t) * cache->n_buckets);
+	cache->values =
+	    (uint8_t *)fx_mem_align(&mem, n_slots * cache->slot_size);
+	fx_mem_zero_aligned(cache->allocated, n_bytes_bitmap);
+	fx_mem_zero_aligned(cache->referenced, n_bytes_bitmap);
+	fx_mem_zero_aligned(cache->index, sizeof(uint32_t) * cache->n_buckets);
+	cache->free_idx = 0U;
+	cache->n_allocated = 0U;
+	cache->hand = 0U;
+	cache->n_hits = 0U;
+	cache->n_misses = 0U;
+	cache->n_evictions = 0U;
+	return cache;
+}
+
+void *fx_mem_cache_get(fx_mem_cache_t *cache, uint64_t key) {
+	const uint32_t b = _fx_cache_find(cache, key);
+	if (b == FX_CACHE_NOT_FOUND) {
+		cache->n_misses++;
+		return NULL;
+	}
+	cache->n_hits++;
+	return _fx_cache_touch(cache, b);
+}
+
+void *fx_mem_cache_put(fx_mem_cache_t *cache, uint64_t key, bool *inserted,
+                       bool *evicted, uint64_t *evicted_key) {
+	if (inserted) {
+		*inserted = false;
+	}
+	if (evicted) {
+		*evicted = false;
+	}
+	const uint32_t b = _fx_cache_find(cache, key);
+	if (b != FX_CACHE_NOT_FOUND) {
+		return _fx_cache_touch(cache, b);
+	}
+	if (cache->n_slots == 0U) {
+		return NULL;
+	}
+
+	uint32_t slot = fx_mem_pool_alloc(cache->allocated, &cache->free_idx,
+	                                  &cache->n_allocated, cache->n_slots);
+	if (slot >= cache->n_slots) {
+		slot = _fx_cache_sweep(cache);
+		const uint64_t old_key = cache->keys[slot];
+		_fx_cache_index_erase(cache, _fx_cache_find(cache, old_key));
+		cache->n_evictions++;
+		if (evicted) {
+			*evicted = true;
+		}
+		if (evicted_key) {
+			*evicted_key = old_key;
+		}
+	}
+	_fx_cache_index_insert(cache, key, slot);
+	if (inserted) {
+		*inserted = true;
+	}
+	return fx_mem_cache_value(cache, slot);
+}
+
+bool fx_mem_cache_remove(fx_mem_cache_t *cache, uint64_t key) {
+	const uint32_t b = _fx_cache_find(cache, key);
+	if (b == FX_CACHE_NOT_FOUND) {
+		return false;
+	}
+	const uint32_t slot = cache->index[b] - 1U;
+	_fx_cache_index_erase(cache, b);
+	cache->referenced[slot / 32U] &= ~(1U << (slot % 32U));
+	fx_mem_pool_free(slot, cache->allocated, &cache->free_idx,
+	                 &cache->n_allocated);
+	return true;
+}
@@ -0,0 +1,141 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_cache.h
+ *
+ * Fixed-capacity key-value cache with CLOCK eviction. Values are fixed-size
+ * slots of a pool managed with fx_mem_pool_alloc(); an open-addressing hash
+ * index maps 64-bit keys to slots. Instead of an LRU list, the cache keeps a
+ * "referenced" bitmap parallel to the "allocated" bitmap of the pool. A hit
+ * only sets the bit of the slot. When the cache is full, the clock hand
+ * sweeps the bitmaps a word at a time: the first allocated, unreferenced slot
+ * at or after the hand is evicted, and words without such a slot have their
+ * referenced bits cleared, giving their entries a second chance.
+ *
+ * New entries start unreferenced, so that entries which are never hit again
+ * are the first to be evicted.
+ *
+ * The cache is not thread-safe.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_CACHE_H
+#define FOXEN_MEM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Cache datastructure. Do not modify the members directly.
+ */
+typedef struct fx_mem_cache {
+	uint32_t n_slots;
+	uint32_t value_size;
+	uint32_t slot_size;
+	uint32_t n_buckets; /* Power of two */
+	uint32_t *allocated;
+	uint32_t *referenced;
+	uint64_t *keys;
+	uint32_t *index; /* Slot index plus one per bucket, zero if empty */
+	uint8_t *values;
+
+	uint32_t free_idx;
+	uint32_t n_allocated;
+	uint32_t hand;
+	uint64_t n_hits;
+	uint64_t n_misses;
+	uint64_t n_evictions;
+} fx_mem_cache_t;
+
+/**
+ * Computes the size of the memory region required to store a cache.
+ *
+ * @param n_slots is the maximum number of entries.
+ * @param value_size is the size of each value in bytes.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_cache_size(uint32_t n_slots, uint32_t value_size);
+
+/**
+ * Initialises an empty cache in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_cache_size()
+ * bytes.
+ * @param n_slots is the maximum number of entries.
+ * @param value_size is the size of each value in bytes.
+ * @return a pointer at the cache.
+ */
+fx_mem_cache_t *fx_mem_cache_init(void *mem, uint32_t n_slots,
+                                  uint32_t value_size);
+
+/**
+ * Returns a pointer at the value of the given slot.
+ */
+static inline void *fx_mem_cache_value(const fx_mem_cache_t *cache,
+                                       uint32_t slot) {
+	return cache->values + (size_t)slot * cache->slot_size;
+}
+
+/**
+ * Looks up a key and marks the entry as referenced.
+ *
+ * @return a pointer at the value, or NULL if the key is not in the cache.
+ */
+void *fx_mem_cache_get(fx_mem_cache_t *cache, uint64_t key);
+
+/**
+ * Returns the value slot for the given key, inserting the key if it is not in
+ * the cache yet. If the cache is full, an entry is evicted and its slot is
+ * reused; the slot still holds the value of the evicted entry, so that the
+ * caller can release resources it references before overwriting it.
+ *
+ * @param cache is the cache.
+ * @param key is the key.
+ * @param inserted is set to true if the key was not in the cache. May be
+ * NULL.
+ * @param evicted is set to true if an entry was evicted. May be NULL.
+ * @param evicted_key receives the key of the evicted entry, if any. May be
+ * NULL.
+ * @return a pointer at the value, or NULL if the cache has no slots. Returns
+ * the value of the existing entry if the key is already in the cache.
+ */
+void *fx_mem_cache_put(fx_mem_cache_t *cache, uint64_t key, bool *inserted,
+                       bool *evicted, uint64_t *evicted_key);
+
+/**
+ * Removes a key from the cache.
+ *
+ * @return true if the key was in the cache.
+ */
+bool fx_mem_cache_remove(fx_mem_cache_t *cache, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_CACHE_H */
@@ -0,0 +1,224 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_coro.hpp
+ *
+ * C++20 companion header providing pooled storage for coroutine frames.
+ * Derive the promise type of a coroutine from foxen::mem::pooled_frame<> to
+ * allocate its frames from a coro_frame_pool instead of the global operator
+ * new:
+ *
+ *     struct task {
+ *         struct promise_type : foxen::mem::pooled_frame<> {
+ *             ...
+ *         };
+ *     };
+ *
+ * The pool consists of one static pool (see mem_allocator.h) per power-of-two
+ * size class between 64 bytes and MAX_FRAME bytes, all placed in the static
+ * storage of the pool object. Each thread keeps a short list of released
+ * frames per size class; allocating a frame that was recently released by
+ * the same thread only pops that list. Frames larger than MAX_FRAME, and
+ * frames requested while a size class is exhausted, are obtained from the
+ * global operator new.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_CORO_HPP
+#define FOXEN_MEM_CORO_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <foxen/mem_allocator.h>
+
+namespace foxen::mem {
+
+/**
+ * Pool of coroutine frames. Use the pool through instance(); each
+ * instantiation of the template has its own storage.
+ *
+ * @tparam N_FRAMES is the number of frames per size class.
+ * @tparam MAX_FRAME is the size of the largest pooled frame in bytes. Must be
+ * a power of two of at least 64 bytes.
+ */
+template <std::uint32_t N_FRAMES = 256U, std::size_t MAX_FRAME = 4096U>
+class coro_frame_pool {
+	static_assert(MAX_FRAME >= 64U && std::has_single_bit(MAX_FRAME),
+	              "MAX_FRAME must be a power of two of at least 64 bytes");
+
+public:
+	static constexpr std::size_t min_frame = 64U;
+	static constexpr std::size_t n_classes =
+	    std::bit_width(MAX_FRAME / min_frame);
+	static constexpr std::uint32_t cache_size = 32U;
+
+	/**
+	 * Returns the pool shared by all coroutines using this instantiation.
+	 */
+	static coro_frame_pool &instance() {
+		static coro_frame_pool pool;
+		return pool;
+	}
+
+	/**
+	 * Returns the size class of a frame of the given size.
+	 */
+	static constexpr std::size_t class_idx(std::size_t size) {
+		return size <= min_frame ? 0U
+		                         : std::bit_width(size - 1U) -
+		                               std::bit_width(min_frame - 1U);
+	}
+
+	void *alloc(std::size_t size) {
+		if (size <= MAX_FRAME) {
+			const std::size_t cls = class_idx(size);
+			if (!flushed()) {
+				cache &c = local_cache();
+				if (void *ptr = c.heads[cls]) {
+					c.heads[cls] = *static_cast<void **>(ptr);
+					c.n_frames[cls]--;
+					return ptr;
+				}
+			}
+			if (void *ptr = fx_mem_static_pool_alloc(m_pools[cls])) {
+				return ptr;
+			}
+		}
+		return ::operator new(size);
+	}
+
+	void free(void *ptr, std::size_t size) noexcept {
+		if (size <= MAX_FRAME) {
+			const std::size_t cls = class_idx(size);
+			fx_mem_static_pool_t *pool = m_pools[cls];
+			if (fx_mem_static_pool_owns(pool, ptr)) {
+				if (!flushed()) {
+					cache &c = local_cache();
+					if (c.n_frames[cls] < cache_size) {
+						*static_cast<void **>(ptr) = c.heads[cls];
+						c.heads[cls] = ptr;
+						c.n_frames[cls]++;
+						return;
+					}
+				}
+				fx_mem_static_pool_free(pool, ptr);
+				return;
+			}
+		}
+		::operator delete(ptr, size);
+	}
+
+	/**
+	 * Returns the static pool backing the given size class, e.g. to inspect
+	 * its statistics.
+	 */
+	const fx_mem_static_pool_t *pool(std::size_t cls) const {
+		return m_pools[cls];
+	}
+
+private:
+	/* Upper bound of fx_mem_static_pool_size() for the given slot size */
+	static constexpr std::size_t class_storage_size(std::size_t slot_size) {
+		return sizeof(fx_mem_static_pool_t) + 3U * FX_ALIGN +
+		       sizeof(std::uint32_t) * ((N_FRAMES + 31U) / 32U) +
+		       N_FRAMES * slot_size;
+	}
+
+	static constexpr std::size_t storage_size() {
+		std::size_t size = 0U;
+		for (std::size_t cls = 0U; cls < n_classes; cls++) {
+			size += class_storage_size(min_frame << cls);
+		}
+		return size;
+	}
+
+	/* Frames released by the current thread, returned to the pools when the
+	   thread exits */
+	struct cache {
+		void *heads[n_classes] = {};
+		std::uint32_t n_frames[n_classes] = {};
+
+		~cache() {
+			coro_frame_pool &self = instance();
+			for (std::size_t cls = 0U; cls < n_classes; cls++) {
+				while (void *ptr = heads[cls]) {
+					heads[cls] = *static_cast<void **>(ptr);
+					fx_mem_static_pool_free(self.m_pools[cls], ptr);
+				}
+				n_frames[cls] = 0U;
+			}
+			flushed() = true;
+		}
+	};
+
+	static cache &local_cache() {
+		static thread_local cache c;
+		return c;
+	}
+
+	/* Set once the cache of the current thread has been destroyed; frames
+	   released by later thread_local destructors bypass the cache. Kept apart
+	   from the cache, since it must remain valid after ~cache() has run */
+	static bool &flushed() {
+		static thread_local bool f = false;
+		return f;
+	}
+
+	coro_frame_pool() {
+		void *mem = m_storage;
+		for (std::size_t cls = 0U; cls < n_classes; cls++) {
+			const std::uint32_t slot_size =
+			    static_cast<std::uint32_t>(min_frame << cls);
+			if (fx_mem_static_pool_size(N_FRAMES, slot_size) >
+			    class_storage_size(slot_size)) {
+				std::abort(); /* Layout of the static pool changed */
+			}
+			m_pools[cls] = fx_mem_static_pool_init(mem, N_FRAMES, slot_size);
+			mem = static_cast<std::uint8_t *>(mem) +
+			      class_storage_size(slot_size);
+		}
+	}
+
+	fx_mem_static_pool_t *m_pools[n_classes];
+	alignas(64) std::uint8_t m_storage[storage_size()];
+};
+
+/**
+ * Mixin for coroutine promise types. Coroutines whose promise type derives
+ * from this class allocate their frames from the given pool.
+ */
+template <typename Pool = coro_frame_pool<>>
+struct pooled_frame {
+	static void *operator new(std::size_t size) {
+		return Pool::instance().alloc(size);
+	}
+
+	static void operator delete(void *ptr, std::size_t size) noexcept {
+		Pool::instance().free(ptr, size);
+	}
+};
+
+}  // namespace foxen::mem
+
+#endif /* FOXEN_MEM_CORO_HPP */
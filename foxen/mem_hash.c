@@ -0,0 +1,323 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_hash.h>
+
+/* Only use the AVX2 kernels if the compiler supports function-level target
+   attributes and runtime CPU detection. Define FX_MEM_NO_SIMD to force the
+   generic implementation. */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(FX_MEM_NO_SIMD)
+#define FX_MEM_HASH_AVX2
+#include <immintrin.h>
+#endif
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* A stripe consists of eight 64-bit lanes, i.e. four FX_ALIGN blocks */
+#define FX_HASH_STRIPE 64U
+#define FX_HASH_N_LANES 8U
+
+/* Number of stripes between two scrambles of the accumulators */
+#define FX_HASH_STRIPES_PER_BLOCK 16U
+
+#define FX_HASH_PRIME32_1 0x9E3779B1U
+#define FX_HASH_PRIME64_1 0x9E3779B185EBCA87ULL
+
+/* Hexadecimal digits of pi; combined with the seed to form the lane keys */
+static const uint64_t _fx_hash_secret[FX_HASH_N_LANES] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL,
+    0x082EFA98EC4E6C89ULL, 0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL,
+    0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL};
+
+static const uint64_t _fx_hash_acc_init[FX_HASH_N_LANES] = {
+    0x00000000C2B2AE3DULL, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL,
+    0x165667B19E3779F9ULL, 0x85EBCA77C2B2AE63ULL, 0x0000000085EBCA77ULL,
+    0x27D4EB2F165667C5ULL, 0x000000009E3779B1ULL};
+
+static inline uint64_t _fx_hash_load64(const uint8_t *p) {
+	uint64_t res;
+	memcpy(&res, p, sizeof(res));
+	return res;
+}
+
+static inline uint64_t _fx_hash_mul_fold(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	__extension__ typedef unsigned __int128 uint128_t;
+	const uint128_t p = (uint128_t)a * b;
+	return (uint64_t)p ^ (uint64_t)(p >> 64U);
+#else
+	const uint64_t a_lo = (uint32_t)a, a_hi = a >> 32U;
+	const uint64_t b_lo = (uint32_t)b, b_hi = b >> 32U;
+	const uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+	const uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	const uint64_t cross = (lo_lo >> 32U) + (uint32_t)hi_lo + lo_hi;
+	const uint64_t upper = (hi_lo >> 32U) + (cross >> 32U) + hi_hi;
+	const uint64_t lower = (cross << 32U) | (uint32_t)lo_lo;
+	return lower ^ upper;
+#endif
+}
+
+static void _fx_hash_key(uint64_t key[FX_HASH_N_LANES], uint64_t seed) {
+	for (uint32_t i = 0U; i < FX_HASH_N_LANES; i++) {
+		key[i] = (i & 1U) ? _fx_hash_secret[i] - seed
+		                  : _fx_hash_secret[i] + seed;
+	}
+}
+
+/* Copies the last partial stripe into a zero-padded buffer; the size of the
+   region is mixed into the final hash. Returns false if there is none. */
+static inline bool _fx_hash_tail(uint8_t tail[FX_HASH_STRIPE],
+                                 const uint8_t *p, size_t size) {
+	const size_t n_rem = size % FX_HASH_STRIPE;
+	if (!n_rem) {
+		return false;
+	}
+	memset(tail, 0, FX_HASH_STRIPE);
+	memcpy(tail, p + (size - n_rem), n_rem);
+	return true;
+}
+
+/**
+ * Table with the implementations of the individual kernels. The kernels keep
+ * their state in registers; the public functions handle the rest.
+ */
+typedef struct {
+	/* Computes the accumulators over all stripes of the region */
+	void (*accumulate)(uint64_t acc[FX_HASH_N_LANES], const uint8_t *p,
+	                   size_t size, uint64_t seed);
+
+	/* Compares n_blocks FX_ALIGN blocks */
+	bool (*equal)(const uint8_t *a, const uint8_t *b, size_t n_blocks);
+} _fx_hash_kernels_t;
+
+/* Generic kernels */
+
+static inline void _fx_hash_stripe(uint64_t acc[FX_HASH_N_LANES],
+                                   const uint8_t *p,
+                                   const uint64_t key[FX_HASH_N_LANES]) {
+	for (uint32_t i = 0U; i < FX_HASH_N_LANES; i++) {
+		const uint64_t d = _fx_hash_load64(p + 8U * i);
+		const uint64_t dk = d ^ key[i];
+		acc[i ^ 1U] += d;
+		acc[i] += (dk & 0xFFFFFFFFU) * (dk >> 32U);
+	}
+}
+
+static void _fx_accumulate_generic(uint64_t acc[FX_HASH_N_LANES],
+                                   const uint8_t *p, size_t size,
+                                   uint64_t seed) {
+	uint64_t key[FX_HASH_N_LANES];
+	_fx_hash_key(key, seed);
+	memcpy(acc, _fx_hash_acc_init, sizeof(_fx_hash_acc_init));
+
+	/* Scramble the accumulators after each block of stripes */
+	const size_t n_stripes = size / FX_HASH_STRIPE;
+	for (size_t s = 0U; s < n_stripes; s++) {
+		_fx_hash_stripe(acc, p + s * FX_HASH_STRIPE, key);
+		if ((s + 1U) % FX_HASH_STRIPES_PER_BLOCK == 0U) {
+			for (uint32_t i = 0U; i < FX_HASH_N_LANES; i++) {
+				acc[i] = ((acc[i] ^ (acc[i] >> 47U)) ^ key[i]) *
+				         FX_HASH_PRIME32_1;
+			}
+		}
+	}
+
+	uint8_t tail[FX_HASH_STRIPE];
+	if (_fx_hash_tail(tail, p, size)) {
+		_fx_hash_stripe(acc, tail, key);
+	}
+}
+
+static bool _fx_equal_generic(const uint8_t *a, const uint8_t *b,
+                              size_t n_blocks) {
+	for (size_t i = 0U; i < n_blocks; i++, a += FX_ALIGN, b += FX_ALIGN) {
+		const uint64_t x = (_fx_hash_load64(a) ^ _fx_hash_load64(b)) |
+		                   (_fx_hash_load64(a + 8U) ^ _fx_hash_load64(b + 8U));
+		if (x) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static const _fx_hash_kernels_t _fx_hash_kernels_generic = {
+    _fx_accumulate_generic, _fx_equal_generic};
+
+/* AVX2 kernels */
+
+#ifdef FX_MEM_HASH_AVX2
+#define FX_TARGET_AVX2 __attribute__((target("avx2")))
+
+FX_TARGET_AVX2 static inline void _fx_hash_stripe_avx2(__m256i *acc0,
+                                                       __m256i *acc1,
+                                                       const uint8_t *p,
+                                                       __m256i key0,
+                                                       __m256i key1) {
+	/* Same computation as the generic kernel; swapping the 64-bit halves of
+	   each 128-bit lane adds lane i to accumulator i ^ 1 */
+	const __m256i d0 = _mm256_loadu_si256((const __m256i *)p);
+	const __m256i d1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+	const __m256i dk0 = _mm256_xor_si256(d0, key0);
+	const __m256i dk1 = _mm256_xor_si256(d1, key1);
+	const __m256i m0 = _mm256_mul_epu32(dk0, _mm256_srli_epi64(dk0, 32));
+	const __m256i m1 = _mm256_mul_epu32(dk1, _mm256_srli_epi64(dk1, 32));
+	const __m256i s0 = _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2));
+	const __m256i s1 = _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2));
+	*acc0 = _mm256_add_epi64(*acc0, _mm256_add_epi64(s0, m0));
+	*acc1 = _mm256_add_epi64(*acc1, _mm256_add_epi64(s1, m1));
+}
+
+FX_TARGET_AVX2 static inline __m256i _fx_hash_scramble_avx2(__m256i acc,
+                                                            __m256i key) {
+	/* 64-bit by 32-bit multiplication assembled from two 32-bit products */
+	const __m256i prime = _mm256_set1_epi64x(FX_HASH_PRIME32_1);
+	const __m256i a = _mm256_xor_si256(
+	    _mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47)), key);
+	const __m256i lo = _mm256_mul_epu32(a, prime);
+	const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+FX_TARGET_AVX2 static void _fx_accumulate_avx2(uint64_t acc[FX_HASH_N_LANES],
+                                               const uint8_t *p, size_t size,
+                                               uint64_t seed) {
+	const __m256i vseed = _mm256_set_epi64x((long long)(0U - seed),
+	                                        (long long)seed,
+	                                        (long long)(0U - seed),
+	                                        (long long)seed);
+	const __m256i key0 = _mm256_add_epi64(
+	    _mm256_loadu_si256((const __m256i *)_fx_hash_secret), vseed);
+	const __m256i key1 = _mm256_add_epi64(
+	    _mm256_loadu_si256((const __m256i *)(_fx_hash_secret + 4)), vseed);
+	__m256i acc0 = _mm256_loadu_si256((const __m256i *)_fx_hash_acc_init);
+	__m256i acc1 =
+	    _mm256_loadu_si256((const __m256i *)(_fx_hash_acc_init + 4));
+
+	const size_t n_stripes = size / FX_HASH_STRIPE;
+	size_t s = 0U;
+	for (; s + FX_HASH_STRIPES_PER_BLOCK <= n_stripes;
+	     s += FX_HASH_STRIPES_PER_BLOCK) {
+		for (uint32_t i = 0U; i < FX_HASH_STRIPES_PER_BLOCK; i++) {
+			_fx_hash_stripe_avx2(&acc0, &acc1,
+			                     p + (s + i) * FX_HASH_STRIPE, key0, key1);
+		}
+		acc0 = _fx_hash_scramble_avx2(acc0, key0);
+		acc1 = _fx_hash_scramble_avx2(acc1, key1);
+	}
+	for (; s < n_stripes; s++) {
+		_fx_hash_stripe_avx2(&acc0, &acc1, p + s * FX_HASH_STRIPE, key0,
+		                     key1);
+	}
+
+	uint8_t tail[FX_HASH_STRIPE];
+	if (_fx_hash_tail(tail, p, size)) {
+		_fx_hash_stripe_avx2(&acc0, &acc1, tail, key0, key1);
+	}
+	_mm256_storeu_si256((__m256i *)acc, acc0);
+	_mm256_storeu_si256((__m256i *)(acc + 4), acc1);
+}
+
+FX_TARGET_AVX2 static bool _fx_equal_avx2(const uint8_t *a, const uint8_t *b,
+                                          size_t n_blocks) {
+	/* Compare eight blocks at once, then let the generic code handle the
+	   remaining blocks */
+	size_t i = 0U;
+	for (; i + 8U <= n_blocks; i += 8U) {
+		const __m256i *pa = (const __m256i *)(a + i * FX_ALIGN);
+		const __m256i *pb = (const __m256i *)(b + i * FX_ALIGN);
+		const __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256(pa),
+		                                    _mm256_loadu_si256(pb));
+		const __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256(pa + 1),
+		                                    _mm256_loadu_si256(pb + 1));
+		const __m256i x2 = _mm256_xor_si256(_mm256_loadu_si256(pa + 2),
+		                                    _mm256_loadu_si256(pb + 2));
+		const __m256i x3 = _mm256_xor_si256(_mm256_loadu_si256(pa + 3),
+		                                    _mm256_loadu_si256(pb + 3));
+		const __m256i x =
+		    _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+		if (!_mm256_testz_si256(x, x)) {
+			return false;
+		}
+	}
+	return _fx_equal_generic(a + i * FX_ALIGN, b + i * FX_ALIGN, n_blocks - i);
+}
+
+#undef FX_TARGET_AVX2
+
+static const _fx_hash_kernels_t _fx_hash_kernels_avx2 = {_fx_accumulate_avx2,
+                                                         _fx_equal_avx2};
+#endif /* FX_MEM_HASH_AVX2 */
+
+/* Runtime dispatch */
+
+static const _fx_hash_kernels_t *_fx_hash_kernels_ptr = NULL;
+
+static const _fx_hash_kernels_t *_fx_hash_kernels(void) {
+	const _fx_hash_kernels_t *kernels =
+	    __atomic_load_n(&_fx_hash_kernels_ptr, __ATOMIC_RELAXED);
+	if (!kernels) {
+		/* Multiple threads may end up here at the same time, but they will all
+		   come to the same conclusion. */
+		kernels = &_fx_hash_kernels_generic;
+#ifdef FX_MEM_HASH_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			kernels = &_fx_hash_kernels_avx2;
+		}
+#endif
+		__atomic_store_n(&_fx_hash_kernels_ptr, kernels, __ATOMIC_RELAXED);
+	}
+	return kernels;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint64_t fx_mem_hash_aligned(const void *mem, size_t size, uint64_t seed) {
+	uint64_t acc[FX_HASH_N_LANES], key[FX_HASH_N_LANES];
+	_fx_hash_kernels()->accumulate(
+	    acc, (const uint8_t *)FX_ASSUME_ALIGNED(mem), size, seed);
+
+	/* Merge the accumulators and avalanche the result */
+	_fx_hash_key(key, seed);
+	uint64_t h = (uint64_t)size * FX_HASH_PRIME64_1 + seed;
+	for (uint32_t i = 0U; i < FX_HASH_N_LANES; i += 2U) {
+		h += _fx_hash_mul_fold(acc[i] ^ key[7U - i], acc[i + 1U] ^ key[6U - i]);
+	}
+	h ^= h >> 37U;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32U;
+	return h;
+}
+
+bool fx_mem_equal_aligned(const void *a, const void *b, size_t size) {
+	const uint8_t *pa = (const uint8_t *)FX_ASSUME_ALIGNED(a);
+	const uint8_t *pb = (const uint8_t *)FX_ASSUME_ALIGNED(b);
+	const size_t n_blocks = size / FX_ALIGN;
+	if (!_fx_hash_kernels()->equal(pa, pb, n_blocks)) {
+		return false;
+	}
+	const size_t offs = n_blocks * FX_ALIGN;
+	return offs == size || memcmp(pa + offs, pb + offs, size - offs) == 0;
+}
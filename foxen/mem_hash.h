@@ -0,0 +1,72 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_hash.h
+ *
+ * Hashing and comparison of FX_ALIGN-aligned memory blocks, e.g. for
+ * deduplicating datastructures built with the fx_mem_align() pattern. Both
+ * functions process the memory in stripes of four FX_ALIGN blocks without
+ * any alignment prologue; the kernels are selected at runtime and use AVX2
+ * on x86-64 processors that support it. Define FX_MEM_NO_SIMD to force the
+ * generic implementation.
+ *
+ * The hash is a non-cryptographic wide-multiply hash in the style of XXH3.
+ * All kernels compute the same function, so hashes computed on different
+ * machines with the same byte order agree.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_HASH_H
+#define FOXEN_MEM_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Computes a 64-bit hash of a memory region.
+ *
+ * @param mem is a pointer at the memory region; must be aligned at FX_ALIGN.
+ * @param size is the size of the region in bytes. Need not be a multiple of
+ * FX_ALIGN; bytes past the end of the region are not read.
+ * @param seed is the seed of the hash.
+ * @return the hash value.
+ */
+uint64_t fx_mem_hash_aligned(const void *mem, size_t size, uint64_t seed);
+
+/**
+ * Compares two memory regions for equality.
+ *
+ * @param a is a pointer at the first region; must be aligned at FX_ALIGN.
+ * @param b is a pointer at the second region; must be aligned at FX_ALIGN.
+ * @param size is the size of both regions in bytes.
+ * @return true if both regions hold the same bytes.
+ */
+bool fx_mem_equal_aligned(const void *a, const void *b, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_HASH_H */
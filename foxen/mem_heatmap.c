@@ -0,0 +1,159 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_heatmap.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static uint32_t _fx_heatmap_log2_ceil(uint32_t x) {
+	uint32_t res = 0U;
+	while (res < 31U && (1U << res) < x) {
+		res++;
+	}
+	return res;
+}
+
+static uint32_t _fx_heatmap_n_buckets(uint32_t n_words, uint32_t shift) {
+	return (uint32_t)(((uint64_t)n_words + (1ULL << shift) - 1U) >> shift);
+}
+
+/* Returns true if bucket a should be listed before bucket b according to the
+   snapshot taken by fx_mem_heatmap_dump() */
+static bool _fx_heatmap_before(const fx_mem_heatmap_t *heatmap, uint32_t a,
+                               uint32_t b) {
+	const fx_mem_heatmap_bucket_t *ba = &heatmap->buckets[a];
+	const fx_mem_heatmap_bucket_t *bb = &heatmap->buckets[b];
+	if (ba->n_failed_snapshot != bb->n_failed_snapshot) {
+		return ba->n_failed_snapshot > bb->n_failed_snapshot;
+	}
+	if (ba->n_claims_snapshot != bb->n_claims_snapshot) {
+		return ba->n_claims_snapshot > bb->n_claims_snapshot;
+	}
+	return a < b;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+__thread uint32_t fx_mem_heatmap_tick = 0U;
+
+uint32_t fx_mem_heatmap_size(uint32_t n_words, uint32_t words_per_bucket) {
+	const uint32_t shift = _fx_heatmap_log2_ceil(words_per_bucket);
+	const uint64_t n_bytes_buckets =
+	    (uint64_t)_fx_heatmap_n_buckets(n_words, shift) *
+	    sizeof(fx_mem_heatmap_bucket_t);
+	if (n_bytes_buckets > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_heatmap_t)) &&
+	          fx_mem_update_size(&size, FX_MEM_HEATMAP_ALIGN - FX_ALIGN) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_buckets);
+	return ok ? size : 0U;
+}
+
+fx_mem_heatmap_t *fx_mem_heatmap_init(void *mem, uint32_t n_words,
+                                      uint32_t words_per_bucket,
+                                      uint32_t sample_rate) {
+	fx_mem_heatmap_t *heatmap =
+	    (fx_mem_heatmap_t *)fx_mem_align(&mem, sizeof(fx_mem_heatmap_t));
+	heatmap->n_words = n_words;
+	heatmap->shift = _fx_heatmap_log2_ceil(words_per_bucket);
+	heatmap->n_buckets = _fx_heatmap_n_buckets(n_words, heatmap->shift);
+	heatmap->sample_mask = (1U << _fx_heatmap_log2_ceil(sample_rate)) - 1U;
+	heatmap->buckets = (fx_mem_heatmap_bucket_t *)fx_mem_align_ex(
+	    &mem, heatmap->n_buckets * sizeof(fx_mem_heatmap_bucket_t),
+	    FX_MEM_HEATMAP_ALIGN);
+	fx_mem_heatmap_reset(heatmap);
+	return heatmap;
+}
+
+void fx_mem_heatmap_reset(fx_mem_heatmap_t *heatmap) {
+	for (uint32_t i = 0U; i < heatmap->n_buckets; i++) {
+		__atomic_store_n(&heatmap->buckets[i].n_claims, 0U, __ATOMIC_RELAXED);
+		__atomic_store_n(&heatmap->buckets[i].n_failed, 0U, __ATOMIC_RELAXED);
+		heatmap->buckets[i].n_claims_snapshot = 0U;
+		heatmap->buckets[i].n_failed_snapshot = 0U;
+	}
+}
+
+bool fx_mem_heatmap_dump(fx_mem_heatmap_t *heatmap, FILE *f, uint32_t n_top) {
+	/* Take a snapshot of the live counters; ranking the live counters would
+	   produce an inconsistent order while claims are recorded */
+	const uint64_t scale = heatmap->sample_mask + 1U;
+	uint64_t n_claims = 0U, n_failed = 0U;
+	for (uint32_t i = 0U; i < heatmap->n_buckets; i++) {
+		fx_mem_heatmap_bucket_t *bucket = &heatmap->buckets[i];
+		bucket->n_claims_snapshot =
+		    __atomic_load_n(&bucket->n_claims, __ATOMIC_RELAXED);
+		bucket->n_failed_snapshot =
+		    __atomic_load_n(&bucket->n_failed, __ATOMIC_RELAXED);
+		n_claims += bucket->n_claims_snapshot * scale;
+		n_failed += bucket->n_failed_snapshot;
+	}
+	fprintf(f,
+	        "# %" PRIu32 " buckets of %" PRIu32 " words, %" PRIu64
+	        " claims (estimated), %" PRIu64 " failed\n",
+	        heatmap->n_buckets, 1U << heatmap->shift, n_claims, n_failed);
+	fprintf(f, "# %-21s %14s %10s %7s\n", "slots", "claims", "failed",
+	        "share");
+
+	/* Selection of the n_top hottest buckets without auxiliary memory: in each
+	   round pick the hottest bucket that is ranked below the previous one. */
+	uint32_t prev = heatmap->n_buckets;
+	uint64_t n_failed_listed = 0U;
+	for (uint32_t k = 0U; k < n_top; k++) {
+		uint32_t best = heatmap->n_buckets;
+		for (uint32_t i = 0U; i < heatmap->n_buckets; i++) {
+			if ((prev == heatmap->n_buckets ||
+			     _fx_heatmap_before(heatmap, prev, i)) &&
+			    (best == heatmap->n_buckets ||
+			     _fx_heatmap_before(heatmap, i, best))) {
+				best = i;
+			}
+		}
+		if (best == heatmap->n_buckets ||
+		    (!heatmap->buckets[best].n_failed_snapshot &&
+		     !heatmap->buckets[best].n_claims_snapshot)) {
+			break;
+		}
+
+		const uint64_t slot0 = (uint64_t)best << (heatmap->shift + 5U);
+		const uint64_t slot1 = slot0 + (32ULL << heatmap->shift) - 1U;
+		const uint32_t failed = heatmap->buckets[best].n_failed_snapshot;
+		fprintf(f, "  %10" PRIu64 "-%-10" PRIu64 " %14" PRIu64 " %10" PRIu32
+		           " %6.1f%%\n",
+		        slot0, slot1, heatmap->buckets[best].n_claims_snapshot * scale,
+		        failed,
+		        n_failed ? 100.0 * (double)failed / (double)n_failed : 0.0);
+		n_failed_listed += failed;
+		prev = best;
+	}
+	if (n_failed) {
+		fprintf(f, "# listed buckets account for %.1f%% of failed claims\n",
+		        100.0 * (double)n_failed_listed / (double)n_failed);
+	}
+	return !ferror(f);
+}
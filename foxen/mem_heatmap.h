@@ -0,0 +1,167 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_heatmap.h
+ *
+ * Contention heatmap for the allocation bitmap of fx_mem_pool_alloc(). The
+ * heatmap divides the bitmap into buckets of one or more 32-bit words and
+ * counts, per bucket, how many slots were claimed and how often a claim
+ * failed because another thread was faster. Failed claims are always counted,
+ * successful claims are sampled; fx_mem_heatmap_dump() scales them back.
+ *
+ * Attach a heatmap to a pool with fx_mem_pool_alloc_probe() or
+ * fx_mem_static_pool_set_heatmap().
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_HEATMAP_H
+#define FOXEN_MEM_HEATMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Alignment of the bucket array; corresponds to the cache line size.
+ */
+#define FX_MEM_HEATMAP_ALIGN 64U
+
+/**
+ * Counters of a single heatmap bucket. Each bucket occupies a cache line of
+ * its own, so recording events does not introduce false sharing between
+ * threads claiming slots in different buckets.
+ */
+typedef struct fx_mem_heatmap_bucket {
+	uint32_t n_claims;
+	uint32_t n_failed;
+
+	/* Counters as seen by the last call to fx_mem_heatmap_dump() */
+	uint32_t n_claims_snapshot;
+	uint32_t n_failed_snapshot;
+	uint8_t _pad[FX_MEM_HEATMAP_ALIGN - 4U * sizeof(uint32_t)];
+} fx_mem_heatmap_bucket_t;
+
+/**
+ * Heatmap state. Do not access the members directly.
+ */
+typedef struct fx_mem_heatmap {
+	uint32_t n_words;
+	uint32_t n_buckets;
+	uint32_t shift;
+	uint32_t sample_mask;
+	fx_mem_heatmap_bucket_t *buckets;
+} fx_mem_heatmap_t;
+
+/**
+ * Thread-local event counter used to sample successful claims.
+ */
+extern __thread uint32_t fx_mem_heatmap_tick;
+
+/**
+ * Computes the size of the memory region required to store a heatmap.
+ *
+ * @param n_words is the number of words in the bitmap.
+ * @param words_per_bucket is the number of consecutive bitmap words that
+ * share a bucket. Rounded up to a power of two. Use 16 to obtain one bucket
+ * per cache line.
+ * @return the size in bytes or zero if there was an overflow.
+ */
+uint32_t fx_mem_heatmap_size(uint32_t n_words, uint32_t words_per_bucket);
+
+/**
+ * Initialises a heatmap in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_heatmap_size()
+ * bytes.
+ * @param n_words is the number of words in the bitmap.
+ * @param words_per_bucket is the number of words per bucket.
+ * @param sample_rate is the number of successful claims per recorded claim.
+ * Rounded up to a power of two.
+ * @return a pointer at the heatmap.
+ */
+fx_mem_heatmap_t *fx_mem_heatmap_init(void *mem, uint32_t n_words,
+                                      uint32_t words_per_bucket,
+                                      uint32_t sample_rate);
+
+/**
+ * Resets all counters to zero.
+ */
+void fx_mem_heatmap_reset(fx_mem_heatmap_t *heatmap);
+
+/**
+ * Records a claim of a slot in the given bitmap word.
+ *
+ * @param heatmap is the heatmap the event should be recorded in.
+ * @param word is the index of the bitmap word.
+ * @param failed is true if the slot had already been claimed by another
+ * thread.
+ */
+static inline void fx_mem_heatmap_record(fx_mem_heatmap_t *heatmap,
+                                         uint32_t word, bool failed) {
+	fx_mem_heatmap_bucket_t *bucket = &heatmap->buckets[word >> heatmap->shift];
+	if (failed) {
+		__atomic_add_fetch(&bucket->n_failed, 1U, __ATOMIC_RELAXED);
+	} else if (((fx_mem_heatmap_tick++) & heatmap->sample_mask) == 0U) {
+		__atomic_add_fetch(&bucket->n_claims, 1U, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Returns the estimated number of claims in the given bucket.
+ */
+static inline uint64_t fx_mem_heatmap_n_claims(const fx_mem_heatmap_t *heatmap,
+                                               uint32_t bucket) {
+	return (uint64_t)__atomic_load_n(&heatmap->buckets[bucket].n_claims,
+	                                 __ATOMIC_RELAXED) *
+	       (heatmap->sample_mask + 1U);
+}
+
+/**
+ * Returns the number of failed claims in the given bucket.
+ */
+static inline uint32_t fx_mem_heatmap_n_failed(const fx_mem_heatmap_t *heatmap,
+                                               uint32_t bucket) {
+	return __atomic_load_n(&heatmap->buckets[bucket].n_failed,
+	                       __ATOMIC_RELAXED);
+}
+
+/**
+ * Writes the hottest buckets, ordered by the number of failed claims, to the
+ * given file. Each line lists the covered slot range, the estimated number of
+ * claims, the number of failed claims, and the share of all failures. The
+ * counters are copied before they are ranked, so concurrent claims do not
+ * affect the order. Must not be called concurrently for the same heatmap.
+ *
+ * @param heatmap is the heatmap that should be written.
+ * @param f is the target file.
+ * @param n_top is the maximum number of buckets to list.
+ * @return true if the data was written successfully.
+ */
+bool fx_mem_heatmap_dump(fx_mem_heatmap_t *heatmap, FILE *f, uint32_t n_top);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_HEATMAP_H */
@@ -0,0 +1,192 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* syscall() */
+#endif
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define FX_MEM_IOBUF_HAVE_MMAP
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define FX_MEM_IOBUF_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#include <foxen/mem_bitset.h>
+#include <foxen/mem_iobuf.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#ifdef FX_MEM_IOBUF_HAVE_MMAP
+typedef struct iovec fx_mem_iobuf_iovec_t;
+#else
+typedef struct fx_mem_iobuf_iovec {
+	void *iov_base;
+	size_t iov_len;
+} fx_mem_iobuf_iovec_t;
+#endif
+
+static uint32_t _fx_iobuf_buf_size(uint32_t buf_size, uint32_t align) {
+	const uint64_t size =
+	    ((uint64_t)buf_size + align - 1U) & ~(uint64_t)(align - 1U);
+	return (size == 0U || size > 0xFFFFFFFFU) ? 0U : (uint32_t)size;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_iobuf_pool_size(uint32_t n_buffers, uint32_t buf_size,
+                                uint32_t align) {
+	if (align < FX_ALIGN || (align & (align - 1U))) {
+		return 0U;
+	}
+	buf_size = _fx_iobuf_buf_size(buf_size, align);
+	const uint64_t n_bytes_buffers = (uint64_t)n_buffers * buf_size;
+	const uint64_t n_bytes_iovecs =
+	    (uint64_t)n_buffers * sizeof(fx_mem_iobuf_iovec_t);
+	if (buf_size == 0U || n_bytes_buffers > 0xFFFFFFFFU ||
+	    n_bytes_iovecs > 0xFFFFFFFFU) {
+		return 0U;
+	}
+
+	/* The buffers need up to align - FX_ALIGN bytes of padding in front */
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_iobuf_pool_t)) &&
+	          fx_mem_update_size(&size, sizeof(uint32_t) *
+	                                        fx_mem_bitset_n_words(n_buffers)) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_iovecs) &&
+	          fx_mem_update_size(&size, align - FX_ALIGN) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_buffers);
+	return ok ? size : 0U;
+}
+
+fx_mem_iobuf_pool_t *fx_mem_iobuf_pool_init(void *mem, uint32_t n_buffers,
+                                            uint32_t buf_size, uint32_t align) {
+	fx_mem_iobuf_pool_t *pool = (fx_mem_iobuf_pool_t *)fx_mem_align(
+	    &mem, sizeof(fx_mem_iobuf_pool_t));
+	pool->buf_size = _fx_iobuf_buf_size(buf_size, align);
+	pool->align = align;
+	pool->n_buffers = n_buffers;
+	pool->allocated = (uint32_t *)fx_mem_align(
+	    &mem, sizeof(uint32_t) * fx_mem_bitset_n_words(n_buffers));
+	fx_mem_iobuf_iovec_t *iovecs = (fx_mem_iobuf_iovec_t *)fx_mem_align(
+	    &mem, n_buffers * sizeof(fx_mem_iobuf_iovec_t));
+	pool->iovecs = iovecs;
+	pool->buffers = (uint8_t *)fx_mem_align_ex(
+	    &mem, n_buffers * pool->buf_size, align);
+	pool->ring_fd = -1;
+	pool->mapped = false;
+	fx_mem_zero_aligned(pool->allocated,
+	                    sizeof(uint32_t) * fx_mem_bitset_n_words(n_buffers));
+	pool->free_idx = 0U;
+	pool->n_allocated = 0U;
+	for (uint32_t i = 0U; i < n_buffers; i++) {
+		iovecs[i].iov_base = fx_mem_iobuf_ptr(pool, i);
+		iovecs[i].iov_len = pool->buf_size;
+	}
+	return pool;
+}
+
+#ifdef FX_MEM_IOBUF_HAVE_MMAP
+
+fx_mem_iobuf_pool_t *fx_mem_iobuf_pool_create(uint32_t n_buffers,
+                                              uint32_t buf_size,
+                                              uint32_t align) {
+	const uint32_t size = fx_mem_iobuf_pool_size(n_buffers, buf_size, align);
+	if (size == 0U) {
+		return NULL;
+	}
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+	fx_mem_iobuf_pool_t *pool =
+	    fx_mem_iobuf_pool_init(mem, n_buffers, buf_size, align);
+	pool->mapped = true;
+	return pool;
+}
+
+void fx_mem_iobuf_pool_destroy(fx_mem_iobuf_pool_t *pool) {
+	if (pool && pool->mapped) {
+		fx_mem_iobuf_unregister(pool);
+		munmap(pool, fx_mem_iobuf_pool_size(pool->n_buffers, pool->buf_size,
+		                                    pool->align));
+	}
+}
+
+#else /* FX_MEM_IOBUF_HAVE_MMAP */
+
+fx_mem_iobuf_pool_t *fx_mem_iobuf_pool_create(uint32_t n_buffers,
+                                              uint32_t buf_size,
+                                              uint32_t align) {
+	return NULL;
+}
+
+void fx_mem_iobuf_pool_destroy(fx_mem_iobuf_pool_t *pool) {}
+
+#endif /* FX_MEM_IOBUF_HAVE_MMAP */
+
+#ifdef FX_MEM_IOBUF_HAVE_IO_URING
+
+bool fx_mem_iobuf_register(fx_mem_iobuf_pool_t *pool, int ring_fd) {
+	if (pool->ring_fd >= 0) {
+		return false; /* Already registered */
+	}
+	if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS,
+	            pool->iovecs, pool->n_buffers) != 0) {
+		return false;
+	}
+	pool->ring_fd = ring_fd;
+	return true;
+}
+
+void fx_mem_iobuf_unregister(fx_mem_iobuf_pool_t *pool) {
+	if (pool->ring_fd >= 0) {
+		syscall(__NR_io_uring_register, pool->ring_fd,
+		        IORING_UNREGISTER_BUFFERS, NULL, 0U);
+		pool->ring_fd = -1;
+	}
+}
+
+#else /* FX_MEM_IOBUF_HAVE_IO_URING */
+
+bool fx_mem_iobuf_register(fx_mem_iobuf_pool_t *pool, int ring_fd) {
+	return false;
+}
+
+void fx_mem_iobuf_unregister(fx_mem_iobuf_pool_t *pool) {}
+
+#endif /* FX_MEM_IOBUF_HAVE_IO_URING */
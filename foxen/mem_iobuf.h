@@ -0,0 +1,200 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_iobuf.h
+ *
+ * Pool of equally-sized I/O buffers aligned for direct I/O (O_DIRECT). The
+ * bookkeeping data, an iovec table describing the buffers, and the buffers
+ * themselves are stored in a single memory region. Buffers are allocated with
+ * fx_mem_pool_alloc() and are identified by their slot index.
+ *
+ * On Linux, the buffers can be registered as io_uring fixed buffers. The slot
+ * index of a buffer is its buffer id, i.e. the value to use as buf_index in
+ * IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED submissions. The slot index
+ * can be encoded in the user_data of a submission, so that completion handlers
+ * can return the buffer to the pool with fx_mem_iobuf_release_user_data().
+ * Allocating and freeing buffers is thread-safe.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_IOBUF_H
+#define FOXEN_MEM_IOBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * I/O buffer pool.
+ */
+typedef struct fx_mem_iobuf_pool {
+	uint32_t buf_size;
+	uint32_t align;
+	uint32_t n_buffers;
+	uint32_t *allocated;
+	void *iovecs; /* struct iovec[n_buffers] */
+	uint8_t *buffers;
+	int ring_fd;
+	bool mapped;
+
+	/* Frequently modified state, placed on its own cache line */
+	uint8_t _pad0[64];
+	uint32_t free_idx;
+	uint32_t n_allocated;
+	uint8_t _pad1[64];
+} fx_mem_iobuf_pool_t;
+
+/**
+ * Computes the size of the memory region required to store an I/O buffer
+ * pool.
+ *
+ * @param n_buffers is the number of buffers.
+ * @param buf_size is the size of a single buffer. Rounded up to a multiple of
+ * align.
+ * @param align is the alignment of the buffers, e.g. 512 or 4096. Must be a
+ * power of two and at least FX_ALIGN.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow or the alignment is invalid.
+ */
+uint32_t fx_mem_iobuf_pool_size(uint32_t n_buffers, uint32_t buf_size,
+                                uint32_t align);
+
+/**
+ * Initialises an I/O buffer pool in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_iobuf_pool_size() bytes.
+ * @param n_buffers is the number of buffers.
+ * @param buf_size is the size of a single buffer.
+ * @param align is the alignment of the buffers.
+ * @return a pointer at the pool.
+ */
+fx_mem_iobuf_pool_t *fx_mem_iobuf_pool_init(void *mem, uint32_t n_buffers,
+                                            uint32_t buf_size, uint32_t align);
+
+/**
+ * Maps an anonymous memory region and initialises a pool in it. Only
+ * available on POSIX systems.
+ *
+ * @return a pointer at the pool or NULL on failure.
+ */
+fx_mem_iobuf_pool_t *fx_mem_iobuf_pool_create(uint32_t n_buffers,
+                                              uint32_t buf_size,
+                                              uint32_t align);
+
+/**
+ * Unregisters the buffers and unmaps a pool created with
+ * fx_mem_iobuf_pool_create().
+ */
+void fx_mem_iobuf_pool_destroy(fx_mem_iobuf_pool_t *pool);
+
+/**
+ * Registers all buffers of the pool as fixed buffers with the given io_uring
+ * instance. Only available on Linux.
+ *
+ * @param pool is the pool.
+ * @param ring_fd is the io_uring file descriptor.
+ * @return false if the registration failed.
+ */
+bool fx_mem_iobuf_register(fx_mem_iobuf_pool_t *pool, int ring_fd);
+
+/**
+ * Unregisters the buffers from the io_uring instance they were registered
+ * with.
+ */
+void fx_mem_iobuf_unregister(fx_mem_iobuf_pool_t *pool);
+
+/**
+ * Returns the iovec table describing the buffers; entry i describes the
+ * buffer with index i. Cast the result to const struct iovec *.
+ */
+static inline const void *fx_mem_iobuf_iovecs(
+    const fx_mem_iobuf_pool_t *pool) {
+	return pool->iovecs;
+}
+
+/**
+ * Allocates a buffer.
+ *
+ * @return the index of the buffer, or pool->n_buffers if all buffers are in
+ * use.
+ */
+static inline uint32_t fx_mem_iobuf_alloc(fx_mem_iobuf_pool_t *pool) {
+	return fx_mem_pool_alloc(pool->allocated, &pool->free_idx,
+	                         &pool->n_allocated, pool->n_buffers);
+}
+
+/**
+ * Returns a buffer to the pool.
+ */
+static inline void fx_mem_iobuf_free(fx_mem_iobuf_pool_t *pool, uint32_t idx) {
+	fx_mem_pool_free(idx, pool->allocated, &pool->free_idx,
+	                 &pool->n_allocated);
+}
+
+/**
+ * Returns a pointer at the buffer with the given index.
+ */
+static inline void *fx_mem_iobuf_ptr(const fx_mem_iobuf_pool_t *pool,
+                                     uint32_t idx) {
+	return pool->buffers + (size_t)idx * pool->buf_size;
+}
+
+/**
+ * Encodes a buffer index and a user-defined tag in an io_uring user_data
+ * value.
+ */
+static inline uint64_t fx_mem_iobuf_user_data(uint32_t idx, uint32_t tag) {
+	return ((uint64_t)tag << 32U) | idx;
+}
+
+/**
+ * Returns the buffer index encoded by fx_mem_iobuf_user_data().
+ */
+static inline uint32_t fx_mem_iobuf_user_data_idx(uint64_t user_data) {
+	return (uint32_t)user_data;
+}
+
+/**
+ * Returns the tag encoded by fx_mem_iobuf_user_data().
+ */
+static inline uint32_t fx_mem_iobuf_user_data_tag(uint64_t user_data) {
+	return (uint32_t)(user_data >> 32U);
+}
+
+/**
+ * Returns the buffer referenced by the user_data of a completion to the pool.
+ */
+static inline void fx_mem_iobuf_release_user_data(fx_mem_iobuf_pool_t *pool,
+                                                  uint64_t user_data) {
+	fx_mem_iobuf_free(pool, fx_mem_iobuf_user_data_idx(user_data));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_IOBUF_H */
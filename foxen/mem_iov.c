@@ -0,0 +1,107 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_iov.h>
+#include <foxen/mem_record.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/**
+ * State of a list that allows to undo a sequence of fx_mem_iov_add() calls.
+ */
+typedef struct fx_mem_iov_mark {
+	uint32_t n_vecs;
+	size_t n_bytes;
+	size_t last_len;
+} fx_mem_iov_mark_t;
+
+static fx_mem_iov_mark_t _fx_iov_mark(const fx_mem_iov_t *iov) {
+	fx_mem_iov_mark_t mark = {iov->n_vecs, iov->n_bytes, 0U};
+	if (iov->n_vecs > 0U) {
+		mark.last_len = iov->vecs[iov->n_vecs - 1U].iov_len;
+	}
+	return mark;
+}
+
+static void _fx_iov_rollback(fx_mem_iov_t *iov, fx_mem_iov_mark_t mark) {
+	iov->n_vecs = mark.n_vecs;
+	iov->n_bytes = mark.n_bytes;
+	if (iov->n_vecs > 0U) {
+		iov->vecs[iov->n_vecs - 1U].iov_len = mark.last_len;
+	}
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+bool fx_mem_iov_add_layout(fx_mem_iov_t *iov, const void *mem,
+                           const uint32_t *sizes, uint32_t n_fields) {
+	const fx_mem_iov_mark_t mark = _fx_iov_mark(iov);
+	void *p = (void *)mem;
+	for (uint32_t i = 0U; i < n_fields; i++) {
+		if (!fx_mem_iov_align(iov, &p, sizes[i])) {
+			_fx_iov_rollback(iov, mark);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool fx_mem_iov_add_records(fx_mem_iov_t *iov, const uint8_t *buf,
+                            uint32_t size, uint32_t *offset) {
+	fx_mem_record_reader_t reader;
+	fx_mem_record_reader_init(&reader, buf, size);
+	reader.offset = *offset;
+
+	const void *payload;
+	uint32_t length;
+	while ((payload = fx_mem_record_next(&reader, &length, NULL))) {
+		const fx_mem_iov_mark_t mark = _fx_iov_mark(iov);
+		if (!fx_mem_iov_add(iov, buf + *offset,
+		                    sizeof(fx_mem_record_header_t)) ||
+		    !fx_mem_iov_add(iov, payload, length)) {
+			_fx_iov_rollback(iov, mark);
+			return false;
+		}
+		*offset = reader.offset;
+	}
+	return true;
+}
+
+void fx_mem_iov_consume(fx_mem_iov_t *iov, size_t n_bytes) {
+	uint32_t i = 0U;
+	if (n_bytes > iov->n_bytes) {
+		n_bytes = iov->n_bytes;
+	}
+	iov->n_bytes -= n_bytes;
+	while (i < iov->n_vecs && n_bytes >= iov->vecs[i].iov_len) {
+		n_bytes -= iov->vecs[i].iov_len;
+		i++;
+	}
+	if (i < iov->n_vecs) {
+		iov->vecs[i].iov_base = (uint8_t *)iov->vecs[i].iov_base + n_bytes;
+		iov->vecs[i].iov_len -= n_bytes;
+	}
+	for (uint32_t j = i; j < iov->n_vecs; j++) {
+		iov->vecs[j - i] = iov->vecs[j];
+	}
+	iov->n_vecs -= i;
+}
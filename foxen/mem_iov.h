@@ -0,0 +1,175 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_iov.h
+ *
+ * Builds scatter-gather lists for writev(), pwritev() and sendmsg() from
+ * memory layouts created with fx_mem_align() and from record streams (see
+ * mem_record.h). Only the field contents are referenced; alignment padding is
+ * skipped and adjacent fields are coalesced into a single entry, so data can
+ * be written without copying it into a contiguous buffer first.
+ *
+ * The iovec array is provided by the caller. When it is full, the functions
+ * return false; write out the entries, call fx_mem_iov_reset() and continue.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_IOV_H
+#define FOXEN_MEM_IOV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+typedef struct iovec fx_mem_iovec_t;
+#else
+typedef struct fx_mem_iovec {
+	void *iov_base;
+	size_t iov_len;
+} fx_mem_iovec_t;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Scatter-gather list under construction.
+ */
+typedef struct fx_mem_iov {
+	fx_mem_iovec_t *vecs;
+	uint32_t n_vecs;
+	uint32_t max_vecs;
+	size_t n_bytes;
+} fx_mem_iov_t;
+
+/**
+ * Initialises an empty scatter-gather list.
+ *
+ * @param iov is the list that should be initialised.
+ * @param vecs is the array receiving the entries.
+ * @param max_vecs is the number of entries in vecs, e.g. IOV_MAX.
+ */
+static inline void fx_mem_iov_init(fx_mem_iov_t *iov, fx_mem_iovec_t *vecs,
+                                   uint32_t max_vecs) {
+	iov->vecs = vecs;
+	iov->n_vecs = 0U;
+	iov->max_vecs = max_vecs;
+	iov->n_bytes = 0U;
+}
+
+/**
+ * Removes all entries from the list.
+ */
+static inline void fx_mem_iov_reset(fx_mem_iov_t *iov) {
+	iov->n_vecs = 0U;
+	iov->n_bytes = 0U;
+}
+
+/**
+ * Appends a memory range to the list. The range is merged with the last entry
+ * if it immediately follows it.
+ *
+ * @return false if the list is full.
+ */
+static inline bool fx_mem_iov_add(fx_mem_iov_t *iov, const void *ptr,
+                                  size_t n_bytes) {
+	if (n_bytes == 0U) {
+		return true;
+	}
+	if (iov->n_vecs > 0U) {
+		fx_mem_iovec_t *last = &iov->vecs[iov->n_vecs - 1U];
+		if ((const uint8_t *)last->iov_base + last->iov_len ==
+		    (const uint8_t *)ptr) {
+			last->iov_len += n_bytes;
+			iov->n_bytes += n_bytes;
+			return true;
+		}
+	}
+	if (iov->n_vecs >= iov->max_vecs) {
+		return false;
+	}
+	iov->vecs[iov->n_vecs].iov_base = (void *)ptr;
+	iov->vecs[iov->n_vecs].iov_len = n_bytes;
+	iov->n_vecs++;
+	iov->n_bytes += n_bytes;
+	return true;
+}
+
+/**
+ * Same as fx_mem_align(), but additionally appends the size bytes of the
+ * field to the list. Replaying the fx_mem_align() calls of an init function
+ * with this function yields the fields of the layout without padding.
+ *
+ * @return the aligned pointer at the field, or NULL if the list is full.
+ */
+static inline void *fx_mem_iov_align(fx_mem_iov_t *iov, void **mem,
+                                     uint32_t size) {
+	void *res = fx_mem_align(mem, size);
+	return fx_mem_iov_add(iov, res, size) ? res : NULL;
+}
+
+/**
+ * Appends the fields of a layout. The fields are placed like a chain of
+ * fx_mem_align() calls with the given sizes, i.e. like the layouts described
+ * by fx_mem_init_size() and fx_mem_update_size().
+ *
+ * @param iov is the list.
+ * @param mem is a pointer at the memory region passed to the init function of
+ * the layout.
+ * @param sizes is an array containing the size of each field.
+ * @param n_fields is the number of fields.
+ * @return false if the list is full.
+ */
+bool fx_mem_iov_add_layout(fx_mem_iov_t *iov, const void *mem,
+                           const uint32_t *sizes, uint32_t n_fields);
+
+/**
+ * Appends the records of a buffer written by a mem_record.h writer. Each
+ * record is emitted as its length and tag (eight bytes) followed by the
+ * payload; the padding of the header slot and the payload is skipped.
+ *
+ * @param iov is the list.
+ * @param buf is the record buffer.
+ * @param size is the number of valid bytes in buf.
+ * @param offset is a pointer at the offset of the first record that should be
+ * added; initialise it with zero. Receives the offset of the first record that
+ * was not added.
+ * @return false if the list became full before all records were added.
+ */
+bool fx_mem_iov_add_records(fx_mem_iov_t *iov, const uint8_t *buf,
+                            uint32_t size, uint32_t *offset);
+
+/**
+ * Removes the first n_bytes from the list, e.g. after a short write. Entries
+ * that were written completely are removed; a partially written entry is
+ * adjusted.
+ */
+void fx_mem_iov_consume(fx_mem_iov_t *iov, size_t n_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_IOV_H */
@@ -0,0 +1,137 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem.h>
+#include <foxen/mem_local_pool.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static inline uint32_t _fx_remote_head(uint64_t remote_free) {
+	return (uint32_t)remote_free;
+}
+
+static inline uint32_t _fx_remote_count(uint64_t remote_free) {
+	return (uint32_t)(remote_free >> 32U);
+}
+
+static inline uint64_t _fx_remote_pack(uint32_t head, uint32_t count) {
+	return ((uint64_t)count << 32U) | head;
+}
+
+static const uint64_t _fx_remote_empty =
+    (uint64_t)FX_MEM_LOCAL_POOL_NIL; /* head = NIL, count = 0 */
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_local_pool_size(uint32_t n_available) {
+	if (n_available >= FX_MEM_LOCAL_POOL_NIL ||
+	    n_available > (0xFFFFFFFFU / sizeof(uint32_t))) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_local_pool_t)) &&
+	          fx_mem_update_size(&size, sizeof(uint32_t) * n_available);
+	return ok ? size : 0U;
+}
+
+fx_mem_local_pool_t *fx_mem_local_pool_init(void *mem, uint32_t n_available,
+                                            uintptr_t owner) {
+	fx_mem_local_pool_t *pool = (fx_mem_local_pool_t *)fx_mem_align(
+	    &mem, sizeof(fx_mem_local_pool_t));
+	pool->owner = owner;
+	pool->n_available = n_available;
+	pool->n_fresh = 0U;
+	pool->n_allocated = 0U;
+	pool->local_free = FX_MEM_LOCAL_POOL_NIL;
+	pool->next = (uint32_t *)fx_mem_align(&mem, sizeof(uint32_t) * n_available);
+	__atomic_store_n(&pool->remote_free, _fx_remote_empty, __ATOMIC_RELEASE);
+	return pool;
+}
+
+uint32_t fx_mem_local_pool_alloc(fx_mem_local_pool_t *pool) {
+	/* Fast path: pop an element from the private free list. If the list is
+	   empty, try to collect the slots freed by other threads. */
+	if (pool->local_free == FX_MEM_LOCAL_POOL_NIL &&
+	    !fx_mem_local_pool_collect(pool)) {
+		/* There are no freed slots, hand out a slot that has never been
+		   used before. This way we do not have to initialise the free list
+		   when the pool is created. */
+		if (pool->n_fresh >= pool->n_available) {
+			return pool->n_available;
+		}
+		pool->n_allocated++;
+		return pool->n_fresh++;
+	}
+
+	const uint32_t idx = pool->local_free;
+	pool->local_free = pool->next[idx];
+	pool->n_allocated++;
+	return idx;
+}
+
+void fx_mem_local_pool_free_local(fx_mem_local_pool_t *pool, uint32_t idx) {
+	pool->next[idx] = pool->local_free;
+	pool->local_free = idx;
+	pool->n_allocated--;
+}
+
+void fx_mem_local_pool_free_remote(fx_mem_local_pool_t *pool, uint32_t idx) {
+	/* Push the slot onto the remote free list. There is no ABA problem here,
+	   since the owner never pops individual elements but always takes the
+	   entire list. */
+	uint64_t old = __atomic_load_n(&pool->remote_free, __ATOMIC_RELAXED);
+	uint64_t list;
+	do {
+		pool->next[idx] = _fx_remote_head(old);
+		list = _fx_remote_pack(idx, _fx_remote_count(old) + 1U);
+	} while (!__atomic_compare_exchange_n(&pool->remote_free, &old, list, true,
+	                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+uint32_t fx_mem_local_pool_collect(fx_mem_local_pool_t *pool) {
+	/* Avoid the atomic exchange (and the resulting cache line transfer) if
+	   the remote free list is empty. */
+	if (__atomic_load_n(&pool->remote_free, __ATOMIC_RELAXED) ==
+	    _fx_remote_empty) {
+		return 0U;
+	}
+
+	/* Take the entire list in one go */
+	const uint64_t list = __atomic_exchange_n(
+	    &pool->remote_free, _fx_remote_empty, __ATOMIC_ACQUIRE);
+	const uint32_t head = _fx_remote_head(list);
+	const uint32_t count = _fx_remote_count(list);
+
+	/* Prepend the list to the private free list. We only have to search the
+	   tail of the collected list if the private free list is not empty. */
+	if (pool->local_free != FX_MEM_LOCAL_POOL_NIL) {
+		uint32_t tail = head;
+		while (pool->next[tail] != FX_MEM_LOCAL_POOL_NIL) {
+			tail = pool->next[tail];
+		}
+		pool->next[tail] = pool->local_free;
+	}
+	pool->local_free = head;
+	pool->n_allocated -= count;
+	return count;
+}
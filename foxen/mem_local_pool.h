@@ -0,0 +1,168 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_local_pool.h
+ *
+ * Owner-local slot pool. In contrast to fx_mem_pool_alloc(), a local pool is
+ * owned by a single thread. Only the owner may allocate slots; the owner
+ * frees slots into a private free list without any atomic operations. Other
+ * threads free slots by pushing them onto a lock-free "remote free" list,
+ * which is collected by the owner in a single atomic operation once its
+ * private free list runs empty. This is the scheme used by the mimalloc
+ * allocator, see Leijen et al., "Mimalloc: Free List Sharding in Action",
+ * 2019.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_LOCAL_POOL_H
+#define FOXEN_MEM_LOCAL_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Index used to mark the end of a free list.
+ */
+#define FX_MEM_LOCAL_POOL_NIL 0xFFFFFFFFU
+
+/**
+ * Bookkeeping data of an owner-local pool. The state accessed by remote
+ * threads is placed on its own cache line to prevent false sharing with the
+ * owner-private state. Do not access the members directly.
+ */
+typedef struct fx_mem_local_pool {
+	/* Owner-private state */
+	uintptr_t owner;
+	uint32_t n_available;
+	uint32_t n_fresh;
+	uint32_t n_allocated;
+	uint32_t local_free;
+	uint32_t *next;
+
+	/* State shared with remote threads. The upper 32 bits of remote_free
+	   contain the number of entries in the list, the lower 32 bits the index
+	   of the first entry. */
+	uint8_t _pad0[64];
+	uint64_t remote_free;
+	uint8_t _pad1[64];
+} fx_mem_local_pool_t;
+
+/**
+ * Computes the number of bytes required to store an owner-local pool with the
+ * given number of slots. Note that this only accounts for the bookkeeping data
+ * and not the slots themselves.
+ *
+ * @param n_available is the number of slots in the pool. Must be smaller than
+ * FX_MEM_LOCAL_POOL_NIL.
+ * @return the required size in bytes or zero if there was an overflow.
+ */
+uint32_t fx_mem_local_pool_size(uint32_t n_available);
+
+/**
+ * Initialises an owner-local pool in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_local_pool_size() bytes.
+ * @param n_available is the number of slots in the pool.
+ * @param owner is an arbitrary token identifying the owner thread, for example
+ * the address of a thread-local variable or the index of the CPU core the
+ * owner is running on.
+ * @return a pointer at the initialised pool.
+ */
+fx_mem_local_pool_t *fx_mem_local_pool_init(void *mem, uint32_t n_available,
+                                            uintptr_t owner);
+
+/**
+ * Allocates a slot from the pool. Must only be called by the owner. If the
+ * private free list is empty, slots freed by remote threads are collected
+ * before new slots are handed out.
+ *
+ * @param pool is the pool from which a slot should be allocated.
+ * @return the allocated slot index or pool->n_available if all slots are
+ * currently in use.
+ */
+uint32_t fx_mem_local_pool_alloc(fx_mem_local_pool_t *pool);
+
+/**
+ * Frees a slot. Must only be called by the owner.
+ *
+ * @param pool is the pool that owns the slot.
+ * @param idx is the slot index that should be freed.
+ */
+void fx_mem_local_pool_free_local(fx_mem_local_pool_t *pool, uint32_t idx);
+
+/**
+ * Frees a slot from any thread other than the owner. The slot is pushed onto
+ * the remote free list with a single compare-and-swap operation and becomes
+ * available to the owner the next time it collects the remote free list.
+ *
+ * @param pool is the pool that owns the slot.
+ * @param idx is the slot index that should be freed.
+ */
+void fx_mem_local_pool_free_remote(fx_mem_local_pool_t *pool, uint32_t idx);
+
+/**
+ * Frees a slot from any thread. Dispatches to fx_mem_local_pool_free_local()
+ * or fx_mem_local_pool_free_remote() depending on whether self matches the
+ * owner token passed to fx_mem_local_pool_init().
+ *
+ * @param pool is the pool that owns the slot.
+ * @param idx is the slot index that should be freed.
+ * @param self is the token identifying the calling thread.
+ */
+static inline void fx_mem_local_pool_free(fx_mem_local_pool_t *pool,
+                                          uint32_t idx, uintptr_t self) {
+	if (self == pool->owner) {
+		fx_mem_local_pool_free_local(pool, idx);
+	} else {
+		fx_mem_local_pool_free_remote(pool, idx);
+	}
+}
+
+/**
+ * Moves all slots on the remote free list to the private free list. Must only
+ * be called by the owner. There is usually no need to call this function
+ * explicitly, since fx_mem_local_pool_alloc() collects the remote free list
+ * whenever the private free list is empty.
+ *
+ * @param pool is the pool for which the remote free list should be collected.
+ * @return the number of collected slots.
+ */
+uint32_t fx_mem_local_pool_collect(fx_mem_local_pool_t *pool);
+
+/**
+ * Returns the number of allocated slots as seen by the owner, i.e., slots on
+ * the remote free list that have not been collected yet are counted as
+ * allocated. Must only be called by the owner.
+ */
+static inline uint32_t fx_mem_local_pool_n_allocated(
+    const fx_mem_local_pool_t *pool) {
+	return pool->n_allocated;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_LOCAL_POOL_H */
@@ -0,0 +1,486 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#define FX_MEM_LOG_HAVE_MMAP
+#endif
+
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_log.h>
+#include <foxen/mem_record.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#ifdef FX_MEM_LOG_HAVE_MMAP
+
+#define FX_MEM_LOG_DEFAULT_GROW_STEP (1024U * 1024U)
+
+/**
+ * Header at the beginning of the log file, padded to FX_MEM_LOG_DATA_OFFSET.
+ */
+typedef struct fx_mem_log_file_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t align;
+} fx_mem_log_file_header_t;
+
+static void _fx_log_lock(uint32_t *lock) {
+	while (__atomic_exchange_n(lock, 1U, __ATOMIC_ACQUIRE)) {
+		sched_yield();
+	}
+}
+
+static void _fx_log_unlock(uint32_t *lock) {
+	__atomic_store_n(lock, 0U, __ATOMIC_RELEASE);
+}
+
+static uint32_t _fx_log_checksum(const uint8_t *data, uint32_t size) {
+	/* Same multiplicative hash as in mem_blob.c; payloads are aligned */
+	uint64_t h = 0xCBF29CE484222325ULL ^ size;
+	uint32_t i = 0U;
+	for (; i + 8U <= size; i += 8U) {
+		uint64_t w;
+		memcpy(&w, data + i, 8U);
+		h = (h ^ w) * 0x100000001B3ULL;
+		h ^= h >> 29U;
+	}
+	for (; i < size; i++) {
+		h = (h ^ data[i]) * 0x100000001B3ULL;
+	}
+	return (uint32_t)(h ^ (h >> 32U));
+}
+
+/**
+ * Returns the number of bytes occupied by the record at the given offset and
+ * stores the marker of its header in marker. Returns zero if the record does
+ * not end before "end"; for headers without a marker, this is one FX_ALIGN
+ * block.
+ */
+static uint32_t _fx_log_extent(const fx_mem_log_t *log, uint64_t offset,
+                               uint64_t end, uint32_t *marker) {
+	*marker = 0U;
+	if (offset > end || end - offset < FX_ALIGN) {
+		return 0U;
+	}
+	const fx_mem_log_record_t *hdr =
+	    (const fx_mem_log_record_t *)(log->base + offset);
+	*marker = __atomic_load_n(&hdr->marker, __ATOMIC_ACQUIRE);
+	if (*marker == 0U) {
+		return FX_ALIGN;
+	}
+	const uint32_t n_bytes = fx_mem_record_size(hdr->length);
+	return (n_bytes > end - offset) ? 0U : n_bytes;
+}
+
+/**
+ * Returns true if the record at the given offset with the given marker was
+ * committed and its payload matches the checksum.
+ */
+static bool _fx_log_complete(const fx_mem_log_t *log, uint64_t offset,
+                             uint32_t marker) {
+	const fx_mem_log_record_t *hdr =
+	    (const fx_mem_log_record_t *)(log->base + offset);
+	return marker == FX_MEM_LOG_RECORD_MARKER &&
+	       hdr->checksum ==
+	           _fx_log_checksum(log->base + offset + FX_ALIGN, hdr->length);
+}
+
+/**
+ * Marks the record at the given offset as aborted, so that readers, the sync,
+ * and the recovery skip it.
+ */
+static void _fx_log_abort(fx_mem_log_t *log, uint64_t offset,
+                          uint32_t length) {
+	fx_mem_log_record_t *hdr = (fx_mem_log_record_t *)(log->base + offset);
+	hdr->length = length;
+	hdr->checksum = 0U;
+	__atomic_store_n(&hdr->marker, FX_MEM_LOG_ABORTED_MARKER, __ATOMIC_RELEASE);
+}
+
+static bool _fx_log_grow(fx_mem_log_t *log, uint64_t end) {
+	bool ok = true;
+	_fx_log_lock(&log->grow_lock);
+	const uint64_t file_size = log->file_size;
+	if (end > file_size) {
+		uint64_t new_size = file_size + log->grow_step;
+		if (new_size < end) {
+			new_size = end;
+		}
+		if (new_size > log->capacity) {
+			new_size = log->capacity;
+		}
+		ok = ftruncate(log->fd, (off_t)new_size) == 0;
+		if (ok) {
+			__atomic_store_n(&log->file_size, new_size, __ATOMIC_RELEASE);
+		}
+	}
+	_fx_log_unlock(&log->grow_lock);
+	return ok;
+}
+
+static bool _fx_log_datasync(int fd) {
+#ifdef __APPLE__
+	return fsync(fd) == 0;
+#else
+	return fdatasync(fd) == 0;
+#endif
+}
+
+/**
+ * Flushes all reserved bytes that have not been synced yet. Must be called
+ * with the sync lock held.
+ */
+static bool _fx_log_sync_locked(fx_mem_log_t *log) {
+	const uint64_t file_size =
+	    __atomic_load_n(&log->file_size, __ATOMIC_ACQUIRE);
+	uint64_t end = __atomic_load_n(&log->cursor, __ATOMIC_SEQ_CST);
+	if (end > file_size) {
+		end = file_size;
+	}
+
+	/* Determine the records that are finished before flushing. Records that
+	   are still pending may be committed while msync() is running and must be
+	   flushed again by the next sync, so the next sync starts at the first of
+	   them. */
+	uint64_t prefix = log->synced;
+	uint32_t n_bytes, marker;
+	while ((n_bytes = _fx_log_extent(log, prefix, end, &marker)) &&
+	       (marker == FX_MEM_LOG_RECORD_MARKER ||
+	        marker == FX_MEM_LOG_ABORTED_MARKER)) {
+		prefix += n_bytes;
+	}
+
+	bool ok = true;
+	if (end > log->synced) {
+		const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+		const uint64_t begin = log->synced & ~(page_size - 1U);
+		ok = msync(log->base + begin, end - begin, MS_SYNC) == 0;
+	}
+
+	/* msync() does not persist the file size after ftruncate() */
+	if (ok && file_size != log->synced_file_size) {
+		ok = _fx_log_datasync(log->fd);
+		if (ok) {
+			log->synced_file_size = file_size;
+		}
+	}
+	if (ok) {
+		log->synced = prefix;
+	}
+	return ok;
+}
+
+/**
+ * Performs a numbered sync and publishes its result to the threads waiting in
+ * fx_mem_log_wait_durable(). Must be called with the sync lock held.
+ */
+static bool _fx_log_sync_run(fx_mem_log_t *log) {
+	const uint32_t seq = log->sync_started + 1U;
+	__atomic_store_n(&log->sync_started, seq, __ATOMIC_SEQ_CST);
+	const bool ok = _fx_log_sync_locked(log);
+	__atomic_store_n(&log->sync_ok, ok, __ATOMIC_RELAXED);
+	__atomic_store_n(&log->sync_completed, seq, __ATOMIC_RELEASE);
+	return ok;
+}
+
+/**
+ * Scans the records following the file header and returns the end of the last
+ * complete record. Holes in front of it, i.e. records that were reserved but
+ * never committed, blocks that were never written, and corrupted records, are
+ * marked as aborted.
+ */
+static uint64_t _fx_log_recover(fx_mem_log_t *log) {
+	uint64_t offset = FX_MEM_LOG_DATA_OFFSET, last = offset;
+	uint32_t n_bytes, marker;
+	bool in_hole = false, has_holes = false;
+	while ((n_bytes = _fx_log_extent(log, offset, log->file_size, &marker))) {
+		if (_fx_log_complete(log, offset, marker)) {
+			has_holes = has_holes || in_hole;
+			last = offset + n_bytes;
+		} else if (marker == 0U || marker == FX_MEM_LOG_RECORD_MARKER ||
+		           marker == FX_MEM_LOG_PENDING_MARKER) {
+			in_hole = true;
+		} else if (marker != FX_MEM_LOG_ABORTED_MARKER) {
+			break; /* Not a record header */
+		}
+		offset += n_bytes;
+	}
+
+	for (offset = FX_MEM_LOG_DATA_OFFSET; has_holes && offset < last;
+	     offset += n_bytes) {
+		n_bytes = _fx_log_extent(log, offset, last, &marker);
+		if (marker != FX_MEM_LOG_ABORTED_MARKER &&
+		    !_fx_log_complete(log, offset, marker)) {
+			_fx_log_abort(log, offset, n_bytes - FX_ALIGN);
+		}
+	}
+	return last;
+}
+
+#endif /* FX_MEM_LOG_HAVE_MMAP */
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+#ifdef FX_MEM_LOG_HAVE_MMAP
+
+bool fx_mem_log_open(fx_mem_log_t *log, const char *path, uint64_t capacity) {
+	memset(log, 0, sizeof(fx_mem_log_t));
+	const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+	capacity = (capacity + page_size - 1U) & ~(page_size - 1U);
+	if (capacity < FX_MEM_LOG_DATA_OFFSET || capacity > (uint64_t)SIZE_MAX) {
+		return false;
+	}
+
+	log->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (log->fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(log->fd, &st) != 0 || (uint64_t)st.st_size > capacity ||
+	    (st.st_size > 0 && st.st_size < (off_t)FX_MEM_LOG_DATA_OFFSET)) {
+		goto err_close;
+	}
+	const bool created = st.st_size == 0;
+	if (created && ftruncate(log->fd, FX_MEM_LOG_DATA_OFFSET) != 0) {
+		goto err_close;
+	}
+
+	/* Reserve the address space for the entire capacity; only the part backed
+	   by the file may be accessed */
+	void *base =
+	    mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+	if (base == MAP_FAILED) {
+		goto err_close;
+	}
+	log->base = (uint8_t *)base;
+	log->capacity = capacity;
+	log->grow_step = FX_MEM_LOG_DEFAULT_GROW_STEP;
+	log->file_size = created ? FX_MEM_LOG_DATA_OFFSET : (uint64_t)st.st_size;
+
+	fx_mem_log_file_header_t *hdr = (fx_mem_log_file_header_t *)log->base;
+	if (created) {
+		hdr->magic = FX_MEM_LOG_MAGIC;
+		hdr->version = FX_MEM_LOG_VERSION;
+		hdr->align = FX_ALIGN;
+		if (msync(log->base, FX_MEM_LOG_DATA_OFFSET, MS_SYNC) != 0 ||
+		    !_fx_log_datasync(log->fd)) {
+			goto err_unmap;
+		}
+	} else if (hdr->magic != FX_MEM_LOG_MAGIC ||
+	           hdr->version != FX_MEM_LOG_VERSION || hdr->align != FX_ALIGN) {
+		goto err_unmap;
+	}
+
+	/* Discard everything after the last complete record. Truncating and
+	   re-extending the file zeroes the tail, so stale records cannot
+	   reappear once new records have been written in front of them. */
+	log->cursor = _fx_log_recover(log);
+	if (log->cursor < log->file_size) {
+		if (ftruncate(log->fd, (off_t)log->cursor) != 0 ||
+		    ftruncate(log->fd, (off_t)log->file_size) != 0 ||
+		    !_fx_log_datasync(log->fd)) {
+			goto err_unmap;
+		}
+	}
+	log->synced = log->cursor;
+	log->synced_file_size = log->file_size;
+	log->sync_ok = true;
+	return true;
+
+err_unmap:
+	munmap(log->base, capacity);
+err_close:
+	close(log->fd);
+	log->fd = -1;
+	log->base = NULL;
+	return false;
+}
+
+void fx_mem_log_close(fx_mem_log_t *log) {
+	if (!log->base) {
+		return;
+	}
+	fx_mem_log_sync(log);
+	uint64_t end = log->cursor;
+	if (end > log->file_size) {
+		end = log->file_size;
+	}
+	munmap(log->base, log->capacity);
+	if (ftruncate(log->fd, (off_t)end) == 0) {
+		_fx_log_datasync(log->fd);
+	}
+	close(log->fd);
+	log->fd = -1;
+	log->base = NULL;
+}
+
+void fx_mem_log_set_grow_step(fx_mem_log_t *log, uint64_t grow_step) {
+	log->grow_step = grow_step;
+}
+
+void fx_mem_log_set_batch_delay(fx_mem_log_t *log, uint32_t delay_us) {
+	log->batch_delay_ns = (uint64_t)delay_us * 1000U;
+}
+
+void *fx_mem_log_reserve(fx_mem_log_t *log, uint32_t length) {
+	const uint32_t n_bytes = fx_mem_record_size(length);
+	if (n_bytes == 0U) {
+		return NULL;
+	}
+	if (__atomic_load_n(&log->failed, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+	const uint64_t offset =
+	    __atomic_fetch_add(&log->cursor, n_bytes, __ATOMIC_RELAXED);
+	const uint64_t end = offset + n_bytes;
+	if (end > log->capacity ||
+	    (end > __atomic_load_n(&log->file_size, __ATOMIC_ACQUIRE) &&
+	     !_fx_log_grow(log, end))) {
+		/* The space has been taken from the cursor; mark it as aborted so
+		   that later records remain reachable. Without a header in the file,
+		   this is not possible, so stop accepting records. */
+		if (offset + FX_ALIGN <=
+		    __atomic_load_n(&log->file_size, __ATOMIC_ACQUIRE)) {
+			_fx_log_abort(log, offset, length);
+		} else {
+			__atomic_store_n(&log->failed, 1U, __ATOMIC_RELAXED);
+		}
+		return NULL;
+	}
+
+	/* The length is needed to skip the record until it is committed */
+	fx_mem_log_record_t *hdr = (fx_mem_log_record_t *)(log->base + offset);
+	hdr->length = length;
+	__atomic_store_n(&hdr->marker, FX_MEM_LOG_PENDING_MARKER, __ATOMIC_RELEASE);
+	return FX_ASSUME_ALIGNED(log->base + offset + FX_ALIGN);
+}
+
+void fx_mem_log_commit(fx_mem_log_t *log, void *payload) {
+	(void)log;
+	fx_mem_log_record_t *hdr =
+	    (fx_mem_log_record_t *)((uint8_t *)payload - FX_ALIGN);
+	hdr->checksum = _fx_log_checksum((const uint8_t *)payload, hdr->length);
+	__atomic_store_n(&hdr->marker, FX_MEM_LOG_RECORD_MARKER, __ATOMIC_RELEASE);
+}
+
+bool fx_mem_log_sync(fx_mem_log_t *log) {
+	_fx_log_lock(&log->sync_lock);
+	const bool ok = _fx_log_sync_run(log);
+	_fx_log_unlock(&log->sync_lock);
+	return ok;
+}
+
+bool fx_mem_log_wait_durable(fx_mem_log_t *log) {
+	/* Any sync numbered higher than the current one starts after this point
+	   and thus covers all records committed by the caller */
+	const uint32_t target =
+	    __atomic_load_n(&log->sync_started, __ATOMIC_SEQ_CST) + 1U;
+	while (true) {
+		if ((int32_t)(__atomic_load_n(&log->sync_completed, __ATOMIC_ACQUIRE) -
+		              target) >= 0) {
+			return __atomic_load_n(&log->sync_ok, __ATOMIC_RELAXED);
+		}
+		if (!__atomic_exchange_n(&log->sync_lock, 1U, __ATOMIC_ACQUIRE)) {
+			/* Another sync may have completed in the meantime */
+			if ((int32_t)(log->sync_completed - target) >= 0) {
+				const bool ok = log->sync_ok;
+				_fx_log_unlock(&log->sync_lock);
+				return ok;
+			}
+
+			/* Give other writers the chance to join the batch */
+			if (log->batch_delay_ns) {
+				struct timespec ts = {
+				    .tv_sec = (time_t)(log->batch_delay_ns / 1000000000U),
+				    .tv_nsec = (long)(log->batch_delay_ns % 1000000000U)};
+				nanosleep(&ts, NULL);
+			}
+
+			const bool ok = _fx_log_sync_run(log);
+			_fx_log_unlock(&log->sync_lock);
+			return ok;
+		}
+		sched_yield();
+	}
+}
+
+const void *fx_mem_log_next(const fx_mem_log_t *log, uint64_t *offset,
+                            uint32_t *length) {
+	if (*offset < FX_MEM_LOG_DATA_OFFSET) {
+		*offset = FX_MEM_LOG_DATA_OFFSET;
+	}
+	uint64_t end = __atomic_load_n(&log->file_size, __ATOMIC_ACQUIRE);
+	const uint64_t cursor = __atomic_load_n(&log->cursor, __ATOMIC_ACQUIRE);
+	if (cursor < end) {
+		end = cursor;
+	}
+	uint32_t n_bytes, marker;
+	while ((n_bytes = _fx_log_extent(log, *offset, end, &marker)) &&
+	       marker == FX_MEM_LOG_ABORTED_MARKER) {
+		*offset += n_bytes;
+	}
+	if (n_bytes == 0U || !_fx_log_complete(log, *offset, marker)) {
+		return NULL;
+	}
+	const uint8_t *payload = log->base + *offset + FX_ALIGN;
+	*length = ((const fx_mem_log_record_t *)(log->base + *offset))->length;
+	*offset += n_bytes;
+	return FX_ASSUME_ALIGNED(payload);
+}
+
+#else /* FX_MEM_LOG_HAVE_MMAP */
+
+bool fx_mem_log_open(fx_mem_log_t *log, const char *path, uint64_t capacity) {
+	return false;
+}
+
+void fx_mem_log_close(fx_mem_log_t *log) {}
+
+void fx_mem_log_set_grow_step(fx_mem_log_t *log, uint64_t grow_step) {}
+
+void fx_mem_log_set_batch_delay(fx_mem_log_t *log, uint32_t delay_us) {}
+
+void *fx_mem_log_reserve(fx_mem_log_t *log, uint32_t length) { return NULL; }
+
+void fx_mem_log_commit(fx_mem_log_t *log, void *payload) {}
+
+bool fx_mem_log_sync(fx_mem_log_t *log) { return false; }
+
+bool fx_mem_log_wait_durable(fx_mem_log_t *log) { return false; }
+
+const void *fx_mem_log_next(const fx_mem_log_t *log, uint64_t *offset,
+                            uint32_t *length) {
+	return NULL;
+}
+
+#endif /* FX_MEM_LOG_HAVE_MMAP */
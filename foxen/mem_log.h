@@ -0,0 +1,216 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_log.h
+ *
+ * Append-only log of aligned records in a memory-mapped file. Records use the
+ * layout of mem_record.h: a header in the first FX_ALIGN bytes followed by the
+ * aligned payload. Writers reserve space for a record with an atomic cursor,
+ * write the payload directly into the mapping, and commit the record, which
+ * stores its checksum. The file grows in steps as the cursor advances. A
+ * reservation that cannot be backed by the file is marked as aborted and
+ * skipped by readers.
+ *
+ * Durability is provided by group commit: fx_mem_log_wait_durable() returns
+ * once a sync that started after the call has completed. One of the waiting
+ * threads performs the msync()/fdatasync() for all of them; an optional delay
+ * lets more records join a batch. Alternatively, a background thread of the
+ * application may call fx_mem_log_sync() periodically.
+ *
+ * When a log is opened, it is scanned up to the last complete record; the
+ * remainder of the file is discarded. Records in front of it that were
+ * reserved but not committed before a crash, or whose payload is corrupted,
+ * are turned into aborted records, so later records that were already
+ * durable are not lost.
+ *
+ * Only available on POSIX systems.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_LOG_H
+#define FOXEN_MEM_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Magic number at the beginning of each log file ("FXML").
+ */
+#define FX_MEM_LOG_MAGIC 0x4C4D5846U
+
+/**
+ * Version of the log file format.
+ */
+#define FX_MEM_LOG_VERSION 1U
+
+/**
+ * Offset of the first record in the file.
+ */
+#define FX_MEM_LOG_DATA_OFFSET 64U
+
+/**
+ * Marker stored in the header of each committed record ("LOGR").
+ */
+#define FX_MEM_LOG_RECORD_MARKER 0x52474F4CU
+
+/**
+ * Marker stored in the header of a record that has been reserved, but not
+ * committed yet ("LOGP").
+ */
+#define FX_MEM_LOG_PENDING_MARKER 0x50474F4CU
+
+/**
+ * Marker stored in the header of a record that will never be committed
+ * ("LOGA").
+ */
+#define FX_MEM_LOG_ABORTED_MARKER 0x41474F4CU
+
+/**
+ * Header of a record in the log.
+ */
+typedef struct fx_mem_log_record {
+	uint32_t marker;
+	uint32_t length;
+	uint32_t checksum;
+	uint32_t _reserved;
+} fx_mem_log_record_t;
+
+/**
+ * Log state. Do not access the members directly.
+ */
+typedef struct fx_mem_log {
+	uint8_t *base;
+	uint64_t capacity;
+	uint64_t grow_step;
+	uint64_t batch_delay_ns;
+	int fd;
+
+	/* Reservation cursor, modified by all writers */
+	uint8_t _pad0[64];
+	uint64_t cursor;
+	uint8_t _pad1[64];
+
+	/* File size, extended while holding grow_lock */
+	uint32_t grow_lock;
+	uint64_t file_size;
+
+	/* Set once a reservation could neither be backed by the file nor be
+	   marked as aborted; further reservations fail */
+	uint32_t failed;
+
+	/* Group commit state, protected by sync_lock. All records in front of
+	   "synced" were committed or aborted before they were last flushed. */
+	uint32_t sync_lock;
+	uint32_t sync_started;
+	uint32_t sync_completed;
+	bool sync_ok;
+	uint64_t synced;
+	uint64_t synced_file_size;
+} fx_mem_log_t;
+
+/**
+ * Opens or creates a log file and recovers all complete records.
+ *
+ * @param log is the log structure that should be initialised.
+ * @param path is the path of the log file.
+ * @param capacity is the maximum size of the log file in bytes. The address
+ * space for the entire capacity is reserved upfront.
+ * @return false if the file could not be opened or is not a log file.
+ */
+bool fx_mem_log_open(fx_mem_log_t *log, const char *path, uint64_t capacity);
+
+/**
+ * Syncs and closes the log. The file is truncated to the end of the last
+ * record.
+ */
+void fx_mem_log_close(fx_mem_log_t *log);
+
+/**
+ * Sets the number of bytes by which the file is extended whenever a
+ * reservation reaches the end of the file. Defaults to 1 MiB.
+ */
+void fx_mem_log_set_grow_step(fx_mem_log_t *log, uint64_t grow_step);
+
+/**
+ * Sets the time in microseconds the thread performing a group commit waits for
+ * other records to join the batch. Defaults to zero.
+ */
+void fx_mem_log_set_batch_delay(fx_mem_log_t *log, uint32_t delay_us);
+
+/**
+ * Reserves space for a record. Thread-safe.
+ *
+ * @param log is the log.
+ * @param length is the length of the record payload in bytes.
+ * @return an aligned pointer at the payload in the mapped file, or NULL if the
+ * log is full or the file could not be extended. Once a failed reservation
+ * could not be marked as aborted, all further reservations fail until the log
+ * is reopened.
+ */
+void *fx_mem_log_reserve(fx_mem_log_t *log, uint32_t length);
+
+/**
+ * Marks a reserved record as complete after its payload has been written. The
+ * record is not durable until it has been synced.
+ *
+ * @param log is the log.
+ * @param payload is the pointer returned by fx_mem_log_reserve().
+ */
+void fx_mem_log_commit(fx_mem_log_t *log, void *payload);
+
+/**
+ * Writes all records reserved so far to disk. Records that are committed
+ * while the sync is in progress are written again by the next sync.
+ *
+ * @return false if msync() or fdatasync() failed.
+ */
+bool fx_mem_log_sync(fx_mem_log_t *log);
+
+/**
+ * Group commit. Waits until a sync that started after this call has been
+ * completed, i.e. all records committed by the calling thread before the call
+ * are durable. Performs the sync itself if no other thread is doing so.
+ *
+ * @return false if the sync failed.
+ */
+bool fx_mem_log_wait_durable(fx_mem_log_t *log);
+
+/**
+ * Iterates over the complete records in the log, skipping aborted records.
+ * Stops at the first record that has not been committed yet.
+ *
+ * @param log is the log.
+ * @param offset is a pointer at the iterator state; initialise it with zero.
+ * @param length receives the payload length of the record.
+ * @return a pointer at the payload of the next complete record or NULL if
+ * there are no further complete records.
+ */
+const void *fx_mem_log_next(const fx_mem_log_t *log, uint64_t *offset,
+                            uint32_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_LOG_H */
@@ -0,0 +1,145 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_record.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* Writes the header of a record that is known to fit into the buffer */
+static void *_fx_record_place(fx_mem_record_writer_t *writer, uint32_t length,
+                              uint32_t tag, uint32_t n_bytes) {
+	void *mem = writer->buf + writer->offset;
+	fx_mem_record_header_t *hdr = (fx_mem_record_header_t *)fx_mem_align_ex(
+	    &mem, sizeof(fx_mem_record_header_t), FX_ALIGN);
+	hdr->length = length;
+	hdr->tag = tag;
+	writer->offset += n_bytes;
+	return fx_mem_align_ex(&mem, length, FX_ALIGN);
+}
+
+/* Returns true if a record of n_bytes fits into the current buffer */
+static bool _fx_record_fits(const fx_mem_record_writer_t *writer,
+                            uint32_t n_bytes) {
+	return writer->buf && n_bytes <= writer->size - writer->offset;
+}
+
+/* Makes sure that a record of n_bytes fits into the current buffer, switching
+   to a new buffer if necessary. */
+static bool _fx_record_make_space(fx_mem_record_writer_t *writer,
+                                  uint32_t n_bytes) {
+	if (_fx_record_fits(writer, n_bytes)) {
+		return true;
+	}
+
+	/* Do not discard the current buffer if the record would not even fit into
+	   it when it was empty; buffers are assumed to have similar sizes */
+	if (writer->buf && n_bytes > writer->size) {
+		return false;
+	}
+	return fx_mem_record_flush(writer) && _fx_record_fits(writer, n_bytes);
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+void fx_mem_record_writer_init(fx_mem_record_writer_t *writer,
+                               fx_mem_record_buffer_callback_t callback,
+                               void *data) {
+	writer->buf = NULL;
+	writer->size = 0U;
+	writer->offset = 0U;
+	writer->callback = callback;
+	writer->callback_data = data;
+}
+
+void fx_mem_record_writer_set_buffer(fx_mem_record_writer_t *writer,
+                                     uint8_t *buf, uint32_t size) {
+	writer->buf = buf;
+	writer->size = size & ~(uint32_t)(FX_ALIGN - 1U);
+	writer->offset = 0U;
+}
+
+void *fx_mem_record_reserve_slow(fx_mem_record_writer_t *writer,
+                                 uint32_t length, uint32_t tag) {
+	const uint32_t n_bytes = fx_mem_record_size(length);
+	if (!n_bytes || length == FX_MEM_RECORD_END ||
+	    !_fx_record_make_space(writer, n_bytes)) {
+		return NULL;
+	}
+	return _fx_record_place(writer, length, tag, n_bytes);
+}
+
+uint32_t fx_mem_record_reserve_batch(fx_mem_record_writer_t *writer,
+                                     uint32_t n, const uint32_t *lengths,
+                                     const uint32_t *tags, void **payloads) {
+	/* Compute how many records fit into the current buffer at once, then
+	   write all headers in a single pass */
+	uint32_t n_fit = 0U, n_bytes_total = 0U;
+	for (uint32_t i = 0U; i < n; i++) {
+		const uint32_t n_bytes = fx_mem_record_size(lengths[i]);
+		if (!n_bytes || lengths[i] == FX_MEM_RECORD_END) {
+			break;
+		}
+		if (i == 0U && !_fx_record_make_space(writer, n_bytes)) {
+			return 0U;
+		}
+		if (n_bytes > writer->size - writer->offset - n_bytes_total) {
+			break;
+		}
+		n_bytes_total += n_bytes;
+		n_fit++;
+	}
+	for (uint32_t i = 0U; i < n_fit; i++) {
+		payloads[i] = _fx_record_place(writer, lengths[i], tags ? tags[i] : 0U,
+		                               fx_mem_record_size(lengths[i]));
+	}
+	return n_fit;
+}
+
+bool fx_mem_record_write(fx_mem_record_writer_t *writer, const void *data,
+                         uint32_t length, uint32_t tag) {
+	void *payload = fx_mem_record_reserve(writer, length, tag);
+	if (payload) {
+		memcpy(payload, data, length);
+	}
+	return payload != NULL;
+}
+
+bool fx_mem_record_flush(fx_mem_record_writer_t *writer) {
+	/* Terminate the current buffer if there is space for an end marker */
+	uint8_t *buf = writer->buf;
+	const uint32_t n_used = writer->offset;
+	if (buf && writer->size - n_used >= FX_ALIGN) {
+		fx_mem_record_header_t *hdr =
+		    (fx_mem_record_header_t *)FX_ASSUME_ALIGNED(buf + n_used);
+		hdr->length = FX_MEM_RECORD_END;
+		hdr->tag = 0U;
+	}
+
+	/* Hand the buffer to the callback, which sets the next buffer */
+	writer->buf = NULL;
+	writer->size = 0U;
+	writer->offset = 0U;
+	return writer->callback(writer, buf, n_used, writer->callback_data) &&
+	       writer->buf;
+}
@@ -0,0 +1,262 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_record.h
+ *
+ * Streams of variable-size records in contiguous buffers. Each record consists
+ * of a header holding the payload length and a user-defined tag, followed by
+ * the payload. Both the header and the payload are aligned at FX_ALIGN bytes,
+ * so the payload can be processed with aligned SIMD loads.
+ *
+ * The writer fills one buffer after another; whenever a buffer is full, it is
+ * terminated and handed to a user-provided callback that supplies the next
+ * buffer. The reader walks the records of a single buffer in place.
+ *
+ * Writers are not thread-safe; use one writer per thread.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_RECORD_H
+#define FOXEN_MEM_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Length value marking the end of the records in a buffer.
+ */
+#define FX_MEM_RECORD_END 0xFFFFFFFFU
+
+/**
+ * Number of bytes the reader prefetches ahead of the current record.
+ */
+#define FX_MEM_RECORD_PREFETCH 512U
+
+/**
+ * Record header. Occupies FX_ALIGN bytes in the buffer.
+ */
+typedef struct fx_mem_record_header {
+	uint32_t length;
+	uint32_t tag;
+} fx_mem_record_header_t;
+
+struct fx_mem_record_writer;
+
+/**
+ * Callback invoked by the writer when the current buffer is full or flushed.
+ *
+ * @param writer is the writer.
+ * @param buf is the buffer that was filled, or NULL if the writer does not
+ * have a buffer yet.
+ * @param n_used is the number of bytes used in buf.
+ * @param data is the user-defined pointer passed to
+ * fx_mem_record_writer_init().
+ * @return false if no further buffer is available; otherwise the callback must
+ * call fx_mem_record_writer_set_buffer() with the next buffer.
+ */
+typedef bool (*fx_mem_record_buffer_callback_t)(
+    struct fx_mem_record_writer *writer, uint8_t *buf, uint32_t n_used,
+    void *data);
+
+/**
+ * Writer state.
+ */
+typedef struct fx_mem_record_writer {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t offset;
+	fx_mem_record_buffer_callback_t callback;
+	void *callback_data;
+} fx_mem_record_writer_t;
+
+/**
+ * Reader state.
+ */
+typedef struct fx_mem_record_reader {
+	const uint8_t *buf;
+	uint32_t size;
+	uint32_t offset;
+} fx_mem_record_reader_t;
+
+/**
+ * Returns the number of bytes occupied by a record with the given payload
+ * length, including the header and the padding.
+ */
+static inline uint32_t fx_mem_record_size(uint32_t length) {
+	uint32_t size = 0U; /* Buffers are aligned, no fx_mem_init_size() */
+	bool ok = length <= 0xFFFFFFFFU - 2U * FX_ALIGN &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_record_header_t)) &&
+	          fx_mem_update_size(&size, length);
+	return ok ? size : 0U;
+}
+
+/**
+ * Initialises a writer. The first buffer is requested from the callback when
+ * the first record is written.
+ *
+ * @param writer is the writer that should be initialised.
+ * @param callback is the function supplying new buffers.
+ * @param data is a user-defined pointer passed to the callback.
+ */
+void fx_mem_record_writer_init(fx_mem_record_writer_t *writer,
+                               fx_mem_record_buffer_callback_t callback,
+                               void *data);
+
+/**
+ * Sets the buffer the writer should write to. Must be called from the buffer
+ * callback.
+ *
+ * @param writer is the writer.
+ * @param buf is the new buffer. Must be aligned at FX_ALIGN bytes.
+ * @param size is the size of the buffer in bytes.
+ */
+void fx_mem_record_writer_set_buffer(fx_mem_record_writer_t *writer,
+                                     uint8_t *buf, uint32_t size);
+
+/**
+ * Slow path of fx_mem_record_reserve(), switches to the next buffer. Do not
+ * call this function directly.
+ */
+void *fx_mem_record_reserve_slow(fx_mem_record_writer_t *writer,
+                                 uint32_t length, uint32_t tag);
+
+/**
+ * Reserves space for a record and writes its header. The payload must be
+ * written before the buffer is flushed.
+ *
+ * @param writer is the writer.
+ * @param length is the length of the payload in bytes.
+ * @param tag is a user-defined tag stored in the record header.
+ * @return an aligned pointer at the payload, or NULL if the record is larger
+ * than the current buffer or no further buffer is available.
+ */
+static inline void *fx_mem_record_reserve(fx_mem_record_writer_t *writer,
+                                          uint32_t length, uint32_t tag) {
+	const uint32_t n_bytes = fx_mem_record_size(length);
+	if (n_bytes && writer->buf && n_bytes <= writer->size - writer->offset &&
+	    length != FX_MEM_RECORD_END) {
+		void *mem = writer->buf + writer->offset;
+		fx_mem_record_header_t *hdr =
+		    (fx_mem_record_header_t *)fx_mem_align_ex(
+		        &mem, sizeof(fx_mem_record_header_t), FX_ALIGN);
+		void *payload = fx_mem_align_ex(&mem, length, FX_ALIGN);
+		hdr->length = length;
+		hdr->tag = tag;
+		writer->offset += n_bytes;
+		return payload;
+	}
+	return fx_mem_record_reserve_slow(writer, length, tag);
+}
+
+/**
+ * Reserves space for multiple records at once. All records are placed in the
+ * current buffer; if not all of them fit, only a prefix is reserved and the
+ * caller should call this function again for the remaining records.
+ *
+ * @param writer is the writer.
+ * @param n is the number of records.
+ * @param lengths is an array containing the payload length of each record.
+ * @param tags is an array containing the tag of each record. May be NULL, in
+ * which case the tags are set to zero.
+ * @param payloads is an array receiving the payload pointers.
+ * @return the number of reserved records. Zero if the first record does not
+ * fit into the current buffer when empty, or no further buffer is available.
+ */
+uint32_t fx_mem_record_reserve_batch(fx_mem_record_writer_t *writer,
+                                     uint32_t n, const uint32_t *lengths,
+                                     const uint32_t *tags, void **payloads);
+
+/**
+ * Reserves space for a record and copies the given payload into it.
+ *
+ * @return false if the record could not be written.
+ */
+bool fx_mem_record_write(fx_mem_record_writer_t *writer, const void *data,
+                         uint32_t length, uint32_t tag);
+
+/**
+ * Terminates the current buffer and passes it to the callback, which supplies
+ * the next buffer.
+ *
+ * @return false if the callback did not supply a new buffer.
+ */
+bool fx_mem_record_flush(fx_mem_record_writer_t *writer);
+
+/**
+ * Initialises a reader for the records in the given buffer.
+ *
+ * @param reader is the reader that should be initialised.
+ * @param buf is the buffer. Must be aligned at FX_ALIGN bytes.
+ * @param size is the number of valid bytes in the buffer, e.g. the n_used
+ * value passed to the buffer callback.
+ */
+static inline void fx_mem_record_reader_init(fx_mem_record_reader_t *reader,
+                                             const uint8_t *buf,
+                                             uint32_t size) {
+	reader->buf = buf;
+	reader->size = size;
+	reader->offset = 0U;
+}
+
+/**
+ * Returns the next record of the buffer. Records are not copied.
+ *
+ * @param reader is the reader.
+ * @param length receives the payload length.
+ * @param tag if not NULL, receives the tag of the record.
+ * @return an aligned pointer at the payload, or NULL if there are no further
+ * records. Records with a length exceeding the buffer end the stream as well.
+ */
+static inline const void *fx_mem_record_next(fx_mem_record_reader_t *reader,
+                                             uint32_t *length, uint32_t *tag) {
+	const uint32_t offset = reader->offset;
+	if (reader->size < FX_ALIGN || offset > reader->size - FX_ALIGN) {
+		return NULL;
+	}
+	const fx_mem_record_header_t *hdr =
+	    (const fx_mem_record_header_t *)FX_ASSUME_ALIGNED(reader->buf + offset);
+	const uint32_t n_bytes = fx_mem_record_size(hdr->length);
+	if (hdr->length == FX_MEM_RECORD_END || n_bytes == 0U ||
+	    n_bytes > reader->size - offset) {
+		return NULL;
+	}
+	reader->offset = offset + n_bytes;
+#ifdef __GNUC__
+	__builtin_prefetch(reader->buf + reader->offset + FX_MEM_RECORD_PREFETCH);
+#endif
+	*length = hdr->length;
+	if (tag) {
+		*tag = hdr->tag;
+	}
+	return FX_ASSUME_ALIGNED(reader->buf + offset + FX_ALIGN);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_RECORD_H */
@@ -0,0 +1,315 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memfd_create(), mremap() */
+#endif
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define FX_MEM_REGION_HAVE_MMAP
+#endif
+
+#include <string.h>
+
+#include <foxen/mem_region.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#ifdef FX_MEM_REGION_HAVE_MMAP
+
+static int _fx_region_open_fd(void) {
+#ifdef __linux__
+	return memfd_create("fx_mem_region", MFD_CLOEXEC);
+#else
+	static uint32_t counter = 0U;
+	char name[64];
+	snprintf(name, sizeof(name), "/fx_mem_region_%d_%u", (int)getpid(),
+	         __atomic_fetch_add(&counter, 1U, __ATOMIC_RELAXED));
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) {
+		shm_unlink(name);
+	}
+	return fd;
+#endif
+}
+
+static bool _fx_region_round(size_t *size, size_t align) {
+	if (*size == 0U || *size > SIZE_MAX - align) {
+		return false;
+	}
+	*size = (*size + align - 1U) & ~(align - 1U);
+	return true;
+}
+
+/* Reserves an inaccessible range of the given size and alignment; the range
+   is subsequently replaced with MAP_FIXED or MREMAP_FIXED */
+static uint8_t *_fx_region_reserve(size_t size, size_t align) {
+	const size_t n_extra = align - (size_t)sysconf(_SC_PAGESIZE);
+	if (size > SIZE_MAX - n_extra) {
+		return NULL;
+	}
+	uint8_t *res = (uint8_t *)mmap(NULL, size + n_extra, PROT_NONE,
+	                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (res == (uint8_t *)MAP_FAILED) {
+		return NULL;
+	}
+	uint8_t *base =
+	    (uint8_t *)(((uintptr_t)res + align - 1U) & ~(uintptr_t)(align - 1U));
+	if (base > res) {
+		munmap(res, (size_t)(base - res));
+	}
+	if (res + n_extra > base) {
+		munmap(base + size, (size_t)(res + n_extra - base));
+	}
+	return base;
+}
+
+static void _fx_region_advise(uint8_t *base, size_t size, size_t align) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (align >= FX_MEM_REGION_HUGE_PAGE) {
+		madvise(base, size, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+/* Returns the new base address of the grown mapping or NULL; the file of a
+   file-backed region has already been extended */
+static uint8_t *_fx_region_remap(fx_mem_region_t *region, size_t size) {
+#ifdef __linux__
+	/* Page tables are moved; the data is never copied */
+	void *base = MAP_FAILED;
+	if (region->align <= (size_t)sysconf(_SC_PAGESIZE)) {
+		base = mremap(region->base, region->size, size, MREMAP_MAYMOVE);
+		return base == MAP_FAILED ? NULL : (uint8_t *)base;
+	}
+	base = mremap(region->base, region->size, size, 0);
+	if (base != MAP_FAILED) {
+		return (uint8_t *)base;
+	}
+	uint8_t *target = _fx_region_reserve(size, region->align);
+	if (!target) {
+		return NULL;
+	}
+	base = mremap(region->base, region->size, size,
+	              MREMAP_MAYMOVE | MREMAP_FIXED, target);
+	if (base == MAP_FAILED) {
+		munmap(target, size);
+		return NULL;
+	}
+	return (uint8_t *)base;
+#else
+	/* File-backed regions are mapped again; anonymous regions are copied */
+	uint8_t *target = _fx_region_reserve(size, region->align);
+	if (!target) {
+		return NULL;
+	}
+	void *base;
+	if (region->fd >= 0) {
+		base = mmap(target, size, PROT_READ | PROT_WRITE,
+		            MAP_SHARED | MAP_FIXED, region->fd, 0);
+	} else {
+		base = mmap(target, size, PROT_READ | PROT_WRITE,
+		            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		if (base != MAP_FAILED) {
+			memcpy(base, region->base, region->size);
+		}
+	}
+	if (base == MAP_FAILED) {
+		munmap(target, size);
+		return NULL;
+	}
+	munmap(region->base, region->size);
+	return (uint8_t *)base;
+#endif
+}
+
+#endif /* FX_MEM_REGION_HAVE_MMAP */
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+#ifdef FX_MEM_REGION_HAVE_MMAP
+
+bool fx_mem_region_create(fx_mem_region_t *region, size_t size) {
+	memset(region, 0, sizeof(fx_mem_region_t));
+	region->fd = -1;
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	if (!_fx_region_round(&size, page_size)) {
+		return false;
+	}
+
+	const int fd = _fx_region_open_fd();
+	if (fd < 0) {
+		return false;
+	}
+	void *base = MAP_FAILED;
+	if (ftruncate(fd, (off_t)size) == 0) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if (base == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	region->base = (uint8_t *)base;
+	region->size = size;
+	region->align = page_size;
+	region->fd = fd;
+	region->growable = true;
+	return true;
+}
+
+bool fx_mem_region_create_anon(fx_mem_region_t *region, size_t size,
+                               size_t align) {
+	memset(region, 0, sizeof(fx_mem_region_t));
+	region->fd = -1;
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	if (align < page_size) {
+		align = page_size;
+	}
+	if ((align & (align - 1U)) || !_fx_region_round(&size, align)) {
+		return false;
+	}
+
+	uint8_t *base = _fx_region_reserve(size, align);
+	if (!base) {
+		return false;
+	}
+	if (mmap(base, size, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		munmap(base, size);
+		return false;
+	}
+	_fx_region_advise(base, size, align);
+	region->base = base;
+	region->size = size;
+	region->align = align;
+	region->growable = true;
+	return true;
+}
+
+bool fx_mem_region_grow(fx_mem_region_t *region, size_t size,
+                        fx_mem_region_move_cb cb, void *data) {
+	if (!region->growable) {
+		return false;
+	}
+	if (size <= region->size) {
+		return true;
+	}
+	if (!_fx_region_round(&size, region->align)) {
+		return false;
+	}
+
+	/* A file that was extended but could not be remapped is harmless; the
+	   additional pages are never touched */
+	if (region->fd >= 0 && ftruncate(region->fd, (off_t)size) != 0) {
+		return false;
+	}
+	uint8_t *base = _fx_region_remap(region, size);
+	if (!base) {
+		return false;
+	}
+	_fx_region_advise(base, size, region->align);
+
+	const uint8_t *old_base = region->base;
+	region->base = base;
+	region->size = size;
+	if (base != old_base && cb) {
+		cb(data, region, old_base);
+	}
+	return true;
+}
+
+bool fx_mem_region_freeze(fx_mem_region_t *region) {
+	return mprotect(region->base, region->size, PROT_READ) == 0;
+}
+
+bool fx_mem_region_clone(const fx_mem_region_t *src, fx_mem_region_t *clone) {
+	memset(clone, 0, sizeof(fx_mem_region_t));
+	clone->fd = -1;
+	if (src->fd < 0) {
+		return false;
+	}
+
+	/* Page faults on the private mapping read from the shared file; the first
+	   write to a page copies it */
+	void *base =
+	    mmap(NULL, src->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, src->fd, 0);
+	if (base == MAP_FAILED) {
+		return false;
+	}
+	clone->base = (uint8_t *)base;
+	clone->size = src->size;
+	clone->align = src->align;
+	return true;
+}
+
+void fx_mem_region_destroy(fx_mem_region_t *region) {
+	if (region->base) {
+		munmap(region->base, region->size);
+	}
+	if (region->fd >= 0) {
+		close(region->fd);
+	}
+	memset(region, 0, sizeof(fx_mem_region_t));
+	region->fd = -1;
+}
+
+#else /* FX_MEM_REGION_HAVE_MMAP */
+
+bool fx_mem_region_create(fx_mem_region_t *region, size_t size) {
+	memset(region, 0, sizeof(fx_mem_region_t));
+	region->fd = -1;
+	return false;
+}
+
+bool fx_mem_region_create_anon(fx_mem_region_t *region, size_t size,
+                               size_t align) {
+	memset(region, 0, sizeof(fx_mem_region_t));
+	region->fd = -1;
+	return false;
+}
+
+bool fx_mem_region_grow(fx_mem_region_t *region, size_t size,
+                        fx_mem_region_move_cb cb, void *data) {
+	return false;
+}
+
+bool fx_mem_region_freeze(fx_mem_region_t *region) { return false; }
+
+bool fx_mem_region_clone(const fx_mem_region_t *src, fx_mem_region_t *clone) {
+	memset(clone, 0, sizeof(fx_mem_region_t));
+	clone->fd = -1;
+	return false;
+}
+
+void fx_mem_region_destroy(fx_mem_region_t *region) {}
+
+#endif /* FX_MEM_REGION_HAVE_MMAP */
@@ -0,0 +1,176 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_region.h
+ *
+ * Page-aligned memory regions backed by an anonymous file (a memfd on Linux,
+ * an unlinked POSIX shared memory object elsewhere). Build a datastructure in
+ * a region with the usual fx_mem_align() pattern, freeze it, and create
+ * copy-on-write clones of it with fx_mem_region_clone(). Cloning maps the
+ * file privately and takes constant time independent of the region size;
+ * only the pages a clone modifies are copied.
+ *
+ * A clone is placed at a different address than its source. Datastructures
+ * that should be cloned must therefore either store relative pointers (see
+ * mem_rptr.h) or translate absolute pointers with fx_mem_region_rebase().
+ *
+ * Regions can grow with fx_mem_region_grow(). On Linux, the mapping is
+ * extended in place or moved with mremap() without copying any data; file
+ * backed regions are remapped after extending the file on other systems.
+ * Anonymous regions created with fx_mem_region_create_anon() may request an
+ * alignment up to the huge page size, which is preserved when moving.
+ *
+ * Only available on POSIX systems.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_REGION_H
+#define FOXEN_MEM_REGION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size of a huge page on common systems; pass as alignment to
+ * fx_mem_region_create_anon() to allow the kernel to back the region with
+ * huge pages.
+ */
+#define FX_MEM_REGION_HUGE_PAGE (2U * 1024U * 1024U)
+
+/**
+ * Memory region. Do not modify the members directly.
+ */
+typedef struct fx_mem_region {
+	uint8_t *base;
+	size_t size;
+	size_t align;
+	int fd; /* -1 for clones and anonymous regions */
+	bool growable;
+} fx_mem_region_t;
+
+/**
+ * Callback invoked by fx_mem_region_grow() after the region moved to a new
+ * address. Use fx_mem_region_relocate() to re-derive absolute pointers into
+ * the region.
+ *
+ * @param data is the user-defined pointer passed to fx_mem_region_grow().
+ * @param region is the region at its new address.
+ * @param old_base is the previous base address; must not be dereferenced.
+ */
+typedef void (*fx_mem_region_move_cb)(void *data,
+                                      const fx_mem_region_t *region,
+                                      const uint8_t *old_base);
+
+/**
+ * Creates a zero-initialised region of the given size.
+ *
+ * @param region is the region that should be initialised.
+ * @param size is the size in bytes. Rounded up to a multiple of the page size.
+ * @return false if the region could not be created.
+ */
+bool fx_mem_region_create(fx_mem_region_t *region, size_t size);
+
+/**
+ * Creates a zero-initialised region backed by anonymous memory. Anonymous
+ * regions cannot be cloned.
+ *
+ * @param region is the region that should be initialised.
+ * @param size is the size in bytes. Rounded up to a multiple of the alignment.
+ * @param align is the alignment of the region; a power of two. Values smaller
+ * than the page size select the page size. On Linux, an alignment of at least
+ * FX_MEM_REGION_HUGE_PAGE advises the kernel to use transparent huge pages.
+ * @return false if the region could not be created.
+ */
+bool fx_mem_region_create_anon(fx_mem_region_t *region, size_t size,
+                               size_t align);
+
+/**
+ * Grows a region to the given size, keeping its contents and its alignment.
+ * The additional memory is zero-initialised. Clones cannot grow; growing a
+ * source does not affect the size of existing clones.
+ *
+ * @param region is the region that should grow. Must not be frozen.
+ * @param size is the new size in bytes. Rounded up to a multiple of the
+ * alignment. Sizes not larger than the current size are ignored.
+ * @param cb is invoked if the region moved. May be NULL.
+ * @param data is passed to the callback.
+ * @return false if the region could not grow; the region remains valid at its
+ * previous size.
+ */
+bool fx_mem_region_grow(fx_mem_region_t *region, size_t size,
+                        fx_mem_region_move_cb cb, void *data);
+
+/**
+ * Write-protects the region. Modifications of a region after it has been
+ * cloned become visible in the clones on pages the clones did not modify yet;
+ * freezing the source turns such modifications into a fault.
+ *
+ * @return false if the protection could not be changed.
+ */
+bool fx_mem_region_freeze(fx_mem_region_t *region);
+
+/**
+ * Creates a copy-on-write clone of a region created with
+ * fx_mem_region_create(). The clone is writable, even if the source is
+ * frozen. Clones cannot be cloned again. The source may be destroyed before
+ * its clones.
+ *
+ * @param src is the region that should be cloned.
+ * @param clone is the region receiving the clone.
+ * @return false if the source is a clone, an anonymous region, or the
+ * mapping failed.
+ */
+bool fx_mem_region_clone(const fx_mem_region_t *src, fx_mem_region_t *clone);
+
+/**
+ * Unmaps the region and releases the backing file.
+ */
+void fx_mem_region_destroy(fx_mem_region_t *region);
+
+/**
+ * Translates a pointer into one region into the corresponding pointer into
+ * another region, e.g. from a source into its clone.
+ */
+static inline void *fx_mem_region_rebase(const fx_mem_region_t *from,
+                                         const fx_mem_region_t *to,
+                                         const void *ptr) {
+	return ptr ? to->base + ((const uint8_t *)ptr - from->base) : NULL;
+}
+
+/**
+ * Translates a pointer into a region before it was moved by
+ * fx_mem_region_grow() into the corresponding pointer after the move.
+ */
+static inline void *fx_mem_region_relocate(const uint8_t *old_base,
+                                           const fx_mem_region_t *region,
+                                           const void *ptr) {
+	return ptr ? region->base + ((const uint8_t *)ptr - old_base) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_REGION_H */
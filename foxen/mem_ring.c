@@ -0,0 +1,153 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memfd_create() */
+#endif
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define FX_MEM_RING_HAVE_MMAP
+#endif
+
+#include <string.h>
+
+#include <foxen/mem_ring.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#ifdef FX_MEM_RING_HAVE_MMAP
+
+/**
+ * Returns an anonymous file descriptor for the ring memory.
+ */
+static int _fx_ring_open_fd(void) {
+#ifdef __linux__
+	return memfd_create("fx_mem_ring", MFD_CLOEXEC);
+#else
+	/* Create a uniquely named shared memory object and unlink it right away */
+	static uint32_t counter = 0U;
+	char name[64];
+	snprintf(name, sizeof(name), "/fx_mem_ring_%d_%u", (int)getpid(),
+	         __atomic_fetch_add(&counter, 1U, __ATOMIC_RELAXED));
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) {
+		shm_unlink(name);
+	}
+	return fd;
+#endif
+}
+
+#endif /* FX_MEM_RING_HAVE_MMAP */
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+#ifdef FX_MEM_RING_HAVE_MMAP
+
+bool fx_mem_ring_init(fx_mem_ring_t *ring, size_t capacity) {
+	memset(ring, 0, sizeof(fx_mem_ring_t));
+
+	/* Round the capacity up to a power of two of at least one page */
+	size_t size = (size_t)sysconf(_SC_PAGESIZE);
+	while (size < capacity) {
+		if (size > (SIZE_MAX >> 2U)) {
+			return false;
+		}
+		size *= 2U;
+	}
+
+	const int fd = _fx_ring_open_fd();
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return false;
+	}
+
+	/* Reserve twice the capacity, then map the file into both halves */
+	uint8_t *base = (uint8_t *)mmap(NULL, 2U * size, PROT_NONE,
+	                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	for (size_t i = 0U; i < 2U; i++) {
+		if (mmap(base + i * size, size, PROT_READ | PROT_WRITE,
+		         MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(base, 2U * size);
+			close(fd);
+			return false;
+		}
+	}
+	close(fd); /* The mappings keep the memory alive */
+
+	ring->base = base;
+	ring->capacity = size;
+	ring->mask = size - 1U;
+	return true;
+}
+
+void fx_mem_ring_destroy(fx_mem_ring_t *ring) {
+	if (ring->base) {
+		munmap(ring->base, 2U * ring->capacity);
+		ring->base = NULL;
+	}
+}
+
+void fx_mem_ring_mp_commit_slow(fx_mem_ring_t *ring, uint64_t pos,
+                                size_t n_bytes) {
+	/* The producer of a preceding window may have been preempted between
+	   reserving and committing; spin for a while, then yield the CPU */
+	uint32_t n_spins = 0U;
+	while (__atomic_load_n(&ring->head_commit, __ATOMIC_ACQUIRE) != pos) {
+		if (++n_spins >= 256U) {
+			sched_yield();
+			n_spins = 0U;
+		}
+	}
+	__atomic_store_n(&ring->head_commit, pos + n_bytes, __ATOMIC_RELEASE);
+}
+
+#else /* FX_MEM_RING_HAVE_MMAP */
+
+bool fx_mem_ring_init(fx_mem_ring_t *ring, size_t capacity) {
+	memset(ring, 0, sizeof(fx_mem_ring_t));
+	return false;
+}
+
+void fx_mem_ring_destroy(fx_mem_ring_t *ring) {}
+
+void fx_mem_ring_mp_commit_slow(fx_mem_ring_t *ring, uint64_t pos,
+                                size_t n_bytes) {}
+
+#endif /* FX_MEM_RING_HAVE_MMAP */
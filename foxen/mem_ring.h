@@ -0,0 +1,191 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_ring.h
+ *
+ * Byte ring buffer whose memory is mapped twice back-to-back. Any window of up
+ * to the capacity starting anywhere in the ring is contiguous in virtual
+ * memory, so records straddling the wrap point can be written and parsed in
+ * place without being split or copied.
+ *
+ * Positions are 64-bit byte counters that never wrap in practice. The ring
+ * supports a single consumer and either a single producer (fx_mem_ring_write_*)
+ * or multiple producers (fx_mem_ring_mp_*); the two producer APIs must not be
+ * mixed on the same ring. The producer and consumer cursors reside in separate
+ * cache lines.
+ *
+ * Only available on POSIX systems. On Linux the memory is backed by a memfd,
+ * elsewhere by an unlinked POSIX shared memory object.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_RING_H
+#define FOXEN_MEM_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Ring buffer state. Do not access the members directly.
+ */
+typedef struct fx_mem_ring {
+	uint8_t *base;
+	uint64_t capacity;
+	uint64_t mask;
+
+	/* Producer cursor; written by the producers */
+	uint8_t _pad0[64];
+	uint64_t head;
+	uint8_t _pad1[64];
+
+	/* End of the data visible to the consumer */
+	uint64_t head_commit;
+	uint8_t _pad2[64];
+
+	/* Consumer cursor; written by the consumer */
+	uint64_t tail;
+	uint8_t _pad3[64];
+} fx_mem_ring_t;
+
+/**
+ * Creates a ring buffer.
+ *
+ * @param ring is the ring that should be initialised.
+ * @param capacity is the minimum capacity in bytes. It is rounded up to a
+ * power of two that is at least the page size.
+ * @return false if the memory could not be mapped.
+ */
+bool fx_mem_ring_init(fx_mem_ring_t *ring, size_t capacity);
+
+/**
+ * Unmaps the memory of a ring buffer.
+ */
+void fx_mem_ring_destroy(fx_mem_ring_t *ring);
+
+/**
+ * Returns a pointer at the ring memory for the given position. The following
+ * ring->capacity bytes are contiguous.
+ */
+static inline uint8_t *fx_mem_ring_ptr(const fx_mem_ring_t *ring,
+                                       uint64_t pos) {
+	return ring->base + (pos & ring->mask);
+}
+
+/**
+ * Single producer. Returns a contiguous window of n_bytes the producer may
+ * write to, or NULL if there is not enough free space.
+ */
+static inline void *fx_mem_ring_write_begin(fx_mem_ring_t *ring,
+                                            size_t n_bytes) {
+	const uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (n_bytes > ring->capacity - (ring->head - tail)) {
+		return NULL;
+	}
+	return fx_mem_ring_ptr(ring, ring->head);
+}
+
+/**
+ * Single producer. Publishes n_bytes written to the window returned by
+ * fx_mem_ring_write_begin().
+ */
+static inline void fx_mem_ring_write_end(fx_mem_ring_t *ring, size_t n_bytes) {
+	ring->head += n_bytes;
+	__atomic_store_n(&ring->head_commit, ring->head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Multiple producers. Reserves a contiguous window of n_bytes.
+ *
+ * @param ring is the ring.
+ * @param n_bytes is the size of the window.
+ * @param pos receives the position of the window, which must be passed to
+ * fx_mem_ring_mp_commit().
+ * @return a pointer at the window or NULL if there is not enough free space.
+ */
+static inline void *fx_mem_ring_mp_reserve(fx_mem_ring_t *ring, size_t n_bytes,
+                                           uint64_t *pos) {
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	do {
+		const uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if (n_bytes > ring->capacity - (head - tail)) {
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&ring->head, &head, head + n_bytes,
+	                                      true, __ATOMIC_RELAXED,
+	                                      __ATOMIC_RELAXED));
+	*pos = head;
+	return fx_mem_ring_ptr(ring, head);
+}
+
+/**
+ * Slow path of fx_mem_ring_mp_commit(), waits for the preceding windows to be
+ * published. Do not call this function directly.
+ */
+void fx_mem_ring_mp_commit_slow(fx_mem_ring_t *ring, uint64_t pos,
+                                size_t n_bytes);
+
+/**
+ * Multiple producers. Publishes a window reserved with
+ * fx_mem_ring_mp_reserve(). Windows are published in the order they were
+ * reserved; this function waits until all preceding windows are published.
+ */
+static inline void fx_mem_ring_mp_commit(fx_mem_ring_t *ring, uint64_t pos,
+                                         size_t n_bytes) {
+	/* Acquire the windows of the preceding producers; the release store below
+	   then publishes them together with this window */
+	if (__atomic_load_n(&ring->head_commit, __ATOMIC_ACQUIRE) != pos) {
+		fx_mem_ring_mp_commit_slow(ring, pos, n_bytes);
+		return;
+	}
+	__atomic_store_n(&ring->head_commit, pos + n_bytes, __ATOMIC_RELEASE);
+}
+
+/**
+ * Consumer. Returns a contiguous window containing all published bytes.
+ *
+ * @param ring is the ring.
+ * @param n_avail receives the number of readable bytes.
+ * @return a pointer at the first unread byte.
+ */
+static inline const void *fx_mem_ring_read_begin(fx_mem_ring_t *ring,
+                                                 size_t *n_avail) {
+	const uint64_t head = __atomic_load_n(&ring->head_commit, __ATOMIC_ACQUIRE);
+	*n_avail = (size_t)(head - ring->tail);
+	return fx_mem_ring_ptr(ring, ring->tail);
+}
+
+/**
+ * Consumer. Releases n_bytes at the beginning of the readable window to the
+ * producers.
+ */
+static inline void fx_mem_ring_read_end(fx_mem_ring_t *ring, size_t n_bytes) {
+	__atomic_store_n(&ring->tail, ring->tail + n_bytes, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_RING_H */
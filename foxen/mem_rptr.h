@@ -0,0 +1,140 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_rptr.h
+ *
+ * 32-bit pointers relative to the base of a memory region. Data structures
+ * laid out with fx_mem_align() usually live in a single region smaller than
+ * 4 GiB; storing relative pointers instead of absolute pointers halves the
+ * size of pointer fields on 64-bit platforms and keeps the structure valid
+ * when the region is copied, mapped at a different address, or shared
+ * between processes.
+ *
+ * The region base is typically the address of the outer structure itself.
+ * Offset zero encodes NULL, hence the base address itself cannot be
+ * referenced by a relative pointer.
+ *
+ * Example (compare with the complex_matrix example in the README):
+ *
+ *     struct complex_matrix {
+ *         uint16_t w, h;
+ *         fx_mem_rptr_t real, imag;
+ *     };
+ *
+ *     mat->real = fx_mem_align_rptr(mat, &mem, n_bytes);
+ *     float *real = FX_MEM_RPTR_DECODE(float, mat, mat->real);
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_RPTR_H
+#define FOXEN_MEM_RPTR_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Relative pointer type, an offset in bytes from the region base.
+ */
+typedef uint32_t fx_mem_rptr_t;
+
+/**
+ * Relative pointer value representing NULL.
+ */
+#define FX_MEM_RPTR_NULL 0U
+
+/**
+ * Returns true if ptr can be encoded as a relative pointer with respect to
+ * the given base, i.e. if ptr is NULL or lies between one and 2^32 - 1 bytes
+ * after the base.
+ */
+static inline bool fx_mem_rptr_in_range(const void *base, const void *ptr) {
+	const uintptr_t offs = (uintptr_t)ptr - (uintptr_t)base;
+	return !ptr || (offs > 0U && offs <= 0xFFFFFFFFU);
+}
+
+/**
+ * Converts an absolute pointer into a relative pointer.
+ *
+ * @param base is the base address of the memory region.
+ * @param ptr is the pointer that should be converted. Must be NULL or point
+ * at an address within the first 4 GiB after base, excluding base itself.
+ * @return the relative pointer.
+ */
+static inline fx_mem_rptr_t fx_mem_rptr_encode(const void *base,
+                                               const void *ptr) {
+	assert(fx_mem_rptr_in_range(base, ptr));
+	return ptr ? (fx_mem_rptr_t)((uintptr_t)ptr - (uintptr_t)base)
+	           : FX_MEM_RPTR_NULL;
+}
+
+/**
+ * Converts a relative pointer into an absolute pointer.
+ *
+ * @param base is the base address of the memory region.
+ * @param rptr is the relative pointer.
+ * @return the absolute pointer or NULL if rptr is FX_MEM_RPTR_NULL.
+ */
+static inline void *fx_mem_rptr_decode(const void *base, fx_mem_rptr_t rptr) {
+	return rptr ? (void *)((uintptr_t)base + rptr) : NULL;
+}
+
+/**
+ * Same as fx_mem_rptr_decode(), but assumes that rptr is not
+ * FX_MEM_RPTR_NULL. Compiles to a single addition.
+ */
+static inline void *fx_mem_rptr_decode_nonnull(const void *base,
+                                               fx_mem_rptr_t rptr) {
+	return (void *)((uintptr_t)base + rptr);
+}
+
+/**
+ * Decodes a relative pointer pointing at an FX_ALIGN-aligned object of type T.
+ * RPTR must not be FX_MEM_RPTR_NULL.
+ */
+#define FX_MEM_RPTR_DECODE(T, BASE, RPTR) \
+	((T *)FX_ASSUME_ALIGNED(fx_mem_rptr_decode_nonnull(BASE, RPTR)))
+
+/**
+ * Relative pointer version of fx_mem_align(). Computes the aligned address of
+ * a substructure of the given size, advances mem, and returns the address as
+ * a relative pointer.
+ *
+ * @param base is the base address of the memory region.
+ * @param mem pointer at the variable holding the current pointer.
+ * @param size is the size of the substructure.
+ * @return a relative pointer at the beginning of the substructure.
+ */
+static inline fx_mem_rptr_t fx_mem_align_rptr(const void *base, void **mem,
+                                              uint32_t size) {
+	return fx_mem_rptr_encode(base, fx_mem_align(mem, size));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_RPTR_H */
@@ -0,0 +1,326 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_sampler.h>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#define FX_MEM_SAMPLER_HAVE_BACKTRACE
+#endif
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* Number of sample table entries searched for a key */
+#define FX_MEM_SAMPLER_WINDOW 16U
+
+/* Special values of fx_mem_sampler_sample_t.key. Keys are stored with an
+   offset of two. */
+#define FX_MEM_SAMPLER_EMPTY 0U
+#define FX_MEM_SAMPLER_BUSY 1U
+#define FX_MEM_SAMPLER_KEY(K) ((uintptr_t)(K) + 2U)
+
+__thread intptr_t fx_mem_sampler_bytes_until_sample = 0;
+
+static __thread uint64_t _fx_sampler_rng = 0U;
+
+static uint32_t _fx_sampler_random26(void) {
+	/* xorshift64*, seeded with the address of the thread-local state, which is
+	   distinct for each thread */
+	uint64_t x = _fx_sampler_rng;
+	if (!x) {
+		x = (uint64_t)(uintptr_t)&_fx_sampler_rng * 0x9E3779B97F4A7C15ULL + 1U;
+	}
+	x ^= x >> 12U;
+	x ^= x << 25U;
+	x ^= x >> 27U;
+	_fx_sampler_rng = x;
+	return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 38U); /* 26 bits */
+}
+
+static double _fx_sampler_log2(uint32_t q) {
+	/* Split q into exponent and mantissa and approximate the base-two
+	   logarithm of the mantissa m in [1, 2) with a polynomial. The absolute
+	   error is below 1e-4, which is plenty for picking sampling intervals. */
+	uint32_t e = 0U;
+	while ((q >> e) > 1U) {
+		e++;
+	}
+	const double m = (double)q / (double)(1ULL << e);
+	return (double)e - 2.5128774 +
+	       (4.0701350 + (-2.1206994 + (0.64514372 - 0.081614486 * m) * m) * m) *
+	           m;
+}
+
+static intptr_t _fx_sampler_next_interval(size_t rate) {
+	/* Draw from an exponential distribution with mean "rate", i.e.
+	   -ln(U) * rate with U uniform in (0, 1]. */
+	const uint32_t q = _fx_sampler_random26() + 1U;
+	const double ln2 = 0.6931471805599453;
+	const double interval = (26.0 - _fx_sampler_log2(q)) * ln2 * (double)rate;
+	return (interval < 1.0) ? 1 : (intptr_t)interval;
+}
+
+static uint32_t _fx_sampler_hash(uintptr_t key) {
+	uint64_t x = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t)(x >> 32U);
+}
+
+static uint32_t _fx_sampler_hash_stack(void *const *stack, uint32_t depth) {
+	uint32_t hash = 2166136261U; /* FNV-1a */
+	for (uint32_t i = 0U; i < depth; i++) {
+		hash = (hash ^ _fx_sampler_hash((uintptr_t)stack[i])) * 16777619U;
+	}
+	return hash;
+}
+
+static void _fx_sampler_lock(uint32_t *lock) {
+	while (__atomic_exchange_n(lock, 1U, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void _fx_sampler_unlock(uint32_t *lock) {
+	__atomic_store_n(lock, 0U, __ATOMIC_RELEASE);
+}
+
+/* Returns the index of the site with the given stack, inserts a new site if
+   there is none. Returns n_sites if the site table is full. */
+static uint32_t _fx_sampler_find_site(fx_mem_sampler_t *sampler,
+                                      void *const *stack, uint32_t depth) {
+	const uint32_t hash = _fx_sampler_hash_stack(stack, depth);
+	uint32_t res = sampler->n_sites;
+	_fx_sampler_lock(&sampler->sites_lock);
+	for (uint32_t i = 0U; i < sampler->n_sites; i++) {
+		const uint32_t idx = (hash + i) % sampler->n_sites;
+		fx_mem_sampler_site_t *site = &sampler->sites[idx];
+		if (site->depth == 0U) {
+			/* Empty slot, insert the site */
+			site->hash = hash;
+			for (uint32_t j = 0U; j < depth; j++) {
+				site->stack[j] = stack[j];
+			}
+			__atomic_store_n(&site->depth, depth, __ATOMIC_RELEASE);
+			sampler->n_sites_used++;
+			res = idx;
+			break;
+		}
+		if (site->hash == hash && site->depth == depth) {
+			bool equal = true;
+			for (uint32_t j = 0U; equal && j < depth; j++) {
+				equal = site->stack[j] == stack[j];
+			}
+			if (equal) {
+				res = idx;
+				break;
+			}
+		}
+	}
+	_fx_sampler_unlock(&sampler->sites_lock);
+	return res;
+}
+
+static uint32_t _fx_sampler_backtrace(void **stack) {
+#ifdef FX_MEM_SAMPLER_HAVE_BACKTRACE
+	/* Skip the frame of fx_mem_sampler_record_alloc() */
+	void *buf[FX_MEM_SAMPLER_MAX_DEPTH + 1U];
+	const int n = backtrace(buf, FX_MEM_SAMPLER_MAX_DEPTH + 1U);
+	uint32_t depth = 0U;
+	for (int i = 1; i < n; i++) {
+		stack[depth++] = buf[i];
+	}
+	return depth;
+#else
+	stack[0] = __builtin_return_address(0);
+	return 1U;
+#endif
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_sampler_size(uint32_t n_sites, uint32_t n_samples) {
+	uint32_t n_samples_pow2 = FX_MEM_SAMPLER_WINDOW;
+	while (n_samples_pow2 < n_samples && n_samples_pow2 < (1U << 30U)) {
+		n_samples_pow2 *= 2U;
+	}
+	const uint64_t n_bytes_sites =
+	    (uint64_t)n_sites * sizeof(fx_mem_sampler_site_t);
+	const uint64_t n_bytes_samples =
+	    (uint64_t)n_samples_pow2 * sizeof(fx_mem_sampler_sample_t);
+	if (n_sites == 0U || n_bytes_sites > 0xFFFFFFFFU ||
+	    n_bytes_samples > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_sampler_t)) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_sites) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_samples);
+	return ok ? size : 0U;
+}
+
+fx_mem_sampler_t *fx_mem_sampler_init(void *mem, uint32_t n_sites,
+                                      uint32_t n_samples, size_t rate) {
+	uint32_t n_samples_pow2 = FX_MEM_SAMPLER_WINDOW;
+	while (n_samples_pow2 < n_samples && n_samples_pow2 < (1U << 30U)) {
+		n_samples_pow2 *= 2U;
+	}
+
+	fx_mem_sampler_t *sampler =
+	    (fx_mem_sampler_t *)fx_mem_align(&mem, sizeof(fx_mem_sampler_t));
+	sampler->rate = rate ? rate : 1U;
+	sampler->n_sites = n_sites;
+	sampler->n_samples = n_samples_pow2;
+	sampler->sites = (fx_mem_sampler_site_t *)fx_mem_align(
+	    &mem, n_sites * sizeof(fx_mem_sampler_site_t));
+	sampler->samples = (fx_mem_sampler_sample_t *)fx_mem_align(
+	    &mem, n_samples_pow2 * sizeof(fx_mem_sampler_sample_t));
+	sampler->sites_lock = 0U;
+	sampler->n_sites_used = 0U;
+	sampler->n_live = 0U;
+	sampler->n_dropped = 0U;
+	fx_mem_zero_aligned(sampler->sites,
+	                    n_sites * sizeof(fx_mem_sampler_site_t));
+	fx_mem_zero_aligned(sampler->samples,
+	                    n_samples_pow2 * sizeof(fx_mem_sampler_sample_t));
+	return sampler;
+}
+
+void fx_mem_sampler_record_alloc(fx_mem_sampler_t *sampler, uintptr_t key,
+                                 size_t size) {
+	/* The thread-local counter starts at zero; do not take a sample the very
+	   first time a thread ends up here, but just draw the first interval. */
+	const bool first = (_fx_sampler_rng == 0U);
+	fx_mem_sampler_bytes_until_sample = _fx_sampler_next_interval(sampler->rate);
+	if (first) {
+		return;
+	}
+
+	/* Find the call site */
+	void *stack[FX_MEM_SAMPLER_MAX_DEPTH];
+	const uint32_t depth = _fx_sampler_backtrace(stack);
+	const uint32_t site_idx = _fx_sampler_find_site(sampler, stack, depth);
+	if (site_idx >= sampler->n_sites) {
+		__atomic_add_fetch(&sampler->n_dropped, 1U, __ATOMIC_RELAXED);
+		return;
+	}
+	fx_mem_sampler_site_t *site = &sampler->sites[site_idx];
+	__atomic_add_fetch(&site->n_alloc_objs, 1U, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->n_alloc_bytes, size, __ATOMIC_RELAXED);
+
+	/* Insert the sample into the sample table */
+	const uint32_t mask = sampler->n_samples - 1U;
+	const uint32_t home = _fx_sampler_hash(key);
+	for (uint32_t i = 0U; i < FX_MEM_SAMPLER_WINDOW; i++) {
+		fx_mem_sampler_sample_t *sample = &sampler->samples[(home + i) & mask];
+		uintptr_t expected = FX_MEM_SAMPLER_EMPTY;
+		if (__atomic_compare_exchange_n(&sample->key, &expected,
+		                                FX_MEM_SAMPLER_BUSY, false,
+		                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			sample->site = site_idx;
+			sample->size = size;
+			__atomic_add_fetch(&site->n_live_objs, 1U, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&site->n_live_bytes, size, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&sampler->n_live, 1U, __ATOMIC_RELAXED);
+			__atomic_store_n(&sample->key, FX_MEM_SAMPLER_KEY(key),
+			                 __ATOMIC_RELEASE);
+			return;
+		}
+	}
+	__atomic_add_fetch(&sampler->n_dropped, 1U, __ATOMIC_RELAXED);
+}
+
+void fx_mem_sampler_record_free(fx_mem_sampler_t *sampler, uintptr_t key) {
+	const uint32_t mask = sampler->n_samples - 1U;
+	const uint32_t home = _fx_sampler_hash(key);
+	for (uint32_t i = 0U; i < FX_MEM_SAMPLER_WINDOW; i++) {
+		fx_mem_sampler_sample_t *sample = &sampler->samples[(home + i) & mask];
+		uintptr_t expected = FX_MEM_SAMPLER_KEY(key);
+		if (__atomic_load_n(&sample->key, __ATOMIC_ACQUIRE) != expected) {
+			continue;
+		}
+
+		/* Read the sample before releasing the table entry */
+		const uint32_t site_idx = sample->site;
+		const size_t size = sample->size;
+		if (__atomic_compare_exchange_n(&sample->key, &expected,
+		                                FX_MEM_SAMPLER_EMPTY, false,
+		                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			fx_mem_sampler_site_t *site = &sampler->sites[site_idx];
+			__atomic_sub_fetch(&site->n_live_objs, 1U, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&site->n_live_bytes, size, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&sampler->n_live, 1U, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+bool fx_mem_sampler_dump(fx_mem_sampler_t *sampler, FILE *f) {
+	/* Compute the totals for the header line */
+	size_t totals[4] = {0U, 0U, 0U, 0U};
+	for (uint32_t i = 0U; i < sampler->n_sites; i++) {
+		const fx_mem_sampler_site_t *site = &sampler->sites[i];
+		if (__atomic_load_n(&site->depth, __ATOMIC_ACQUIRE)) {
+			totals[0] += __atomic_load_n(&site->n_live_objs, __ATOMIC_RELAXED);
+			totals[1] += __atomic_load_n(&site->n_live_bytes, __ATOMIC_RELAXED);
+			totals[2] += __atomic_load_n(&site->n_alloc_objs, __ATOMIC_RELAXED);
+			totals[3] += __atomic_load_n(&site->n_alloc_bytes, __ATOMIC_RELAXED);
+		}
+	}
+	fprintf(f, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", totals[0],
+	        totals[1], totals[2], totals[3], sampler->rate);
+
+	/* Write one line per call site */
+	for (uint32_t i = 0U; i < sampler->n_sites; i++) {
+		const fx_mem_sampler_site_t *site = &sampler->sites[i];
+		const uint32_t depth = __atomic_load_n(&site->depth, __ATOMIC_ACQUIRE);
+		if (!depth) {
+			continue;
+		}
+		fprintf(f, "%zu: %zu [%zu: %zu] @",
+		        __atomic_load_n(&site->n_live_objs, __ATOMIC_RELAXED),
+		        __atomic_load_n(&site->n_live_bytes, __ATOMIC_RELAXED),
+		        __atomic_load_n(&site->n_alloc_objs, __ATOMIC_RELAXED),
+		        __atomic_load_n(&site->n_alloc_bytes, __ATOMIC_RELAXED));
+		for (uint32_t j = 0U; j < depth; j++) {
+			fprintf(f, " 0x%" PRIxPTR, (uintptr_t)site->stack[j]);
+		}
+		fputc('\n', f);
+	}
+
+#ifdef __linux__
+	/* Append the memory map, pprof needs it to symbolise the addresses */
+	FILE *maps = fopen("/proc/self/maps", "r");
+	if (maps) {
+		char buf[4096];
+		size_t n;
+		fputs("\nMAPPED_LIBRARIES:\n", f);
+		while ((n = fread(buf, 1U, sizeof(buf), maps)) > 0U) {
+			fwrite(buf, 1U, n, f);
+		}
+		fclose(maps);
+	}
+#endif
+
+	return !ferror(f);
+}
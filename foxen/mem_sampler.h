@@ -0,0 +1,188 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_sampler.h
+ *
+ * Low-overhead sampling allocation profiler. On average, one allocation per
+ * "rate" allocated bytes is sampled (the distance between two samples is
+ * exponentially distributed, as in tcmalloc). For each sampled allocation the
+ * sampler records a backtrace and attributes the allocation to the
+ * corresponding call site until the allocation is freed. Allocations are
+ * identified by an arbitrary key, e.g. the slot index in a pool or the
+ * pointer returned by the allocator.
+ *
+ * fx_mem_sampler_dump() writes the collected data in the legacy text heap
+ * profile format understood by pprof.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_SAMPLER_H
+#define FOXEN_MEM_SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of stack frames recorded per call site.
+ */
+#define FX_MEM_SAMPLER_MAX_DEPTH 32U
+
+/**
+ * Call site statistics. The counters are only based on sampled allocations;
+ * pprof scales them according to the sampling rate.
+ */
+typedef struct fx_mem_sampler_site {
+	uint32_t hash;
+	uint32_t depth;
+	void *stack[FX_MEM_SAMPLER_MAX_DEPTH];
+	size_t n_live_objs;
+	size_t n_live_bytes;
+	size_t n_alloc_objs;
+	size_t n_alloc_bytes;
+} fx_mem_sampler_site_t;
+
+/**
+ * Live sampled allocation.
+ */
+typedef struct fx_mem_sampler_sample {
+	uintptr_t key;
+	uint32_t site;
+	size_t size;
+} fx_mem_sampler_sample_t;
+
+/**
+ * Sampler state. Do not access the members directly.
+ */
+typedef struct fx_mem_sampler {
+	size_t rate;
+	uint32_t n_sites;
+	uint32_t n_samples;
+	fx_mem_sampler_site_t *sites;
+	fx_mem_sampler_sample_t *samples;
+	uint32_t sites_lock;
+	uint32_t n_sites_used;
+	uint32_t n_live;
+	uint32_t n_dropped;
+} fx_mem_sampler_t;
+
+/**
+ * Number of bytes the calling thread may still allocate before the next
+ * allocation is sampled. Used by the inline fast path below.
+ */
+extern __thread intptr_t fx_mem_sampler_bytes_until_sample;
+
+/**
+ * Computes the size of the memory region required to store a sampler.
+ *
+ * @param n_sites is the maximum number of distinct call sites.
+ * @param n_samples is the maximum number of simultaneously live samples.
+ * Rounded up to a power of two.
+ * @return the size in bytes or zero if there was an overflow.
+ */
+uint32_t fx_mem_sampler_size(uint32_t n_sites, uint32_t n_samples);
+
+/**
+ * Initialises a sampler in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_sampler_size() bytes.
+ * @param n_sites is the maximum number of distinct call sites.
+ * @param n_samples is the maximum number of simultaneously live samples.
+ * @param rate is the mean number of bytes between two samples.
+ * @return a pointer at the sampler.
+ */
+fx_mem_sampler_t *fx_mem_sampler_init(void *mem, uint32_t n_sites,
+                                      uint32_t n_samples, size_t rate);
+
+/**
+ * Records a sampled allocation. Called by fx_mem_sampler_alloc(), do not call
+ * this function directly.
+ */
+void fx_mem_sampler_record_alloc(fx_mem_sampler_t *sampler, uintptr_t key,
+                                 size_t size);
+
+/**
+ * Removes a sampled allocation. Called by fx_mem_sampler_free(), do not call
+ * this function directly.
+ */
+void fx_mem_sampler_record_free(fx_mem_sampler_t *sampler, uintptr_t key);
+
+/**
+ * Must be called after each allocation that should be profiled. In the common
+ * case this only decrements a thread-local counter.
+ *
+ * @param sampler is the sampler the allocation should be reported to.
+ * @param key is a value identifying the allocation, e.g. the slot index or the
+ * pointer.
+ * @param size is the size of the allocation in bytes.
+ */
+static inline void fx_mem_sampler_alloc(fx_mem_sampler_t *sampler,
+                                        uintptr_t key, size_t size) {
+	fx_mem_sampler_bytes_until_sample -= (intptr_t)size;
+	if (fx_mem_sampler_bytes_until_sample <= 0) {
+		fx_mem_sampler_record_alloc(sampler, key, size);
+	}
+}
+
+/**
+ * Must be called before an allocation reported to fx_mem_sampler_alloc() is
+ * freed. Only performs a hash table lookup if there are live samples.
+ *
+ * @param sampler is the sampler the allocation was reported to.
+ * @param key is the key that was passed to fx_mem_sampler_alloc().
+ */
+static inline void fx_mem_sampler_free(fx_mem_sampler_t *sampler,
+                                       uintptr_t key) {
+	if (__atomic_load_n(&sampler->n_live, __ATOMIC_RELAXED)) {
+		fx_mem_sampler_record_free(sampler, key);
+	}
+}
+
+/**
+ * Writes the current heap profile to the given file in the legacy pprof heap
+ * profile format. On Linux the memory map of the process is appended so that
+ * pprof can symbolise the addresses.
+ *
+ * @param sampler is the sampler for which the profile should be written.
+ * @param f is the file the profile should be written to.
+ * @return true if the profile was written successfully.
+ */
+bool fx_mem_sampler_dump(fx_mem_sampler_t *sampler, FILE *f);
+
+/**
+ * Returns the number of samples that were dropped because the site or sample
+ * tables were full.
+ */
+static inline uint32_t fx_mem_sampler_n_dropped(
+    const fx_mem_sampler_t *sampler) {
+	return __atomic_load_n(&sampler->n_dropped, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_SAMPLER_H */
@@ -0,0 +1,144 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_search.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* Additional space required to align a region at FX_MEM_SEARCH_ALIGN given
+   that the size computation already aligns it at FX_ALIGN */
+#define FX_SEARCH_SLACK (FX_MEM_SEARCH_ALIGN - FX_ALIGN)
+
+static void _fx_eytz_fill(uint8_t *dst, const uint8_t *src, uint64_t *i,
+                          uint64_t k, uint32_t n, uint32_t elem_size) {
+	/* An in-order traversal of the implicit tree visits the nodes in sorted
+	   order */
+	if (k > n) {
+		return;
+	}
+	_fx_eytz_fill(dst, src, i, 2U * k, n, elem_size);
+	memcpy(dst + k * elem_size, src + (*i)++ * elem_size, elem_size);
+	_fx_eytz_fill(dst, src, i, 2U * k + 1U, n, elem_size);
+}
+
+static uint32_t _fx_veb_height(uint32_t n) {
+	return n ? 32U - (uint32_t)__builtin_clz(n) : 0U;
+}
+
+static void _fx_veb_tables(fx_mem_veb_t *veb, uint32_t depth,
+                           uint32_t height) {
+	/* The roots of the bottom trees of a subtree rooted at the given depth
+	   are located at depth + top height */
+	if (height <= 1U) {
+		return;
+	}
+	const uint32_t ht = height / 2U, hb = height - ht;
+	veb->top_size[depth + ht] = (1U << ht) - 1U;
+	veb->bottom_size[depth + ht] = (1U << hb) - 1U;
+	veb->top_depth[depth + ht] = depth;
+	_fx_veb_tables(veb, depth, ht);
+	_fx_veb_tables(veb, depth + ht, hb);
+}
+
+static void _fx_veb_fill(const fx_mem_veb_t *veb, uint8_t *dst,
+                         const uint8_t *src, uint64_t offs, uint64_t stride,
+                         uint32_t height) {
+	/* The k-th node of the subtree in sorted order is the element with index
+	   offs + k * stride of the sorted array */
+	const uint32_t es = veb->elem_size;
+	if (height == 1U) {
+		if (offs < veb->n) {
+			memcpy(dst, src + offs * es, es);
+		} else {
+			memset(dst, 0xFF, es);
+		}
+		return;
+	}
+	const uint32_t ht = height / 2U, hb = height - ht;
+	const uint64_t n_top = (1ULL << ht) - 1U, n_bottom = (1ULL << hb) - 1U;
+
+	/* Every node of the top tree is followed by a bottom tree in sorted
+	   order */
+	_fx_veb_fill(veb, dst, src, offs + stride * n_bottom,
+	             stride * (n_bottom + 1U), ht);
+	dst += n_top * es;
+	for (uint64_t b = 0U; b <= n_top; b++) {
+		_fx_veb_fill(veb, dst, src, offs + stride * b * (n_bottom + 1U),
+		             stride, hb);
+		dst += n_bottom * es;
+	}
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_eytz_size(uint32_t n, uint32_t elem_size) {
+	const uint64_t n_bytes = ((uint64_t)n + 1U) * elem_size;
+	if (n_bytes > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, FX_SEARCH_SLACK) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes);
+	return ok ? size : 0U;
+}
+
+void *fx_mem_eytz_init(void *mem, const void *src, uint32_t n,
+                       uint32_t elem_size) {
+	uint8_t *base =
+	    (uint8_t *)fx_mem_align_ex(&mem, 0U, FX_MEM_SEARCH_ALIGN);
+	uint64_t i = 0U;
+	_fx_eytz_fill(base, (const uint8_t *)src, &i, 1U, n, elem_size);
+	return base;
+}
+
+uint32_t fx_mem_veb_size(uint32_t n, uint32_t elem_size) {
+	const uint64_t n_nodes = (1ULL << _fx_veb_height(n)) - 1U;
+	const uint64_t n_bytes = n_nodes * elem_size;
+	if (n_bytes > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_veb_t)) &&
+	          fx_mem_update_size(&size, FX_SEARCH_SLACK) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes);
+	return ok ? size : 0U;
+}
+
+fx_mem_veb_t *fx_mem_veb_init(void *mem, const void *src, uint32_t n,
+                              uint32_t elem_size) {
+	fx_mem_veb_t *veb = (fx_mem_veb_t *)fx_mem_align(&mem, sizeof(*veb));
+	memset(veb, 0, sizeof(*veb));
+	veb->n = n;
+	veb->height = _fx_veb_height(n);
+	veb->elem_size = elem_size;
+	veb->data = (uint8_t *)fx_mem_align_ex(&mem, 0U, FX_MEM_SEARCH_ALIGN);
+	_fx_veb_tables(veb, 0U, veb->height);
+	if (veb->height > 0U) {
+		_fx_veb_fill(veb, veb->data, (const uint8_t *)src, 0U, 1U,
+		             veb->height);
+	}
+	return veb;
+}
@@ -0,0 +1,209 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_search.h
+ *
+ * Cache-friendly layouts of sorted arrays. Binary search over a sorted array
+ * touches a new cache line on almost every level once the array exceeds the
+ * cache. The functions in this header permute a sorted array into
+ *
+ * - the Eytzinger (breadth-first) layout, in which the node with index k has
+ *   its children at 2k and 2k + 1; the descendants four levels below a node
+ *   share a single cache line and can be prefetched early, or
+ * - the van Emde Boas layout, which recursively stores the top half of the
+ *   implicit search tree followed by the bottom subtrees, so that each
+ *   subtree of height h occupies a contiguous block of 2^h - 1 elements
+ *   irrespective of the cache line or page size.
+ *
+ * Both layouts are built from sorted arrays of arbitrary fixed-size elements,
+ * which allows storing a payload array in the same order as the keys. The
+ * search functions operate on uint32_t keys, are branch-free, and return a
+ * pointer at the first element not less than the key, or NULL. The position
+ * of that element in the layout indexes the permuted payload.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_SEARCH_H
+#define FOXEN_MEM_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Alignment of the layouts; corresponds to the cache line size.
+ */
+#define FX_MEM_SEARCH_ALIGN 64U
+
+/**
+ * Maximum height of the implicit search tree of a van Emde Boas layout.
+ */
+#define FX_MEM_VEB_MAX_HEIGHT 32U
+
+/******************************************************************************
+ * EYTZINGER LAYOUT                                                           *
+ ******************************************************************************/
+
+/**
+ * Computes the size of the memory region required to store n elements in the
+ * Eytzinger layout.
+ *
+ * @param n is the number of elements.
+ * @param elem_size is the size of an element in bytes.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_eytz_size(uint32_t n, uint32_t elem_size);
+
+/**
+ * Permutes a sorted array into the Eytzinger layout.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_eytz_size()
+ * bytes.
+ * @param src is the sorted array.
+ * @param n is the number of elements.
+ * @param elem_size is the size of an element in bytes.
+ * @return a pointer at the cache line aligned layout. The elements are stored
+ * at indices 1 to n; the element at index zero is unused.
+ */
+void *fx_mem_eytz_init(void *mem, const void *src, uint32_t n,
+                       uint32_t elem_size);
+
+/**
+ * Searches the first key that is not less than the given key.
+ *
+ * @param base is the layout returned by fx_mem_eytz_init() for uint32_t keys.
+ * @param n is the number of keys.
+ * @param key is the key to search for.
+ * @return a pointer at the key, or NULL if all keys are less than the given
+ * key.
+ */
+static inline const uint32_t *fx_mem_eytz_lower_bound(const uint32_t *base,
+                                                      uint32_t n,
+                                                      uint32_t key) {
+	uint64_t k = 1U;
+	while (k <= n) {
+		/* Fetch the cache line holding the 16 descendants four levels down */
+		__builtin_prefetch(base + 16U * k);
+		k = 2U * k + (base[k] < key);
+	}
+
+	/* Undo the right turns taken after the last left turn */
+	k >>= (uint32_t)__builtin_ctzll(~k) + 1U;
+	return k ? base + k : NULL;
+}
+
+/******************************************************************************
+ * VAN EMDE BOAS LAYOUT                                                       *
+ ******************************************************************************/
+
+/**
+ * Van Emde Boas layout; a header followed by the elements. The implicit search
+ * tree is complete; elements past the end of the sorted array are padding.
+ * For each depth d, the tables describe the recursion level at which nodes of
+ * depth d are the roots of bottom subtrees: the size of the top tree, the
+ * size of each bottom tree, and the depth of the root of the top tree.
+ */
+typedef struct fx_mem_veb {
+	uint32_t n;
+	uint32_t height;
+	uint32_t elem_size;
+	uint32_t top_size[FX_MEM_VEB_MAX_HEIGHT + 1U];
+	uint32_t bottom_size[FX_MEM_VEB_MAX_HEIGHT + 1U];
+	uint32_t top_depth[FX_MEM_VEB_MAX_HEIGHT + 1U];
+	uint8_t *data;
+} fx_mem_veb_t;
+
+/**
+ * Computes the size of the memory region required to store n elements in the
+ * van Emde Boas layout, including the padding to a complete tree.
+ *
+ * @param n is the number of elements.
+ * @param elem_size is the size of an element in bytes.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_veb_size(uint32_t n, uint32_t elem_size);
+
+/**
+ * Permutes a sorted array into the van Emde Boas layout. Padding elements are
+ * filled with 0xFF bytes.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_veb_size()
+ * bytes.
+ * @param src is the sorted array.
+ * @param n is the number of elements.
+ * @param elem_size is the size of an element in bytes.
+ * @return a pointer at the layout.
+ */
+fx_mem_veb_t *fx_mem_veb_init(void *mem, const void *src, uint32_t n,
+                              uint32_t elem_size);
+
+/**
+ * Searches the first key that is not less than the given key.
+ *
+ * @param veb is a layout of uint32_t keys.
+ * @param key is the key to search for.
+ * @return a pointer at the key, or NULL if all keys are less than the given
+ * key.
+ */
+static inline const uint32_t *fx_mem_veb_lower_bound(const fx_mem_veb_t *veb,
+                                                     uint32_t key) {
+	const uint32_t *a = (const uint32_t *)veb->data;
+	const uint32_t h = veb->height;
+	size_t pos[FX_MEM_VEB_MAX_HEIGHT + 1U];
+	uint64_t i = 1U;
+	pos[0] = 0U;
+	for (uint32_t d = 0U; d < h; d++) {
+		/* The children are the roots of adjacent bottom trees; prefetch both
+		   before comparing */
+		const uint32_t c = d + 1U;
+		const uint32_t t = veb->top_size[c];
+		const size_t b = veb->bottom_size[c];
+		const size_t left = pos[veb->top_depth[c]] + t + ((2U * i) & t) * b;
+		__builtin_prefetch(a + left);
+		__builtin_prefetch(a + left + b);
+		const bool right = a[pos[d]] < key;
+		pos[c] = left + right * b;
+		i = 2U * i + right;
+	}
+
+	/* The answer is the last node at which the search turned left */
+	const uint32_t n_right = (uint32_t)__builtin_ctzll(~i);
+	if (n_right >= h) {
+		return NULL;
+	}
+	const uint32_t depth = h - 1U - n_right;
+	const uint64_t j = (i >> (n_right + 1U)) - (1ULL << depth);
+	const uint64_t rank = ((2U * j + 1U) << (h - 1U - depth)) - 1U;
+	return rank < veb->n ? a + pos[depth] : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_SEARCH_H */
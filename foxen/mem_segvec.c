@@ -0,0 +1,155 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
+#endif
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <sched.h>
+#include <sys/mman.h>
+#define FX_MEM_SEGVEC_HAVE_MMAP
+#endif
+
+#include <string.h>
+
+#include <foxen/mem_segvec.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static size_t _fx_segvec_segment_size(const fx_mem_segvec_t *vec, uint32_t k) {
+	return (size_t)vec->elem_size << (vec->shift + k);
+}
+
+static uint8_t *_fx_segvec_alloc(fx_mem_segvec_t *vec, uint32_t k) {
+	const size_t size = _fx_segvec_segment_size(vec, k);
+	if (vec->arena) {
+		uint8_t *mem =
+		    (uint8_t *)fx_mem_arena_alloc(vec->arena, size, FX_ALIGN);
+		return mem ? mem : FX_MEM_SEGVEC_FAILED;
+	}
+#ifdef FX_MEM_SEGVEC_HAVE_MMAP
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (mem == MAP_FAILED) ? FX_MEM_SEGVEC_FAILED : (uint8_t *)mem;
+#else
+	return FX_MEM_SEGVEC_FAILED;
+#endif
+}
+
+static void _fx_segvec_yield(void) {
+#ifdef FX_MEM_SEGVEC_HAVE_MMAP
+	sched_yield();
+#endif
+}
+
+static uint64_t _fx_segvec_segment_start(const fx_mem_segvec_t *vec,
+                                         uint32_t k) {
+	return ((1ULL << k) - 1U) << vec->shift;
+}
+
+static uint8_t *_fx_segvec_wait(fx_mem_segvec_t *vec, uint32_t k) {
+	uint8_t *segment;
+	while (!(segment = __atomic_load_n(&vec->segments[k], __ATOMIC_ACQUIRE))) {
+		_fx_segvec_yield();
+	}
+	return segment;
+}
+
+static void _fx_segvec_fail(fx_mem_segvec_t *vec, uint32_t k) {
+	/* Exclude segment k and all following segments from the capacity */
+	const uint64_t capacity = _fx_segvec_segment_start(vec, k);
+	uint64_t old = __atomic_load_n(&vec->capacity, __ATOMIC_RELAXED);
+	while (old > capacity &&
+	       !__atomic_compare_exchange_n(&vec->capacity, &old, capacity, true,
+	                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+bool fx_mem_segvec_init(fx_mem_segvec_t *vec, uint32_t elem_size,
+                        uint32_t first_capacity, fx_mem_arena_t *arena) {
+	memset(vec, 0, sizeof(fx_mem_segvec_t));
+	if (elem_size == 0U || first_capacity == 0U ||
+	    (first_capacity & (first_capacity - 1U))) {
+		return false;
+	}
+	vec->elem_size = elem_size;
+	vec->shift = (uint32_t)__builtin_ctz(first_capacity);
+	vec->arena = arena;
+
+	/* Limit the number of segments such that neither the element indices nor
+	   the segment sizes overflow */
+	uint32_t n = 0U;
+	while (n < FX_MEM_SEGVEC_MAX_SEGMENTS && vec->shift + n < 62U &&
+	       ((SIZE_MAX >> (vec->shift + n)) >= elem_size)) {
+		n++;
+	}
+	vec->n_segments_max = n;
+	vec->capacity = _fx_segvec_segment_start(vec, n);
+	return true;
+}
+
+void fx_mem_segvec_destroy(fx_mem_segvec_t *vec) {
+#ifdef FX_MEM_SEGVEC_HAVE_MMAP
+	for (uint32_t k = 0U; !vec->arena && k < vec->n_segments_max; k++) {
+		if (vec->segments[k] > FX_MEM_SEGVEC_FAILED) {
+			munmap(vec->segments[k], _fx_segvec_segment_size(vec, k));
+		}
+	}
+#endif
+	memset(vec, 0, sizeof(fx_mem_segvec_t));
+}
+
+void *fx_mem_segvec_push_slow(fx_mem_segvec_t *vec, uint32_t k,
+                              uint64_t offs) {
+	if (k >= vec->n_segments_max) {
+		return NULL;
+	}
+
+	/* The thread appending the first element of a segment allocates it, but
+	   only once the preceding segment exists; a failed segment thus fails
+	   all following segments instead of leaving a hole */
+	uint8_t *segment;
+	if (offs == 0U) {
+		const bool ok = k == 0U || _fx_segvec_wait(vec, k - 1U) !=
+		                               FX_MEM_SEGVEC_FAILED;
+		segment = ok ? _fx_segvec_alloc(vec, k) : FX_MEM_SEGVEC_FAILED;
+		if (segment == FX_MEM_SEGVEC_FAILED) {
+			_fx_segvec_fail(vec, k);
+		}
+		__atomic_store_n(&vec->segments[k], segment, __ATOMIC_RELEASE);
+	} else {
+		segment = _fx_segvec_wait(vec, k);
+	}
+	if (segment == FX_MEM_SEGVEC_FAILED) {
+		return NULL;
+	}
+	return segment + offs * vec->elem_size;
+}
@@ -0,0 +1,184 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_segvec.h
+ *
+ * Append-only vector consisting of geometrically growing segments. Segment k
+ * holds first_capacity * 2^k elements; growing the vector allocates the next
+ * segment and never moves existing elements, so pointers at elements remain
+ * valid for the lifetime of the vector. The segment holding an element and
+ * the offset within that segment are computed with a single leading-zero
+ * count.
+ *
+ * Appending is thread-safe and costs one atomic fetch-and-add. The thread
+ * whose element is the first one of a segment allocates that segment; other
+ * threads appending to the same segment wait until it has been published.
+ * Segments are allocated either from an arena (see mem_allocator.h) or, if no
+ * arena is given, with mmap().
+ *
+ * A segment is only allocated once the preceding segment exists. If a segment
+ * cannot be allocated, appending fails from then on, even if memory becomes
+ * available again; the vector never contains holes.
+ *
+ * The vector does not track which elements have been written. Threads reading
+ * elements appended by other threads must synchronise with the writers.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_SEGVEC_H
+#define FOXEN_MEM_SEGVEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem_allocator.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of segments of a vector.
+ */
+#define FX_MEM_SEGVEC_MAX_SEGMENTS 40U
+
+/**
+ * Marks a segment that could not be allocated.
+ */
+#define FX_MEM_SEGVEC_FAILED ((uint8_t *)1)
+
+/**
+ * Segmented vector. Do not modify the members directly.
+ */
+typedef struct fx_mem_segvec {
+	uint32_t elem_size;
+	uint32_t shift; /* log2 of the capacity of the first segment */
+	uint32_t n_segments_max;
+	uint64_t capacity; /* Elements in segments that have not failed */
+	fx_mem_arena_t *arena;
+	uint8_t *segments[FX_MEM_SEGVEC_MAX_SEGMENTS];
+
+	/* Frequently modified state, placed on its own cache line */
+	uint8_t _pad0[64];
+	uint64_t length;
+	uint8_t _pad1[64];
+} fx_mem_segvec_t;
+
+/**
+ * Initialises an empty vector. No memory is allocated until the first element
+ * is appended.
+ *
+ * @param vec is the vector that should be initialised.
+ * @param elem_size is the size of an element in bytes. Elements are stored
+ * without padding; segments are aligned to FX_ALIGN.
+ * @param first_capacity is the number of elements in the first segment. Must
+ * be a power of two.
+ * @param arena is the arena the segments are allocated from, or NULL to map
+ * each segment with mmap().
+ * @return false if the parameters are invalid.
+ */
+bool fx_mem_segvec_init(fx_mem_segvec_t *vec, uint32_t elem_size,
+                        uint32_t first_capacity, fx_mem_arena_t *arena);
+
+/**
+ * Unmaps the segments of a vector created without an arena. Segments
+ * allocated from an arena are reclaimed together with the arena.
+ */
+void fx_mem_segvec_destroy(fx_mem_segvec_t *vec);
+
+/**
+ * Returns the segment holding the element with the given index and stores the
+ * offset of the element within the segment in offs.
+ */
+static inline uint32_t fx_mem_segvec_locate(const fx_mem_segvec_t *vec,
+                                            uint64_t idx, uint64_t *offs) {
+	const uint64_t j = (idx >> vec->shift) + 1U;
+	const uint32_t k = 63U - (uint32_t)__builtin_clzll(j);
+	*offs = idx - (((1ULL << k) - 1U) << vec->shift);
+	return k;
+}
+
+/**
+ * Returns the number of elements in the vector, including elements that are
+ * currently being appended. Appends that failed are not counted.
+ */
+static inline uint64_t fx_mem_segvec_length(const fx_mem_segvec_t *vec) {
+	const uint64_t length = __atomic_load_n(&vec->length, __ATOMIC_ACQUIRE);
+	const uint64_t capacity =
+	    __atomic_load_n(&vec->capacity, __ATOMIC_ACQUIRE);
+	return (length < capacity) ? length : capacity;
+}
+
+/**
+ * Returns a pointer at the element with the given index. The index should be
+ * smaller than the length of the vector.
+ *
+ * @return a pointer at the element, or NULL if the segment holding the element
+ * has not been allocated.
+ */
+static inline void *fx_mem_segvec_get(const fx_mem_segvec_t *vec,
+                                      uint64_t idx) {
+	if (idx >= __atomic_load_n(&vec->capacity, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	uint64_t offs;
+	const uint32_t k = fx_mem_segvec_locate(vec, idx, &offs);
+	uint8_t *segment = __atomic_load_n(&vec->segments[k], __ATOMIC_ACQUIRE);
+	return (segment > FX_MEM_SEGVEC_FAILED) ? segment + offs * vec->elem_size
+	                                        : NULL;
+}
+
+/**
+ * Slow path of fx_mem_segvec_push(); allocates or waits for the segment.
+ */
+void *fx_mem_segvec_push_slow(fx_mem_segvec_t *vec, uint32_t k,
+                              uint64_t offs);
+
+/**
+ * Appends an uninitialised element to the vector.
+ *
+ * @param vec is the vector.
+ * @param idx receives the index of the new element. May be NULL.
+ * @return a pointer at the new element, or NULL if its segment or a preceding
+ * segment could not be allocated, or the vector reached its maximum capacity.
+ */
+static inline void *fx_mem_segvec_push(fx_mem_segvec_t *vec, uint64_t *idx) {
+	const uint64_t i = __atomic_fetch_add(&vec->length, 1U, __ATOMIC_ACQ_REL);
+	if (idx) {
+		*idx = i;
+	}
+	uint64_t offs;
+	const uint32_t k = fx_mem_segvec_locate(vec, i, &offs);
+	uint8_t *segment =
+	    k < vec->n_segments_max
+	        ? __atomic_load_n(&vec->segments[k], __ATOMIC_ACQUIRE)
+	        : FX_MEM_SEGVEC_FAILED;
+	if (segment > FX_MEM_SEGVEC_FAILED) {
+		return segment + offs * vec->elem_size;
+	}
+	return fx_mem_segvec_push_slow(vec, k, offs);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_SEGVEC_H */
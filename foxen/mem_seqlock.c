@@ -0,0 +1,49 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem.h>
+#include <foxen/mem_seqlock.h>
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_seqlock_size(uint32_t n_slots) {
+	const uint64_t n_bytes_counters =
+	    (uint64_t)n_slots * sizeof(fx_mem_seqlock_counter_t);
+	if (n_bytes_counters > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_seqlock_t)) &&
+	          fx_mem_update_size(&size, FX_MEM_SEQLOCK_ALIGN - FX_ALIGN) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_counters);
+	return ok ? size : 0U;
+}
+
+fx_mem_seqlock_t *fx_mem_seqlock_init(void *mem, uint32_t n_slots) {
+	fx_mem_seqlock_t *lock =
+	    (fx_mem_seqlock_t *)fx_mem_align(&mem, sizeof(fx_mem_seqlock_t));
+	lock->n_slots = n_slots;
+	lock->counters = (fx_mem_seqlock_counter_t *)fx_mem_align_ex(
+	    &mem, n_slots * sizeof(fx_mem_seqlock_counter_t), FX_MEM_SEQLOCK_ALIGN);
+	fx_mem_zero_aligned(lock->counters,
+	                    n_slots * sizeof(fx_mem_seqlock_counter_t));
+	return lock;
+}
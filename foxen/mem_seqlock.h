@@ -0,0 +1,157 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_seqlock.h
+ *
+ * Per-slot sequence counters for optimistic reads of small, rarely modified
+ * pool objects. A writer makes the counter of a slot odd before modifying the
+ * slot and even again afterwards. A reader records the counter, copies the
+ * object, and retries if the counter was odd or changed in the meantime.
+ * Readers never write to shared memory; writers pay two stores. Each counter
+ * occupies a cache line of its own, so writing one slot does not disturb
+ * readers of neighbouring slots.
+ *
+ * Writers of the same slot must be serialised by other means, e.g. a single
+ * writer thread or a writer lock. Readers must copy the fields they need and
+ * only use the copy once fx_mem_seqlock_read_retry() returned false. Since
+ * the copy races with writers, read all fields with __atomic_load_n() and
+ * __ATOMIC_RELAXED; a plain memcpy() is a data race.
+ *
+ * Store the counters next to the pool by reserving fx_mem_seqlock_size()
+ * bytes in the same memory region. Attached to a static pool with
+ * fx_mem_static_pool_set_seqlock(), the counter of a slot is also advanced
+ * when the slot is freed, so that readers holding a stale pointer retry.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_SEQLOCK_H
+#define FOXEN_MEM_SEQLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Alignment and stride of the counters; corresponds to the cache line size.
+ */
+#define FX_MEM_SEQLOCK_ALIGN 64U
+
+/**
+ * Counter of a single slot, padded to a cache line.
+ */
+typedef struct fx_mem_seqlock_counter {
+	uint32_t seq;
+	uint8_t _pad[FX_MEM_SEQLOCK_ALIGN - sizeof(uint32_t)];
+} fx_mem_seqlock_counter_t;
+
+/**
+ * Sequence counters of a set of slots. Do not access the members directly.
+ */
+typedef struct fx_mem_seqlock {
+	uint32_t n_slots;
+	fx_mem_seqlock_counter_t *counters;
+} fx_mem_seqlock_t;
+
+/**
+ * Computes the size of the memory region required to store the counters.
+ *
+ * @param n_slots is the number of slots.
+ * @return the size in bytes or zero if there was an overflow.
+ */
+uint32_t fx_mem_seqlock_size(uint32_t n_slots);
+
+/**
+ * Initialises the counters in the given memory region to zero.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_seqlock_size()
+ * bytes.
+ * @param n_slots is the number of slots.
+ * @return a pointer at the counters.
+ */
+fx_mem_seqlock_t *fx_mem_seqlock_init(void *mem, uint32_t n_slots);
+
+/**
+ * Starts an optimistic read of the given slot.
+ *
+ * @return the counter value that must be passed to
+ * fx_mem_seqlock_read_retry().
+ */
+static inline uint32_t fx_mem_seqlock_read_begin(const fx_mem_seqlock_t *lock,
+                                                 uint32_t idx) {
+	return __atomic_load_n(&lock->counters[idx].seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Finishes an optimistic read of the given slot.
+ *
+ * @param lock is the set of counters.
+ * @param idx is the index of the slot.
+ * @param start is the value returned by fx_mem_seqlock_read_begin().
+ * @return true if a write overlapped with the read; the data read must be
+ * discarded and the read repeated.
+ */
+static inline bool fx_mem_seqlock_read_retry(const fx_mem_seqlock_t *lock,
+                                             uint32_t idx, uint32_t start) {
+	/* Order the reads of the slot before the second read of the counter */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return (start & 1U) ||
+	       __atomic_load_n(&lock->counters[idx].seq, __ATOMIC_RELAXED) != start;
+}
+
+/**
+ * Marks the given slot as being modified.
+ */
+static inline void fx_mem_seqlock_write_begin(fx_mem_seqlock_t *lock,
+                                              uint32_t idx) {
+	/* Order the counter store before the stores to the slot */
+	const uint32_t seq =
+	    __atomic_load_n(&lock->counters[idx].seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&lock->counters[idx].seq, seq + 1U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Marks the modification of the given slot as complete.
+ */
+static inline void fx_mem_seqlock_write_end(fx_mem_seqlock_t *lock,
+                                            uint32_t idx) {
+	const uint32_t seq =
+	    __atomic_load_n(&lock->counters[idx].seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&lock->counters[idx].seq, seq + 1U, __ATOMIC_RELEASE);
+}
+
+/**
+ * Advances the counter of the given slot by a complete write; used when a
+ * slot is freed. May be called concurrently with readers, but not with
+ * writers of the same slot.
+ */
+static inline void fx_mem_seqlock_invalidate(fx_mem_seqlock_t *lock,
+                                             uint32_t idx) {
+	__atomic_add_fetch(&lock->counters[idx].seq, 2U, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_SEQLOCK_H */
@@ -0,0 +1,104 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_bitset.h>
+#include <foxen/mem_slice.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static uint32_t _fx_slice_slot_size(uint32_t buf_size) {
+	/* Keep the reference counter of each slot on its own cache line */
+	const uint64_t mask = FX_MEM_SLICE_HEADER_SIZE - 1U;
+	const uint64_t size =
+	    FX_MEM_SLICE_HEADER_SIZE + (((uint64_t)buf_size + mask) & ~mask);
+	return size > 0xFFFFFFFFU ? 0U : (uint32_t)size;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_slice_pool_size(uint32_t n_buffers, uint32_t buf_size) {
+	const uint32_t slot_size = _fx_slice_slot_size(buf_size);
+	const uint64_t n_bytes_slots = (uint64_t)n_buffers * slot_size;
+	if (slot_size == 0U || n_bytes_slots > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_slice_pool_t)) &&
+	          fx_mem_update_size(&size, sizeof(uint32_t) *
+	                                        fx_mem_bitset_n_words(n_buffers)) &&
+	          fx_mem_update_size(&size, FX_MEM_SLICE_HEADER_SIZE - FX_ALIGN) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes_slots);
+	return ok ? size : 0U;
+}
+
+fx_mem_slice_pool_t *fx_mem_slice_pool_init(void *mem, uint32_t n_buffers,
+                                            uint32_t buf_size) {
+	fx_mem_slice_pool_t *pool = (fx_mem_slice_pool_t *)fx_mem_align(
+	    &mem, sizeof(fx_mem_slice_pool_t));
+	pool->buf_size = buf_size;
+	pool->slot_size = _fx_slice_slot_size(buf_size);
+	pool->n_buffers = n_buffers;
+	pool->allocated = (uint32_t *)fx_mem_align(
+	    &mem, sizeof(uint32_t) * fx_mem_bitset_n_words(n_buffers));
+	pool->slots = (uint8_t *)fx_mem_align_ex(
+	    &mem, n_buffers * pool->slot_size, FX_MEM_SLICE_HEADER_SIZE);
+	fx_mem_zero_aligned(pool->allocated,
+	                    sizeof(uint32_t) * fx_mem_bitset_n_words(n_buffers));
+	pool->free_idx = 0U;
+	pool->n_allocated = 0U;
+	return pool;
+}
+
+uint8_t *fx_mem_slice_alloc(fx_mem_slice_pool_t *pool, fx_mem_slice_t *slice) {
+	const uint32_t slot = fx_mem_pool_alloc(pool->allocated, &pool->free_idx,
+	                                        &pool->n_allocated, pool->n_buffers);
+	if (slot >= pool->n_buffers) {
+		return NULL;
+	}
+	__atomic_store_n(fx_mem_slice_refcount(pool, slot), 1U, __ATOMIC_RELAXED);
+	uint8_t *data = (uint8_t *)fx_mem_slice_refcount(pool, slot) +
+	                FX_MEM_SLICE_HEADER_SIZE;
+	slice->data = data;
+	slice->length = pool->buf_size;
+	slice->slot = slot;
+	return data;
+}
+
+void fx_mem_slice_release_n(fx_mem_slice_pool_t *pool, uint32_t slot,
+                            uint32_t n) {
+	/* The thread dropping the last reference must observe all writes made by
+	   the other owners before the buffer is reused */
+	if (__atomic_sub_fetch(fx_mem_slice_refcount(pool, slot), n,
+	                       __ATOMIC_ACQ_REL) == 0U) {
+		fx_mem_pool_free(slot, pool->allocated, &pool->free_idx,
+		                 &pool->n_allocated);
+	}
+}
+
+void fx_mem_slice_batch_flush(fx_mem_slice_batch_t *batch) {
+	for (uint32_t i = 0U; i < batch->n_entries; i++) {
+		fx_mem_slice_release_n(batch->pool, batch->slots[i],
+		                       batch->counts[i]);
+	}
+	batch->n_entries = 0U;
+}
@@ -0,0 +1,231 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_slice.h
+ *
+ * Reference-counted, immutable byte slices. The buffers backing the slices are
+ * slots of a pool managed with fx_mem_pool_alloc(); each slot starts with a
+ * cache line holding its reference counter. A slice is a small value
+ * consisting of a pointer, a length and the slot index. Cloning and
+ * sub-slicing only increment the reference counter; the buffer returns to the
+ * pool when the last slice referencing it is released.
+ *
+ * Releasing many slices of the same hot buffer from several threads contends
+ * on its reference counter. A release batch owned by a single thread collects
+ * the releases per buffer and applies them with one atomic operation per
+ * buffer when it is flushed.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_SLICE_H
+#define FOXEN_MEM_SLICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size of the header in front of each buffer holding the reference counter.
+ */
+#define FX_MEM_SLICE_HEADER_SIZE 64U
+
+/**
+ * Number of distinct buffers a release batch can track.
+ */
+#define FX_MEM_SLICE_BATCH_SIZE 16U
+
+/**
+ * Pool of buffers backing the slices.
+ */
+typedef struct fx_mem_slice_pool {
+	uint32_t buf_size;
+	uint32_t slot_size;
+	uint32_t n_buffers;
+	uint32_t *allocated;
+	uint8_t *slots;
+
+	/* Frequently modified state, placed on its own cache line */
+	uint8_t _pad0[64];
+	uint32_t free_idx;
+	uint32_t n_allocated;
+	uint8_t _pad1[64];
+} fx_mem_slice_pool_t;
+
+/**
+ * Slice referencing a range of a pooled buffer.
+ */
+typedef struct fx_mem_slice {
+	const uint8_t *data;
+	uint32_t length;
+	uint32_t slot;
+} fx_mem_slice_t;
+
+/**
+ * Collects releases of slices; must only be used by a single thread.
+ */
+typedef struct fx_mem_slice_batch {
+	fx_mem_slice_pool_t *pool;
+	uint32_t n_entries;
+	uint32_t slots[FX_MEM_SLICE_BATCH_SIZE];
+	uint32_t counts[FX_MEM_SLICE_BATCH_SIZE];
+} fx_mem_slice_batch_t;
+
+/**
+ * Computes the size of the memory region required to store a slice pool.
+ *
+ * @param n_buffers is the number of buffers.
+ * @param buf_size is the size of each buffer in bytes.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_slice_pool_size(uint32_t n_buffers, uint32_t buf_size);
+
+/**
+ * Initialises a slice pool in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least
+ * fx_mem_slice_pool_size() bytes.
+ * @param n_buffers is the number of buffers.
+ * @param buf_size is the size of each buffer in bytes.
+ * @return a pointer at the pool.
+ */
+fx_mem_slice_pool_t *fx_mem_slice_pool_init(void *mem, uint32_t n_buffers,
+                                            uint32_t buf_size);
+
+/**
+ * Allocates a buffer with a reference count of one.
+ *
+ * @param pool is the pool.
+ * @param slice receives a slice covering the entire buffer.
+ * @return a writable pointer at the buffer, or NULL if all buffers are in use.
+ * The buffer must not be modified once it has been shared.
+ */
+uint8_t *fx_mem_slice_alloc(fx_mem_slice_pool_t *pool, fx_mem_slice_t *slice);
+
+/**
+ * Returns a pointer at the reference counter of the given buffer.
+ */
+static inline uint32_t *fx_mem_slice_refcount(const fx_mem_slice_pool_t *pool,
+                                              uint32_t slot) {
+	return (uint32_t *)(pool->slots + (size_t)slot * pool->slot_size);
+}
+
+/**
+ * Returns a new reference to the same range as the given slice.
+ */
+static inline fx_mem_slice_t fx_mem_slice_clone(fx_mem_slice_pool_t *pool,
+                                                const fx_mem_slice_t *slice) {
+	__atomic_fetch_add(fx_mem_slice_refcount(pool, slice->slot), 1U,
+	                   __ATOMIC_RELAXED);
+	return *slice;
+}
+
+/**
+ * Returns a new reference to a sub-range of the given slice. The range is
+ * clamped to the slice.
+ *
+ * @param pool is the pool.
+ * @param slice is the slice.
+ * @param offset is the offset of the sub-range relative to the slice.
+ * @param length is the length of the sub-range.
+ */
+static inline fx_mem_slice_t fx_mem_slice_sub(fx_mem_slice_pool_t *pool,
+                                              const fx_mem_slice_t *slice,
+                                              uint32_t offset,
+                                              uint32_t length) {
+	fx_mem_slice_t res = fx_mem_slice_clone(pool, slice);
+	if (offset > slice->length) {
+		offset = slice->length;
+	}
+	if (length > slice->length - offset) {
+		length = slice->length - offset;
+	}
+	res.data += offset;
+	res.length = length;
+	return res;
+}
+
+/**
+ * Drops n references to the given buffer and returns it to the pool if it was
+ * the last reference.
+ */
+void fx_mem_slice_release_n(fx_mem_slice_pool_t *pool, uint32_t slot,
+                            uint32_t n);
+
+/**
+ * Releases a slice.
+ */
+static inline void fx_mem_slice_release(fx_mem_slice_pool_t *pool,
+                                        fx_mem_slice_t *slice) {
+	fx_mem_slice_release_n(pool, slice->slot, 1U);
+	slice->data = NULL;
+	slice->length = 0U;
+}
+
+/**
+ * Initialises an empty release batch.
+ */
+static inline void fx_mem_slice_batch_init(fx_mem_slice_batch_t *batch,
+                                           fx_mem_slice_pool_t *pool) {
+	batch->pool = pool;
+	batch->n_entries = 0U;
+}
+
+/**
+ * Applies all releases collected in the batch.
+ */
+void fx_mem_slice_batch_flush(fx_mem_slice_batch_t *batch);
+
+/**
+ * Adds the release of a slice to the batch. Flushes the batch if it already
+ * tracks FX_MEM_SLICE_BATCH_SIZE other buffers. The buffer is returned to the
+ * pool no earlier than the batch is flushed.
+ */
+static inline void fx_mem_slice_batch_release(fx_mem_slice_batch_t *batch,
+                                              fx_mem_slice_t *slice) {
+	for (uint32_t i = 0U; i < batch->n_entries; i++) {
+		if (batch->slots[i] == slice->slot) {
+			batch->counts[i]++;
+			slice->data = NULL;
+			slice->length = 0U;
+			return;
+		}
+	}
+	if (batch->n_entries == FX_MEM_SLICE_BATCH_SIZE) {
+		fx_mem_slice_batch_flush(batch);
+	}
+	batch->slots[batch->n_entries] = slice->slot;
+	batch->counts[batch->n_entries] = 1U;
+	batch->n_entries++;
+	slice->data = NULL;
+	slice->length = 0U;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_SLICE_H */
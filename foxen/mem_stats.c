@@ -0,0 +1,270 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#define FX_MEM_STATS_HAVE_SHM
+#endif
+
+#include <string.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_stats.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+/* Number of attempts of fx_mem_stats_read() to obtain a consistent copy */
+#define FX_STATS_READ_RETRIES 1000U
+
+typedef struct {
+	fx_mem_stats_page_t *page;
+	uint32_t n_entries;
+} _fx_stats_publish_t;
+
+static void _fx_stats_yield(void) {
+#ifdef FX_MEM_STATS_HAVE_SHM
+	sched_yield();
+#endif
+}
+
+/* The page is read while the publisher may be writing to it; all fields are
+   thus accessed with relaxed atomic operations */
+static void _fx_stats_store(uint64_t *tar, uint64_t value) {
+	__atomic_store_n(tar, value, __ATOMIC_RELAXED);
+}
+
+static uint64_t _fx_stats_load(const uint64_t *src) {
+	return __atomic_load_n(src, __ATOMIC_RELAXED);
+}
+
+static void _fx_stats_copy_entry(fx_mem_stats_entry_t *tar,
+                                 const fx_mem_stats_entry_t *src) {
+	for (uint32_t i = 0U; i < FX_MEM_STATS_NAME_LEN; i++) {
+		tar->name[i] = __atomic_load_n(&src->name[i], __ATOMIC_RELAXED);
+	}
+	tar->n_bytes_reserved = _fx_stats_load(&src->n_bytes_reserved);
+	tar->n_bytes_used = _fx_stats_load(&src->n_bytes_used);
+	tar->n_bytes_peak = _fx_stats_load(&src->n_bytes_peak);
+	tar->n_allocations = _fx_stats_load(&src->n_allocations);
+	tar->n_allocs_total = _fx_stats_load(&src->n_allocs_total);
+	tar->n_frees_total = _fx_stats_load(&src->n_frees_total);
+	tar->n_contended = _fx_stats_load(&src->n_contended);
+}
+
+static uint64_t _fx_stats_timestamp(void) {
+#ifdef FX_MEM_STATS_HAVE_SHM
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+	}
+#endif
+	return 0U;
+}
+
+static void _fx_stats_publish_member(fx_mem_budget_member_t *member,
+                                     void *data) {
+	_fx_stats_publish_t *state = (_fx_stats_publish_t *)data;
+	if (state->n_entries >= state->page->max_entries) {
+		return;
+	}
+
+	fx_mem_allocator_stats_t stats;
+	fx_mem_allocator_stats(member->allocator, &stats);
+
+	fx_mem_stats_entry_t *entry = &state->page->entries[state->n_entries++];
+	const char *name = member->name ? member->name : "";
+	for (uint32_t i = 0U; i < FX_MEM_STATS_NAME_LEN; i++) {
+		const char c = (i + 1U < FX_MEM_STATS_NAME_LEN) ? *name : '\0';
+		__atomic_store_n(&entry->name[i], c, __ATOMIC_RELAXED);
+		name += (c != '\0');
+	}
+	_fx_stats_store(&entry->n_bytes_reserved, stats.n_bytes_reserved);
+	_fx_stats_store(&entry->n_bytes_used, stats.n_bytes_used);
+	_fx_stats_store(&entry->n_bytes_peak, stats.n_bytes_peak);
+	_fx_stats_store(&entry->n_allocations, stats.n_allocations);
+	_fx_stats_store(&entry->n_allocs_total, stats.n_allocs_total);
+	_fx_stats_store(&entry->n_frees_total, stats.n_frees_total);
+	_fx_stats_store(&entry->n_contended, stats.n_contended);
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_stats_size(uint32_t max_entries) {
+	const uint64_t size = sizeof(fx_mem_stats_page_t) +
+	                      (uint64_t)max_entries * sizeof(fx_mem_stats_entry_t);
+	return (size > 0xFFFFFFFFU) ? 0U : (uint32_t)size;
+}
+
+fx_mem_stats_page_t *fx_mem_stats_init(void *mem, uint32_t max_entries) {
+	fx_mem_stats_page_t *page = (fx_mem_stats_page_t *)mem;
+	memset(page, 0, fx_mem_stats_size(max_entries));
+	page->magic = FX_MEM_STATS_MAGIC;
+	page->version = FX_MEM_STATS_VERSION;
+	page->max_entries = max_entries;
+	return page;
+}
+
+void fx_mem_stats_publish(fx_mem_stats_page_t *page, fx_mem_budget_t *budget) {
+	/* Mark the page as being updated. The release fence makes sure that the
+	   odd sequence number is visible before any of the data is changed. */
+	const uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->seq, seq + 1U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	_fx_stats_publish_t state = {page, 0U};
+	fx_mem_budget_foreach(budget, _fx_stats_publish_member, &state);
+	__atomic_store_n(&page->n_entries, state.n_entries, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->pressure, fx_mem_budget_under_pressure(budget),
+	                 __ATOMIC_RELAXED);
+	_fx_stats_store(&page->timestamp, _fx_stats_timestamp());
+	_fx_stats_store(&page->budget_limit, budget->limit);
+	_fx_stats_store(&page->budget_used, fx_mem_budget_used(budget));
+	_fx_stats_store(&page->budget_reserved, fx_mem_budget_reserved(budget));
+
+	__atomic_store_n(&page->seq, seq + 2U, __ATOMIC_RELEASE);
+}
+
+bool fx_mem_stats_read(const fx_mem_stats_page_t *page,
+                       fx_mem_stats_page_t *snapshot, uint32_t max_entries) {
+	if (page->magic != FX_MEM_STATS_MAGIC ||
+	    page->version != FX_MEM_STATS_VERSION) {
+		return false;
+	}
+	for (uint32_t retry = 0U; retry < FX_STATS_READ_RETRIES; retry++) {
+		const uint32_t seq0 = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1U) {
+			_fx_stats_yield(); /* The publisher is updating the page */
+			continue;
+		}
+
+		uint32_t n_entries =
+		    __atomic_load_n(&page->n_entries, __ATOMIC_RELAXED);
+		if (n_entries > page->max_entries) {
+			n_entries = page->max_entries;
+		}
+		if (n_entries > max_entries) {
+			n_entries = max_entries;
+		}
+		snapshot->magic = page->magic;
+		snapshot->version = page->version;
+		snapshot->seq = seq0;
+		snapshot->max_entries = max_entries;
+		snapshot->n_entries = n_entries;
+		snapshot->pressure = __atomic_load_n(&page->pressure, __ATOMIC_RELAXED);
+		snapshot->timestamp = _fx_stats_load(&page->timestamp);
+		snapshot->budget_limit = _fx_stats_load(&page->budget_limit);
+		snapshot->budget_used = _fx_stats_load(&page->budget_used);
+		snapshot->budget_reserved = _fx_stats_load(&page->budget_reserved);
+		for (uint32_t i = 0U; i < n_entries; i++) {
+			_fx_stats_copy_entry(&snapshot->entries[i], &page->entries[i]);
+		}
+
+		/* Make sure all data was read before checking the sequence number */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef FX_MEM_STATS_HAVE_SHM
+
+fx_mem_stats_page_t *fx_mem_stats_create(const char *name,
+                                         uint32_t max_entries) {
+	const uint32_t size = fx_mem_stats_size(max_entries);
+	if (!size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	void *mem = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	return (mem == MAP_FAILED) ? NULL : fx_mem_stats_init(mem, max_entries);
+}
+
+const fx_mem_stats_page_t *fx_mem_stats_attach(const char *name) {
+	const int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	void *mem = MAP_FAILED;
+	if (fstat(fd, &st) == 0 &&
+	    (size_t)st.st_size >= sizeof(fx_mem_stats_page_t)) {
+		mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* Make sure the page is valid and the entries are actually mapped */
+	const fx_mem_stats_page_t *page = (const fx_mem_stats_page_t *)mem;
+	if (page->magic != FX_MEM_STATS_MAGIC ||
+	    (size_t)st.st_size < fx_mem_stats_size(page->max_entries)) {
+		munmap(mem, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+	return page;
+}
+
+void fx_mem_stats_detach(const fx_mem_stats_page_t *page) {
+	if (page) {
+		munmap((void *)page, fx_mem_stats_size(page->max_entries));
+	}
+}
+
+void fx_mem_stats_unlink(const char *name) { shm_unlink(name); }
+
+#else /* FX_MEM_STATS_HAVE_SHM */
+
+fx_mem_stats_page_t *fx_mem_stats_create(const char *name,
+                                         uint32_t max_entries) {
+	return NULL;
+}
+
+const fx_mem_stats_page_t *fx_mem_stats_attach(const char *name) {
+	return NULL;
+}
+
+void fx_mem_stats_detach(const fx_mem_stats_page_t *page) {}
+
+void fx_mem_stats_unlink(const char *name) {}
+
+#endif /* FX_MEM_STATS_HAVE_SHM */
@@ -0,0 +1,192 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_stats.h
+ *
+ * Statistics page for external monitoring. A publisher periodically copies
+ * the statistics of all allocators registered with a budget into a page that
+ * is protected by a sequence lock. The page can be placed in POSIX shared
+ * memory, so that a monitoring process can read it without calling into the
+ * library. Allocating threads are never involved in publishing or reading the
+ * page.
+ *
+ * The occupancy of each allocator is derived from state the allocator
+ * maintains anyway. The high-water mark, the allocation and free totals, and
+ * the contention counter are only published for allocators with attached
+ * counters (see fx_mem_allocator_set_counters()) and are zero otherwise.
+ * These counters are accumulated per thread stripe and summed up by the
+ * publisher, so allocating threads only write to their own cache line.
+ *
+ * The layout of the page only consists of fixed-width integers and is
+ * identical for all processes on the same machine.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_STATS_H
+#define FOXEN_MEM_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <foxen/mem_budget.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Magic number at the beginning of each statistics page ("FXMS").
+ */
+#define FX_MEM_STATS_MAGIC 0x534D5846U
+
+/**
+ * Version of the page layout. Incremented whenever the layout changes.
+ */
+#define FX_MEM_STATS_VERSION 1U
+
+/**
+ * Maximum length of an allocator name, including the terminating zero.
+ */
+#define FX_MEM_STATS_NAME_LEN 32U
+
+/**
+ * Statistics of a single allocator. See fx_mem_allocator_stats_t for a
+ * description of the counters.
+ */
+typedef struct fx_mem_stats_entry {
+	char name[FX_MEM_STATS_NAME_LEN];
+	uint64_t n_bytes_reserved;
+	uint64_t n_bytes_used;
+	uint64_t n_bytes_peak;
+	uint64_t n_allocations;
+	uint64_t n_allocs_total;
+	uint64_t n_frees_total;
+	uint64_t n_contended;
+} fx_mem_stats_entry_t;
+
+/**
+ * Statistics page header, followed by max_entries entries.
+ */
+typedef struct fx_mem_stats_page {
+	uint32_t magic;
+	uint32_t version;
+
+	/* Sequence counter. Odd while the publisher is updating the page. */
+	uint32_t seq;
+
+	uint32_t max_entries;
+	uint32_t n_entries;
+	uint32_t pressure;
+
+	/* Time of the last update in nanoseconds (CLOCK_MONOTONIC) */
+	uint64_t timestamp;
+
+	/* Budget the entries were taken from */
+	uint64_t budget_limit;
+	uint64_t budget_used;
+	uint64_t budget_reserved;
+
+	fx_mem_stats_entry_t entries[];
+} fx_mem_stats_page_t;
+
+/**
+ * Computes the size of a statistics page.
+ *
+ * @param max_entries is the maximum number of allocators that can be
+ * published.
+ * @return the size of the page in bytes or zero if there was an overflow.
+ */
+uint32_t fx_mem_stats_size(uint32_t max_entries);
+
+/**
+ * Initialises a statistics page in the given memory region.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_stats_size()
+ * bytes.
+ * @param max_entries is the maximum number of allocators that can be
+ * published.
+ * @return a pointer at the page.
+ */
+fx_mem_stats_page_t *fx_mem_stats_init(void *mem, uint32_t max_entries);
+
+/**
+ * Copies the statistics of all members of the given budget into the page.
+ * Members that do not fit into the page are skipped. There must be only one
+ * publisher per page.
+ *
+ * @param page is the page that should be updated.
+ * @param budget is the budget whose members should be published.
+ */
+void fx_mem_stats_publish(fx_mem_stats_page_t *page, fx_mem_budget_t *budget);
+
+/**
+ * Reads a consistent snapshot of the page. Retries a bounded number of times
+ * while the publisher is updating the page, yielding the processor in between.
+ *
+ * @param page is the page that should be read, e.g. a page mapped with
+ * fx_mem_stats_attach().
+ * @param snapshot is a memory region of at least fx_mem_stats_size(
+ * max_entries) bytes receiving the snapshot.
+ * @param max_entries is the maximum number of entries that fit into the
+ * snapshot. Further entries are not copied.
+ * @return false if the page has an unknown format, or if no consistent
+ * snapshot could be obtained, e.g. because the publisher was terminated while
+ * updating the page. The latter case is indicated by an odd sequence number.
+ */
+bool fx_mem_stats_read(const fx_mem_stats_page_t *page,
+                       fx_mem_stats_page_t *snapshot, uint32_t max_entries);
+
+/**
+ * Creates (or replaces) a POSIX shared memory object with the given name and
+ * initialises a statistics page in it. Only available on POSIX systems.
+ *
+ * @param name is the name of the shared memory object, e.g. "/myapp.mem".
+ * @param max_entries is the maximum number of allocators that can be
+ * published.
+ * @return a pointer at the mapped page or NULL on failure; errno is set
+ * accordingly.
+ */
+fx_mem_stats_page_t *fx_mem_stats_create(const char *name,
+                                         uint32_t max_entries);
+
+/**
+ * Maps an existing statistics page read-only.
+ *
+ * @param name is the name that was passed to fx_mem_stats_create().
+ * @return a pointer at the mapped page or NULL on failure.
+ */
+const fx_mem_stats_page_t *fx_mem_stats_attach(const char *name);
+
+/**
+ * Unmaps a page returned by fx_mem_stats_create() or fx_mem_stats_attach().
+ */
+void fx_mem_stats_detach(const fx_mem_stats_page_t *page);
+
+/**
+ * Removes the shared memory object with the given name. Existing mappings
+ * stay valid.
+ */
+void fx_mem_stats_unlink(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_STATS_H */
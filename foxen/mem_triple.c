@@ -0,0 +1,62 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_triple.h>
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+static uint64_t _fx_triple_instance_size(uint32_t instance_size) {
+	return ((uint64_t)instance_size + FX_MEM_TRIPLE_ALIGN - 1U) &
+	       ~(uint64_t)(FX_MEM_TRIPLE_ALIGN - 1U);
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+uint32_t fx_mem_triple_size(uint32_t instance_size) {
+	const uint64_t n_bytes = 3U * _fx_triple_instance_size(instance_size);
+	if (instance_size == 0U || n_bytes > 0xFFFFFFFFU) {
+		return 0U;
+	}
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(fx_mem_triple_t)) &&
+	          fx_mem_update_size(&size, FX_MEM_TRIPLE_ALIGN - FX_ALIGN) &&
+	          fx_mem_update_size(&size, (uint32_t)n_bytes);
+	return ok ? size : 0U;
+}
+
+fx_mem_triple_t *fx_mem_triple_init(void *mem, uint32_t instance_size) {
+	fx_mem_triple_t *tb =
+	    (fx_mem_triple_t *)fx_mem_align(&mem, sizeof(fx_mem_triple_t));
+	memset(tb, 0, sizeof(fx_mem_triple_t));
+	tb->instance_size = (uint32_t)_fx_triple_instance_size(instance_size);
+	tb->instances =
+	    (uint8_t *)fx_mem_align_ex(&mem, 3U * tb->instance_size,
+	                               FX_MEM_TRIPLE_ALIGN);
+	tb->front = 0U;
+	tb->middle = 1U;
+	tb->back = 2U;
+	tb->has_front = false;
+	return tb;
+}
@@ -0,0 +1,173 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mem_triple.h
+ *
+ * Lock-free triple buffer for publishing large snapshots from one writer
+ * thread to one reader thread. The buffer holds three instances of a
+ * datastructure: the writer builds the next snapshot in the back instance,
+ * the reader accesses the front instance, and the third instance holds the
+ * latest published snapshot. Publishing and acquiring a snapshot each swap an
+ * instance index with a single atomic exchange; neither side ever blocks,
+ * waits for the other, or copies data.
+ *
+ * Each instance is an independent, cache line aligned memory region of the
+ * given size. Build datastructures inside an instance with the usual
+ * *_init(mem, ...) functions. The writer reuses instances, so it must rebuild
+ * or update the back instance completely before publishing it.
+ *
+ * Each triple buffer has a single reader. Publish to multiple readers by
+ * using one triple buffer per reader.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MEM_TRIPLE_H
+#define FOXEN_MEM_TRIPLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <foxen/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Alignment of the instances; corresponds to the cache line size.
+ */
+#define FX_MEM_TRIPLE_ALIGN 64U
+
+/**
+ * Flag set in the shared index if the instance it refers to has been
+ * published but not yet acquired by the reader.
+ */
+#define FX_MEM_TRIPLE_FRESH 4U
+
+/**
+ * Triple buffer. Do not modify the members directly.
+ */
+typedef struct fx_mem_triple {
+	uint32_t instance_size; /* padded to FX_MEM_TRIPLE_ALIGN */
+	uint8_t *instances;
+
+	/* Index of the latest published instance and the FX_MEM_TRIPLE_FRESH
+	   flag, shared by writer and reader */
+	uint8_t _pad0[64];
+	uint32_t middle;
+
+	/* Index owned by the writer */
+	uint8_t _pad1[64];
+	uint32_t back;
+
+	/* Index owned by the reader */
+	uint8_t _pad2[64];
+	uint32_t front;
+	bool has_front;
+	uint8_t _pad3[64];
+} fx_mem_triple_t;
+
+/**
+ * Computes the size of the memory region required to store a triple buffer
+ * with instances of the given size.
+ *
+ * @param instance_size is the size of each instance in bytes, e.g. the value
+ * returned by the *_size() function of the datastructure.
+ * @return the size of the memory region in bytes, or zero if there was an
+ * overflow.
+ */
+uint32_t fx_mem_triple_size(uint32_t instance_size);
+
+/**
+ * Initialises a triple buffer. The contents of the instances are
+ * uninitialised.
+ *
+ * @param mem is a pointer at a memory region of at least fx_mem_triple_size()
+ * bytes.
+ * @param instance_size is the size of each instance in bytes.
+ * @return a pointer at the triple buffer.
+ */
+fx_mem_triple_t *fx_mem_triple_init(void *mem, uint32_t instance_size);
+
+/**
+ * Returns a pointer at the instance with the given index.
+ */
+static inline void *fx_mem_triple_instance(const fx_mem_triple_t *tb,
+                                           uint32_t idx) {
+	return tb->instances + (size_t)idx * tb->instance_size;
+}
+
+/**
+ * Returns the instance the writer builds the next snapshot in. Must only be
+ * called by the writer. The instance changes with each call to
+ * fx_mem_triple_publish().
+ */
+static inline void *fx_mem_triple_back(fx_mem_triple_t *tb) {
+	return fx_mem_triple_instance(tb, tb->back);
+}
+
+/**
+ * Publishes the back instance as the latest snapshot and hands the writer a
+ * new back instance. A snapshot the reader has not acquired yet is replaced.
+ * Must only be called by the writer.
+ *
+ * @return the new back instance.
+ */
+static inline void *fx_mem_triple_publish(fx_mem_triple_t *tb) {
+	/* Release the contents of the back instance, acquire the reader's
+	   accesses to the instance it handed back */
+	tb->back = __atomic_exchange_n(&tb->middle, tb->back | FX_MEM_TRIPLE_FRESH,
+	                               __ATOMIC_ACQ_REL) &
+	           (FX_MEM_TRIPLE_FRESH - 1U);
+	return fx_mem_triple_back(tb);
+}
+
+/**
+ * Returns the latest published snapshot. The snapshot remains valid and
+ * unchanged until the next call to fx_mem_triple_read(). Must only be called
+ * by the reader.
+ *
+ * @param tb is the triple buffer.
+ * @param updated is set to true if the snapshot changed since the last call.
+ * May be NULL.
+ * @return a pointer at the snapshot, or NULL if nothing was published yet.
+ */
+static inline const void *fx_mem_triple_read(fx_mem_triple_t *tb,
+                                             bool *updated) {
+	const bool fresh = __atomic_load_n(&tb->middle, __ATOMIC_RELAXED) &
+	                   FX_MEM_TRIPLE_FRESH;
+	if (fresh) {
+		tb->front = __atomic_exchange_n(&tb->middle, tb->front,
+		                                __ATOMIC_ACQ_REL) &
+		            (FX_MEM_TRIPLE_FRESH - 1U);
+		tb->has_front = true;
+	}
+	if (updated) {
+		*updated = fresh;
+	}
+	return tb->has_front ? fx_mem_triple_instance(tb, tb->front) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOXEN_MEM_TRIPLE_H */
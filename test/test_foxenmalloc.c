@@ -0,0 +1,170 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <foxen/unittest.h>
+
+#include "foxenmalloc.h"
+#include "test_threads.h"
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static void test_malloc_sizes(void) {
+	for (size_t size = 0U; size < 3U * FX_MALLOC_MAX_SMALL; size += 97U) {
+		uint8_t *ptr = (uint8_t *)fx_malloc(size);
+		EXPECT_TRUE(ptr != NULL);
+		EXPECT_EQ(0U, (uintptr_t)ptr & 15U);
+		EXPECT_TRUE(fx_malloc_usable_size(ptr) >= size);
+		EXPECT_TRUE(fx_malloc_usable_size(ptr) < size + size / 4U + 4096U);
+		memset(ptr, 0xAB, fx_malloc_usable_size(ptr));
+		fx_free(ptr);
+	}
+	fx_free(NULL);
+	EXPECT_EQ(0U, fx_malloc_usable_size(NULL));
+}
+
+static void test_malloc_reuse(void) {
+	/* Freed blocks are handed out again for the same size class */
+	void *ptrs[1000];
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		ptrs[i] = fx_malloc(48U);
+	}
+	void *first = ptrs[0];
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		fx_free(ptrs[i]);
+	}
+	bool found = false;
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		ptrs[i] = fx_malloc(40U);
+		found = found || ptrs[i] == first;
+	}
+	EXPECT_TRUE(found);
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		fx_free(ptrs[i]);
+	}
+}
+
+static void test_malloc_calloc_realloc(void) {
+	uint8_t *ptr = (uint8_t *)fx_malloc(100U);
+	memset(ptr, 0xFF, 100U);
+	fx_free(ptr);
+	ptr = (uint8_t *)fx_calloc(10U, 10U);
+	for (uint32_t i = 0U; i < 100U; i++) {
+		EXPECT_EQ(0U, ptr[i]);
+		ptr[i] = (uint8_t)i;
+	}
+	EXPECT_TRUE(fx_calloc(SIZE_MAX / 2U, 3U) == NULL);
+
+	/* Grow from a pooled block into a mapped block and back */
+	const size_t sizes[] = {120U, 4000U, 100000U, 3000000U, 200000U, 50U};
+	for (uint32_t i = 0U; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		ptr = (uint8_t *)fx_realloc(ptr, sizes[i]);
+		EXPECT_TRUE(ptr != NULL);
+		EXPECT_TRUE(fx_malloc_usable_size(ptr) >= sizes[i]);
+		EXPECT_EQ(49U, ptr[49]);
+		ptr[sizes[i] - 1U] = 1U;
+	}
+	EXPECT_TRUE(fx_realloc(ptr, 0U) == NULL);
+	ptr = (uint8_t *)fx_realloc(NULL, 10U);
+	EXPECT_TRUE(ptr != NULL);
+	fx_free(ptr);
+}
+
+static void test_malloc_memalign(void) {
+	const size_t sizes[] = {1U, 100U, 5000U, 40000U, 1000000U};
+	for (size_t align = 8U; align <= 65536U; align *= 2U) {
+		for (uint32_t i = 0U; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			uint8_t *ptr = (uint8_t *)fx_memalign(align, sizes[i]);
+			EXPECT_TRUE(ptr != NULL);
+			EXPECT_EQ(0U, (uintptr_t)ptr & (align - 1U));
+			EXPECT_TRUE(fx_malloc_usable_size(ptr) >= sizes[i]);
+			memset(ptr, 1, sizes[i]);
+			ptr = (uint8_t *)fx_realloc(ptr, sizes[i] * 2U);
+			EXPECT_EQ(1U, ptr[sizes[i] - 1U]);
+			fx_free(ptr);
+		}
+	}
+	EXPECT_TRUE(fx_memalign(48U, 10U) == NULL);
+}
+
+static void test_malloc_std(void) {
+	/* Exercises the replacement when the test runs with LD_PRELOAD */
+	void *ptr = NULL;
+	EXPECT_EQ(0, posix_memalign(&ptr, 256U, 1000U));
+	EXPECT_EQ(0U, (uintptr_t)ptr & 255U);
+	EXPECT_TRUE(posix_memalign(&ptr, 3U, 1000U) != 0);
+	free(ptr);
+	char *str = (char *)calloc(6U, 1U);
+	memcpy(str, "hello", 5U);
+	str = (char *)realloc(str, 100000U);
+	EXPECT_EQ(0, strcmp(str, "hello"));
+	free(str);
+}
+
+#define N_THREADS 4U
+#define N_OPS 200000U
+#define N_LIVE 256U
+
+static void *thread_main(void *arg) {
+	uint8_t *live[N_LIVE] = {NULL};
+	size_t sizes[N_LIVE] = {0U};
+	uint32_t seed = (uint32_t)(uintptr_t)arg * 7919U + 1U;
+	bool ok = true;
+	for (uint32_t i = 0U; i < N_OPS; i++) {
+		seed = seed * 1103515245U + 12345U;
+		const uint32_t j = (seed >> 8U) % N_LIVE;
+		if (live[j]) {
+			const uint8_t tag = (uint8_t)(uintptr_t)live[j];
+			ok = ok && live[j][0] == tag && live[j][sizes[j] - 1U] == tag;
+			fx_free(live[j]);
+		}
+		sizes[j] = 1U + (seed >> 16U) % ((seed & 1U) ? 64U : 2048U);
+		live[j] = (uint8_t *)fx_malloc(sizes[j]);
+		live[j][0] = live[j][sizes[j] - 1U] = (uint8_t)(uintptr_t)live[j];
+	}
+	for (uint32_t j = 0U; j < N_LIVE; j++) {
+		fx_free(live[j]);
+	}
+	return ok ? arg : NULL;
+}
+
+static void test_malloc_threads(void) {
+	EXPECT_TRUE(test_run_threads(N_THREADS, thread_main));
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_malloc_sizes);
+	RUN(test_malloc_reuse);
+	RUN(test_malloc_calloc_realloc);
+	RUN(test_malloc_memalign);
+	RUN(test_malloc_std);
+	RUN(test_malloc_threads);
+	DONE;
+}
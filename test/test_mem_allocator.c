@@ -0,0 +1,158 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[65536] __attribute__((aligned(64)));
+
+/* Generic code only knowing about the allocator interface */
+static uint32_t _fill_allocator(fx_mem_allocator_t *allocator, void *ptrs[],
+                                uint32_t n_max, size_t size) {
+	uint32_t n = 0U;
+	for (; n < n_max; n++) {
+		ptrs[n] = fx_mem_allocator_alloc(allocator, size, FX_ALIGN);
+		if (!ptrs[n]) {
+			break;
+		}
+		EXPECT_EQ(0U, (uintptr_t)ptrs[n] & (FX_ALIGN - 1U));
+		memset(ptrs[n], (int)n, size);
+	}
+	for (uint32_t i = 0U; i < n; i++) {
+		EXPECT_EQ((uint8_t)i, ((uint8_t *)ptrs[i])[size - 1U]);
+	}
+	return n;
+}
+
+static void test_static_pool(void) {
+	const uint32_t size = fx_mem_static_pool_size(100U, 40U);
+	ASSERT_LT(0U, size);
+	ASSERT_GT(sizeof(mem) + 1U, size);
+
+	fx_mem_static_pool_t *pool = fx_mem_static_pool_init(mem + 3, 100U, 40U);
+	fx_mem_allocator_t *allocator = &pool->allocator;
+	EXPECT_EQ(48U, pool->slot_size);
+	EXPECT_TRUE((uint8_t *)pool->slots + 100U * 48U <= mem + 3 + size);
+
+	/* Requests larger than the slot size must fail */
+	EXPECT_TRUE(fx_mem_allocator_alloc(allocator, 49U, 1U) == NULL);
+	EXPECT_TRUE(fx_mem_allocator_alloc(allocator, 8U, 64U) == NULL);
+
+	void *ptrs[128];
+	EXPECT_EQ(100U, _fill_allocator(allocator, ptrs, 128U, 48U));
+
+	fx_mem_allocator_stats_t stats;
+	fx_mem_allocator_stats(allocator, &stats);
+	EXPECT_EQ(4800U, stats.n_bytes_reserved);
+	EXPECT_EQ(4800U, stats.n_bytes_used);
+	EXPECT_EQ(100U, stats.n_allocations);
+
+	/* Resizing within the slot works in place */
+	EXPECT_TRUE(ptrs[5] == fx_mem_allocator_realloc(allocator, ptrs[5], 48U,
+	                                                 20U, FX_ALIGN));
+	EXPECT_TRUE(NULL == fx_mem_allocator_realloc(allocator, ptrs[5], 20U, 49U,
+	                                              FX_ALIGN));
+
+	/* Freed slots are reused */
+	fx_mem_allocator_free(allocator, ptrs[17], 48U);
+	fx_mem_allocator_free(allocator, NULL, 48U);
+	EXPECT_TRUE(ptrs[17] == fx_mem_static_pool_alloc(pool));
+	EXPECT_EQ(17U, fx_mem_static_pool_idx(pool, ptrs[17]));
+	EXPECT_TRUE(fx_mem_static_pool_owns(pool, ptrs[99]));
+	EXPECT_FALSE(fx_mem_static_pool_owns(pool, (uint8_t *)ptrs[99] + 48U));
+
+	/* Resetting the pool frees everything */
+	fx_mem_allocator_reset(allocator);
+	fx_mem_allocator_stats(allocator, &stats);
+	EXPECT_EQ(0U, stats.n_allocations);
+	EXPECT_EQ(100U, _fill_allocator(allocator, ptrs, 128U, 10U));
+}
+
+static void test_arena(void) {
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem + 5, 4096U);
+	ASSERT_LT(0U, (uintptr_t)arena);
+	fx_mem_allocator_t *allocator = &arena->allocator;
+	EXPECT_TRUE(arena->base + arena->capacity == mem + 5 + 4096U);
+
+	/* Allocations respect the requested alignment */
+	uint8_t *p1 = (uint8_t *)fx_mem_allocator_alloc(allocator, 3U, 1U);
+	uint8_t *p2 = (uint8_t *)fx_mem_allocator_alloc(allocator, 10U, 64U);
+	EXPECT_TRUE(p1 == arena->base);
+	EXPECT_EQ(0U, (uintptr_t)p2 & 63U);
+	EXPECT_TRUE(p2 > p1);
+
+	/* The most recent allocation can be resized in place */
+	EXPECT_TRUE(p2 == fx_mem_allocator_realloc(allocator, p2, 10U, 100U, 64U));
+	fx_mem_allocator_stats_t stats;
+	fx_mem_allocator_stats(allocator, &stats);
+	EXPECT_EQ((size_t)(p2 - arena->base) + 100U, stats.n_bytes_used);
+	EXPECT_EQ(2U, stats.n_allocations);
+
+	/* Others are moved */
+	memset(p1, 0xAB, 3U);
+	uint8_t *p3 = (uint8_t *)fx_mem_allocator_realloc(allocator, p1, 3U, 20U, 1U);
+	EXPECT_TRUE(p3 > p2);
+	EXPECT_EQ(0xABU, p3[2]);
+
+	/* Freeing the last allocation reclaims the memory */
+	fx_mem_allocator_stats(allocator, &stats);
+	const size_t used = stats.n_bytes_used;
+	fx_mem_allocator_free(allocator, p3, 20U);
+	fx_mem_allocator_stats(allocator, &stats);
+	EXPECT_EQ(used - 20U, stats.n_bytes_used);
+
+	/* Shrinking while raising the alignment moves the block; only the new
+	   size is copied */
+	p3 = (uint8_t *)fx_mem_allocator_alloc(allocator, 20U, 1U);
+	ASSERT_LT(0U, (uintptr_t)p3 & 63U);
+	memset(p3, 0xCD, 20U);
+	memset(p3 + 20U, 0xEE, 128U);
+	uint8_t *p4 = (uint8_t *)fx_mem_allocator_realloc(allocator, p3, 20U, 4U,
+	                                                  64U);
+	ASSERT_LT(0U, (uintptr_t)p4);
+	EXPECT_EQ(0U, (uintptr_t)p4 & 63U);
+	EXPECT_EQ(0xCDU, p4[3]);
+	EXPECT_EQ(0xEEU, p4[4]);
+
+	/* Exhausting the arena */
+	fx_mem_allocator_reset(allocator);
+	void *ptrs[512];
+	EXPECT_EQ(arena->capacity / 16U,
+	          _fill_allocator(allocator, ptrs, 512U, 16U));
+	EXPECT_TRUE(fx_mem_arena_alloc(arena, 16U, 1U) == NULL);
+	EXPECT_TRUE(fx_mem_arena_alloc(arena, (size_t)-1, 1U) == NULL);
+
+	/* Regions that are too small */
+	EXPECT_TRUE(fx_mem_arena_init(mem, 8U) == NULL);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_static_pool);
+	RUN(test_arena);
+	DONE;
+}
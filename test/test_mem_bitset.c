@@ -0,0 +1,197 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_bitset.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * HELPER FUNCTIONS                                                           *
+ ******************************************************************************/
+
+#define n_bits 1000U
+#define n_words ((n_bits + 31U) / 32U)
+
+static uint32_t bits[n_words];
+
+static uint32_t _xorshift(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13U;
+	x ^= x >> 17U;
+	x ^= x << 5U;
+	return *state = x;
+}
+
+static void _fill_random(uint32_t *tar, uint32_t n, uint32_t *state,
+                         uint32_t density) {
+	/* density = 0 yields sparse bitmaps, density = 2 dense ones */
+	for (uint32_t i = 0U; i < n; i++) {
+		uint32_t v = _xorshift(state);
+		if (density == 0U) {
+			v &= _xorshift(state) & _xorshift(state) & _xorshift(state);
+		} else if (density == 2U) {
+			v |= _xorshift(state) | _xorshift(state) | _xorshift(state);
+		}
+		tar[i] = v;
+	}
+}
+
+static bool _get(const uint32_t *tar, uint32_t i) {
+	return (tar[i / 32U] >> (i % 32U)) & 1U;
+}
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static void test_lsb(void) {
+	for (uint32_t i = 0U; i < 32U; i++) {
+		EXPECT_EQ(i, fx_mem_bitset_lsb(1U << i));
+		EXPECT_EQ(i, fx_mem_bitset_lsb(0xFFFFFFFFU << i));
+	}
+}
+
+static void test_find_next(void) {
+	uint32_t state = 0x1234567U;
+	for (uint32_t density = 0U; density < 3U; density++) {
+		_fill_random(bits, n_words, &state, density);
+		for (uint32_t pos = 0U; pos <= n_bits; pos++) {
+			uint32_t ref_set = pos, ref_clear = pos;
+			while (ref_set < n_bits && !_get(bits, ref_set)) {
+				ref_set++;
+			}
+			while (ref_clear < n_bits && _get(bits, ref_clear)) {
+				ref_clear++;
+			}
+			EXPECT_EQ(ref_set, fx_mem_bitset_find_next_set(bits, n_bits, pos));
+			EXPECT_EQ(ref_clear,
+			          fx_mem_bitset_find_next_clear(bits, n_bits, pos));
+		}
+	}
+}
+
+static void test_find_next_empty_full(void) {
+	for (uint32_t i = 0U; i < n_words; i++) {
+		bits[i] = 0U;
+	}
+	EXPECT_EQ(n_bits, fx_mem_bitset_find_next_set(bits, n_bits, 0U));
+	EXPECT_EQ(17U, fx_mem_bitset_find_next_clear(bits, n_bits, 17U));
+
+	/* Bits past n_bits must never be returned */
+	for (uint32_t i = 0U; i < n_words; i++) {
+		bits[i] = 0xFFFFFFFFU;
+	}
+	bits[n_words - 1U] = 0xFFU;
+	EXPECT_EQ(n_bits, fx_mem_bitset_find_next_clear(bits, n_bits, 0U));
+	EXPECT_EQ(999U, fx_mem_bitset_find_next_set(bits, n_bits, 999U));
+}
+
+static void test_popcount(void) {
+	uint32_t state = 0xABCDEFU;
+	_fill_random(bits, n_words, &state, 1U);
+	for (uint32_t begin = 0U; begin < n_bits; begin += 7U) {
+		for (uint32_t end = begin; end <= n_bits; end += 13U) {
+			uint32_t ref = 0U;
+			for (uint32_t i = begin; i < end; i++) {
+				ref += _get(bits, i);
+			}
+			EXPECT_EQ(ref, fx_mem_bitset_popcount(bits, begin, end));
+		}
+	}
+}
+
+static void test_set_clear_range(void) {
+	uint32_t state = 0x55AA55AAU;
+	uint32_t ref[n_words];
+	for (uint32_t i = 0U; i < 200U; i++) {
+		_fill_random(bits, n_words, &state, 1U);
+		for (uint32_t j = 0U; j < n_words; j++) {
+			ref[j] = bits[j];
+		}
+		uint32_t begin = _xorshift(&state) % n_bits;
+		uint32_t end = begin + _xorshift(&state) % (n_bits - begin + 1U);
+		bool set = i % 2U;
+		if (set) {
+			fx_mem_bitset_set_range(bits, begin, end);
+		} else {
+			fx_mem_bitset_clear_range(bits, begin, end);
+		}
+		for (uint32_t j = 0U; j < n_bits; j++) {
+			bool expected = (j >= begin && j < end) ? set : _get(ref, j);
+			EXPECT_EQ(expected, _get(bits, j));
+		}
+	}
+}
+
+static void test_test_and_set(void) {
+	for (uint32_t i = 0U; i < n_words; i++) {
+		bits[i] = 0U;
+	}
+	EXPECT_FALSE(fx_mem_bitset_test_and_set(bits, 37U));
+	EXPECT_TRUE(fx_mem_bitset_test(bits, 37U));
+	EXPECT_TRUE(fx_mem_bitset_test_and_set(bits, 37U));
+	EXPECT_EQ(1U << 5U, bits[1]);
+	EXPECT_TRUE(fx_mem_bitset_test_and_clear(bits, 37U));
+	EXPECT_FALSE(fx_mem_bitset_test(bits, 37U));
+	EXPECT_FALSE(fx_mem_bitset_test_and_clear(bits, 37U));
+	EXPECT_EQ(0U, bits[1]);
+}
+
+static void test_logic(void) {
+	uint32_t state = 0xF00BA4U;
+	uint32_t a[n_words], b[n_words], c[n_words];
+	_fill_random(a, n_words, &state, 1U);
+	_fill_random(b, n_words, &state, 1U);
+
+	/* Use an odd word count to exercise the scalar tail */
+	fx_mem_bitset_and(c, a, b, n_words);
+	for (uint32_t i = 0U; i < n_words; i++) {
+		EXPECT_EQ(a[i] & b[i], c[i]);
+	}
+	fx_mem_bitset_or(c, a, b, n_words);
+	for (uint32_t i = 0U; i < n_words; i++) {
+		EXPECT_EQ(a[i] | b[i], c[i]);
+	}
+	fx_mem_bitset_andnot(c, a, b, n_words);
+	for (uint32_t i = 0U; i < n_words; i++) {
+		EXPECT_EQ(a[i] & ~b[i], c[i]);
+	}
+
+	/* In-place operation */
+	for (uint32_t i = 0U; i < n_words; i++) {
+		c[i] = a[i];
+	}
+	fx_mem_bitset_andnot(c, c, b, n_words);
+	for (uint32_t i = 0U; i < n_words; i++) {
+		EXPECT_EQ(a[i] & ~b[i], c[i]);
+	}
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_lsb);
+	RUN(test_find_next);
+	RUN(test_find_next_empty_full);
+	RUN(test_popcount);
+	RUN(test_set_clear_range);
+	RUN(test_test_and_set);
+	RUN(test_logic);
+	DONE;
+}
@@ -0,0 +1,145 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_blob.h>
+#include <foxen/mem_rptr.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define TAG_KEYS 1U
+#define TAG_INDEX 2U
+#define N_KEYS 100U
+
+typedef struct index {
+	uint32_t n_keys;
+	fx_mem_rptr_t keys; /* Relative to the blob header */
+} index_t;
+
+static uint8_t mem_blob[4096U] __attribute__((aligned(64)));
+static uint8_t mem_copy[4096U] __attribute__((aligned(64)));
+
+static fx_mem_blob_t *build_blob(void) {
+	uint32_t size;
+	EXPECT_TRUE(fx_mem_blob_init_size(&size, 4U) &&
+	            fx_mem_update_size(&size, sizeof(uint32_t) * N_KEYS) &&
+	            fx_mem_update_size(&size, sizeof(index_t)));
+	EXPECT_GT(sizeof(mem_blob), size);
+
+	fx_mem_blob_t *blob = fx_mem_blob_init(mem_blob, 4U);
+	uint32_t *keys = (uint32_t *)fx_mem_blob_add(blob, TAG_KEYS,
+	                                             sizeof(uint32_t) * N_KEYS);
+	index_t *index = (index_t *)fx_mem_blob_add(blob, TAG_INDEX, sizeof(index_t));
+	for (uint32_t i = 0U; i < N_KEYS; i++) {
+		keys[i] = i * i;
+	}
+	index->n_keys = N_KEYS;
+	index->keys = fx_mem_rptr_encode(blob, keys);
+	fx_mem_blob_seal(blob);
+	EXPECT_GE(size, blob->size);
+	return blob;
+}
+
+static void check_blob(const fx_mem_blob_t *blob) {
+	uint64_t size = 0U;
+	const index_t *index =
+	    (const index_t *)fx_mem_blob_get(blob, TAG_INDEX, &size);
+	EXPECT_TRUE(index != NULL);
+	EXPECT_EQ(sizeof(index_t), size);
+	if (!index) {
+		return;
+	}
+	EXPECT_EQ(N_KEYS, index->n_keys);
+	const uint32_t *keys = FX_MEM_RPTR_DECODE(const uint32_t, blob, index->keys);
+	EXPECT_TRUE(keys == fx_mem_blob_get(blob, TAG_KEYS, NULL));
+	for (uint32_t i = 0U; i < N_KEYS; i++) {
+		EXPECT_EQ(i * i, keys[i]);
+	}
+}
+
+static void test_blob_build_and_open(void) {
+	fx_mem_blob_t *blob = build_blob();
+	EXPECT_TRUE(fx_mem_blob_add(blob, 3U, 0U) != NULL);
+	EXPECT_TRUE(fx_mem_blob_add(blob, 4U, 0U) != NULL);
+	EXPECT_TRUE(fx_mem_blob_add(blob, 5U, 0U) == NULL); /* Table is full */
+	EXPECT_TRUE(fx_mem_blob_get(blob, 6U, NULL) == NULL);
+
+	/* Relocate the blob by copying it */
+	blob = build_blob();
+	memcpy(mem_copy, blob, blob->size);
+	const fx_mem_blob_t *copy = fx_mem_blob_open(mem_copy, blob->size);
+	EXPECT_TRUE(copy != NULL);
+	if (copy) {
+		check_blob(copy);
+		EXPECT_TRUE(fx_mem_blob_verify(copy, TAG_KEYS));
+		EXPECT_TRUE(fx_mem_blob_verify(copy, TAG_INDEX));
+	}
+
+	/* Corrupting a field is only detected by verifying that field */
+	mem_copy[blob->fields[0].offset + 17U] ^= 1U;
+	EXPECT_TRUE(fx_mem_blob_open(mem_copy, blob->size) != NULL);
+	EXPECT_FALSE(fx_mem_blob_verify((const fx_mem_blob_t *)mem_copy, TAG_KEYS));
+	EXPECT_TRUE(fx_mem_blob_verify((const fx_mem_blob_t *)mem_copy, TAG_INDEX));
+
+	/* Truncated blobs, broken field tables and bad magic numbers are
+	   rejected when opening the blob */
+	EXPECT_TRUE(fx_mem_blob_open(mem_copy, blob->size - 1U) == NULL);
+	memcpy(mem_copy, blob, blob->size);
+	((fx_mem_blob_t *)mem_copy)->fields[1].offset = blob->size;
+	EXPECT_TRUE(fx_mem_blob_open(mem_copy, blob->size) == NULL);
+	memcpy(mem_copy, blob, blob->size);
+	((fx_mem_blob_t *)mem_copy)->magic = 0U;
+	EXPECT_TRUE(fx_mem_blob_open(mem_copy, blob->size) == NULL);
+}
+
+static void test_blob_file(void) {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/foxenmem_blob_%d", (int)getpid());
+	fx_mem_blob_t *blob = build_blob();
+	EXPECT_TRUE(fx_mem_blob_write(blob, path));
+
+	const fx_mem_blob_t *mapped = fx_mem_blob_map(path);
+	EXPECT_TRUE(mapped != NULL);
+	if (mapped) {
+		EXPECT_TRUE((const void *)mapped != (const void *)blob);
+		check_blob(mapped);
+		EXPECT_TRUE(fx_mem_blob_verify(mapped, TAG_KEYS));
+		fx_mem_blob_unmap(mapped);
+	}
+	unlink(path);
+	EXPECT_TRUE(fx_mem_blob_map(path) == NULL);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_blob_build_and_open);
+#ifndef __EMSCRIPTEN__
+	RUN(test_blob_file);
+#endif
+	DONE;
+}
@@ -0,0 +1,233 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_budget.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem_arena[1U << 16U] __attribute__((aligned(64)));
+static uint8_t mem_pool[1U << 16U] __attribute__((aligned(64)));
+
+static uint32_t n_pressure_events;
+static uint32_t n_relief_events;
+
+static void _budget_callback(fx_mem_budget_t *budget, bool pressure,
+                             size_t n_bytes_used, void *data) {
+	EXPECT_TRUE(data == (void *)&n_pressure_events);
+	if (pressure) {
+		EXPECT_GE(n_bytes_used, budget->high_watermark);
+		n_pressure_events++;
+	} else {
+		EXPECT_LT(n_bytes_used, budget->low_watermark);
+		n_relief_events++;
+	}
+}
+
+static void _count_member(fx_mem_budget_member_t *member, void *data) {
+	(*(uint32_t *)data)++;
+}
+
+static void test_budget_limit_and_watermarks(void) {
+	fx_mem_budget_t budget;
+	fx_mem_budget_init(&budget, 16384U);
+	fx_mem_budget_set_watermarks(&budget, 4096U, 8192U);
+	fx_mem_budget_set_slack(&budget, 1024U);
+	fx_mem_budget_set_callback(&budget, _budget_callback, &n_pressure_events);
+
+	int fds[2];
+	ASSERT_LT(-1, pipe(fds));
+	fx_mem_budget_set_notify_fd(&budget, fds[1]);
+
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem_arena, sizeof(mem_arena));
+	fx_mem_budget_member_t member;
+	fx_mem_budget_join(&budget, &member, "arena", &arena->allocator);
+	EXPECT_EQ(arena->capacity, fx_mem_budget_reserved(&budget));
+
+	uint32_t n_members = 0U;
+	fx_mem_budget_foreach(&budget, _count_member, &n_members);
+	EXPECT_EQ(1U, n_members);
+
+	/* The first allocation charges the allocation plus the slack */
+	n_pressure_events = n_relief_events = 0U;
+	void *p1 = fx_mem_allocator_alloc(&arena->allocator, 100U, 1U);
+	EXPECT_TRUE(p1 != NULL);
+	EXPECT_EQ(1124U, fx_mem_budget_used(&budget));
+
+	/* Subsequent small allocations are served from the thread-local credit */
+	void *p2 = fx_mem_allocator_alloc(&arena->allocator, 1000U, 1U);
+	EXPECT_TRUE(p2 != NULL);
+	EXPECT_EQ(1124U, fx_mem_budget_used(&budget));
+	EXPECT_FALSE(fx_mem_budget_under_pressure(&budget));
+
+	/* Crossing the high watermark */
+	void *p3 = fx_mem_allocator_alloc(&arena->allocator, 8000U, 1U);
+	EXPECT_TRUE(p3 != NULL);
+	EXPECT_TRUE(fx_mem_budget_under_pressure(&budget));
+	EXPECT_EQ(1U, n_pressure_events);
+
+	/* Exceeding the limit */
+	EXPECT_TRUE(fx_mem_allocator_alloc(&arena->allocator, 8000U, 1U) == NULL);
+	EXPECT_GE(16384U, fx_mem_budget_used(&budget));
+
+	/* Close to the limit, allocations still succeed without slack */
+	const size_t n_left = 16384U - fx_mem_budget_used(&budget);
+	void *p4 = fx_mem_allocator_alloc(&arena->allocator, n_left, 1U);
+	EXPECT_TRUE(p4 != NULL);
+	EXPECT_EQ(16384U, fx_mem_budget_used(&budget));
+	fx_mem_allocator_free(&arena->allocator, p4, n_left);
+
+	/* Freeing memory drops below the low watermark */
+	fx_mem_allocator_free(&arena->allocator, p3, 8000U);
+	EXPECT_FALSE(fx_mem_budget_under_pressure(&budget));
+	EXPECT_EQ(1U, n_relief_events);
+
+	/* Each transition wrote to the notification file descriptor */
+	uint64_t events[2];
+	EXPECT_EQ((ssize_t)sizeof(events), read(fds[0], events, sizeof(events)));
+	EXPECT_EQ(1U, events[0]);
+	EXPECT_EQ(1U, events[1]);
+
+	/* Resetting and leaving the budget returns all charged bytes */
+	fx_mem_allocator_reset(&arena->allocator);
+	fx_mem_budget_flush();
+	EXPECT_EQ(0U, fx_mem_budget_used(&budget));
+	p1 = fx_mem_allocator_alloc(&arena->allocator, 100U, 1U);
+	fx_mem_budget_leave(&budget, &member);
+	fx_mem_budget_flush();
+	EXPECT_EQ(0U, fx_mem_budget_used(&budget));
+	EXPECT_EQ(0U, fx_mem_budget_reserved(&budget));
+	n_members = 0U;
+	fx_mem_budget_foreach(&budget, _count_member, &n_members);
+	EXPECT_EQ(0U, n_members);
+
+	fx_mem_budget_destroy(&budget);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_budget_switch(void) {
+	/* Alternating between budgets keeps the credit of both */
+	fx_mem_budget_t budgets[2];
+	for (uint32_t i = 0U; i < 2U; i++) {
+		fx_mem_budget_init(&budgets[i], 1U << 20U);
+		fx_mem_budget_set_slack(&budgets[i], 1024U);
+	}
+	for (uint32_t i = 0U; i < 100U; i++) {
+		EXPECT_TRUE(fx_mem_budget_charge(&budgets[0], 10U));
+		EXPECT_TRUE(fx_mem_budget_charge(&budgets[1], 10U));
+	}
+	EXPECT_EQ(1034U, fx_mem_budget_used(&budgets[0]));
+	EXPECT_EQ(1034U, fx_mem_budget_used(&budgets[1]));
+
+	/* Flushing returns the credit of all budgets */
+	fx_mem_budget_flush();
+	EXPECT_EQ(1000U, fx_mem_budget_used(&budgets[0]));
+	EXPECT_EQ(1000U, fx_mem_budget_used(&budgets[1]));
+	fx_mem_budget_release(&budgets[0], 1000U);
+	fx_mem_budget_release(&budgets[1], 1000U);
+	fx_mem_budget_flush();
+	EXPECT_EQ(0U, fx_mem_budget_used(&budgets[0]));
+	EXPECT_EQ(0U, fx_mem_budget_used(&budgets[1]));
+	fx_mem_budget_destroy(&budgets[0]);
+	fx_mem_budget_destroy(&budgets[1]);
+}
+
+static void test_budget_destroy(void) {
+	fx_mem_budget_t budget;
+	fx_mem_budget_init(&budget, 1U << 20U);
+	fx_mem_budget_set_slack(&budget, 1024U);
+	EXPECT_TRUE(fx_mem_budget_charge(&budget, 10U));
+	EXPECT_EQ(1034U, fx_mem_budget_used(&budget));
+
+	/* Credit of the destroyed budget is not used by a new budget at the same
+	   address */
+	fx_mem_budget_destroy(&budget);
+	fx_mem_budget_init(&budget, 1U << 20U);
+	fx_mem_budget_set_slack(&budget, 1024U);
+	EXPECT_TRUE(fx_mem_budget_charge(&budget, 10U));
+	EXPECT_EQ(1034U, fx_mem_budget_used(&budget));
+
+	/* Credit of a destroyed budget is dropped instead of being returned */
+	fx_mem_budget_destroy(&budget);
+	budget.n_bytes_used = 12345U;
+	fx_mem_budget_flush();
+	EXPECT_EQ(12345U, fx_mem_budget_used(&budget));
+}
+
+#define N_THREADS 4U
+#define N_REPEAT 1000U
+#define N_SLOTS 64U
+
+static fx_mem_budget_t shared_budget;
+static fx_mem_static_pool_t *shared_pool;
+
+static void *_test_budget_threads_main(void *data) {
+	void *ptrs[N_SLOTS / N_THREADS];
+	for (uint32_t i = 0U; i < N_REPEAT; i++) {
+		for (uint32_t j = 0U; j < N_SLOTS / N_THREADS; j++) {
+			ptrs[j] = fx_mem_allocator_alloc(&shared_pool->allocator, 64U, 1U);
+			EXPECT_TRUE(ptrs[j] != NULL);
+		}
+		for (uint32_t j = 0U; j < N_SLOTS / N_THREADS; j++) {
+			fx_mem_allocator_free(&shared_pool->allocator, ptrs[j], 64U);
+		}
+	}
+	fx_mem_budget_flush();
+	return NULL;
+}
+
+static void test_budget_threads(void) {
+	fx_mem_budget_init(&shared_budget, 1U << 20U);
+	fx_mem_budget_set_slack(&shared_budget, 256U);
+	shared_pool = fx_mem_static_pool_init(mem_pool, N_SLOTS, 64U);
+	fx_mem_budget_member_t member;
+	fx_mem_budget_join(&shared_budget, &member, "pool", &shared_pool->allocator);
+	EXPECT_EQ(N_SLOTS * 64U, fx_mem_budget_reserved(&shared_budget));
+
+	pthread_t threads[N_THREADS];
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, _test_budget_threads_main, NULL);
+	}
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	EXPECT_EQ(0U, fx_mem_budget_used(&shared_budget));
+	fx_mem_budget_leave(&shared_budget, &member);
+	fx_mem_budget_destroy(&shared_budget);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_budget_limit_and_watermarks);
+	RUN(test_budget_switch);
+	RUN(test_budget_destroy);
+#ifndef __EMSCRIPTEN__
+	RUN(test_budget_threads);
+#endif
+	DONE;
+}
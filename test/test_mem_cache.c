@@ -0,0 +1,169 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_cache.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[65536U] __attribute__((aligned(16)));
+
+static void test_cache_size(void) {
+	EXPECT_EQ(0U, fx_mem_cache_size(0x10000000U, 64U));
+	EXPECT_EQ(0U, fx_mem_cache_size(0x10000U, 0xFFFFFFFFU));
+	EXPECT_EQ(0U, fx_mem_cache_size(0x40000000U, 0U));
+	const uint32_t size = fx_mem_cache_size(100U, 12U);
+	ASSERT_GT(size, 100U * (16U + 8U + 8U));
+	ASSERT_LT(size, sizeof(mem));
+	fx_mem_cache_t *cache = fx_mem_cache_init(mem + 4, 100U, 12U);
+	EXPECT_EQ(256U, cache->n_buckets);
+	EXPECT_TRUE((uint8_t *)fx_mem_cache_value(cache, 99U) + 12 <=
+	            mem + 4 + size);
+}
+
+static void test_cache_put_get_remove(void) {
+	fx_mem_cache_t *cache = fx_mem_cache_init(mem, 10U, sizeof(uint64_t));
+	bool inserted, evicted;
+	for (uint64_t key = 0U; key < 10U; key++) {
+		uint64_t *value = (uint64_t *)fx_mem_cache_put(cache, key * 1000U,
+		                                               &inserted, &evicted,
+		                                               NULL);
+		EXPECT_TRUE(inserted);
+		EXPECT_FALSE(evicted);
+		*value = key;
+	}
+	EXPECT_EQ(10U, cache->n_allocated);
+	for (uint64_t key = 0U; key < 10U; key++) {
+		uint64_t *value = (uint64_t *)fx_mem_cache_get(cache, key * 1000U);
+		EXPECT_TRUE(value && *value == key);
+	}
+	EXPECT_TRUE(fx_mem_cache_get(cache, 1U) == NULL);
+	EXPECT_EQ(10U, cache->n_hits);
+	EXPECT_EQ(1U, cache->n_misses);
+
+	/* Putting an existing key returns its value */
+	uint64_t *value =
+	    (uint64_t *)fx_mem_cache_put(cache, 3000U, &inserted, NULL, NULL);
+	EXPECT_FALSE(inserted);
+	EXPECT_EQ(3U, *value);
+
+	/* Removal keeps the remaining keys reachable */
+	for (uint64_t key = 0U; key < 10U; key += 2U) {
+		EXPECT_TRUE(fx_mem_cache_remove(cache, key * 1000U));
+	}
+	EXPECT_FALSE(fx_mem_cache_remove(cache, 0U));
+	EXPECT_EQ(5U, cache->n_allocated);
+	for (uint64_t key = 0U; key < 10U; key++) {
+		EXPECT_EQ(key % 2U == 1U, fx_mem_cache_get(cache, key * 1000U) != NULL);
+	}
+}
+
+static void test_cache_clock(void) {
+	fx_mem_cache_t *cache = fx_mem_cache_init(mem, 100U, 4U);
+	for (uint64_t key = 1U; key <= 100U; key++) {
+		fx_mem_cache_put(cache, key, NULL, NULL, NULL);
+	}
+	for (uint64_t key = 2U; key <= 100U; key += 2U) {
+		fx_mem_cache_get(cache, key);
+	}
+
+	/* Unreferenced entries are evicted first */
+	bool evicted;
+	uint64_t evicted_key;
+	for (uint64_t key = 101U; key <= 150U; key++) {
+		fx_mem_cache_put(cache, key, NULL, &evicted, &evicted_key);
+		EXPECT_TRUE(evicted);
+		EXPECT_EQ(1U, evicted_key % 2U);
+	}
+	EXPECT_EQ(50U, cache->n_evictions);
+	for (uint64_t key = 1U; key <= 150U; key++) {
+		const bool expected = key > 100U || key % 2U == 0U;
+		EXPECT_EQ(expected, fx_mem_cache_get(cache, key) != NULL);
+	}
+
+	/* Entries that keep being hit survive arbitrarily many evictions */
+	for (uint64_t key = 151U; key <= 1000U; key++) {
+		fx_mem_cache_put(cache, key, NULL, &evicted, NULL);
+		EXPECT_TRUE(evicted);
+		EXPECT_TRUE(fx_mem_cache_get(cache, 2U) != NULL);
+		EXPECT_TRUE(fx_mem_cache_get(cache, key) != NULL);
+	}
+	EXPECT_EQ(100U, cache->n_allocated);
+	EXPECT_EQ(900U, cache->n_evictions);
+
+	/* An entry that was hit once is evicted once the hand has passed it */
+	cache = fx_mem_cache_init(mem, 64U, 4U);
+	fx_mem_cache_put(cache, 1U, NULL, NULL, NULL);
+	EXPECT_TRUE(fx_mem_cache_get(cache, 1U) != NULL);
+	bool evicted_one = false;
+	for (uint64_t key = 2U; key <= 1000U && !evicted_one; key++) {
+		fx_mem_cache_put(cache, key, NULL, &evicted, &evicted_key);
+		evicted_one = evicted && evicted_key == 1U;
+	}
+	EXPECT_TRUE(evicted_one);
+	EXPECT_TRUE(fx_mem_cache_get(cache, 1U) == NULL);
+}
+
+static void test_cache_random(void) {
+	/* The index stays consistent under random insertions and removals */
+	fx_mem_cache_t *cache = fx_mem_cache_init(mem, 500U, 8U);
+	uint32_t seed = 1U;
+	bool ok = true;
+	for (uint32_t i = 0U; i < 100000U; i++) {
+		seed = seed * 1103515245U + 12345U;
+		const uint64_t key = (seed >> 8U) % 2000U;
+		if (seed & 0x10000U) {
+			fx_mem_cache_remove(cache, key);
+			ok = ok && fx_mem_cache_get(cache, key) == NULL;
+		} else {
+			bool inserted;
+			uint64_t *value = (uint64_t *)fx_mem_cache_put(
+			    cache, key, &inserted, NULL, NULL);
+			if (inserted) {
+				*value = key;
+			}
+			ok = ok && *value == key;
+			value = (uint64_t *)fx_mem_cache_get(cache, key);
+			ok = ok && value && *value == key;
+		}
+	}
+	EXPECT_TRUE(ok);
+	uint32_t n_found = 0U;
+	for (uint64_t key = 0U; key < 2000U; key++) {
+		uint64_t *value = (uint64_t *)fx_mem_cache_get(cache, key);
+		if (value) {
+			n_found++;
+			EXPECT_EQ(key, *value);
+		}
+	}
+	EXPECT_EQ(cache->n_allocated, n_found);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_cache_size);
+	RUN(test_cache_put_get_remove);
+	RUN(test_cache_clock);
+	RUN(test_cache_random);
+	DONE;
+}
@@ -0,0 +1,178 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Include a C header first; mem_coro.hpp must not rely on include order */
+#include <foxen/mem.h>
+#include <foxen/mem_coro.hpp>
+
+#include <coroutine>
+#include <thread>
+#include <vector>
+
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+using pool_t = foxen::mem::coro_frame_pool<64U, 1024U>;
+
+struct generator {
+	struct promise_type : foxen::mem::pooled_frame<pool_t> {
+		int value = 0;
+		generator get_return_object() {
+			return generator{
+			    std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(int v) noexcept {
+			value = v;
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() { std::abort(); }
+	};
+
+	explicit generator(std::coroutine_handle<promise_type> h) : handle(h) {}
+	generator(generator &&o) noexcept : handle(o.handle) { o.handle = {}; }
+	generator(const generator &) = delete;
+	~generator() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	bool next() {
+		handle.resume();
+		return !handle.done();
+	}
+	int value() const { return handle.promise().value; }
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+static generator count(int n) {
+	for (int i = 0; i < n; i++) {
+		co_yield i;
+	}
+}
+
+static generator count_big(int n) {
+	volatile char buf[2048];
+	for (int i = 0; i < n; i++) {
+		buf[i % sizeof(buf)] = static_cast<char>(i);
+		co_yield i + buf[i % sizeof(buf)] - static_cast<char>(i);
+	}
+}
+
+static uint32_t n_pooled() {
+	uint32_t n = 0U;
+	for (std::size_t cls = 0U; cls < pool_t::n_classes; cls++) {
+		n += pool_t::instance().pool(cls)->n_allocated;
+	}
+	return n;
+}
+
+static void test_coro_class_idx() {
+	EXPECT_EQ(0U, pool_t::class_idx(1U));
+	EXPECT_EQ(0U, pool_t::class_idx(64U));
+	EXPECT_EQ(1U, pool_t::class_idx(65U));
+	EXPECT_EQ(4U, pool_t::class_idx(1024U));
+	EXPECT_EQ(5U, pool_t::n_classes);
+}
+
+static void test_coro_frames() {
+	{
+		generator g = count(3);
+		EXPECT_EQ(1U, n_pooled());
+		int sum = 0;
+		while (g.next()) {
+			sum += g.value();
+		}
+		EXPECT_EQ(3, sum);
+	}
+
+	/* The released frame is cached by this thread and reused */
+	EXPECT_EQ(1U, n_pooled());
+	void *frame;
+	{
+		generator g = count(1);
+		frame = g.handle.address();
+	}
+	{
+		generator g = count(1);
+		EXPECT_TRUE(g.handle.address() == frame);
+		EXPECT_EQ(1U, n_pooled());
+	}
+
+	/* Frames above the largest size class use the global heap */
+	{
+		generator g = count_big(10);
+		EXPECT_EQ(1U, n_pooled());
+		EXPECT_TRUE(g.next());
+		EXPECT_EQ(0, g.value());
+	}
+}
+
+static void test_coro_exhausted() {
+	/* More live frames than slots fall back to the global heap */
+	std::vector<generator> gens;
+	for (int i = 0; i < 100; i++) {
+		gens.push_back(count(2));
+	}
+	EXPECT_EQ(64U, n_pooled());
+	int sum = 0;
+	for (generator &g : gens) {
+		while (g.next()) {
+			sum += g.value();
+		}
+	}
+	EXPECT_EQ(100, sum);
+}
+
+static void test_coro_threads() {
+	/* Frame caches of exited threads are returned to the pools */
+	const uint32_t n_before = n_pooled();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([] {
+			for (int i = 0; i < 10000; i++) {
+				generator g = count(4);
+				while (g.next()) {
+				}
+			}
+		});
+	}
+	for (std::thread &t : threads) {
+		t.join();
+	}
+	EXPECT_EQ(n_before, n_pooled());
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_coro_class_idx);
+	RUN(test_coro_frames);
+	RUN(test_coro_exhausted);
+	RUN(test_coro_threads);
+	DONE;
+}
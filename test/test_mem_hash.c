@@ -0,0 +1,106 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_hash.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define N_BYTES 4096U
+
+static uint8_t buf_a[N_BYTES] __attribute__((aligned(16)));
+static uint8_t buf_b[N_BYTES] __attribute__((aligned(16)));
+
+static void fill(uint8_t *buf, uint32_t n) {
+	uint32_t seed = 1U;
+	for (uint32_t i = 0U; i < n; i++) {
+		seed = seed * 1103515245U + 12345U;
+		buf[i] = (uint8_t)(seed >> 16U);
+	}
+}
+
+static void test_hash_known_answers(void) {
+	/* All kernels must compute the same function; this test is also run with
+	   the generic kernels only */
+	fill(buf_a, N_BYTES);
+	EXPECT_EQ(0xB30A93EA030A5A14ULL, fx_mem_hash_aligned(buf_a, 0U, 0U));
+	EXPECT_EQ(0xD2950B72A058CB7CULL, fx_mem_hash_aligned(buf_a, 13U, 0U));
+	EXPECT_EQ(0xA6244153DF77DF8CULL, fx_mem_hash_aligned(buf_a, 64U, 0U));
+	EXPECT_EQ(0x2CFFC98DC3572E1EULL, fx_mem_hash_aligned(buf_a, 1000U, 42U));
+	EXPECT_EQ(0xB8D8D7F4BAE61F4CULL, fx_mem_hash_aligned(buf_a, N_BYTES, 42U));
+}
+
+static void test_hash_sensitivity(void) {
+	/* Every single-bit flip changes the hash */
+	fill(buf_a, N_BYTES);
+	const uint64_t h = fx_mem_hash_aligned(buf_a, 1024U, 0U);
+	bool ok = true;
+	for (uint32_t i = 0U; i < 1024U * 8U; i++) {
+		buf_a[i / 8U] ^= 1U << (i % 8U);
+		ok = ok && fx_mem_hash_aligned(buf_a, 1024U, 0U) != h;
+		buf_a[i / 8U] ^= 1U << (i % 8U);
+	}
+	EXPECT_TRUE(ok);
+
+	/* Bytes past the end are ignored; the size and seed are not */
+	buf_a[1024U] ^= 1U;
+	EXPECT_EQ(h, fx_mem_hash_aligned(buf_a, 1024U, 0U));
+	EXPECT_TRUE(h != fx_mem_hash_aligned(buf_a, 1024U, 1U));
+	memset(buf_b, 0, N_BYTES);
+	ok = true;
+	for (uint32_t n = 1U; n <= 256U; n++) {
+		ok = ok && fx_mem_hash_aligned(buf_b, n, 0U) !=
+		               fx_mem_hash_aligned(buf_b, n - 1U, 0U);
+	}
+	EXPECT_TRUE(ok);
+}
+
+static void test_equal(void) {
+	fill(buf_a, N_BYTES);
+	fill(buf_b, N_BYTES);
+	EXPECT_TRUE(fx_mem_equal_aligned(buf_a, buf_b, N_BYTES));
+	EXPECT_TRUE(fx_mem_equal_aligned(buf_a, buf_b, 0U));
+
+	/* A difference at any position is found, differences past the end are
+	   ignored */
+	bool ok = true;
+	for (uint32_t n = 1U; n <= 300U; n++) {
+		for (uint32_t i = 0U; i <= n; i++) {
+			buf_b[i] ^= 0x80U;
+			ok = ok && fx_mem_equal_aligned(buf_a, buf_b, n) == (i == n);
+			ok = ok && (memcmp(buf_a, buf_b, n) == 0) == (i == n);
+			buf_b[i] ^= 0x80U;
+		}
+	}
+	EXPECT_TRUE(ok);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_hash_known_answers);
+	RUN(test_hash_sensitivity);
+	RUN(test_equal);
+	DONE;
+}
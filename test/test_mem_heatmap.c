@@ -0,0 +1,148 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_bitset.h>
+#include <foxen/mem_heatmap.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define N_SLOTS 1024U
+
+static uint8_t mem_pool[1U << 16U] __attribute__((aligned(64)));
+static uint8_t mem_heatmap[4096U] __attribute__((aligned(64)));
+static uint8_t mem_counters[2048U] __attribute__((aligned(64)));
+
+static void test_heatmap_buckets(void) {
+	const uint32_t n_words = fx_mem_bitset_n_words(N_SLOTS);
+	ASSERT_GT(sizeof(mem_heatmap) - 4U, fx_mem_heatmap_size(n_words, 1U));
+	fx_mem_heatmap_t *heatmap =
+	    fx_mem_heatmap_init(mem_heatmap + 4U, n_words, 1U, 1U);
+	EXPECT_EQ(32U, heatmap->n_buckets);
+
+	/* Each bucket occupies a cache line of its own */
+	EXPECT_EQ(FX_MEM_HEATMAP_ALIGN, sizeof(fx_mem_heatmap_bucket_t));
+	EXPECT_EQ(0U, (uintptr_t)heatmap->buckets & (FX_MEM_HEATMAP_ALIGN - 1U));
+	EXPECT_TRUE((uint8_t *)(heatmap->buckets + heatmap->n_buckets) <=
+	            mem_heatmap + 4U + fx_mem_heatmap_size(n_words, 1U));
+
+	fx_mem_static_pool_t *pool = fx_mem_static_pool_init(mem_pool, N_SLOTS, 16U);
+	fx_mem_static_pool_set_heatmap(pool, heatmap);
+	for (uint32_t i = 0U; i < 40U; i++) {
+		fx_mem_static_pool_alloc(pool);
+	}
+	EXPECT_EQ(32U, fx_mem_heatmap_n_claims(heatmap, 0U));
+	EXPECT_EQ(8U, fx_mem_heatmap_n_claims(heatmap, 1U));
+	EXPECT_EQ(0U, fx_mem_heatmap_n_claims(heatmap, 2U));
+	EXPECT_EQ(0U, fx_mem_heatmap_n_failed(heatmap, 0U));
+
+	/* The dump lists the busiest bucket first */
+	FILE *f = tmpfile();
+	EXPECT_TRUE(f != NULL);
+	if (!f) {
+		return;
+	}
+	EXPECT_TRUE(fx_mem_heatmap_dump(heatmap, f, 10U));
+	rewind(f);
+	char line[256];
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_TRUE(strstr(line, "40 claims") != NULL);
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_TRUE(strstr(line, "0-31 ") != NULL);
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_TRUE(strstr(line, "32-63 ") != NULL);
+	EXPECT_TRUE(fgets(line, sizeof(line), f) == NULL);
+	fclose(f);
+
+	/* One bucket per cache line of bitmap words */
+	heatmap = fx_mem_heatmap_init(mem_heatmap, n_words, 16U, 1U);
+	EXPECT_EQ(2U, heatmap->n_buckets);
+	fx_mem_static_pool_set_heatmap(pool, heatmap);
+	fx_mem_static_pool_alloc(pool);
+	EXPECT_EQ(1U, fx_mem_heatmap_n_claims(heatmap, 0U));
+	fx_mem_heatmap_reset(heatmap);
+	EXPECT_EQ(0U, fx_mem_heatmap_n_claims(heatmap, 0U));
+}
+
+#define N_THREADS 4U
+#define N_REPEAT 1000U
+#define N_BATCH 32U
+
+static fx_mem_static_pool_t *shared_pool;
+
+static void *_test_heatmap_threads_main(void *data) {
+	void *ptrs[N_BATCH];
+	for (uint32_t i = 0U; i < N_REPEAT; i++) {
+		for (uint32_t j = 0U; j < N_BATCH; j++) {
+			ptrs[j] = fx_mem_static_pool_alloc(shared_pool);
+		}
+		for (uint32_t j = 0U; j < N_BATCH; j++) {
+			fx_mem_static_pool_free(shared_pool, ptrs[j]);
+		}
+	}
+	return NULL;
+}
+
+static void test_heatmap_threads(void) {
+	const uint32_t n_words = fx_mem_bitset_n_words(N_SLOTS);
+	fx_mem_heatmap_t *heatmap =
+	    fx_mem_heatmap_init(mem_heatmap, n_words, 1U, 1U);
+	shared_pool = fx_mem_static_pool_init(mem_pool, N_SLOTS, 16U);
+	fx_mem_static_pool_set_heatmap(shared_pool, heatmap);
+	fx_mem_allocator_set_counters(
+	    &shared_pool->allocator, fx_mem_allocator_counters_init(mem_counters));
+
+	pthread_t threads[N_THREADS];
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, _test_heatmap_threads_main, NULL);
+	}
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* Without sampling, the heatmap agrees with the pool statistics */
+	uint64_t n_claims = 0U, n_failed = 0U;
+	for (uint32_t i = 0U; i < heatmap->n_buckets; i++) {
+		n_claims += fx_mem_heatmap_n_claims(heatmap, i);
+		n_failed += fx_mem_heatmap_n_failed(heatmap, i);
+	}
+	fx_mem_allocator_stats_t stats;
+	fx_mem_allocator_stats(&shared_pool->allocator, &stats);
+	EXPECT_EQ(N_THREADS * N_REPEAT * N_BATCH, n_claims);
+	EXPECT_EQ(stats.n_allocs_total, n_claims);
+	EXPECT_EQ(stats.n_contended, n_failed);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_heatmap_buckets);
+#ifndef __EMSCRIPTEN__
+	RUN(test_heatmap_threads);
+#endif
+	DONE;
+}
@@ -0,0 +1,120 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define _GNU_SOURCE
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <foxen/mem_iobuf.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[64U * 1024U] __attribute__((aligned(64)));
+
+static void test_iobuf_layout(void) {
+	EXPECT_EQ(0U, fx_mem_iobuf_pool_size(4U, 512U, 8U));
+	EXPECT_EQ(0U, fx_mem_iobuf_pool_size(4U, 512U, 1000U));
+	EXPECT_EQ(0U, fx_mem_iobuf_pool_size(0x10000U, 0x10000U, 512U));
+
+	/* Use a misaligned region; the buffers must be aligned anyway */
+	const uint32_t size = fx_mem_iobuf_pool_size(16U, 1000U, 512U);
+	ASSERT_GT(size, 16U * 1024U);
+	ASSERT_LT(size + 16U, sizeof(mem));
+	fx_mem_iobuf_pool_t *pool =
+	    fx_mem_iobuf_pool_init(mem + 16U, 16U, 1000U, 512U);
+	EXPECT_EQ(1024U, pool->buf_size);
+	const struct iovec *iov = (const struct iovec *)fx_mem_iobuf_iovecs(pool);
+	for (uint32_t i = 0U; i < 16U; i++) {
+		uint8_t *buf = (uint8_t *)fx_mem_iobuf_ptr(pool, i);
+		EXPECT_EQ(0U, (uintptr_t)buf & 511U);
+		EXPECT_TRUE(iov[i].iov_base == buf);
+		EXPECT_EQ(1024U, iov[i].iov_len);
+		EXPECT_TRUE(buf + 1024U <= mem + 16U + size);
+		memset(buf, (int)i, 1024U);
+	}
+	EXPECT_EQ(0U, pool->n_allocated);
+}
+
+static void test_iobuf_alloc_free(void) {
+	ASSERT_LT(fx_mem_iobuf_pool_size(40U, 512U, 512U), sizeof(mem));
+	fx_mem_iobuf_pool_t *pool = fx_mem_iobuf_pool_init(mem, 40U, 512U, 512U);
+	bool seen[40] = {false};
+	uint32_t idcs[40];
+	for (uint32_t i = 0U; i < 40U; i++) {
+		idcs[i] = fx_mem_iobuf_alloc(pool);
+		ASSERT_LT(idcs[i], 40U);
+		EXPECT_FALSE(seen[idcs[i]]);
+		seen[idcs[i]] = true;
+	}
+	EXPECT_EQ(40U, fx_mem_iobuf_alloc(pool));
+
+	/* Completion handlers return buffers through the user_data */
+	const uint64_t user_data = fx_mem_iobuf_user_data(idcs[7], 0xABCDU);
+	EXPECT_EQ(idcs[7], fx_mem_iobuf_user_data_idx(user_data));
+	EXPECT_EQ(0xABCDU, fx_mem_iobuf_user_data_tag(user_data));
+	fx_mem_iobuf_release_user_data(pool, user_data);
+	EXPECT_EQ(39U, pool->n_allocated);
+	EXPECT_EQ(idcs[7], fx_mem_iobuf_alloc(pool));
+}
+
+#ifdef HAVE_IO_URING
+static void test_iobuf_register(void) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const int ring_fd = (int)syscall(__NR_io_uring_setup, 4U, &params);
+	if (ring_fd < 0) {
+		return; /* io_uring is not available, e.g. disabled by seccomp */
+	}
+	fx_mem_iobuf_pool_t *pool = fx_mem_iobuf_pool_create(8U, 4096U, 4096U);
+	EXPECT_TRUE(pool != NULL);
+	if (pool) {
+		EXPECT_EQ(0U, (uintptr_t)fx_mem_iobuf_ptr(pool, 0U) & 4095U);
+		EXPECT_TRUE(fx_mem_iobuf_register(pool, ring_fd));
+		EXPECT_FALSE(fx_mem_iobuf_register(pool, ring_fd));
+		fx_mem_iobuf_unregister(pool);
+		EXPECT_TRUE(fx_mem_iobuf_register(pool, ring_fd));
+		fx_mem_iobuf_pool_destroy(pool); /* Unregisters the buffers */
+	}
+	close(ring_fd);
+}
+#endif
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_iobuf_layout);
+	RUN(test_iobuf_alloc_free);
+#ifdef HAVE_IO_URING
+	RUN(test_iobuf_register);
+#endif
+	DONE;
+}
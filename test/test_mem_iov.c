@@ -0,0 +1,174 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_iov.h>
+#include <foxen/mem_record.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[4096U] __attribute__((aligned(64)));
+
+static void test_iov_add_coalesce(void) {
+	fx_mem_iovec_t vecs[2];
+	fx_mem_iov_t iov;
+	fx_mem_iov_init(&iov, vecs, 2U);
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem, 16U));
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem + 16, 16U)); /* Adjacent */
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem + 64, 0U));  /* Empty */
+	EXPECT_EQ(1U, iov.n_vecs);
+	EXPECT_EQ(32U, vecs[0].iov_len);
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem + 64, 8U));
+	EXPECT_FALSE(fx_mem_iov_add(&iov, mem + 128, 8U));
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem + 72, 8U));
+	EXPECT_EQ(2U, iov.n_vecs);
+	EXPECT_EQ(48U, iov.n_bytes);
+}
+
+static void test_iov_layout(void) {
+	/* Fields of 8, 13, 32 and 16 bytes; the last two are adjacent */
+	const uint32_t sizes[4] = {8U, 13U, 32U, 16U};
+	fx_mem_iovec_t vecs[8];
+	fx_mem_iov_t iov;
+	fx_mem_iov_init(&iov, vecs, 8U);
+	EXPECT_TRUE(fx_mem_iov_add_layout(&iov, mem + 1, sizes, 4U));
+	EXPECT_EQ(3U, iov.n_vecs);
+	EXPECT_EQ(8U + 13U + 32U + 16U, iov.n_bytes);
+	EXPECT_TRUE(vecs[0].iov_base == mem + 16);
+	EXPECT_TRUE(vecs[1].iov_base == mem + 32);
+	EXPECT_TRUE(vecs[2].iov_base == mem + 48);
+	EXPECT_EQ(48U, vecs[2].iov_len);
+
+	/* A layout that does not fit is not added at all */
+	fx_mem_iov_init(&iov, vecs, 2U);
+	EXPECT_TRUE(fx_mem_iov_add(&iov, mem + 1024, 4U));
+	EXPECT_FALSE(fx_mem_iov_add_layout(&iov, mem, sizes, 4U));
+	EXPECT_EQ(1U, iov.n_vecs);
+	EXPECT_EQ(4U, iov.n_bytes);
+}
+
+static bool flush_cb(fx_mem_record_writer_t *writer, uint8_t *buf,
+                     uint32_t n_used, void *data) {
+	if (buf) {
+		*(uint32_t *)data = n_used;
+		return false;
+	}
+	fx_mem_record_writer_set_buffer(writer, mem, sizeof(mem));
+	return true;
+}
+
+static void test_iov_records(void) {
+	uint32_t n_used = 0U;
+	fx_mem_record_writer_t writer;
+	fx_mem_record_writer_init(&writer, flush_cb, &n_used);
+	for (uint32_t i = 0U; i < 5U; i++) {
+		uint8_t payload[20];
+		memset(payload, (int)i, sizeof(payload));
+		EXPECT_TRUE(fx_mem_record_write(&writer, payload, 5U + i, i));
+	}
+	fx_mem_record_flush(&writer);
+	ASSERT_GT(n_used, 0U);
+
+	/* Two entries per record; resume after the list is full */
+	fx_mem_iovec_t vecs[4];
+	fx_mem_iov_t iov;
+	fx_mem_iov_init(&iov, vecs, 4U);
+	uint32_t offset = 0U, n_records = 0U;
+	size_t n_bytes = 0U;
+	while (!fx_mem_iov_add_records(&iov, mem, n_used, &offset)) {
+		EXPECT_EQ(4U, iov.n_vecs);
+		n_records += iov.n_vecs / 2U;
+		n_bytes += iov.n_bytes;
+		fx_mem_iov_reset(&iov);
+	}
+	n_records += iov.n_vecs / 2U;
+	n_bytes += iov.n_bytes;
+	EXPECT_EQ(5U, n_records);
+	EXPECT_EQ(5U * 8U + 5U + 6U + 7U + 8U + 9U, n_bytes);
+	EXPECT_EQ(8U, vecs[0].iov_len);
+	EXPECT_EQ(9U, vecs[1].iov_len);
+}
+
+static void test_iov_consume(void) {
+	fx_mem_iovec_t vecs[3];
+	fx_mem_iov_t iov;
+	fx_mem_iov_init(&iov, vecs, 3U);
+	fx_mem_iov_add(&iov, mem, 10U);
+	fx_mem_iov_add(&iov, mem + 32, 10U);
+	fx_mem_iov_add(&iov, mem + 64, 10U);
+	fx_mem_iov_consume(&iov, 14U);
+	EXPECT_EQ(2U, iov.n_vecs);
+	EXPECT_EQ(16U, iov.n_bytes);
+	EXPECT_TRUE(vecs[0].iov_base == mem + 36);
+	EXPECT_EQ(6U, vecs[0].iov_len);
+	fx_mem_iov_consume(&iov, 6U);
+	EXPECT_EQ(1U, iov.n_vecs);
+	EXPECT_TRUE(vecs[0].iov_base == mem + 64);
+	fx_mem_iov_consume(&iov, 100U);
+	EXPECT_EQ(0U, iov.n_vecs);
+	EXPECT_EQ(0U, iov.n_bytes);
+}
+
+#ifndef __EMSCRIPTEN__
+static void test_iov_writev(void) {
+	const uint32_t sizes[3] = {3U, 5U, 7U};
+	for (uint32_t i = 0U; i < 64U; i++) {
+		mem[i] = (uint8_t)i;
+	}
+	fx_mem_iovec_t vecs[3];
+	fx_mem_iov_t iov;
+	fx_mem_iov_init(&iov, vecs, 3U);
+	EXPECT_TRUE(fx_mem_iov_add_layout(&iov, mem, sizes, 3U));
+
+	int fds[2];
+	EXPECT_TRUE(pipe(fds) == 0);
+	EXPECT_EQ(15, (int)writev(fds[1], vecs, (int)iov.n_vecs));
+	uint8_t out[15];
+	EXPECT_EQ(15, (int)read(fds[0], out, sizeof(out)));
+	const uint8_t expected[15] = {0,  1,  2,  16, 17, 18, 19, 20,
+	                              32, 33, 34, 35, 36, 37, 38};
+	EXPECT_TRUE(memcmp(out, expected, sizeof(out)) == 0);
+	close(fds[0]);
+	close(fds[1]);
+}
+#endif
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_iov_add_coalesce);
+	RUN(test_iov_layout);
+	RUN(test_iov_records);
+	RUN(test_iov_consume);
+#ifndef __EMSCRIPTEN__
+	RUN(test_iov_writev);
+#endif
+	DONE;
+}
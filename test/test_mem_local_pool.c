@@ -0,0 +1,150 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include <foxen/mem_local_pool.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define n_available 4099U
+#define OWNER 1U
+
+static uint8_t pool_mem[32768] __attribute__((aligned(64)));
+static uint8_t slot_acquired[n_available];
+
+static void test_local_pool_alloc_free_simple(void) {
+	ASSERT_GT(sizeof(pool_mem) + 1U, fx_mem_local_pool_size(n_available));
+	fx_mem_local_pool_t *pool =
+	    fx_mem_local_pool_init(pool_mem, n_available, OWNER);
+
+	/* The first n_available allocations should hand out consecutive slots */
+	for (uint32_t i = 0U; i < n_available; i++) {
+		EXPECT_EQ(i, fx_mem_local_pool_alloc(pool));
+	}
+	EXPECT_EQ(n_available, fx_mem_local_pool_n_allocated(pool));
+	EXPECT_EQ(n_available, fx_mem_local_pool_alloc(pool));
+
+	/* Locally freed slots are reused in LIFO order */
+	fx_mem_local_pool_free(pool, 10U, OWNER);
+	fx_mem_local_pool_free(pool, 20U, OWNER);
+	EXPECT_EQ(n_available - 2U, fx_mem_local_pool_n_allocated(pool));
+	EXPECT_EQ(20U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(10U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(n_available, fx_mem_local_pool_alloc(pool));
+
+	/* Remotely freed slots only become available once collected */
+	fx_mem_local_pool_free(pool, 30U, OWNER + 1U);
+	fx_mem_local_pool_free(pool, 40U, OWNER + 1U);
+	EXPECT_EQ(n_available, fx_mem_local_pool_n_allocated(pool));
+	EXPECT_EQ(40U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(n_available - 1U, fx_mem_local_pool_n_allocated(pool));
+	EXPECT_EQ(30U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(n_available, fx_mem_local_pool_alloc(pool));
+
+	/* Collecting the remote list while the local list is not empty */
+	fx_mem_local_pool_free_local(pool, 1U);
+	fx_mem_local_pool_free_remote(pool, 2U);
+	fx_mem_local_pool_free_remote(pool, 3U);
+	EXPECT_EQ(2U, fx_mem_local_pool_collect(pool));
+	EXPECT_EQ(0U, fx_mem_local_pool_collect(pool));
+	EXPECT_EQ(n_available - 3U, fx_mem_local_pool_n_allocated(pool));
+	EXPECT_EQ(3U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(2U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(1U, fx_mem_local_pool_alloc(pool));
+	EXPECT_EQ(n_available, fx_mem_local_pool_alloc(pool));
+}
+
+#define N_THREADS 4U
+#define N_REPEAT 50U
+
+static fx_mem_local_pool_t *shared_pool;
+static uint32_t handoff[n_available];
+static uint32_t n_handoff;
+
+static void *_test_local_pool_remote_main(void *data) {
+	/* Free every N_THREADS-th slot in the handoff array remotely */
+	const uintptr_t self = (uintptr_t)data;
+	for (uint32_t i = (uint32_t)self; i < n_handoff; i += N_THREADS) {
+		uint8_t *flag = &slot_acquired[handoff[i]];
+		EXPECT_EQ(1U, __atomic_load_n(flag, __ATOMIC_SEQ_CST));
+		__atomic_store_n(flag, 0U, __ATOMIC_SEQ_CST);
+		fx_mem_local_pool_free(shared_pool, handoff[i], self + OWNER + 1U);
+	}
+	return NULL;
+}
+
+static void test_local_pool_remote_free_threads(void) {
+	shared_pool = fx_mem_local_pool_init(pool_mem, n_available, OWNER);
+	for (uint32_t i = 0U; i < n_available; i++) {
+		slot_acquired[i] = 0U;
+	}
+
+	for (uint32_t r = 0U; r < N_REPEAT; r++) {
+		/* Allocate all slots as the owner */
+		n_handoff = 0U;
+		while (true) {
+			const uint32_t idx = fx_mem_local_pool_alloc(shared_pool);
+			if (idx == n_available) {
+				break;
+			}
+			EXPECT_EQ(0U, __atomic_load_n(&slot_acquired[idx],
+			                              __ATOMIC_SEQ_CST));
+			__atomic_store_n(&slot_acquired[idx], 1U, __ATOMIC_SEQ_CST);
+			handoff[n_handoff++] = idx;
+		}
+		EXPECT_EQ(n_available, n_handoff);
+
+		/* Have other threads free the slots while the owner keeps trying to
+		   allocate slots, thereby collecting the remote frees. */
+		pthread_t threads[N_THREADS];
+		for (uintptr_t i = 0U; i < N_THREADS; i++) {
+			pthread_create(&threads[i], NULL, _test_local_pool_remote_main,
+			               (void *)i);
+		}
+		uint32_t n_reacquired = 0U;
+		while (n_reacquired < n_available / 2U) {
+			const uint32_t idx = fx_mem_local_pool_alloc(shared_pool);
+			if (idx != n_available) {
+				/* Immediately free the slot again */
+				n_reacquired++;
+				fx_mem_local_pool_free(shared_pool, idx, OWNER);
+			}
+		}
+		for (uint32_t i = 0U; i < N_THREADS; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		fx_mem_local_pool_collect(shared_pool);
+		EXPECT_EQ(0U, fx_mem_local_pool_n_allocated(shared_pool));
+	}
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_local_pool_alloc_free_simple);
+#ifndef __EMSCRIPTEN__
+	RUN(test_local_pool_remote_free_threads);
+#endif
+	DONE;
+}
@@ -0,0 +1,273 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_log.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#ifndef __EMSCRIPTEN__
+
+#define CAPACITY (16U * 1024U * 1024U)
+
+static char path[64];
+
+#define OPEN_OR_RETURN(LOG, CAPACITY)                          \
+	do {                                                       \
+		const bool ok_ = fx_mem_log_open(LOG, path, CAPACITY); \
+		EXPECT_TRUE(ok_);                                      \
+		if (!ok_) {                                            \
+			return;                                            \
+		}                                                      \
+	} while (0)
+
+static void make_path(void) {
+	snprintf(path, sizeof(path), "/tmp/test_mem_log_%d.log", (int)getpid());
+	unlink(path);
+}
+
+static bool append(fx_mem_log_t *log, uint32_t value, uint32_t length) {
+	uint8_t *payload = (uint8_t *)fx_mem_log_reserve(log, length);
+	if (!payload) {
+		return false;
+	}
+	for (uint32_t i = 0U; i < length; i++) {
+		payload[i] = (uint8_t)(value + i);
+	}
+	fx_mem_log_commit(log, payload);
+	return true;
+}
+
+static uint32_t count_records(fx_mem_log_t *log, bool *intact) {
+	uint64_t offset = 0U;
+	uint32_t length, n = 0U;
+	const uint8_t *payload;
+	*intact = true;
+	while ((payload = fx_mem_log_next(log, &offset, &length))) {
+		*intact = *intact && ((uintptr_t)payload & (FX_ALIGN - 1U)) == 0U;
+		for (uint32_t i = 1U; i < length; i++) {
+			*intact = *intact && payload[i] == (uint8_t)(payload[0] + i);
+		}
+		n++;
+	}
+	return n;
+}
+
+static void test_log_append_reopen(void) {
+	make_path();
+	fx_mem_log_t log;
+	bool intact;
+	OPEN_OR_RETURN(&log, CAPACITY);
+	fx_mem_log_set_grow_step(&log, 4096U);
+	EXPECT_EQ(0U, count_records(&log, &intact));
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		EXPECT_TRUE(append(&log, i, i % 97U));
+	}
+	EXPECT_TRUE(fx_mem_log_wait_durable(&log));
+	EXPECT_EQ(1000U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+	fx_mem_log_close(&log);
+
+	/* Records are recovered and new records are appended after them */
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(1000U, count_records(&log, &intact));
+	EXPECT_TRUE(append(&log, 7U, 100U));
+	EXPECT_TRUE(fx_mem_log_sync(&log));
+	fx_mem_log_close(&log);
+
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(1001U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+	fx_mem_log_close(&log);
+	unlink(path);
+}
+
+static void test_log_full(void) {
+	make_path();
+	fx_mem_log_t log;
+	OPEN_OR_RETURN(&log, 8192U);
+	EXPECT_TRUE(fx_mem_log_reserve(&log, 4096U) != NULL);
+	EXPECT_TRUE(fx_mem_log_reserve(&log, 4096U) == NULL);
+	EXPECT_TRUE(fx_mem_log_reserve(&log, 0xFFFFFFFFU) == NULL);
+	fx_mem_log_close(&log);
+	unlink(path);
+}
+
+static uint8_t *nth_record(fx_mem_log_t *log, uint32_t n) {
+	uint64_t offset = 0U;
+	uint32_t length;
+	const void *payload = NULL;
+	for (uint32_t i = 0U; i <= n; i++) {
+		payload = fx_mem_log_next(log, &offset, &length);
+	}
+	return (uint8_t *)payload;
+}
+
+static void test_log_recovery(void) {
+	make_path();
+	fx_mem_log_t log;
+	bool intact;
+	OPEN_OR_RETURN(&log, CAPACITY);
+	for (uint32_t i = 0U; i < 3U; i++) {
+		EXPECT_TRUE(append(&log, i, 32U));
+	}
+
+	/* Readers stop at a record that was reserved but not committed yet... */
+	EXPECT_TRUE(fx_mem_log_reserve(&log, 32U) != NULL);
+	EXPECT_TRUE(append(&log, 4U, 32U));
+	EXPECT_EQ(3U, count_records(&log, &intact));
+	fx_mem_log_close(&log);
+
+	/* ...but once the log is reopened, the record is skipped and the records
+	   following it are kept */
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(4U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+
+	/* Corrupted records are skipped as well */
+	uint8_t *payload = nth_record(&log, 1U);
+	EXPECT_TRUE(payload != NULL);
+	if (payload) {
+		payload[3] ^= 0xFFU;
+	}
+	fx_mem_log_close(&log);
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(3U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+
+	/* Corrupting the last record discards it. The discarded tail must not
+	   reappear after shorter records filled the gap. */
+	payload = nth_record(&log, 2U);
+	EXPECT_TRUE(payload != NULL);
+	if (payload) {
+		payload[3] ^= 0xFFU;
+	}
+	fx_mem_log_close(&log);
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(2U, count_records(&log, &intact));
+	EXPECT_TRUE(append(&log, 5U, 0U));
+	EXPECT_TRUE(append(&log, 6U, 0U));
+	fx_mem_log_close(&log);
+	OPEN_OR_RETURN(&log, CAPACITY);
+	EXPECT_EQ(4U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+	fx_mem_log_close(&log);
+	unlink(path);
+}
+
+static void test_log_sync_pending(void) {
+	make_path();
+	fx_mem_log_t log;
+	bool intact;
+	OPEN_OR_RETURN(&log, CAPACITY);
+
+	/* A sync that happens while a record is pending does not count that
+	   record as synced, so the next sync flushes it once it is committed */
+	EXPECT_TRUE(append(&log, 1U, 32U));
+	uint8_t *pending = (uint8_t *)fx_mem_log_reserve(&log, 32U);
+	EXPECT_TRUE(pending != NULL);
+	if (!pending) {
+		return;
+	}
+	EXPECT_TRUE(append(&log, 2U, 32U));
+	EXPECT_TRUE(fx_mem_log_wait_durable(&log));
+	const uint64_t offset_pending = (uint64_t)(pending - log.base) - FX_ALIGN;
+	EXPECT_EQ(offset_pending, log.synced);
+	for (uint32_t i = 0U; i < 32U; i++) {
+		pending[i] = (uint8_t)(3U + i);
+	}
+	fx_mem_log_commit(&log, pending);
+	EXPECT_TRUE(fx_mem_log_wait_durable(&log));
+	EXPECT_EQ(log.cursor, log.synced);
+	EXPECT_EQ(3U, count_records(&log, &intact));
+	EXPECT_TRUE(intact);
+	fx_mem_log_close(&log);
+	unlink(path);
+}
+
+#define N_THREADS 4U
+#define N_RECORDS 2000U
+
+static fx_mem_log_t thread_log;
+
+static void *thread_main(void *arg) {
+	const uint32_t idx = (uint32_t)(uintptr_t)arg;
+	bool ok = true;
+	for (uint32_t i = 0U; i < N_RECORDS; i++) {
+		ok = append(&thread_log, idx * N_RECORDS + i, 8U + (i % 64U)) && ok;
+		if ((i % 100U) == 99U) {
+			ok = fx_mem_log_wait_durable(&thread_log) && ok;
+		}
+	}
+	return ok ? arg : NULL;
+}
+
+static void test_log_group_commit(void) {
+	make_path();
+	bool intact;
+	OPEN_OR_RETURN(&thread_log, CAPACITY);
+	fx_mem_log_set_grow_step(&thread_log, 16384U);
+	fx_mem_log_set_batch_delay(&thread_log, 50U);
+
+	pthread_t threads[N_THREADS];
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, thread_main,
+		               (void *)(uintptr_t)(i + 1U));
+	}
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		void *res;
+		pthread_join(threads[i], &res);
+		EXPECT_TRUE(res == (void *)(uintptr_t)(i + 1U));
+	}
+	fx_mem_log_close(&thread_log);
+
+	OPEN_OR_RETURN(&thread_log, CAPACITY);
+	EXPECT_EQ(N_THREADS * N_RECORDS, count_records(&thread_log, &intact));
+	EXPECT_TRUE(intact);
+	fx_mem_log_close(&thread_log);
+	unlink(path);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+#ifndef __EMSCRIPTEN__
+	RUN(test_log_append_reopen);
+	RUN(test_log_full);
+	RUN(test_log_recovery);
+	RUN(test_log_sync_pending);
+	RUN(test_log_group_commit);
+#endif
+	DONE;
+}
@@ -0,0 +1,164 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_record.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define N_BUFFERS 8U
+#define BUFFER_SIZE 256U
+
+static uint8_t buffers[N_BUFFERS][BUFFER_SIZE] __attribute__((aligned(64)));
+
+typedef struct {
+	uint32_t n_supplied;
+	uint32_t n_filled;
+	uint32_t n_used[N_BUFFERS];
+} buffer_state_t;
+
+static bool _next_buffer(fx_mem_record_writer_t *writer, uint8_t *buf,
+                         uint32_t n_used, void *data) {
+	buffer_state_t *state = (buffer_state_t *)data;
+	if (buf) {
+		EXPECT_TRUE(buf == buffers[state->n_filled]);
+		state->n_used[state->n_filled++] = n_used;
+	}
+	if (state->n_supplied >= N_BUFFERS) {
+		return false;
+	}
+	fx_mem_record_writer_set_buffer(writer, buffers[state->n_supplied++],
+	                                BUFFER_SIZE);
+	return true;
+}
+
+static void test_record_size(void) {
+	EXPECT_EQ(16U, fx_mem_record_size(0U));
+	EXPECT_EQ(32U, fx_mem_record_size(1U));
+	EXPECT_EQ(32U, fx_mem_record_size(16U));
+	EXPECT_EQ(48U, fx_mem_record_size(17U));
+	EXPECT_EQ(0U, fx_mem_record_size(0xFFFFFFF8U));
+}
+
+static void test_record_write_read(void) {
+	buffer_state_t state;
+	memset(&state, 0, sizeof(state));
+	fx_mem_record_writer_t writer;
+	fx_mem_record_writer_init(&writer, _next_buffer, &state);
+
+	/* Records spanning multiple buffers */
+	uint8_t data[100];
+	for (uint32_t i = 0U; i < sizeof(data); i++) {
+		data[i] = (uint8_t)i;
+	}
+	for (uint32_t i = 0U; i < 20U; i++) {
+		EXPECT_TRUE(fx_mem_record_write(&writer, data, (i * 7U) % 100U, i));
+	}
+
+	/* A record larger than a buffer is rejected without wasting a buffer */
+	const uint32_t n_supplied = state.n_supplied;
+	EXPECT_TRUE(fx_mem_record_reserve(&writer, BUFFER_SIZE, 0U) == NULL);
+	EXPECT_TRUE(fx_mem_record_flush(&writer));
+	EXPECT_TRUE(fx_mem_record_reserve(&writer, BUFFER_SIZE, 0U) == NULL);
+	EXPECT_EQ(n_supplied + 1U, state.n_supplied);
+	EXPECT_GT(state.n_filled, 1U);
+
+	/* Read all records back in order */
+	uint32_t i = 0U;
+	for (uint32_t j = 0U; j < state.n_filled; j++) {
+		fx_mem_record_reader_t reader;
+		fx_mem_record_reader_init(&reader, buffers[j], state.n_used[j]);
+		uint32_t length, tag;
+		const uint8_t *payload;
+		while ((payload = fx_mem_record_next(&reader, &length, &tag))) {
+			EXPECT_EQ(0U, ((uintptr_t)payload) & (FX_ALIGN - 1U));
+			EXPECT_EQ(i, tag);
+			EXPECT_EQ((i * 7U) % 100U, length);
+			EXPECT_EQ(0, memcmp(payload, data, length));
+			i++;
+		}
+	}
+	EXPECT_EQ(20U, i);
+
+	/* The end marker also terminates a reader given the full buffer size */
+	fx_mem_record_reader_t reader;
+	fx_mem_record_reader_init(&reader, buffers[0], BUFFER_SIZE);
+	uint32_t n_records = 0U, length;
+	while (fx_mem_record_next(&reader, &length, NULL)) {
+		n_records++;
+	}
+	EXPECT_GT(n_records, 0U);
+	EXPECT_GE(state.n_used[0], reader.offset);
+}
+
+static void test_record_batch(void) {
+	buffer_state_t state;
+	memset(&state, 0, sizeof(state));
+	fx_mem_record_writer_t writer;
+	fx_mem_record_writer_init(&writer, _next_buffer, &state);
+
+	/* Each record occupies 64 bytes, so four of them fit into a buffer */
+	uint32_t lengths[10], tags[10];
+	void *payloads[10];
+	for (uint32_t i = 0U; i < 10U; i++) {
+		lengths[i] = 48U;
+		tags[i] = 100U + i;
+	}
+	EXPECT_EQ(4U, fx_mem_record_reserve_batch(&writer, 10U, lengths, tags,
+	                                          payloads));
+	for (uint32_t i = 0U; i < 4U; i++) {
+		EXPECT_TRUE(payloads[i] == buffers[0] + 64U * i + 16U);
+		memset(payloads[i], (int)i, 48U);
+	}
+	EXPECT_EQ(4U, fx_mem_record_reserve_batch(&writer, 6U, lengths + 4U,
+	                                          tags + 4U, payloads + 4U));
+	EXPECT_TRUE(payloads[4] == buffers[1] + 16U);
+	EXPECT_EQ(2U, fx_mem_record_reserve_batch(&writer, 2U, lengths + 8U, NULL,
+	                                          payloads + 8U));
+	EXPECT_TRUE(fx_mem_record_flush(&writer));
+	EXPECT_EQ(3U, state.n_filled);
+	EXPECT_EQ(128U, state.n_used[2]);
+
+	fx_mem_record_reader_t reader;
+	fx_mem_record_reader_init(&reader, buffers[2], state.n_used[2]);
+	uint32_t length, tag = 1U;
+	EXPECT_TRUE(fx_mem_record_next(&reader, &length, &tag) == payloads[8]);
+	EXPECT_EQ(0U, tag);
+
+	/* Running out of buffers */
+	while (fx_mem_record_flush(&writer))
+		;
+	EXPECT_EQ(0U, fx_mem_record_reserve_batch(&writer, 1U, lengths, NULL,
+	                                          payloads));
+	EXPECT_FALSE(fx_mem_record_write(&writer, payloads, 1U, 0U));
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_record_size);
+	RUN(test_record_write_read);
+	RUN(test_record_batch);
+	DONE;
+}
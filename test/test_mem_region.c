@@ -0,0 +1,202 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem.h>
+#include <foxen/mem_region.h>
+#include <foxen/mem_rptr.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#ifndef __EMSCRIPTEN__
+
+#define N_VALUES (4U * 1024U * 1024U)
+
+typedef struct model {
+	uint32_t n_values;
+	fx_mem_rptr_t values;
+	uint32_t *abs_values;
+} model_t;
+
+static model_t *model_init(void *mem, uint32_t n_values) {
+	model_t *model = (model_t *)fx_mem_align(&mem, sizeof(model_t));
+	model->n_values = n_values;
+	model->values =
+	    fx_mem_align_rptr(model, &mem, sizeof(uint32_t) * n_values);
+	model->abs_values = FX_MEM_RPTR_DECODE(uint32_t, model, model->values);
+	for (uint32_t i = 0U; i < n_values; i++) {
+		model->abs_values[i] = i;
+	}
+	return model;
+}
+
+static void test_region_clone(void) {
+	fx_mem_region_t src, clone1, clone2, bad;
+	EXPECT_FALSE(fx_mem_region_create(&src, 0U));
+	EXPECT_TRUE(fx_mem_region_create(&src, 16U * 1024U * 1024U + 1U));
+	if (!src.base) {
+		return;
+	}
+	EXPECT_EQ(0U, src.size % 4096U);
+	model_t *model = model_init(src.base, N_VALUES);
+	EXPECT_TRUE(fx_mem_region_freeze(&src));
+	EXPECT_TRUE(fx_mem_region_clone(&src, &clone1));
+	EXPECT_TRUE(fx_mem_region_clone(&src, &clone2));
+	EXPECT_FALSE(fx_mem_region_clone(&clone1, &bad));
+	if (!clone1.base || !clone2.base) {
+		return;
+	}
+
+	/* Relative pointers work in the clones without modification */
+	model_t *m1 = (model_t *)fx_mem_region_rebase(&src, &clone1, model);
+	model_t *m2 = (model_t *)fx_mem_region_rebase(&src, &clone2, model);
+	uint32_t *v1 = FX_MEM_RPTR_DECODE(uint32_t, m1, m1->values);
+	uint32_t *v2 = FX_MEM_RPTR_DECODE(uint32_t, m2, m2->values);
+	EXPECT_TRUE((uint8_t *)v1 > clone1.base);
+	EXPECT_TRUE(fx_mem_region_rebase(&src, &clone1, model->abs_values) == v1);
+	EXPECT_TRUE(fx_mem_region_rebase(&src, &clone1, NULL) == NULL);
+
+	/* Modifications are private to each clone */
+	v1[10] = 1000U;
+	v1[N_VALUES - 1U] = 2000U;
+	v2[10] = 3000U;
+	EXPECT_EQ(1000U, v1[10]);
+	EXPECT_EQ(3000U, v2[10]);
+	EXPECT_EQ(10U, model->abs_values[10]);
+	EXPECT_EQ(N_VALUES - 1U, model->abs_values[N_VALUES - 1U]);
+	EXPECT_EQ(N_VALUES - 1U, v2[N_VALUES - 1U]);
+	EXPECT_EQ(12345U, v1[12345]);
+
+	/* Clones survive the destruction of their source */
+	fx_mem_region_destroy(&src);
+	EXPECT_EQ(2000U, v1[N_VALUES - 1U]);
+	EXPECT_EQ(11U, v2[11]);
+	fx_mem_region_destroy(&clone1);
+	fx_mem_region_destroy(&clone2);
+	EXPECT_TRUE(clone2.base == NULL);
+}
+
+typedef struct move_state {
+	uint32_t n_moves;
+	uint32_t *values; /* absolute pointer into the region */
+} move_state_t;
+
+static void on_move(void *data, const fx_mem_region_t *region,
+                    const uint8_t *old_base) {
+	move_state_t *state = (move_state_t *)data;
+	state->n_moves++;
+	state->values =
+	    (uint32_t *)fx_mem_region_relocate(old_base, region, state->values);
+}
+
+static void test_region_grow_anon(void) {
+	fx_mem_region_t region;
+	EXPECT_FALSE(fx_mem_region_create_anon(&region, 0U, 0U));
+	EXPECT_FALSE(fx_mem_region_create_anon(&region, 4096U, 3U * 4096U));
+	EXPECT_TRUE(fx_mem_region_create_anon(&region, 1U << 20U,
+	                                      FX_MEM_REGION_HUGE_PAGE));
+	if (!region.base) {
+		return;
+	}
+	EXPECT_EQ(FX_MEM_REGION_HUGE_PAGE, region.size);
+	EXPECT_EQ(0U, (uintptr_t)region.base % FX_MEM_REGION_HUGE_PAGE);
+
+	/* Contents and alignment are kept while growing */
+	move_state_t state = {0U, (uint32_t *)region.base + 100U};
+	uint32_t n_values = region.size / sizeof(uint32_t) - 100U;
+	for (uint32_t i = 0U; i < n_values; i += 1024U) {
+		state.values[i] = i;
+	}
+	for (uint32_t size = 4U; size <= 64U; size *= 2U) {
+		const uint8_t *old_base = region.base;
+		const uint32_t n_moves = state.n_moves;
+		EXPECT_TRUE(fx_mem_region_grow(&region, size << 20U, on_move,
+		                               &state));
+		EXPECT_EQ(size << 20U, region.size);
+		EXPECT_EQ(0U, (uintptr_t)region.base % FX_MEM_REGION_HUGE_PAGE);
+		EXPECT_EQ(old_base != region.base, state.n_moves == n_moves + 1U);
+		EXPECT_TRUE(state.values == (uint32_t *)region.base + 100U);
+		bool ok = true;
+		for (uint32_t i = 0U; i < n_values; i += 1024U) {
+			ok = ok && state.values[i] == i;
+		}
+		EXPECT_TRUE(ok);
+
+		/* The additional memory is zeroed */
+		EXPECT_EQ(0U, state.values[n_values]);
+		EXPECT_EQ(0U, region.base[region.size - 1U]);
+		const uint32_t n_values_new = region.size / sizeof(uint32_t) - 100U;
+		for (uint32_t i = (n_values + 1023U) & ~1023U; i < n_values_new;
+		     i += 1024U) {
+			state.values[i] = i;
+		}
+		n_values = n_values_new;
+	}
+
+	/* Shrinking is a no-op; anonymous regions cannot be cloned */
+	fx_mem_region_t clone;
+	EXPECT_TRUE(fx_mem_region_grow(&region, 4096U, NULL, NULL));
+	EXPECT_EQ(64U << 20U, region.size);
+	EXPECT_FALSE(fx_mem_region_clone(&region, &clone));
+	fx_mem_region_destroy(&region);
+}
+
+static void test_region_grow_move(void) {
+	/* Regions are usually mapped top-down; the region created second is
+	   placed directly below the first one and cannot grow in place */
+	fx_mem_region_t blocker, region;
+	EXPECT_TRUE(fx_mem_region_create(&blocker, 4096U));
+	EXPECT_TRUE(fx_mem_region_create(&region, 4096U));
+	if (!blocker.base || !region.base) {
+		return;
+	}
+	move_state_t state = {0U, (uint32_t *)region.base};
+	state.values[0] = 42U;
+	const uint8_t *old_base = region.base;
+	EXPECT_TRUE(fx_mem_region_grow(&region, 1U << 20U, on_move, &state));
+	EXPECT_EQ(old_base != region.base, state.n_moves == 1U);
+	EXPECT_EQ(42U, state.values[0]);
+	EXPECT_EQ(0U, region.base[(1U << 20U) - 1U]);
+
+	/* Clones of a grown region see its full size; clones cannot grow */
+	fx_mem_region_t clone;
+	EXPECT_TRUE(fx_mem_region_clone(&region, &clone));
+	EXPECT_EQ(1U << 20U, clone.size);
+	EXPECT_EQ(42U, *(uint32_t *)clone.base);
+	EXPECT_FALSE(fx_mem_region_grow(&clone, 2U << 20U, NULL, NULL));
+	fx_mem_region_destroy(&clone);
+	fx_mem_region_destroy(&region);
+	fx_mem_region_destroy(&blocker);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+#ifndef __EMSCRIPTEN__
+	RUN(test_region_clone);
+	RUN(test_region_grow_anon);
+	RUN(test_region_grow_move);
+#endif
+	DONE;
+}
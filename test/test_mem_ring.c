@@ -0,0 +1,197 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <string.h>
+
+#include <foxen/mem_ring.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#ifndef __EMSCRIPTEN__
+
+static void test_ring_mirror(void) {
+	fx_mem_ring_t ring;
+	EXPECT_TRUE(fx_mem_ring_init(&ring, 1000U));
+	if (!ring.base) {
+		return;
+	}
+	EXPECT_GE(ring.capacity, 1000U);
+	EXPECT_EQ(0U, ring.capacity & (ring.capacity - 1U));
+
+	/* Both halves show the same memory */
+	ring.base[5] = 42U;
+	EXPECT_EQ(42U, ring.base[ring.capacity + 5U]);
+	ring.base[2U * ring.capacity - 1U] = 17U;
+	EXPECT_EQ(17U, ring.base[ring.capacity - 1U]);
+	fx_mem_ring_destroy(&ring);
+}
+
+static void test_ring_spsc_wrap(void) {
+	fx_mem_ring_t ring;
+	EXPECT_TRUE(fx_mem_ring_init(&ring, 4096U));
+	if (!ring.base) {
+		return;
+	}
+	const size_t cap = ring.capacity;
+	size_t n_avail;
+
+	/* Fill the ring completely, then fail to write another byte */
+	EXPECT_TRUE(fx_mem_ring_write_begin(&ring, cap) != NULL);
+	EXPECT_TRUE(fx_mem_ring_write_begin(&ring, cap + 1U) == NULL);
+	fx_mem_ring_write_end(&ring, cap - 16U);
+	EXPECT_TRUE(fx_mem_ring_write_begin(&ring, 17U) == NULL);
+	fx_mem_ring_read_begin(&ring, &n_avail);
+	EXPECT_EQ(cap - 16U, n_avail);
+	fx_mem_ring_read_end(&ring, n_avail);
+
+	/* A record straddling the wrap point is contiguous for both sides */
+	uint8_t *w = (uint8_t *)fx_mem_ring_write_begin(&ring, 64U);
+	EXPECT_TRUE(w != NULL);
+	if (!w) {
+		return;
+	}
+	EXPECT_TRUE(w == ring.base + cap - 16U);
+	for (uint32_t i = 0U; i < 64U; i++) {
+		w[i] = (uint8_t)i;
+	}
+	fx_mem_ring_write_end(&ring, 64U);
+	EXPECT_EQ(16U, ring.base[0]);
+
+	const uint8_t *r = (const uint8_t *)fx_mem_ring_read_begin(&ring, &n_avail);
+	EXPECT_EQ(64U, n_avail);
+	bool ok = true;
+	for (uint32_t i = 0U; i < 64U; i++) {
+		ok = ok && r[i] == (uint8_t)i;
+	}
+	EXPECT_TRUE(ok);
+	fx_mem_ring_read_end(&ring, 64U);
+	fx_mem_ring_read_begin(&ring, &n_avail);
+	EXPECT_EQ(0U, n_avail);
+	fx_mem_ring_destroy(&ring);
+}
+
+#define N_PRODUCERS 4U
+#define N_MESSAGES 100000U
+
+typedef struct message {
+	uint32_t producer;
+	uint32_t seq;
+	uint32_t payload[6];
+} message_t;
+
+static fx_mem_ring_t mp_ring;
+static bool mp_stop;
+
+static void *producer_main(void *arg) {
+	const uint32_t idx = (uint32_t)(uintptr_t)arg;
+	for (uint32_t i = 0U; i < N_MESSAGES; i++) {
+		/* Vary the size so that messages straddle the wrap point */
+		const size_t n_bytes = 8U + 4U * (i % 7U);
+		uint64_t pos;
+		message_t *msg;
+		while (!(msg = (message_t *)fx_mem_ring_mp_reserve(&mp_ring, n_bytes,
+		                                                   &pos))) {
+			if (__atomic_load_n(&mp_stop, __ATOMIC_RELAXED)) {
+				return NULL;
+			}
+			sched_yield();
+		}
+		msg->producer = idx;
+		msg->seq = i;
+		for (uint32_t j = 0U; j < i % 7U; j++) {
+			msg->payload[j] = i + j;
+		}
+		fx_mem_ring_mp_commit(&mp_ring, pos, n_bytes);
+	}
+	return NULL;
+}
+
+static void test_ring_mpsc(void) {
+	EXPECT_TRUE(fx_mem_ring_init(&mp_ring, 4096U));
+	if (!mp_ring.base) {
+		return;
+	}
+	pthread_t threads[N_PRODUCERS];
+	for (uint32_t i = 0U; i < N_PRODUCERS; i++) {
+		pthread_create(&threads[i], NULL, producer_main, (void *)(uintptr_t)i);
+	}
+
+	/* Messages of each producer must arrive complete and in order */
+	uint32_t next_seq[N_PRODUCERS] = {0U};
+	uint32_t n_received = 0U;
+	bool ok = true;
+	while (n_received < N_PRODUCERS * N_MESSAGES) {
+		size_t n_avail;
+		const uint8_t *r =
+		    (const uint8_t *)fx_mem_ring_read_begin(&mp_ring, &n_avail);
+		if (n_avail == 0U) {
+			sched_yield();
+		}
+		size_t offset = 0U;
+		while (n_avail - offset >= 8U) {
+			message_t msg;
+			memcpy(&msg, r + offset, 8U);
+			const size_t n_bytes = 8U + 4U * (msg.seq % 7U);
+			memcpy(&msg, r + offset, n_bytes);
+			ok = ok && msg.producer < N_PRODUCERS &&
+			     msg.seq == next_seq[msg.producer];
+			if (!ok) {
+				break;
+			}
+			for (uint32_t j = 0U; j < msg.seq % 7U; j++) {
+				ok = ok && msg.payload[j] == msg.seq + j;
+			}
+			next_seq[msg.producer]++;
+			offset += n_bytes;
+			n_received++;
+		}
+		fx_mem_ring_read_end(&mp_ring, offset);
+		if (!ok) {
+			break;
+		}
+	}
+	EXPECT_TRUE(ok);
+	__atomic_store_n(&mp_stop, true, __ATOMIC_RELAXED);
+	for (uint32_t i = 0U; i < N_PRODUCERS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	fx_mem_ring_destroy(&mp_ring);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+#ifndef __EMSCRIPTEN__
+	RUN(test_ring_mirror);
+	RUN(test_ring_spsc_wrap);
+	RUN(test_ring_mpsc);
+#endif
+	DONE;
+}
@@ -0,0 +1,104 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_rptr.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+typedef struct complex_matrix {
+	uint16_t w, h;
+	fx_mem_rptr_t real, imag;
+} complex_matrix_t;
+
+static uint32_t complex_matrix_size(uint16_t w, uint16_t h) {
+	uint32_t size;
+	bool ok = fx_mem_init_size(&size) &&
+	          fx_mem_update_size(&size, sizeof(complex_matrix_t)) &&
+	          fx_mem_update_size(&size, sizeof(float) * w * h) &&
+	          fx_mem_update_size(&size, sizeof(float) * w * h);
+	return ok ? size : 0U;
+}
+
+static complex_matrix_t *complex_matrix_init(void *mem, uint16_t w,
+                                             uint16_t h) {
+	complex_matrix_t *mat =
+	    (complex_matrix_t *)fx_mem_align(&mem, sizeof(complex_matrix_t));
+	mat->w = w, mat->h = h;
+	mat->real = fx_mem_align_rptr(mat, &mem, sizeof(float) * w * h);
+	mat->imag = fx_mem_align_rptr(mat, &mem, sizeof(float) * w * h);
+	return mat;
+}
+
+static uint8_t mem1[4096U] __attribute__((aligned(64)));
+static uint8_t mem2[4096U] __attribute__((aligned(64)));
+
+static void test_rptr_encode_decode(void) {
+	uint8_t *base = mem1;
+	EXPECT_EQ(FX_MEM_RPTR_NULL, fx_mem_rptr_encode(base, NULL));
+	EXPECT_TRUE(fx_mem_rptr_decode(base, FX_MEM_RPTR_NULL) == NULL);
+	EXPECT_EQ(100U, fx_mem_rptr_encode(base, base + 100));
+	EXPECT_TRUE(fx_mem_rptr_decode(base, 100U) == base + 100);
+	EXPECT_TRUE(fx_mem_rptr_decode_nonnull(base, 16U) == base + 16);
+
+	EXPECT_TRUE(fx_mem_rptr_in_range(base, NULL));
+	EXPECT_TRUE(fx_mem_rptr_in_range(base, base + 1));
+	EXPECT_FALSE(fx_mem_rptr_in_range(base, base));
+	EXPECT_FALSE(fx_mem_rptr_in_range(base + 1, base));
+}
+
+static void test_rptr_layout_relocatable(void) {
+	EXPECT_EQ(4U + 2U * sizeof(fx_mem_rptr_t), sizeof(complex_matrix_t));
+	ASSERT_GT(sizeof(mem1), complex_matrix_size(8U, 8U));
+	complex_matrix_t *mat = complex_matrix_init(mem1, 8U, 8U);
+	float *real = FX_MEM_RPTR_DECODE(float, mat, mat->real);
+	float *imag = FX_MEM_RPTR_DECODE(float, mat, mat->imag);
+	EXPECT_TRUE((uint8_t *)real > (uint8_t *)mat);
+	EXPECT_TRUE(imag >= real + 64);
+	EXPECT_EQ(0U, ((uintptr_t)real) & (FX_ALIGN - 1U));
+	for (uint32_t i = 0U; i < 64U; i++) {
+		real[i] = (float)i, imag[i] = -(float)i;
+	}
+
+	/* Copying the region to another address keeps the structure intact */
+	memcpy(mem2, mem1, complex_matrix_size(8U, 8U));
+	complex_matrix_t *mat2 = (complex_matrix_t *)mem2;
+	float *real2 = FX_MEM_RPTR_DECODE(float, mat2, mat2->real);
+	float *imag2 = FX_MEM_RPTR_DECODE(float, mat2, mat2->imag);
+	EXPECT_TRUE((uint8_t *)real2 >= mem2);
+	EXPECT_TRUE((uint8_t *)imag2 < mem2 + sizeof(mem2));
+	for (uint32_t i = 0U; i < 64U; i++) {
+		EXPECT_EQ((float)i, real2[i]);
+		EXPECT_EQ(-(float)i, imag2[i]);
+	}
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_rptr_encode_decode);
+	RUN(test_rptr_layout_relocatable);
+	DONE;
+}
@@ -0,0 +1,163 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_sampler.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem_sampler[1U << 20U] __attribute__((aligned(64)));
+static uint8_t mem_arena[1U << 16U] __attribute__((aligned(64)));
+
+static void __attribute__((noinline))
+_alloc_site_a(fx_mem_sampler_t *sampler, uintptr_t key) {
+	fx_mem_sampler_alloc(sampler, key, 32U);
+}
+
+static void __attribute__((noinline))
+_alloc_site_b(fx_mem_sampler_t *sampler, uintptr_t key) {
+	fx_mem_sampler_alloc(sampler, key, 100U);
+}
+
+static uint32_t _count_sites(fx_mem_sampler_t *sampler, size_t n_live_bytes) {
+	uint32_t n = 0U;
+	for (uint32_t i = 0U; i < sampler->n_sites; i++) {
+		if (sampler->sites[i].depth &&
+		    sampler->sites[i].n_live_bytes == n_live_bytes) {
+			n++;
+		}
+	}
+	return n;
+}
+
+static void test_sampler_attribution(void) {
+	ASSERT_GT(sizeof(mem_sampler), fx_mem_sampler_size(16U, 64U));
+	fx_mem_sampler_t *sampler = fx_mem_sampler_init(mem_sampler, 16U, 64U, 1U);
+
+	/* The first allocation on a thread only initialises the countdown */
+	fx_mem_sampler_alloc(sampler, 1000U, 1U);
+	EXPECT_EQ(0U, sampler->n_live);
+
+	/* With a rate of one byte every allocation is sampled */
+	for (uintptr_t i = 0U; i < 10U; i++) {
+		_alloc_site_a(sampler, i);
+	}
+	for (uintptr_t i = 10U; i < 15U; i++) {
+		_alloc_site_b(sampler, i);
+	}
+	EXPECT_EQ(15U, sampler->n_live);
+	EXPECT_EQ(1U, _count_sites(sampler, 320U));
+	EXPECT_EQ(1U, _count_sites(sampler, 500U));
+
+	/* Freeing samples reduces the live bytes of the call site */
+	for (uintptr_t i = 0U; i < 5U; i++) {
+		fx_mem_sampler_free(sampler, i);
+	}
+	fx_mem_sampler_free(sampler, 12345U); /* Never sampled */
+	EXPECT_EQ(10U, sampler->n_live);
+	EXPECT_EQ(1U, _count_sites(sampler, 160U));
+	EXPECT_EQ(1U, _count_sites(sampler, 500U));
+	EXPECT_EQ(0U, fx_mem_sampler_n_dropped(sampler));
+
+	/* The header line of the profile contains the totals */
+	FILE *f = tmpfile();
+	EXPECT_TRUE(f != NULL);
+	if (!f) {
+		return;
+	}
+	EXPECT_TRUE(fx_mem_sampler_dump(sampler, f));
+	rewind(f);
+	char line[256];
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_EQ(0, strcmp(line, "heap profile: 10: 660 [15: 820] @ heap_v2/1\n"));
+	EXPECT_TRUE(fgets(line, sizeof(line), f) != NULL);
+	EXPECT_TRUE(strstr(line, "] @ 0x") != NULL);
+	fclose(f);
+}
+
+static void test_sampler_overflow(void) {
+	/* The sample table has at least 16 entries */
+	fx_mem_sampler_t *sampler = fx_mem_sampler_init(mem_sampler, 4U, 1U, 1U);
+	for (uintptr_t i = 0U; i < 64U; i++) {
+		_alloc_site_a(sampler, i);
+	}
+	EXPECT_GT(fx_mem_sampler_n_dropped(sampler), 0U);
+	EXPECT_GE(16U, sampler->n_live);
+}
+
+static void test_sampler_rate(void) {
+	/* Allocate 1 MiB in 64 byte blocks with a sampling rate of 1 KiB */
+	fx_mem_sampler_t *sampler =
+	    fx_mem_sampler_init(mem_sampler, 16U, 4096U, 1024U);
+	for (uintptr_t i = 0U; i < (1U << 14U); i++) {
+		fx_mem_sampler_alloc(sampler, i, 64U);
+	}
+	EXPECT_GT(sampler->n_live, 800U);
+	EXPECT_LT(sampler->n_live, 1250U);
+}
+
+static void test_sampler_interval(void) {
+	/* The mean distance between two samples matches the sampling rate */
+	const size_t rate = 1U << 20U;
+	fx_mem_sampler_t *sampler = fx_mem_sampler_init(mem_sampler, 1U, 16U, rate);
+	const uint32_t n = 20000U;
+	double sum = 0.0;
+	for (uint32_t i = 0U; i < n; i++) {
+		fx_mem_sampler_bytes_until_sample = 0;
+		fx_mem_sampler_alloc(sampler, i, 0U);
+		sum += (double)fx_mem_sampler_bytes_until_sample;
+	}
+	EXPECT_GT(sum / n, 0.97 * rate);
+	EXPECT_LT(sum / n, 1.03 * rate);
+}
+
+static void test_sampler_allocator(void) {
+	fx_mem_sampler_t *sampler = fx_mem_sampler_init(mem_sampler, 16U, 64U, 1U);
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem_arena, sizeof(mem_arena));
+	fx_mem_allocator_set_sampler(&arena->allocator, sampler);
+
+	/* Discard the countdown left over from the previous sampling rate */
+	fx_mem_sampler_bytes_until_sample = 0;
+
+	void *p1 = fx_mem_allocator_alloc(&arena->allocator, 64U, 16U);
+	void *p2 = fx_mem_allocator_alloc(&arena->allocator, 64U, 16U);
+	EXPECT_EQ(2U, sampler->n_live);
+	p2 = fx_mem_allocator_realloc(&arena->allocator, p2, 64U, 128U, 16U);
+	EXPECT_EQ(2U, sampler->n_live);
+	fx_mem_allocator_free(&arena->allocator, p2, 128U);
+	fx_mem_allocator_free(&arena->allocator, p1, 64U);
+	EXPECT_EQ(0U, sampler->n_live);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_sampler_attribution);
+	RUN(test_sampler_overflow);
+	RUN(test_sampler_rate);
+	RUN(test_sampler_interval);
+	RUN(test_sampler_allocator);
+	DONE;
+}
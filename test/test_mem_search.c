@@ -0,0 +1,128 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_search.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define MAX_N 5000U
+
+static uint8_t mem[1U << 18U] __attribute__((aligned(16)));
+static uint8_t mem_payload[1U << 18U] __attribute__((aligned(16)));
+static uint32_t keys[MAX_N];
+static uint64_t payload[MAX_N];
+
+static void fill_keys(uint32_t n) {
+	/* Odd keys; even queries fall between two keys */
+	for (uint32_t i = 0U; i < n; i++) {
+		keys[i] = 2U * i + 1U;
+		payload[i] = 1000000U + i;
+	}
+}
+
+static uint32_t expected_rank(uint32_t n, uint32_t key) {
+	uint32_t i = 0U;
+	while (i < n && keys[i] < key) {
+		i++;
+	}
+	return i;
+}
+
+static void test_search_size(void) {
+	EXPECT_EQ(0U, fx_mem_eytz_size(0x40000000U, 4U));
+	EXPECT_EQ(0U, fx_mem_veb_size(0x20000000U, 8U));
+	ASSERT_GT(fx_mem_eytz_size(100U, 4U), 101U * 4U);
+	ASSERT_GT(fx_mem_veb_size(100U, 4U), 127U * 4U);
+	EXPECT_TRUE(fx_mem_veb_size(127U, 4U) == fx_mem_veb_size(100U, 4U));
+	ASSERT_LT(fx_mem_veb_size(MAX_N, sizeof(uint64_t)), sizeof(mem));
+
+	/* The layouts are cache line aligned irrespective of the memory */
+	uint32_t *base = (uint32_t *)fx_mem_eytz_init(mem + 4, keys, 0U, 4U);
+	EXPECT_EQ(0U, (uintptr_t)base % FX_MEM_SEARCH_ALIGN);
+	fx_mem_veb_t *veb = fx_mem_veb_init(mem + 4, keys, 0U, 4U);
+	EXPECT_EQ(0U, (uintptr_t)veb->data % FX_MEM_SEARCH_ALIGN);
+	EXPECT_TRUE(fx_mem_eytz_lower_bound(base, 0U, 0U) == NULL);
+	EXPECT_TRUE(fx_mem_veb_lower_bound(veb, 0U) == NULL);
+}
+
+static void test_search_eytz(void) {
+	const uint32_t ns[] = {1U, 2U, 3U, 15U, 16U, 17U, 100U, 1023U, MAX_N};
+	for (uint32_t t = 0U; t < sizeof(ns) / sizeof(ns[0]); t++) {
+		const uint32_t n = ns[t];
+		fill_keys(n);
+		const uint32_t *base =
+		    (const uint32_t *)fx_mem_eytz_init(mem, keys, n, sizeof(uint32_t));
+		const uint64_t *values = (const uint64_t *)fx_mem_eytz_init(
+		    mem_payload, payload, n, sizeof(uint64_t));
+		bool ok = true;
+		for (uint32_t key = 0U; key <= 2U * n + 1U; key++) {
+			const uint32_t rank = expected_rank(n, key);
+			const uint32_t *res = fx_mem_eytz_lower_bound(base, n, key);
+			if (rank == n) {
+				ok = ok && res == NULL;
+			} else {
+				ok = ok && res && *res == keys[rank] &&
+				     values[res - base] == payload[rank];
+			}
+		}
+		EXPECT_TRUE(ok);
+	}
+}
+
+static void test_search_veb(void) {
+	const uint32_t ns[] = {1U, 2U, 3U, 7U, 8U, 100U, 255U, 256U, MAX_N};
+	for (uint32_t t = 0U; t < sizeof(ns) / sizeof(ns[0]); t++) {
+		const uint32_t n = ns[t];
+		fill_keys(n);
+		const fx_mem_veb_t *veb =
+		    fx_mem_veb_init(mem, keys, n, sizeof(uint32_t));
+		const fx_mem_veb_t *values =
+		    fx_mem_veb_init(mem_payload, payload, n, sizeof(uint64_t));
+		const uint32_t *base = (const uint32_t *)veb->data;
+		bool ok = true;
+		for (uint32_t key = 0U; key <= 2U * n + 1U; key++) {
+			const uint32_t rank = expected_rank(n, key);
+			const uint32_t *res = fx_mem_veb_lower_bound(veb, key);
+			if (rank == n) {
+				ok = ok && res == NULL;
+			} else {
+				ok = ok && res && *res == keys[rank] &&
+				     ((const uint64_t *)values->data)[res - base] ==
+				         payload[rank];
+			}
+		}
+		EXPECT_TRUE(ok);
+
+		/* Padding is never returned, not even for the largest key */
+		EXPECT_TRUE(fx_mem_veb_lower_bound(veb, 0xFFFFFFFFU) == NULL);
+	}
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_search_size);
+	RUN(test_search_eytz);
+	RUN(test_search_veb);
+	DONE;
+}
@@ -0,0 +1,166 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
+#include <foxen/mem_segvec.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[1U << 20U] __attribute__((aligned(16)));
+
+static void test_segvec_locate(void) {
+	fx_mem_segvec_t vec;
+	EXPECT_FALSE(fx_mem_segvec_init(&vec, 4U, 12U, NULL));
+	EXPECT_FALSE(fx_mem_segvec_init(&vec, 0U, 16U, NULL));
+	EXPECT_TRUE(fx_mem_segvec_init(&vec, 4U, 16U, NULL));
+
+	/* Segment k starts at element 16 * (2^k - 1) */
+	uint64_t offs;
+	EXPECT_EQ(0U, fx_mem_segvec_locate(&vec, 0U, &offs));
+	EXPECT_EQ(0U, offs);
+	EXPECT_EQ(0U, fx_mem_segvec_locate(&vec, 15U, &offs));
+	EXPECT_EQ(15U, offs);
+	EXPECT_EQ(1U, fx_mem_segvec_locate(&vec, 16U, &offs));
+	EXPECT_EQ(0U, offs);
+	EXPECT_EQ(1U, fx_mem_segvec_locate(&vec, 47U, &offs));
+	EXPECT_EQ(31U, offs);
+	EXPECT_EQ(2U, fx_mem_segvec_locate(&vec, 48U, &offs));
+	EXPECT_EQ(0U, offs);
+	EXPECT_EQ(10U, fx_mem_segvec_locate(&vec, 16U * 1023U + 5U, &offs));
+	EXPECT_EQ(5U, offs);
+}
+
+static void test_segvec_stable(void) {
+	fx_mem_segvec_t vec;
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem, sizeof(mem));
+	fx_mem_segvec_init(&vec, sizeof(uint32_t), 4U, arena);
+	uint32_t *first = NULL;
+	for (uint32_t i = 0U; i < 100000U; i++) {
+		uint64_t idx;
+		uint32_t *elem = (uint32_t *)fx_mem_segvec_push(&vec, &idx);
+		EXPECT_TRUE(elem != NULL);
+		EXPECT_EQ(i, idx);
+		*elem = i;
+		if (i == 0U) {
+			first = elem;
+		}
+	}
+	EXPECT_EQ(100000U, fx_mem_segvec_length(&vec));
+	EXPECT_TRUE(fx_mem_segvec_get(&vec, 0U) == first);
+	bool ok = true;
+	for (uint32_t i = 0U; i < 100000U; i++) {
+		ok = ok && *(uint32_t *)fx_mem_segvec_get(&vec, i) == i;
+	}
+	EXPECT_TRUE(ok);
+	fx_mem_segvec_destroy(&vec);
+}
+
+static void test_segvec_arena(void) {
+	/* The arena holds segments of 16, 32, 64 and 128 elements */
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem, 4096U);
+	fx_mem_segvec_t vec;
+	fx_mem_segvec_init(&vec, 8U, 16U, arena);
+	uint32_t n = 0U;
+	while (fx_mem_segvec_push(&vec, NULL)) {
+		n++;
+	}
+	EXPECT_EQ(16U + 32U + 64U + 128U, n);
+	EXPECT_TRUE(fx_mem_segvec_push(&vec, NULL) == NULL);
+	EXPECT_TRUE((uint8_t *)fx_mem_segvec_get(&vec, n - 1U) < mem + 4096U);
+
+	/* Failed appends are not counted and their elements do not exist */
+	EXPECT_EQ(n, fx_mem_segvec_length(&vec));
+	EXPECT_TRUE(fx_mem_segvec_get(&vec, n) == NULL);
+	EXPECT_TRUE(fx_mem_segvec_get(&vec, 1ULL << 50U) == NULL);
+
+	/* Failure is sticky, even if the arena has room for later segments */
+	EXPECT_TRUE(fx_mem_arena_init(mem, sizeof(mem)) == arena);
+	for (uint32_t i = 0U; i < 1000U; i++) {
+		EXPECT_TRUE(fx_mem_segvec_push(&vec, NULL) == NULL);
+	}
+	EXPECT_EQ(n, fx_mem_segvec_length(&vec));
+	fx_mem_segvec_destroy(&vec);
+}
+
+#ifndef __EMSCRIPTEN__
+
+#define N_THREADS 4U
+#define N_PUSH 50000U
+
+static fx_mem_segvec_t thread_vec;
+
+static void *thread_main(void *arg) {
+	const uint64_t tag = (uint64_t)(uintptr_t)arg << 32U;
+	for (uint32_t i = 0U; i < N_PUSH; i++) {
+		uint64_t idx;
+		uint64_t *elem = (uint64_t *)fx_mem_segvec_push(&thread_vec, &idx);
+		if (!elem) {
+			return NULL;
+		}
+		*elem = tag | i;
+	}
+	return arg;
+}
+
+static void test_segvec_threads(void) {
+	fx_mem_segvec_init(&thread_vec, sizeof(uint64_t), 1U, NULL);
+	pthread_t threads[N_THREADS];
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, thread_main,
+		               (void *)(uintptr_t)(i + 1U));
+	}
+	for (uint32_t i = 0U; i < N_THREADS; i++) {
+		void *res;
+		pthread_join(threads[i], &res);
+		EXPECT_TRUE(res == (void *)(uintptr_t)(i + 1U));
+	}
+
+	/* Every element was written exactly once, in order per thread */
+	EXPECT_EQ(N_THREADS * N_PUSH, fx_mem_segvec_length(&thread_vec));
+	uint32_t next[N_THREADS] = {0U};
+	bool ok = true;
+	for (uint64_t i = 0U; i < N_THREADS * N_PUSH; i++) {
+		const uint64_t v = *(uint64_t *)fx_mem_segvec_get(&thread_vec, i);
+		const uint32_t t = (uint32_t)(v >> 32U) - 1U;
+		ok = ok && t < N_THREADS && (uint32_t)v == next[t]++;
+	}
+	EXPECT_TRUE(ok);
+	fx_mem_segvec_destroy(&thread_vec);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_segvec_locate);
+	RUN(test_segvec_stable);
+	RUN(test_segvec_arena);
+#ifndef __EMSCRIPTEN__
+	RUN(test_segvec_threads);
+#endif
+	DONE;
+}
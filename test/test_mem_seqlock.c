@@ -0,0 +1,175 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_seqlock.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define N_SLOTS 64U
+
+typedef struct route {
+	uint64_t addr;
+	uint64_t next_hop; /* always ~addr */
+} route_t;
+
+static uint8_t mem_pool[16384U] __attribute__((aligned(16)));
+static uint8_t mem_seqlock[8192U] __attribute__((aligned(16)));
+
+static void test_seqlock_size(void) {
+	EXPECT_EQ(0U, fx_mem_seqlock_size(0x40000000U));
+	const uint32_t size = fx_mem_seqlock_size(N_SLOTS);
+	ASSERT_GT(size, N_SLOTS * FX_MEM_SEQLOCK_ALIGN);
+	ASSERT_LT(size, sizeof(mem_seqlock));
+	fx_mem_seqlock_t *lock = fx_mem_seqlock_init(mem_seqlock + 4, N_SLOTS);
+	EXPECT_EQ(N_SLOTS, lock->n_slots);
+	EXPECT_EQ(0U, (uintptr_t)lock->counters % FX_MEM_SEQLOCK_ALIGN);
+	EXPECT_TRUE((uint8_t *)(lock->counters + N_SLOTS) <=
+	            mem_seqlock + 4 + size);
+}
+
+static void test_seqlock_read_write(void) {
+	fx_mem_seqlock_t *lock = fx_mem_seqlock_init(mem_seqlock, N_SLOTS);
+
+	/* Reads without concurrent writes succeed */
+	uint32_t seq = fx_mem_seqlock_read_begin(lock, 3U);
+	EXPECT_FALSE(fx_mem_seqlock_read_retry(lock, 3U, seq));
+
+	/* Reads overlapping with a write are retried */
+	fx_mem_seqlock_write_begin(lock, 3U);
+	EXPECT_TRUE(fx_mem_seqlock_read_retry(lock, 3U, seq));
+	const uint32_t seq_odd = fx_mem_seqlock_read_begin(lock, 3U);
+	EXPECT_TRUE(fx_mem_seqlock_read_retry(lock, 3U, seq_odd));
+	const uint32_t seq_other = fx_mem_seqlock_read_begin(lock, 4U);
+	EXPECT_FALSE(fx_mem_seqlock_read_retry(lock, 4U, seq_other));
+	fx_mem_seqlock_write_end(lock, 3U);
+	EXPECT_TRUE(fx_mem_seqlock_read_retry(lock, 3U, seq_odd));
+	seq = fx_mem_seqlock_read_begin(lock, 3U);
+	EXPECT_EQ(2U, seq);
+	EXPECT_FALSE(fx_mem_seqlock_read_retry(lock, 3U, seq));
+}
+
+static void test_seqlock_pool(void) {
+	fx_mem_static_pool_t *pool =
+	    fx_mem_static_pool_init(mem_pool, N_SLOTS, sizeof(route_t));
+	fx_mem_seqlock_t *lock = fx_mem_seqlock_init(mem_seqlock, N_SLOTS);
+	fx_mem_static_pool_set_seqlock(pool, lock);
+
+	/* Readers holding a pointer at a freed slot retry */
+	route_t *route = (route_t *)fx_mem_static_pool_alloc(pool);
+	const uint32_t idx = fx_mem_static_pool_idx(pool, route);
+	const uint32_t seq = fx_mem_seqlock_read_begin(lock, idx);
+	fx_mem_static_pool_free(pool, route);
+	EXPECT_TRUE(fx_mem_seqlock_read_retry(lock, idx, seq));
+	EXPECT_EQ(0U, fx_mem_seqlock_read_begin(lock, idx) & 1U);
+
+	fx_mem_static_pool_set_seqlock(pool, NULL);
+	route = (route_t *)fx_mem_static_pool_alloc(pool);
+	fx_mem_static_pool_free(pool, route);
+	EXPECT_EQ(seq + 2U, fx_mem_seqlock_read_begin(lock, idx));
+}
+
+#ifndef __EMSCRIPTEN__
+
+#define N_READERS 2U
+#define N_WRITES 200000U
+#define N_READS 200000U
+
+static route_t *routes;
+static fx_mem_seqlock_t *thread_lock;
+
+static void *writer_main(void *arg) {
+	for (uint32_t i = 0U; i < N_WRITES; i++) {
+		const uint32_t idx = (i * 7U) % N_SLOTS;
+		fx_mem_seqlock_write_begin(thread_lock, idx);
+		__atomic_store_n(&routes[idx].addr, i, __ATOMIC_RELAXED);
+		__atomic_store_n(&routes[idx].next_hop, ~(uint64_t)i,
+		                 __ATOMIC_RELAXED);
+		fx_mem_seqlock_write_end(thread_lock, idx);
+	}
+	return arg;
+}
+
+static void *reader_main(void *arg) {
+	uint64_t n_torn = 0U;
+	for (uint32_t i = 0U; i < N_READS; i++) {
+		const uint32_t idx = (i * 13U) % N_SLOTS;
+		route_t copy;
+		uint32_t seq;
+		do {
+			seq = fx_mem_seqlock_read_begin(thread_lock, idx);
+			copy.addr = __atomic_load_n(&routes[idx].addr, __ATOMIC_RELAXED);
+			copy.next_hop =
+			    __atomic_load_n(&routes[idx].next_hop, __ATOMIC_RELAXED);
+		} while (fx_mem_seqlock_read_retry(thread_lock, idx, seq));
+		n_torn += copy.next_hop != ~copy.addr;
+	}
+	return (void *)(uintptr_t)n_torn;
+}
+
+static void test_seqlock_threads(void) {
+	fx_mem_static_pool_t *pool =
+	    fx_mem_static_pool_init(mem_pool, N_SLOTS, sizeof(route_t));
+	thread_lock = fx_mem_seqlock_init(mem_seqlock, N_SLOTS);
+	fx_mem_static_pool_set_seqlock(pool, thread_lock);
+	for (uint32_t i = 0U; i < N_SLOTS; i++) {
+		fx_mem_static_pool_alloc(pool);
+	}
+	EXPECT_EQ(sizeof(route_t), pool->slot_size);
+	routes = (route_t *)fx_mem_static_pool_ptr(pool, 0U);
+	for (uint32_t i = 0U; i < N_SLOTS; i++) {
+		routes[i].addr = 0U;
+		routes[i].next_hop = ~(uint64_t)0U;
+	}
+
+	/* Readers never observe a partially written entry */
+	pthread_t writer, readers[N_READERS];
+	pthread_create(&writer, NULL, writer_main, NULL);
+	for (uint32_t i = 0U; i < N_READERS; i++) {
+		pthread_create(&readers[i], NULL, reader_main, NULL);
+	}
+	pthread_join(writer, NULL);
+	for (uint32_t i = 0U; i < N_READERS; i++) {
+		void *res;
+		pthread_join(readers[i], &res);
+		EXPECT_EQ(0U, (uintptr_t)res);
+	}
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_seqlock_size);
+	RUN(test_seqlock_read_write);
+	RUN(test_seqlock_pool);
+#ifndef __EMSCRIPTEN__
+	RUN(test_seqlock_threads);
+#endif
+	DONE;
+}
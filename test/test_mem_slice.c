@@ -0,0 +1,157 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <foxen/mem_slice.h>
+#include <foxen/unittest.h>
+
+#ifndef __EMSCRIPTEN__
+#include "test_threads.h"
+#endif
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem[16384U] __attribute__((aligned(64)));
+
+static void test_slice_layout(void) {
+	EXPECT_EQ(0U, fx_mem_slice_pool_size(0x10000U, 0x10000U));
+	const uint32_t size = fx_mem_slice_pool_size(8U, 100U);
+	ASSERT_GT(size, 8U * (64U + 128U));
+	ASSERT_LT(size, sizeof(mem));
+	fx_mem_slice_pool_t *pool = fx_mem_slice_pool_init(mem + 8, 8U, 100U);
+	fx_mem_slice_t slice;
+	for (uint32_t i = 0U; i < 8U; i++) {
+		uint8_t *data = fx_mem_slice_alloc(pool, &slice);
+		EXPECT_TRUE(data != NULL);
+		EXPECT_EQ(0U, (uintptr_t)data & 63U);
+		EXPECT_EQ(100U, slice.length);
+		EXPECT_TRUE(data + 100 <= mem + 8 + size);
+	}
+	EXPECT_TRUE(fx_mem_slice_alloc(pool, &slice) == NULL);
+}
+
+static void test_slice_sub_release(void) {
+	fx_mem_slice_pool_t *pool = fx_mem_slice_pool_init(mem, 2U, 64U);
+	fx_mem_slice_t buf;
+	uint8_t *data = fx_mem_slice_alloc(pool, &buf);
+	ASSERT_GT((uintptr_t)data, 0U);
+	for (uint32_t i = 0U; i < 64U; i++) {
+		data[i] = (uint8_t)i;
+	}
+
+	/* Split into a header and a payload, then drop the original buffer */
+	fx_mem_slice_t hdr = fx_mem_slice_sub(pool, &buf, 0U, 8U);
+	fx_mem_slice_t payload = fx_mem_slice_sub(pool, &buf, 8U, 1000U);
+	fx_mem_slice_t tail = fx_mem_slice_sub(pool, &payload, 50U, 10U);
+	fx_mem_slice_release(pool, &buf);
+	EXPECT_TRUE(buf.data == NULL);
+	EXPECT_EQ(8U, hdr.length);
+	EXPECT_EQ(56U, payload.length);
+	EXPECT_EQ(8U, payload.data[0]);
+	EXPECT_EQ(6U, tail.length);
+	EXPECT_EQ(58U, tail.data[0]);
+	EXPECT_EQ(3U, *fx_mem_slice_refcount(pool, hdr.slot));
+	EXPECT_EQ(1U, pool->n_allocated);
+
+	fx_mem_slice_t copy = fx_mem_slice_clone(pool, &hdr);
+	fx_mem_slice_release(pool, &hdr);
+	fx_mem_slice_release(pool, &payload);
+	fx_mem_slice_release(pool, &tail);
+	EXPECT_EQ(1U, pool->n_allocated);
+	EXPECT_EQ(7U, copy.data[7]);
+	fx_mem_slice_release(pool, &copy);
+	EXPECT_EQ(0U, pool->n_allocated);
+}
+
+static void test_slice_batch(void) {
+	fx_mem_slice_pool_t *pool = fx_mem_slice_pool_init(mem, 32U, 16U);
+	fx_mem_slice_batch_t batch;
+	fx_mem_slice_batch_init(&batch, pool);
+
+	/* Releases are deferred until the batch is flushed */
+	fx_mem_slice_t a, b;
+	fx_mem_slice_alloc(pool, &a);
+	fx_mem_slice_t a2 = fx_mem_slice_clone(pool, &a);
+	fx_mem_slice_batch_release(&batch, &a);
+	fx_mem_slice_batch_release(&batch, &a2);
+	EXPECT_EQ(1U, batch.n_entries);
+	EXPECT_EQ(1U, pool->n_allocated);
+	fx_mem_slice_batch_flush(&batch);
+	EXPECT_EQ(0U, pool->n_allocated);
+
+	/* A full batch flushes itself */
+	for (uint32_t i = 0U; i < FX_MEM_SLICE_BATCH_SIZE + 1U; i++) {
+		fx_mem_slice_alloc(pool, &b);
+		fx_mem_slice_batch_release(&batch, &b);
+	}
+	EXPECT_EQ(1U, batch.n_entries);
+	EXPECT_EQ(1U, pool->n_allocated);
+	fx_mem_slice_batch_flush(&batch);
+	EXPECT_EQ(0U, pool->n_allocated);
+}
+
+#ifndef __EMSCRIPTEN__
+
+#define N_THREADS 4U
+#define N_CLONES 100000U
+
+static fx_mem_slice_pool_t *thread_pool;
+static fx_mem_slice_t thread_slice;
+
+static void *thread_main(void *arg) {
+	fx_mem_slice_batch_t batch;
+	fx_mem_slice_batch_init(&batch, thread_pool);
+	bool ok = true;
+	for (uint32_t i = 0U; i < N_CLONES; i++) {
+		fx_mem_slice_t s = fx_mem_slice_sub(thread_pool, &thread_slice, 4U, 4U);
+		ok = ok && s.data[0] == 4U;
+		fx_mem_slice_batch_release(&batch, &s);
+	}
+	fx_mem_slice_batch_flush(&batch);
+	return ok ? arg : NULL;
+}
+
+static void test_slice_threads(void) {
+	thread_pool = fx_mem_slice_pool_init(mem, 4U, 16U);
+	uint8_t *data = fx_mem_slice_alloc(thread_pool, &thread_slice);
+	ASSERT_GT((uintptr_t)data, 0U);
+	for (uint32_t i = 0U; i < 16U; i++) {
+		data[i] = (uint8_t)i;
+	}
+	EXPECT_TRUE(test_run_threads(N_THREADS, thread_main));
+	EXPECT_EQ(1U, *fx_mem_slice_refcount(thread_pool, thread_slice.slot));
+	fx_mem_slice_release(thread_pool, &thread_slice);
+	EXPECT_EQ(0U, thread_pool->n_allocated);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_slice_layout);
+	RUN(test_slice_sub_release);
+	RUN(test_slice_batch);
+#ifndef __EMSCRIPTEN__
+	RUN(test_slice_threads);
+#endif
+	DONE;
+}
@@ -0,0 +1,205 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <foxen/mem_allocator.h>
+#include <foxen/mem_stats.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+static uint8_t mem_arena[1U << 16U] __attribute__((aligned(64)));
+static uint8_t mem_pool[1U << 16U] __attribute__((aligned(64)));
+static uint8_t mem_page[4096U] __attribute__((aligned(64)));
+static uint8_t mem_snapshot[4096U] __attribute__((aligned(64)));
+static uint8_t mem_counters[2U][2048U] __attribute__((aligned(64)));
+
+static const fx_mem_stats_entry_t *_find(const fx_mem_stats_page_t *page,
+                                         const char *name) {
+	for (uint32_t i = 0U; i < page->n_entries; i++) {
+		if (strcmp(page->entries[i].name, name) == 0) {
+			return &page->entries[i];
+		}
+	}
+	return NULL;
+}
+
+static void test_stats_allocator_counters(void) {
+	/* The detailed counters are only maintained once counters are attached */
+	fx_mem_static_pool_t *pool = fx_mem_static_pool_init(mem_pool, 64U, 32U);
+	fx_mem_allocator_stats_t stats;
+	fx_mem_static_pool_alloc(pool);
+	fx_mem_allocator_stats(&pool->allocator, &stats);
+	EXPECT_EQ(1U, stats.n_allocations);
+	EXPECT_EQ(0U, stats.n_allocs_total);
+	EXPECT_EQ(0U, stats.n_frees_total);
+	EXPECT_EQ(0U, stats.n_bytes_peak);
+
+	ASSERT_GT(sizeof(mem_counters[0]), fx_mem_allocator_counters_size());
+	pool = fx_mem_static_pool_init(mem_pool, 64U, 32U);
+	fx_mem_allocator_set_counters(
+	    &pool->allocator, fx_mem_allocator_counters_init(mem_counters[0] + 4));
+	void *ptrs[10];
+	for (uint32_t i = 0U; i < 10U; i++) {
+		ptrs[i] = fx_mem_static_pool_alloc(pool);
+	}
+	for (uint32_t i = 0U; i < 6U; i++) {
+		fx_mem_static_pool_free(pool, ptrs[i]);
+	}
+
+	fx_mem_allocator_stats(&pool->allocator, &stats);
+	EXPECT_EQ(4U, stats.n_allocations);
+	EXPECT_EQ(10U * 32U, stats.n_bytes_peak);
+	EXPECT_EQ(10U, stats.n_allocs_total);
+	EXPECT_EQ(6U, stats.n_frees_total);
+	EXPECT_EQ(0U, stats.n_contended);
+
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem_arena, sizeof(mem_arena));
+	fx_mem_allocator_set_counters(
+	    &arena->allocator, fx_mem_allocator_counters_init(mem_counters[1]));
+	void *p1 = fx_mem_arena_alloc(arena, 100U, 1U);
+	fx_mem_arena_alloc(arena, 100U, 1U);
+	fx_mem_arena_reset(arena);
+	p1 = fx_mem_arena_alloc(arena, 50U, 1U);
+	fx_mem_arena_free(arena, p1, 50U);
+	fx_mem_allocator_stats(&arena->allocator, &stats);
+	EXPECT_EQ(0U, stats.n_allocations);
+	EXPECT_EQ(200U, stats.n_bytes_peak);
+	EXPECT_EQ(3U, stats.n_allocs_total);
+	EXPECT_EQ(3U, stats.n_frees_total);
+}
+
+static void test_stats_publish(void) {
+	fx_mem_budget_t budget;
+	fx_mem_budget_init(&budget, 1U << 20U);
+	fx_mem_static_pool_t *pool = fx_mem_static_pool_init(mem_pool, 64U, 32U);
+	fx_mem_arena_t *arena = fx_mem_arena_init(mem_arena, sizeof(mem_arena));
+	fx_mem_budget_member_t members[2];
+	fx_mem_budget_join(&budget, &members[0], "pool", &pool->allocator);
+	fx_mem_budget_join(&budget, &members[1], "arena", &arena->allocator);
+
+	/* Only the pool maintains the detailed counters */
+	fx_mem_allocator_set_counters(
+	    &pool->allocator, fx_mem_allocator_counters_init(mem_counters[0]));
+	for (uint32_t i = 0U; i < 5U; i++) {
+		fx_mem_allocator_alloc(&pool->allocator, 32U, 1U);
+	}
+	fx_mem_allocator_alloc(&arena->allocator, 1000U, 1U);
+
+	ASSERT_GT(sizeof(mem_page), fx_mem_stats_size(4U));
+	fx_mem_stats_page_t *page = fx_mem_stats_init(mem_page, 4U);
+	fx_mem_stats_publish(page, &budget);
+	EXPECT_EQ(2U, page->seq);
+	EXPECT_EQ(2U, page->n_entries);
+
+	/* Read a snapshot that only has space for a single entry */
+	fx_mem_stats_page_t *snapshot = (fx_mem_stats_page_t *)mem_snapshot;
+	EXPECT_TRUE(fx_mem_stats_read(page, snapshot, 1U));
+	EXPECT_EQ(1U, snapshot->n_entries);
+
+	EXPECT_TRUE(fx_mem_stats_read(page, snapshot, 4U));
+	EXPECT_EQ(2U, snapshot->n_entries);
+	EXPECT_EQ(1U << 20U, snapshot->budget_limit);
+	EXPECT_EQ(fx_mem_budget_used(&budget), snapshot->budget_used);
+	const fx_mem_stats_entry_t *e_pool = _find(snapshot, "pool");
+	const fx_mem_stats_entry_t *e_arena = _find(snapshot, "arena");
+	EXPECT_TRUE(e_pool != NULL);
+	EXPECT_TRUE(e_arena != NULL);
+	if (e_pool && e_arena) {
+		EXPECT_EQ(64U * 32U, e_pool->n_bytes_reserved);
+		EXPECT_EQ(5U * 32U, e_pool->n_bytes_used);
+		EXPECT_EQ(5U, e_pool->n_allocs_total);
+		EXPECT_EQ(1000U, e_arena->n_bytes_used);
+		EXPECT_EQ(1U, e_arena->n_allocations);
+		EXPECT_EQ(0U, e_arena->n_allocs_total);
+	}
+
+	/* Reading a page that is stuck mid-update gives up eventually */
+	__atomic_store_n(&page->seq, page->seq + 1U, __ATOMIC_RELAXED);
+	EXPECT_FALSE(fx_mem_stats_read(page, snapshot, 4U));
+	__atomic_store_n(&page->seq, page->seq + 1U, __ATOMIC_RELAXED);
+	EXPECT_TRUE(fx_mem_stats_read(page, snapshot, 4U));
+
+	/* Pages with an unknown format are rejected */
+	page->version = 0U;
+	EXPECT_FALSE(fx_mem_stats_read(page, snapshot, 4U));
+
+	fx_mem_allocator_reset(&pool->allocator);
+	fx_mem_allocator_reset(&arena->allocator);
+	fx_mem_budget_leave(&budget, &members[1]);
+	fx_mem_budget_leave(&budget, &members[0]);
+	fx_mem_budget_flush();
+	fx_mem_budget_destroy(&budget);
+}
+
+static void test_stats_shm(void) {
+	char name[64];
+	snprintf(name, sizeof(name), "/foxenmem_test_%d", (int)getpid());
+
+	fx_mem_budget_t budget;
+	fx_mem_budget_init(&budget, 1U << 20U);
+	fx_mem_static_pool_t *pool = fx_mem_static_pool_init(mem_pool, 64U, 32U);
+	fx_mem_budget_member_t member;
+	fx_mem_budget_join(&budget, &member, "pool", &pool->allocator);
+	fx_mem_allocator_alloc(&pool->allocator, 32U, 1U);
+
+	fx_mem_stats_page_t *page = fx_mem_stats_create(name, 8U);
+	EXPECT_TRUE(page != NULL);
+	if (!page) {
+		fx_mem_budget_leave(&budget, &member);
+		fx_mem_budget_destroy(&budget);
+		return;
+	}
+	fx_mem_stats_publish(page, &budget);
+
+	const fx_mem_stats_page_t *reader = fx_mem_stats_attach(name);
+	EXPECT_TRUE(reader != NULL);
+	if (reader) {
+		fx_mem_stats_page_t *snapshot = (fx_mem_stats_page_t *)mem_snapshot;
+		EXPECT_TRUE(fx_mem_stats_read(reader, snapshot, 8U));
+		EXPECT_EQ(1U, snapshot->n_entries);
+		EXPECT_EQ(32U, snapshot->entries[0].n_bytes_used);
+		EXPECT_GT(snapshot->timestamp, 0U);
+		fx_mem_stats_detach(reader);
+	}
+	fx_mem_stats_detach(page);
+	fx_mem_stats_unlink(name);
+	EXPECT_TRUE(fx_mem_stats_attach(name) == NULL);
+
+	fx_mem_budget_leave(&budget, &member);
+	fx_mem_budget_flush();
+	fx_mem_budget_destroy(&budget);
+}
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_stats_allocator_counters);
+	RUN(test_stats_publish);
+#ifndef __EMSCRIPTEN__
+	RUN(test_stats_shm);
+#endif
+	DONE;
+}
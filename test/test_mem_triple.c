@@ -0,0 +1,143 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <foxen/mem_triple.h>
+#include <foxen/unittest.h>
+
+/******************************************************************************
+ * UNIT TESTS                                                                 *
+ ******************************************************************************/
+
+#define N_WORDS 16384U
+
+static uint8_t mem[4U * N_WORDS * sizeof(uint32_t)]
+    __attribute__((aligned(16)));
+
+static void test_triple_size(void) {
+	EXPECT_EQ(0U, fx_mem_triple_size(0U));
+	EXPECT_EQ(0U, fx_mem_triple_size(0x60000000U));
+	const uint32_t size = fx_mem_triple_size(100U);
+	ASSERT_GT(size, 3U * 128U);
+	ASSERT_LT(size, sizeof(mem));
+	fx_mem_triple_t *tb = fx_mem_triple_init(mem + 4, 100U);
+	EXPECT_EQ(128U, tb->instance_size);
+	for (uint32_t i = 0U; i < 3U; i++) {
+		uint8_t *instance = (uint8_t *)fx_mem_triple_instance(tb, i);
+		EXPECT_EQ(0U, (uintptr_t)instance % FX_MEM_TRIPLE_ALIGN);
+		EXPECT_TRUE(instance + 100U <= mem + 4 + size);
+	}
+}
+
+static void test_triple_publish_read(void) {
+	fx_mem_triple_t *tb = fx_mem_triple_init(mem, sizeof(uint32_t));
+	bool updated = true;
+	EXPECT_TRUE(fx_mem_triple_read(tb, &updated) == NULL);
+	EXPECT_FALSE(updated);
+
+	uint32_t *back = (uint32_t *)fx_mem_triple_back(tb);
+	*back = 1U;
+	uint32_t *next = (uint32_t *)fx_mem_triple_publish(tb);
+	EXPECT_TRUE(next != back);
+	const uint32_t *front = (const uint32_t *)fx_mem_triple_read(tb, &updated);
+	EXPECT_TRUE(front == back);
+	EXPECT_TRUE(updated);
+	EXPECT_EQ(1U, *front);
+
+	/* The snapshot stays put until something new is published */
+	EXPECT_TRUE(fx_mem_triple_read(tb, &updated) == front);
+	EXPECT_FALSE(updated);
+
+	/* Unread snapshots are replaced; the writer never touches the front */
+	for (uint32_t seq = 2U; seq <= 10U; seq++) {
+		EXPECT_TRUE(next != front);
+		*next = seq;
+		next = (uint32_t *)fx_mem_triple_publish(tb);
+	}
+	EXPECT_EQ(1U, *front);
+	front = (const uint32_t *)fx_mem_triple_read(tb, &updated);
+	EXPECT_TRUE(updated);
+	EXPECT_EQ(10U, *front);
+	EXPECT_TRUE(next != front);
+}
+
+#ifndef __EMSCRIPTEN__
+
+#define N_SNAPSHOTS 5000U
+
+static fx_mem_triple_t *thread_tb;
+
+static void *writer_main(void *arg) {
+	uint32_t *back = (uint32_t *)fx_mem_triple_back(thread_tb);
+	for (uint32_t seq = 1U; seq <= N_SNAPSHOTS; seq++) {
+		for (uint32_t i = 0U; i < N_WORDS; i++) {
+			back[i] = seq;
+		}
+		back = (uint32_t *)fx_mem_triple_publish(thread_tb);
+	}
+	return arg;
+}
+
+static void test_triple_threads(void) {
+	thread_tb = fx_mem_triple_init(mem, N_WORDS * sizeof(uint32_t));
+	pthread_t writer;
+	pthread_create(&writer, NULL, writer_main, NULL);
+
+	/* Every snapshot is complete and snapshots never go back in time */
+	uint32_t last = 0U, n_updates = 0U;
+	bool ok = true;
+	while (last < N_SNAPSHOTS) {
+		bool updated;
+		const uint32_t *front =
+		    (const uint32_t *)fx_mem_triple_read(thread_tb, &updated);
+		if (!updated) {
+			sched_yield();
+			continue;
+		}
+		const uint32_t seq = front[0];
+		for (uint32_t i = 1U; i < N_WORDS; i++) {
+			ok = ok && front[i] == seq;
+		}
+		ok = ok && seq > last;
+		last = seq;
+		n_updates++;
+	}
+	pthread_join(writer, NULL);
+	EXPECT_TRUE(ok);
+	EXPECT_EQ(N_SNAPSHOTS, last);
+	EXPECT_GT(n_updates, 0U);
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+/******************************************************************************
+ * MAIN                                                                       *
+ ******************************************************************************/
+
+int main() {
+	RUN(test_triple_size);
+	RUN(test_triple_publish_read);
+#ifndef __EMSCRIPTEN__
+	RUN(test_triple_threads);
+#endif
+	DONE;
+}
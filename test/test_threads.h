@@ -0,0 +1,63 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file test_threads.h
+ *
+ * Shared multi-thread driver for the unit tests.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_TEST_THREADS_H
+#define FOXEN_TEST_THREADS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Runs n_threads instances of thread_main() concurrently and waits for them
+ * to finish. The i-th thread receives (void *)(i + 1) as argument; the
+ * argument is not the address of the pthread_t being written, which would
+ * alias the output of pthread_create().
+ *
+ * @return true if all threads were started and each one returned its
+ * argument.
+ */
+static inline bool test_run_threads(uint32_t n_threads,
+                                    void *(*thread_main)(void *)) {
+	pthread_t threads[n_threads];
+	bool ok = true;
+	uint32_t n_started = 0U;
+	for (; n_started < n_threads; n_started++) {
+		void *arg = (void *)(uintptr_t)(n_started + 1U);
+		if (pthread_create(&threads[n_started], NULL, thread_main, arg)) {
+			ok = false;
+			break;
+		}
+	}
+	for (uint32_t i = 0U; i < n_started; i++) {
+		void *res = NULL;
+		pthread_join(threads[i], &res);
+		ok = ok && (res == (void *)(uintptr_t)(i + 1U));
+	}
+	return ok;
+}
+
+#endif /* FOXEN_TEST_THREADS_H */
@@ -0,0 +1,492 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file foxenmalloc.c
+ *
+ * Drop-in malloc() replacement built on the static pools and the arena of
+ * mem_allocator.h. On first use, a large address range is reserved with
+ * mmap(); pages are only backed by memory once they are touched. An arena
+ * over that range hands out chunks of FX_MALLOC_CHUNK_SIZE bytes, each of
+ * which holds a static pool for a single size class. Requests up to
+ * FX_MALLOC_MAX_SMALL bytes are rounded up to one of 40 size classes (four
+ * per power of two) and served lock-free from the bitmap of a chunk of that
+ * class. Since chunks are aligned to their size, free() finds the owning
+ * pool by masking the pointer; blocks carry no header.
+ *
+ * Each thread keeps up to FX_MALLOC_CACHE_SIZE freed blocks per size class
+ * up to FX_MALLOC_CACHE_MAX_SIZE bytes in a thread-local list, so that the
+ * common pattern of freeing and reallocating a block does not touch the
+ * shared bitmap. The lists are returned to the pools when the thread exits.
+ *
+ * Larger requests, and all requests once the reserved range is exhausted,
+ * are mapped individually with a small header in front of the block.
+ *
+ * Chunks are never returned to the operating system; memory freed into a
+ * chunk is reused for allocations of the same size class only.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* MAP_ANONYMOUS, MAP_NORESERVE, mremap() */
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <foxen/mem.h>
+#include <foxen/mem_allocator.h>
+
+#include "foxenmalloc.h"
+
+/******************************************************************************
+ * PRIVATE IMPLEMENTATION DETAILS                                             *
+ ******************************************************************************/
+
+#define FX_MALLOC_CHUNK_SIZE ((size_t)1U << 20U)
+#define FX_MALLOC_N_CLASSES 40U
+#define FX_MALLOC_CACHE_SIZE 32U
+#define FX_MALLOC_CACHE_MAX_SIZE 1024U
+#define FX_MALLOC_N_CACHED_CLASSES 20U /* Classes up to 1024 bytes */
+
+#ifndef FX_MALLOC_RESERVE
+#define FX_MALLOC_RESERVE \
+	(SIZE_MAX > 0xFFFFFFFFU ? (size_t)64U << 30U : (size_t)1U << 30U)
+#endif
+
+typedef struct _fx_chunk {
+	struct _fx_chunk *next;
+	fx_mem_static_pool_t *pool;
+	uint32_t cls;
+} _fx_chunk_t;
+
+typedef struct _fx_class {
+	_fx_chunk_t *head;
+	_fx_chunk_t *current;
+	uint32_t slot_size;
+	uint32_t n_slots;
+	uint8_t _pad[64U - 2U * sizeof(void *) - 2U * sizeof(uint32_t)];
+} _fx_class_t;
+
+/* Header in front of individually mapped blocks */
+typedef struct _fx_large {
+	size_t map_size;
+	size_t offset; /* Distance between the mapping and the block */
+} _fx_large_t;
+
+/* Thread-local lists of freed blocks, linked through their first word */
+typedef struct _fx_cache {
+	void *heads[FX_MALLOC_N_CACHED_CLASSES];
+	uint32_t n_blocks[FX_MALLOC_N_CACHED_CLASSES];
+	uint32_t state;
+} _fx_cache_t;
+
+enum { FX_STATE_UNINIT, FX_STATE_INIT, FX_STATE_READY, FX_STATE_FAILED };
+enum { FX_CACHE_UNREGISTERED, FX_CACHE_ACTIVE, FX_CACHE_DISABLED };
+
+static uint32_t _fx_state = FX_STATE_UNINIT;
+static size_t _fx_page_size;
+static uint8_t *_fx_region;
+static size_t _fx_region_size;
+static fx_mem_arena_t *_fx_arena;
+static _fx_class_t _fx_classes[FX_MALLOC_N_CLASSES]
+    __attribute__((aligned(64)));
+static pthread_key_t _fx_cache_key;
+static bool _fx_have_cache_key;
+static __thread _fx_cache_t _fx_cache;
+
+static uint32_t _fx_class_idx(size_t size) {
+	if (size <= 128U) {
+		return size ? (uint32_t)((size - 1U) >> 4U) : 0U;
+	}
+	const uint32_t e = 63U - (uint32_t)__builtin_clzll(size - 1U);
+	return 8U + (e - 7U) * 4U + (uint32_t)(((size - 1U) >> (e - 2U)) & 3U);
+}
+
+static uint32_t _fx_class_size(uint32_t cls) {
+	if (cls < 8U) {
+		return 16U * (cls + 1U);
+	}
+	const uint32_t e = 7U + (cls - 8U) / 4U;
+	return (1U << e) + ((cls - 8U) % 4U + 1U) * (1U << (e - 2U));
+}
+
+static void _fx_init_classes(void) {
+	const size_t hdr_size =
+	    (sizeof(_fx_chunk_t) + FX_ALIGN - 1U) & ~(size_t)(FX_ALIGN - 1U);
+	const size_t avail = FX_MALLOC_CHUNK_SIZE - hdr_size;
+	for (uint32_t cls = 0U; cls < FX_MALLOC_N_CLASSES; cls++) {
+		const uint32_t slot_size = _fx_class_size(cls);
+		uint32_t n = (uint32_t)(avail * 8U / (8U * slot_size + 1U));
+		while (n > 0U && fx_mem_static_pool_size(n, slot_size) > avail) {
+			n--;
+		}
+		_fx_classes[cls].slot_size = slot_size;
+		_fx_classes[cls].n_slots = n;
+	}
+}
+
+static inline _fx_chunk_t *_fx_chunk_of(const void *ptr) {
+	if ((size_t)((const uint8_t *)ptr - _fx_region) >= _fx_region_size) {
+		return NULL;
+	}
+	return (_fx_chunk_t *)((uintptr_t)ptr & ~(FX_MALLOC_CHUNK_SIZE - 1U));
+}
+
+static void _fx_cache_flush(void *arg) {
+	_fx_cache_t *cache = (_fx_cache_t *)arg;
+	cache->state = FX_CACHE_DISABLED;
+	for (uint32_t cls = 0U; cls < FX_MALLOC_N_CACHED_CLASSES; cls++) {
+		while (cache->heads[cls]) {
+			void *ptr = cache->heads[cls];
+			cache->heads[cls] = *(void **)ptr;
+			fx_mem_static_pool_free(_fx_chunk_of(ptr)->pool, ptr);
+		}
+		cache->n_blocks[cls] = 0U;
+	}
+}
+
+static bool _fx_init_slow(void) {
+	uint32_t state = FX_STATE_UNINIT;
+	if (__atomic_compare_exchange_n(&_fx_state, &state, FX_STATE_INIT, false,
+	                                __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		_fx_page_size = (size_t)sysconf(_SC_PAGESIZE);
+		_fx_init_classes();
+		void *region =
+		    mmap(NULL, FX_MALLOC_RESERVE, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		state = FX_STATE_FAILED;
+		if (region != MAP_FAILED) {
+			_fx_region = (uint8_t *)region;
+			_fx_region_size = FX_MALLOC_RESERVE;
+			_fx_arena = fx_mem_arena_init(region, FX_MALLOC_RESERVE);
+			_fx_have_cache_key =
+			    pthread_key_create(&_fx_cache_key, _fx_cache_flush) == 0;
+			state = FX_STATE_READY;
+		}
+		__atomic_store_n(&_fx_state, state, __ATOMIC_RELEASE);
+		return state == FX_STATE_READY;
+	}
+
+	/* Another thread is initialising the allocator; mmap() cannot be
+	   interrupted by a recursive allocation, so this does not deadlock */
+	while (state == FX_STATE_INIT) {
+		sched_yield();
+		state = __atomic_load_n(&_fx_state, __ATOMIC_ACQUIRE);
+	}
+	return state == FX_STATE_READY;
+}
+
+static inline bool _fx_init(void) {
+	const uint32_t state = __atomic_load_n(&_fx_state, __ATOMIC_ACQUIRE);
+	return (state == FX_STATE_READY) ||
+	       (state != FX_STATE_FAILED && _fx_init_slow());
+}
+
+static inline bool _fx_cache_push(_fx_cache_t *cache, uint32_t cls,
+                                   void *ptr) {
+	if (cls >= FX_MALLOC_N_CACHED_CLASSES ||
+	    cache->n_blocks[cls] >= FX_MALLOC_CACHE_SIZE) {
+		return false;
+	}
+	if (cache->state != FX_CACHE_ACTIVE) {
+		/* Register the cache for flushing when the thread exits; caching is
+		   disabled once the flush has happened */
+		if (cache->state == FX_CACHE_DISABLED) {
+			return false;
+		}
+		cache->state = FX_CACHE_DISABLED;
+		if (!_fx_have_cache_key ||
+		    pthread_setspecific(_fx_cache_key, cache) != 0) {
+			return false;
+		}
+		cache->state = FX_CACHE_ACTIVE;
+	}
+	*(void **)ptr = cache->heads[cls];
+	cache->heads[cls] = ptr;
+	cache->n_blocks[cls]++;
+	return true;
+}
+
+static _fx_chunk_t *_fx_chunk_create(uint32_t cls) {
+	void *mem = fx_mem_arena_alloc(_fx_arena, FX_MALLOC_CHUNK_SIZE,
+	                               FX_MALLOC_CHUNK_SIZE);
+	if (!mem) {
+		return NULL;
+	}
+	_fx_chunk_t *chunk = (_fx_chunk_t *)fx_mem_align(&mem, sizeof(_fx_chunk_t));
+	chunk->next = NULL;
+	chunk->cls = cls;
+	chunk->pool = fx_mem_static_pool_init(mem, _fx_classes[cls].n_slots,
+	                                      _fx_classes[cls].slot_size);
+	return chunk;
+}
+
+static void *_fx_class_alloc(uint32_t cls) {
+	void *ptr;
+	if (cls < FX_MALLOC_N_CACHED_CLASSES && (ptr = _fx_cache.heads[cls])) {
+		_fx_cache.heads[cls] = *(void **)ptr;
+		_fx_cache.n_blocks[cls]--;
+		return ptr;
+	}
+
+	_fx_class_t *cl = &_fx_classes[cls];
+	_fx_chunk_t *chunk = __atomic_load_n(&cl->current, __ATOMIC_ACQUIRE);
+	if (chunk && (ptr = fx_mem_static_pool_alloc(chunk->pool))) {
+		return ptr;
+	}
+
+	/* The current chunk is full; look for space freed in older chunks */
+	for (chunk = __atomic_load_n(&cl->head, __ATOMIC_ACQUIRE); chunk;
+	     chunk = chunk->next) {
+		const fx_mem_static_pool_t *pool = chunk->pool;
+		if (__atomic_load_n(&pool->n_allocated, __ATOMIC_RELAXED) <
+		        pool->n_available &&
+		    (ptr = fx_mem_static_pool_alloc(chunk->pool))) {
+			__atomic_store_n(&cl->current, chunk, __ATOMIC_RELEASE);
+			return ptr;
+		}
+	}
+
+	/* Carve a new chunk from the reserved range and publish it. Concurrent
+	   threads may each add a chunk; the surplus is used up later on. */
+	if (!(chunk = _fx_chunk_create(cls))) {
+		return NULL;
+	}
+	ptr = fx_mem_static_pool_alloc(chunk->pool);
+	chunk->next = __atomic_load_n(&cl->head, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&cl->head, &chunk->next, chunk,
+	                                    true, __ATOMIC_RELEASE,
+	                                    __ATOMIC_RELAXED)) {
+	}
+	__atomic_store_n(&cl->current, chunk, __ATOMIC_RELEASE);
+	return ptr;
+}
+
+static void *_fx_large_alloc(size_t size, size_t align) {
+	if (align < FX_ALIGN) {
+		align = FX_ALIGN;
+	}
+	const size_t page = _fx_page_size;
+	const size_t slack = sizeof(_fx_large_t) + align;
+	if (size > SIZE_MAX - slack - page) {
+		return NULL;
+	}
+	const size_t map_size = (size + slack + page - 1U) & ~(page - 1U);
+	uint8_t *base = (uint8_t *)mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+	                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((void *)base == MAP_FAILED) {
+		return NULL;
+	}
+	uint8_t *ptr = (uint8_t *)(((uintptr_t)base + sizeof(_fx_large_t) +
+	                            align - 1U) &
+	                           ~(uintptr_t)(align - 1U));
+	_fx_large_t *hdr = (_fx_large_t *)ptr - 1;
+	hdr->map_size = map_size;
+	hdr->offset = (size_t)(ptr - base);
+	return ptr;
+}
+
+static inline void *_fx_oom(void) {
+	errno = ENOMEM;
+	return NULL;
+}
+
+/******************************************************************************
+ * PUBLIC C API                                                               *
+ ******************************************************************************/
+
+void *fx_malloc(size_t size) {
+	void *ptr = NULL;
+	if (_fx_init() && size <= FX_MALLOC_MAX_SMALL) {
+		ptr = _fx_class_alloc(_fx_class_idx(size));
+	}
+	if (!ptr && !(ptr = _fx_large_alloc(size, FX_ALIGN))) {
+		return _fx_oom();
+	}
+	return ptr;
+}
+
+void fx_free(void *ptr) {
+	if (!ptr) {
+		return;
+	}
+	_fx_chunk_t *chunk = _fx_chunk_of(ptr);
+	if (chunk) {
+		/* Cache the start of the slot; ptr may point into it */
+		fx_mem_static_pool_t *pool = chunk->pool;
+		void *slot =
+		    fx_mem_static_pool_ptr(pool, fx_mem_static_pool_idx(pool, ptr));
+		if (!_fx_cache_push(&_fx_cache, chunk->cls, slot)) {
+			fx_mem_static_pool_free(pool, slot);
+		}
+		return;
+	}
+	const _fx_large_t *hdr = (const _fx_large_t *)ptr - 1;
+	munmap((uint8_t *)ptr - hdr->offset, hdr->map_size);
+}
+
+void *fx_calloc(size_t n, size_t size) {
+	if (size && n > SIZE_MAX / size) {
+		return _fx_oom();
+	}
+	void *ptr = fx_malloc(n * size);
+	if (ptr && _fx_chunk_of(ptr)) {
+		memset(ptr, 0, n * size); /* Fresh mappings are zeroed already */
+	}
+	return ptr;
+}
+
+size_t fx_malloc_usable_size(void *ptr) {
+	if (!ptr) {
+		return 0U;
+	}
+	const _fx_chunk_t *chunk = _fx_chunk_of(ptr);
+	if (chunk) {
+		const fx_mem_static_pool_t *pool = chunk->pool;
+		const uint8_t *slot = fx_mem_static_pool_ptr(
+		    (fx_mem_static_pool_t *)pool, fx_mem_static_pool_idx(pool, ptr));
+		return (size_t)(slot + pool->slot_size - (uint8_t *)ptr);
+	}
+	const _fx_large_t *hdr = (const _fx_large_t *)ptr - 1;
+	return hdr->map_size - hdr->offset;
+}
+
+void *fx_realloc(void *ptr, size_t size) {
+	if (!ptr) {
+		return fx_malloc(size);
+	}
+	if (size == 0U) {
+		fx_free(ptr);
+		return NULL;
+	}
+
+	/* Keep the block if it is large enough and not excessively large */
+	const size_t old_size = fx_malloc_usable_size(ptr);
+	if (size <= old_size && size >= old_size / 2U) {
+		return ptr;
+	}
+
+#ifdef __linux__
+	/* Let the kernel move the pages of large blocks instead of copying */
+	_fx_large_t *hdr = (_fx_large_t *)ptr - 1;
+	if (size > FX_MALLOC_MAX_SMALL && !_fx_chunk_of(ptr) &&
+	    hdr->offset == sizeof(_fx_large_t) &&
+	    size <= SIZE_MAX - sizeof(_fx_large_t) - _fx_page_size) {
+		/* Grow geometrically, so that a buffer grown in small steps is only
+		   remapped a logarithmic number of times */
+		size_t map_size = size + sizeof(_fx_large_t);
+		if (size > old_size && map_size < hdr->map_size + hdr->map_size / 2U &&
+		    hdr->map_size <= SIZE_MAX / 2U) {
+			map_size = hdr->map_size + hdr->map_size / 2U;
+		}
+		map_size = (map_size + _fx_page_size - 1U) & ~(_fx_page_size - 1U);
+		uint8_t *base = (uint8_t *)ptr - hdr->offset;
+		base = (uint8_t *)mremap(base, hdr->map_size, map_size,
+		                         MREMAP_MAYMOVE);
+		if ((void *)base == MAP_FAILED) {
+			return _fx_oom();
+		}
+		hdr = (_fx_large_t *)base;
+		hdr->map_size = map_size;
+		return base + sizeof(_fx_large_t);
+	}
+#endif
+
+	void *res = fx_malloc(size);
+	if (res) {
+		memcpy(res, ptr, size < old_size ? size : old_size);
+		fx_free(ptr);
+	}
+	return res;
+}
+
+void *fx_memalign(size_t align, size_t size) {
+	if (align <= FX_ALIGN) {
+		return fx_malloc(size);
+	}
+	if (align & (align - 1U)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Blocks in the pools are FX_ALIGN aligned; over-allocate and return an
+	   aligned pointer into the slot. fx_free() accepts interior pointers. */
+	const bool ready = _fx_init();
+	if (ready && align < FX_MALLOC_MAX_SMALL &&
+	    size <= FX_MALLOC_MAX_SMALL - (align - FX_ALIGN)) {
+		void *ptr = _fx_class_alloc(_fx_class_idx(size + align - FX_ALIGN));
+		if (ptr) {
+			return (void *)(((uintptr_t)ptr + align - 1U) &
+			                ~(uintptr_t)(align - 1U));
+		}
+	}
+	void *ptr = _fx_large_alloc(size, align);
+	return ptr ? ptr : _fx_oom();
+}
+
+/******************************************************************************
+ * STANDARD ALLOCATION FUNCTIONS                                              *
+ ******************************************************************************/
+
+#ifndef FX_MALLOC_NO_OVERRIDE
+
+void *malloc(size_t size) { return fx_malloc(size); }
+
+void free(void *ptr) { fx_free(ptr); }
+
+void *calloc(size_t n, size_t size) { return fx_calloc(n, size); }
+
+void *realloc(void *ptr, size_t size) { return fx_realloc(ptr, size); }
+
+int posix_memalign(void **res, size_t align, size_t size) {
+	if ((align & (align - 1U)) || align < sizeof(void *)) {
+		return EINVAL;
+	}
+	void *ptr = fx_memalign(align, size);
+	if (!ptr) {
+		return ENOMEM;
+	}
+	*res = ptr;
+	return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+	return fx_memalign(align, size);
+}
+
+void *memalign(size_t align, size_t size) { return fx_memalign(align, size); }
+
+void *valloc(size_t size) {
+	return fx_memalign((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size) {
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return fx_memalign(page, (size + page - 1U) & ~(page - 1U));
+}
+
+size_t malloc_usable_size(void *ptr) { return fx_malloc_usable_size(ptr); }
+
+#endif /* FX_MALLOC_NO_OVERRIDE */
@@ -0,0 +1,54 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file foxenmalloc.h
+ *
+ * Entry points of the malloc() replacement in foxenmalloc.c. The shared
+ * library built from that file exports the standard allocation functions
+ * as aliases of the functions declared here and can be loaded into any
+ * program with
+ *
+ *     LD_PRELOAD=libfoxenmalloc.so PROGRAM
+ *
+ * Compile foxenmalloc.c with FX_MALLOC_NO_OVERRIDE defined to only obtain
+ * the fx_* functions, e.g. to compare the allocator with the system malloc()
+ * within the same process.
+ *
+ * @author Andreas Stöckel
+ */
+
+#ifndef FOXEN_MALLOC_H
+#define FOXEN_MALLOC_H
+
+#include <stddef.h>
+
+/**
+ * Largest request served from the size-class pools. Larger blocks are mapped
+ * individually.
+ */
+#define FX_MALLOC_MAX_SMALL 32768U
+
+void *fx_malloc(size_t size);
+void fx_free(void *ptr);
+void *fx_calloc(size_t n, size_t size);
+void *fx_realloc(void *ptr, size_t size);
+void *fx_memalign(size_t align, size_t size);
+size_t fx_malloc_usable_size(void *ptr);
+
+#endif /* FOXEN_MALLOC_H */
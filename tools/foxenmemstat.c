@@ -0,0 +1,219 @@
+/*
+ *  libfoxenmem -- Utilities for heap-free memory management
+ *  Copyright (C) 2018  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file foxenmemstat.c
+ *
+ * Command line reader for statistics pages created with fx_mem_stats_create().
+ *
+ *     foxenmemstat [-p] [-i SECONDS] NAME
+ *
+ * By default, prints a table with one line per allocator. With -i, prints a
+ * new table every SECONDS seconds, including the allocation and free rates
+ * since the previous table. With -p, prints the counters in the Prometheus
+ * text exposition format, suitable for scraping.
+ *
+ * @author Andreas Stöckel
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <foxen/mem_stats.h>
+
+static void _print_table(const fx_mem_stats_page_t *cur,
+                         const fx_mem_stats_page_t *prev) {
+	double dt = 0.0;
+	if (prev && cur->timestamp > prev->timestamp) {
+		dt = (double)(cur->timestamp - prev->timestamp) * 1e-9;
+	}
+	printf("budget: %" PRIu64 " / %" PRIu64 " bytes used, %" PRIu64
+	       " bytes reserved%s\n",
+	       cur->budget_used, cur->budget_limit, cur->budget_reserved,
+	       cur->pressure ? ", UNDER PRESSURE" : "");
+	printf("%-24s %12s %12s %12s %10s %10s %10s %10s\n", "name", "reserved",
+	       "used", "peak", "live", "allocs/s", "frees/s", "contended");
+	for (uint32_t i = 0U; i < cur->n_entries; i++) {
+		const fx_mem_stats_entry_t *e = &cur->entries[i];
+		double alloc_rate = 0.0, free_rate = 0.0;
+		if (dt > 0.0 && i < prev->n_entries &&
+		    strcmp(e->name, prev->entries[i].name) == 0) {
+			alloc_rate =
+			    (double)(e->n_allocs_total - prev->entries[i].n_allocs_total) /
+			    dt;
+			free_rate =
+			    (double)(e->n_frees_total - prev->entries[i].n_frees_total) / dt;
+		}
+		printf("%-24s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %10" PRIu64
+		       " %10.0f %10.0f %10" PRIu64 "\n",
+		       e->name, e->n_bytes_reserved, e->n_bytes_used, e->n_bytes_peak,
+		       e->n_allocations, alloc_rate, free_rate, e->n_contended);
+	}
+}
+
+static void _print_label(const char *value) {
+	/* Escape backslashes, double quotes and line feeds as required by the
+	   text exposition format */
+	for (; *value; value++) {
+		switch (*value) {
+			case '\\':
+				fputs("\\\\", stdout);
+				break;
+			case '"':
+				fputs("\\\"", stdout);
+				break;
+			case '\n':
+				fputs("\\n", stdout);
+				break;
+			default:
+				putchar(*value);
+				break;
+		}
+	}
+}
+
+static void _print_prometheus(const fx_mem_stats_page_t *page) {
+	printf("# TYPE foxenmem_budget_limit_bytes gauge\n");
+	printf("foxenmem_budget_limit_bytes %" PRIu64 "\n", page->budget_limit);
+	printf("# TYPE foxenmem_budget_used_bytes gauge\n");
+	printf("foxenmem_budget_used_bytes %" PRIu64 "\n", page->budget_used);
+	printf("# TYPE foxenmem_budget_reserved_bytes gauge\n");
+	printf("foxenmem_budget_reserved_bytes %" PRIu64 "\n",
+	       page->budget_reserved);
+	printf("# TYPE foxenmem_budget_pressure gauge\n");
+	printf("foxenmem_budget_pressure %" PRIu32 "\n", page->pressure);
+
+	/* All samples of a metric family must directly follow its TYPE line */
+	static const struct {
+		const char *name;
+		const char *type;
+		size_t offset;
+	} metrics[] = {
+	    {"reserved_bytes", "gauge",
+	     offsetof(fx_mem_stats_entry_t, n_bytes_reserved)},
+	    {"used_bytes", "gauge", offsetof(fx_mem_stats_entry_t, n_bytes_used)},
+	    {"peak_bytes", "gauge", offsetof(fx_mem_stats_entry_t, n_bytes_peak)},
+	    {"allocations", "gauge",
+	     offsetof(fx_mem_stats_entry_t, n_allocations)},
+	    {"allocs_total", "counter",
+	     offsetof(fx_mem_stats_entry_t, n_allocs_total)},
+	    {"frees_total", "counter",
+	     offsetof(fx_mem_stats_entry_t, n_frees_total)},
+	    {"contended_total", "counter",
+	     offsetof(fx_mem_stats_entry_t, n_contended)}};
+	for (size_t j = 0U; j < sizeof(metrics) / sizeof(metrics[0]); j++) {
+		printf("# TYPE foxenmem_allocator_%s %s\n", metrics[j].name,
+		       metrics[j].type);
+		for (uint32_t i = 0U; i < page->n_entries; i++) {
+			const fx_mem_stats_entry_t *e = &page->entries[i];
+			uint64_t value;
+			memcpy(&value, (const uint8_t *)e + metrics[j].offset,
+			       sizeof(value));
+			printf("foxenmem_allocator_%s{name=\"", metrics[j].name);
+			_print_label(e->name);
+			printf("\"} %" PRIu64 "\n", value);
+		}
+	}
+}
+
+static int _usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-p] [-i SECONDS] NAME\n", argv0);
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	bool prometheus = false;
+	double interval = 0.0;
+	const char *name = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0) {
+			prometheus = true;
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			interval = atof(argv[++i]);
+		} else if (argv[i][0] != '-' && !name) {
+			name = argv[i];
+		} else {
+			return _usage(argv[0]);
+		}
+	}
+	if (!name) {
+		return _usage(argv[0]);
+	}
+
+	const fx_mem_stats_page_t *page = fx_mem_stats_attach(name);
+	if (!page) {
+		fprintf(stderr, "%s: cannot attach to statistics page \"%s\"\n",
+		        argv[0], name);
+		return 1;
+	}
+
+	/* Allocate two snapshots, the previous one is used to compute rates */
+	const uint32_t max_entries = page->max_entries;
+	fx_mem_stats_page_t *cur = malloc(fx_mem_stats_size(max_entries));
+	fx_mem_stats_page_t *prev = malloc(fx_mem_stats_size(max_entries));
+	if (!cur || !prev) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	prev->n_entries = 0U;
+	prev->timestamp = 0U;
+
+	int res = 0;
+	do {
+		if (!fx_mem_stats_read(page, cur, max_entries)) {
+			if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) & 1U) {
+				fprintf(stderr, "%s: publisher stalled while updating page\n",
+				        argv[0]);
+			} else {
+				fprintf(stderr, "%s: unsupported page format\n", argv[0]);
+			}
+			res = 1;
+			break;
+		}
+		if (prometheus) {
+			_print_prometheus(cur);
+		} else {
+			_print_table(cur, prev);
+		}
+		fflush(stdout);
+
+		fx_mem_stats_page_t *tmp = prev;
+		prev = cur;
+		cur = tmp;
+		if (interval > 0.0) {
+			struct timespec ts;
+			ts.tv_sec = (time_t)interval;
+			ts.tv_nsec = (long)((interval - (double)ts.tv_sec) * 1e9);
+			nanosleep(&ts, NULL);
+			if (!prometheus) {
+				printf("\n");
+			}
+		}
+	} while (interval > 0.0);
+
+	free(cur);
+	free(prev);
+	fx_mem_stats_detach(page);
+	return res;
+}